@@ -0,0 +1,366 @@
+#include "config.h"
+#include "allocationTracker.h"
+
+#include <new>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifndef _MSC_VER
+#include <dlfcn.h>
+#include <cxxabi.h>
+#endif
+
+namespace Core
+{
+	namespace
+	{
+		// Constant initialised, operator new can run before any constructor.
+		std::atomic<bool> AllocationRecording = false;
+		thread_local bool AllocationIgnored = false;
+
+		void* Allocate(size_t size, void* site)
+		{
+			if (AllocationRecording.load(std::memory_order_relaxed) && !AllocationIgnored)
+			{
+				AllocationTracker::getInstance().Record(size, site);
+			}
+			return std::malloc(size > 0 ? size : 1);
+		}
+
+		void* AllocateAligned(size_t size, std::align_val_t alignment, void* site)
+		{
+			if (AllocationRecording.load(std::memory_order_relaxed) && !AllocationIgnored)
+			{
+				AllocationTracker::getInstance().Record(size, site);
+			}
+			const size_t align = (size_t)alignment;
+#ifdef _MSC_VER
+			return _aligned_malloc(size > 0 ? size : 1, align);
+#else
+			return std::aligned_alloc(align, std::max(align, (size + align - 1) / align * align));
+#endif
+		}
+
+		void FreeAligned(void* pointer)
+		{
+#ifdef _MSC_VER
+			_aligned_free(pointer);
+#else
+			std::free(pointer);
+#endif
+		}
+	}
+
+	AllocationTracker& AllocationTracker::getInstance()
+	{
+		static AllocationTracker instance;
+		return instance;
+	}
+
+	void AllocationTracker::setEnabled(bool status)
+	{
+		enabled = status;
+	}
+
+	bool AllocationTracker::getEnabled()
+	{
+		return enabled;
+	}
+
+	void AllocationTracker::setStrict(bool status)
+	{
+		strict = status;
+	}
+
+	bool AllocationTracker::getStrict()
+	{
+		return strict;
+	}
+
+	void AllocationTracker::IgnoreCurrentThread()
+	{
+		AllocationIgnored = true;
+	}
+
+	void AllocationTracker::RecordBlock(size_t bytes, void* site)
+	{
+		if (AllocationRecording.load(std::memory_order_relaxed) && !AllocationIgnored)
+		{
+			getInstance().Record(bytes, site);
+		}
+	}
+
+	UntrackedScope::UntrackedScope() : previous(AllocationIgnored)
+	{
+		AllocationIgnored = true;
+	}
+
+	UntrackedScope::~UntrackedScope()
+	{
+		AllocationIgnored = previous;
+	}
+
+	void AllocationTracker::Lock()
+	{
+		while (spin.test_and_set(std::memory_order_acquire))
+		{
+		}
+	}
+
+	void AllocationTracker::Unlock()
+	{
+		spin.clear(std::memory_order_release);
+	}
+
+	void AllocationTracker::BeginStep(bool steadyState)
+	{
+		if (!enabled) return;
+
+		Lock();
+		steady = steadyState;
+		slotCount = 0;
+		currentSlot = 0;
+		Unlock();
+		BeginPhase("Update");
+		AllocationRecording.store(true, std::memory_order_relaxed);
+	}
+
+	void AllocationTracker::BeginPhase(const char* name)
+	{
+		if (!enabled) return;
+
+		Lock();
+		uint32 slot = 0;
+		while (slot < slotCount && strcmp(slots[slot].name, name) != 0) slot++;
+		if (slot == slotCount && slotCount < MaxPhases)
+		{
+			slots[slotCount] = PhaseSlot();
+			slots[slotCount].name = name;
+			slotCount++;
+		}
+		// Past MaxPhases everything lands in the last phase.
+		currentSlot = std::min(slot, MaxPhases - 1);
+		Unlock();
+	}
+
+	void AllocationTracker::Record(size_t bytes, void* site)
+	{
+		Lock();
+		if (slotCount > 0)
+		{
+			PhaseSlot& phase = slots[currentSlot];
+			phase.count++;
+			phase.bytes += bytes;
+
+			uint32 k = 0;
+			while (k < phase.siteCount && phase.sites[k].address != site) k++;
+			if (k == phase.siteCount && phase.siteCount < MaxSites)
+			{
+				phase.sites[phase.siteCount++] = { site, 0, 0 };
+			}
+			if (k < phase.siteCount)
+			{
+				phase.sites[k].count++;
+				phase.sites[k].bytes += bytes;
+			}
+		}
+		Unlock();
+	}
+
+	bool AllocationTracker::EndStep()
+	{
+		if (!AllocationRecording.load(std::memory_order_relaxed)) return true;
+		AllocationRecording.store(false, std::memory_order_relaxed);
+		steps++;
+
+		// Copied out under the lock into locals first, building the report allocates.
+		Lock();
+		PhaseSlot step[MaxPhases];
+		const uint32 stepSlots = slotCount;
+		std::copy(slots, slots + stepSlots, step);
+		Unlock();
+
+		uint64 count = 0;
+		uint64 bytes = 0;
+		for (uint32 slot = 0; slot < stepSlots; slot++)
+		{
+			count += step[slot].count;
+			bytes += step[slot].bytes;
+		}
+		if (count == 0) return true;
+
+		lastAllocatingIndex = steps;
+		lastAllocating.clear();
+		for (uint32 slot = 0; slot < stepSlots; slot++)
+		{
+			if (step[slot].count == 0) continue;
+			PhaseAllocations phase;
+			phase.phase = step[slot].name;
+			phase.count = step[slot].count;
+			phase.bytes = step[slot].bytes;
+			phase.sites.assign(step[slot].sites, step[slot].sites + step[slot].siteCount);
+			std::sort(phase.sites.begin(), phase.sites.end(), [](const AllocationSite& a, const AllocationSite& b) { return a.count > b.count; });
+			lastAllocating.push_back(phase);
+		}
+
+		if (!strict || !steady) return true;
+
+		failedSteps++;
+		printf("[ Allocation Tracker ] : ERROR : Steady-state step %llu made %llu allocations (%llu bytes).\n",
+			(unsigned long long)steps, (unsigned long long)count, (unsigned long long)bytes);
+		for (const PhaseAllocations& phase : lastAllocating)
+		{
+			printf("    %s: %llu allocations, %llu bytes, first at %s\n", phase.phase, (unsigned long long)phase.count,
+				(unsigned long long)phase.bytes, phase.sites.empty() ? "?" : DescribeSite(phase.sites[0].address).c_str());
+		}
+		return false;
+	}
+
+	uint64 AllocationTracker::getSteps()
+	{
+		return steps;
+	}
+
+	uint64 AllocationTracker::getFailedSteps()
+	{
+		return failedSteps;
+	}
+
+	void AllocationTracker::resetFailedSteps()
+	{
+		failedSteps = 0;
+	}
+
+	const std::vector<PhaseAllocations>& AllocationTracker::getLastAllocatingStep()
+	{
+		return lastAllocating;
+	}
+
+	uint64 AllocationTracker::getLastAllocatingStepIndex()
+	{
+		return lastAllocatingIndex;
+	}
+
+	std::string AllocationTracker::DescribeSite(void* address)
+	{
+		char buffer[64];
+#ifndef _MSC_VER
+		Dl_info info;
+		if (dladdr(address, &info) != 0)
+		{
+			if (info.dli_sname != nullptr)
+			{
+				int status = 0;
+				char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+				std::string symbol = status == 0 ? demangled : info.dli_sname;
+				std::free(demangled);
+				return symbol;
+			}
+			if (info.dli_fname != nullptr)
+			{
+				snprintf(buffer, sizeof(buffer), "+0x%llx", (unsigned long long)((char*)address - (char*)info.dli_fbase));
+				return std::string(info.dli_fname) + buffer;
+			}
+		}
+#endif
+		snprintf(buffer, sizeof(buffer), "%p", address);
+		return buffer;
+	}
+
+	AllocationStep::AllocationStep(bool steadyState) : active(AllocationTracker::getInstance().getEnabled())
+	{
+		if (active) AllocationTracker::getInstance().BeginStep(steadyState);
+	}
+
+	AllocationStep::~AllocationStep()
+	{
+		End();
+	}
+
+	bool AllocationStep::End()
+	{
+		if (!active) return true;
+		active = false;
+		return AllocationTracker::getInstance().EndStep();
+	}
+}
+
+// Replaced global allocation functions, every other form of new and delete forwards to these in the standard library.
+void* operator new(std::size_t size)
+{
+	void* pointer = Core::Allocate(size, ALLOCATION_RETURN_ADDRESS());
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](std::size_t size)
+{
+	void* pointer = Core::Allocate(size, ALLOCATION_RETURN_ADDRESS());
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	return Core::Allocate(size, ALLOCATION_RETURN_ADDRESS());
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	return Core::Allocate(size, ALLOCATION_RETURN_ADDRESS());
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	void* pointer = Core::AllocateAligned(size, alignment, ALLOCATION_RETURN_ADDRESS());
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+	void* pointer = Core::AllocateAligned(size, alignment, ALLOCATION_RETURN_ADDRESS());
+	if (pointer == nullptr) throw std::bad_alloc();
+	return pointer;
+}
+
+void operator delete(void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+	std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+	Core::FreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+	Core::FreeAligned(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+	Core::FreeAligned(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+	Core::FreeAligned(pointer);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ALLOCATION_RETURN_ADDRESS() _ReturnAddress()
+#else
+#define ALLOCATION_RETURN_ADDRESS() __builtin_return_address(0)
+#endif
+
+namespace Core
+{
+	// Return address of operator new, resolve with DescribeSite.
+	struct AllocationSite
+	{
+		void* address = nullptr;
+		uint64 count = 0;
+		uint64 bytes = 0;
+	};
+
+	struct PhaseAllocations
+	{
+		const char* phase = nullptr;
+		uint64 count = 0;
+		uint64 bytes = 0;
+		std::vector<AllocationSite> sites; // most allocations first, sites past MaxSites are folded into the counts only
+	};
+
+	// Counts every operator new made on any thread while a step is open, attributed to the phase the stepping thread
+	// last began. The replaced operator new only pays an atomic load while no step is recorded.
+	class AllocationTracker
+	{
+	public:
+		static constexpr uint32 MaxPhases = 32;
+		static constexpr uint32 MaxSites = 16;
+
+		static AllocationTracker& getInstance();
+
+		void setEnabled(bool status);
+		bool getEnabled();
+
+		// Strict mode reports every steady-state step that allocated and counts it as failed.
+		void setStrict(bool status);
+		bool getStrict();
+
+		void BeginStep(bool steadyState);
+		// False if strict mode failed the step.
+		bool EndStep();
+		// The name is kept, not copied, pass string literals.
+		void BeginPhase(const char* name);
+
+		// Hook of the replaced operator new, never allocates.
+		void Record(size_t bytes, void* site);
+		// For allocators that hand out memory of their own, like the simulation arena. Counts the block if a step is
+		// being recorded on this thread, exactly like an operator new from site.
+		static void RecordBlock(size_t bytes, void* site);
+
+		// Service threads that run beside the solver, like the metrics server, call this once so their allocations
+		// never count against a step.
+		static void IgnoreCurrentThread();
+
+		uint64 getSteps();
+		uint64 getFailedSteps();
+		void resetFailedSteps();
+		// The last step that allocated anything, and its step number.
+		const std::vector<PhaseAllocations>& getLastAllocatingStep();
+		uint64 getLastAllocatingStepIndex();
+
+		// Symbol or module and offset of a site, feed the offset to addr2line when the symbol is not exported.
+		static std::string DescribeSite(void* address);
+
+	private:
+		AllocationTracker() {};
+		AllocationTracker(const AllocationTracker& cpy) = delete;
+
+		struct PhaseSlot
+		{
+			const char* name = nullptr;
+			uint64 count = 0;
+			uint64 bytes = 0;
+			AllocationSite sites[MaxSites];
+			uint32 siteCount = 0;
+		};
+
+		void Lock();
+		void Unlock();
+
+		std::atomic_flag spin = ATOMIC_FLAG_INIT; // Record runs inside operator new, a mutex could allocate
+		bool enabled = false;
+		bool strict = false;
+		bool steady = false;
+		PhaseSlot slots[MaxPhases];
+		uint32 slotCount = 0;
+		uint32 currentSlot = 0;
+
+		uint64 steps = 0;
+		uint64 failedSteps = 0;
+		uint64 lastAllocatingIndex = 0;
+		std::vector<PhaseAllocations> lastAllocating;
+	};
+
+	// Keeps the allocations of the current thread out of the counts for its lifetime. An allocator that records its
+	// blocks with RecordBlock opens one around its own bookkeeping, which is not the caller's doing.
+	class UntrackedScope
+	{
+	public:
+		UntrackedScope();
+		~UntrackedScope();
+
+	private:
+		bool previous;
+	};
+
+	// Opens a tracker step for its lifetime, a no-op while the tracker is disabled.
+	class AllocationStep
+	{
+	public:
+		AllocationStep(bool steadyState);
+		~AllocationStep();
+
+		// Closes the step early and returns EndStep's verdict, false if strict mode failed it. True when inactive.
+		bool End();
+
+	private:
+		bool active;
+	};
+}
@@ -0,0 +1,154 @@
+#include "config.h"
+#include "metricsServer.h"
+#include "allocationTracker.h"
+
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace Core
+{
+	MetricsServer::~MetricsServer()
+	{
+		Stop();
+	}
+
+	bool MetricsServer::Start(uint16 port, const char* address, std::function<std::string()> render)
+	{
+		Stop();
+#ifndef _WIN32
+		sockaddr_in bindAddress;
+		memset(&bindAddress, 0, sizeof(bindAddress));
+		bindAddress.sin_family = AF_INET;
+		bindAddress.sin_port = htons(port);
+		if (inet_pton(AF_INET, address, &bindAddress.sin_addr) != 1)
+		{
+			status = std::string("Invalid address ") + address;
+			printf("[ Metrics Server ] : ERROR : Invalid address %s.\n", address);
+			return false;
+		}
+
+		listener = socket(AF_INET, SOCK_STREAM, 0);
+		const int reuse = 1;
+		if (listener < 0 ||
+			setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+			bind(listener, (sockaddr*)&bindAddress, sizeof(bindAddress)) != 0 ||
+			listen(listener, 8) != 0)
+		{
+			status = std::string("Unavailable: ") + strerror(errno);
+			printf("[ Metrics Server ] : ERROR : Could not listen on %s:%u, %s.\n", address, port, strerror(errno));
+			if (listener >= 0) close(listener);
+			listener = -1;
+			return false;
+		}
+
+		this->render = std::move(render);
+		status = "Serving http://" + std::string(address) + ":" + std::to_string(port) + "/metrics";
+		running = true;
+		thread = std::thread(&MetricsServer::Serve, this);
+		return true;
+#else
+		status = "Unavailable: needs POSIX sockets";
+		return false;
+#endif
+	}
+
+	void MetricsServer::Stop()
+	{
+		if (!thread.joinable()) return;
+		running = false;
+		thread.join();
+#ifndef _WIN32
+		close(listener);
+#endif
+		listener = -1;
+		status = "Stopped";
+	}
+
+	bool MetricsServer::getRunning()
+	{
+		return running.load(std::memory_order_relaxed);
+	}
+
+	uint64 MetricsServer::getScrapes()
+	{
+		return scrapes;
+	}
+
+	const char* MetricsServer::getStatus()
+	{
+		return status.c_str();
+	}
+
+	void MetricsServer::Serve()
+	{
+#ifndef _WIN32
+		AllocationTracker::IgnoreCurrentThread();
+
+		// Wakes up a few times a second to notice Stop.
+		pollfd waiting = { listener, POLLIN, 0 };
+		while (running)
+		{
+			if (poll(&waiting, 1, 200) <= 0) continue;
+			const int connection = accept(listener, nullptr, nullptr);
+			if (connection < 0) continue;
+			Respond(connection);
+			close(connection);
+		}
+#endif
+	}
+
+	void MetricsServer::Respond(int connection)
+	{
+#ifndef _WIN32
+		// A slow or silent client only holds the next scrape back for the timeout.
+		timeval timeout = { 1, 0 };
+		setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		char request[4096];
+		size_t length = 0;
+		while (length < sizeof(request) - 1)
+		{
+			const ssize_t received = recv(connection, request + length, sizeof(request) - 1 - length, 0);
+			if (received <= 0) break;
+			length += received;
+			request[length] = '\0';
+			if (strstr(request, "\r\n\r\n") != nullptr) break;
+		}
+		request[length] = '\0';
+
+		std::string body;
+		std::string header;
+		const bool metrics = strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0;
+		if (metrics)
+		{
+			body = render();
+			header = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+			scrapes++;
+		}
+		else
+		{
+			body = "Not found, metrics are served on /metrics\n";
+			header = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain; charset=utf-8\r\n";
+		}
+		header += "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+
+		const std::string response = header + body;
+		size_t sent = 0;
+		while (sent < response.size())
+		{
+			const ssize_t written = send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+			if (written <= 0) break;
+			sent += written;
+		}
+#endif
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+namespace Core
+{
+	// Minimal HTTP server on a background thread. GET /metrics answers with whatever the render callback returns, in
+	// the Prometheus text exposition format, every other path is a 404. One connection at a time, closed after the
+	// response, which is all a scraper needs.
+	class MetricsServer
+	{
+	public:
+		MetricsServer() {};
+		~MetricsServer();
+
+		// Listens on address:port, 127.0.0.1 keeps it local. Returns false, and getStatus says why, when the socket can
+		// not be bound. The callback runs on the server thread.
+		bool Start(uint16 port, const char* address, std::function<std::string()> render);
+		void Stop();
+
+		bool getRunning();
+		uint64 getScrapes();
+		const char* getStatus();
+
+	private:
+		MetricsServer(const MetricsServer& cpy) = delete;
+
+		void Serve();
+		void Respond(int connection);
+
+		std::thread thread;
+		std::function<std::string()> render;
+		std::atomic<bool> running = false;
+		std::atomic<uint64> scrapes = 0;
+		int listener = -1;
+		std::string status = "Stopped";
+	};
+}
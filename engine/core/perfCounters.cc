@@ -0,0 +1,182 @@
+#include "config.h"
+#include "perfCounters.h"
+
+#include <cstring>
+#include <filesystem>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace Core
+{
+	PerfCounters& PerfCounters::getInstance()
+	{
+		static PerfCounters instance;
+		return instance;
+	}
+
+	PerfCounters::~PerfCounters()
+	{
+		CloseGroups();
+	}
+
+	bool PerfCounters::setEnabled(bool status)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		CloseGroups();
+		enabled = false;
+		this->status = "Disabled";
+		if (!status) return true;
+
+#ifdef __linux__
+		ThreadGroup probe;
+		if (!OpenGroup(0, probe))
+		{
+			this->status = std::string("Unavailable: ") + strerror(errno);
+			printf("[ Perf Counters ] : ERROR : Could not open any counter, %s.\n", strerror(errno));
+			return false;
+		}
+		for (uint32 i = 0; i < probe.opened; i++) close(probe.fds[i]);
+
+		enabled = true;
+		this->status = probe.opened == PerfValues::Count ? "Enabled" : "Enabled, some events unavailable";
+		return true;
+#else
+		this->status = "Unavailable: needs Linux perf events";
+		return false;
+#endif
+	}
+
+	bool PerfCounters::getEnabled()
+	{
+		return enabled;
+	}
+
+	const char* PerfCounters::getStatus()
+	{
+		return status.c_str();
+	}
+
+	bool PerfCounters::OpenGroup(int tid, ThreadGroup& group)
+	{
+#ifdef __linux__
+		static const uint32 types[PerfValues::Count] = {
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HARDWARE,
+			PERF_TYPE_HW_CACHE,
+			PERF_TYPE_SOFTWARE
+		};
+		static const uint64 configs[PerfValues::Count] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES,
+			PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_SW_PAGE_FAULTS
+		};
+
+		group.tid = tid;
+		group.opened = 0;
+		for (uint32 i = 0; i < PerfValues::Count; i++)
+		{
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[i];
+			attr.config = configs[i];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			// The first event that opens leads the group, a refused event is only dropped, so page faults still count
+			// on machines without a PMU.
+			const int leader = group.opened > 0 ? group.fds[0] : -1;
+			const int fd = (int)syscall(SYS_perf_event_open, &attr, tid, -1, leader, 0);
+			if (fd < 0) continue;
+			group.fds[group.opened] = fd;
+			group.events[group.opened] = i;
+			group.opened++;
+		}
+		return group.opened > 0;
+#else
+		return false;
+#endif
+	}
+
+	void PerfCounters::CloseGroups()
+	{
+#ifdef __linux__
+		for (ThreadGroup& group : groups)
+		{
+			for (uint32 i = 0; i < group.opened; i++) close(group.fds[i]);
+		}
+#endif
+		groups.clear();
+	}
+
+	void PerfCounters::AttachNewThreads()
+	{
+#ifdef __linux__
+		std::lock_guard<std::mutex> guard(lock);
+		if (!enabled) return;
+
+		std::error_code error;
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator("/proc/self/task", error))
+		{
+			const int tid = atoi(entry.path().filename().c_str());
+			bool attached = false;
+			for (const ThreadGroup& group : groups)
+			{
+				attached |= group.tid == tid;
+			}
+			if (attached) continue;
+
+			ThreadGroup group;
+			if (OpenGroup(tid, group))
+			{
+				groups.push_back(group);
+			}
+		}
+#endif
+	}
+
+	PerfValues PerfCounters::Read()
+	{
+		PerfValues values;
+#ifdef __linux__
+		std::lock_guard<std::mutex> guard(lock);
+		if (!enabled || groups.empty()) return values;
+
+		for (uint32 i = 0; i < PerfValues::Count; i++)
+		{
+			values.available[i] = true;
+		}
+		for (ThreadGroup& group : groups)
+		{
+			// nr, time enabled, time running, then one value per event in open order.
+			uint64 data[3 + PerfValues::Count] = {};
+			if (read(group.fds[0], data, sizeof(data)) < (ssize_t)(3 * sizeof(uint64))) continue;
+
+			// Scales up when the kernel had to multiplex the group with other users of the PMU.
+			const double scale = data[2] > 0 && data[2] < data[1] ? (double)data[1] / data[2] : 1.0;
+			bool present[PerfValues::Count] = {};
+			for (uint32 k = 0; k < data[0] && k < group.opened; k++)
+			{
+				values.value[group.events[k]] += data[3 + k] * scale;
+				present[group.events[k]] = true;
+			}
+			for (uint32 i = 0; i < PerfValues::Count; i++)
+			{
+				values.available[i] &= present[i];
+			}
+		}
+#endif
+		return values;
+	}
+}
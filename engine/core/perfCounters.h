@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+
+namespace Core
+{
+	enum class PerfEvent : uint32
+	{
+		Cycles,
+		Instructions,
+		LLCMisses,
+		BranchMisses,
+		DTLBMisses,
+		PageFaults,
+		Count
+	};
+
+	// Counter totals summed over every attached thread, events the kernel or the hardware refused stay unavailable.
+	struct PerfValues
+	{
+		static constexpr uint32 Count = (uint32)PerfEvent::Count;
+
+		double value[Count] = {};
+		bool available[Count] = {};
+
+		double get(PerfEvent event) const { return value[(uint32)event]; }
+		bool has(PerfEvent event) const { return available[(uint32)event]; }
+
+		PerfValues operator-(const PerfValues& start) const
+		{
+			PerfValues delta;
+			for (uint32 i = 0; i < Count; i++)
+			{
+				delta.value[i] = value[i] - start.value[i];
+				delta.available[i] = available[i] && start.available[i];
+			}
+			return delta;
+		}
+	};
+
+	// Hardware counters through Linux perf events, one counter group per thread of the process, user space only.
+	class PerfCounters
+	{
+	public:
+		static PerfCounters& getInstance();
+
+		// Returns false, and getStatus says why, when no counter at all could be opened.
+		bool setEnabled(bool status);
+		bool getEnabled();
+		const char* getStatus();
+
+		// Thread pools start their workers lazily, call before measuring to count threads started since the last call.
+		void AttachNewThreads();
+
+		PerfValues Read();
+
+	private:
+		PerfCounters() {};
+		PerfCounters(const PerfCounters& cpy) = delete;
+		~PerfCounters();
+
+		struct ThreadGroup
+		{
+			int tid = 0;
+			int fds[PerfValues::Count] = {};
+			uint32 events[PerfValues::Count] = {}; // event of each value in the group read, in open order
+			uint32 opened = 0;
+		};
+
+		bool OpenGroup(int tid, ThreadGroup& group);
+		void CloseGroups();
+
+		std::mutex lock;
+		std::vector<ThreadGroup> groups;
+		bool enabled = false;
+		std::string status = "Disabled";
+	};
+}
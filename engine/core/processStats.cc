@@ -0,0 +1,43 @@
+#include "config.h"
+#include "processStats.h"
+
+#include <cstring>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Core
+{
+	ProcessStats ReadProcessStats()
+	{
+		ProcessStats stats;
+#ifdef __linux__
+		const int file = open("/proc/self/stat", O_RDONLY);
+		if (file < 0) return stats;
+		char buffer[1024];
+		const ssize_t length = read(file, buffer, sizeof(buffer) - 1);
+		close(file);
+		if (length <= 0) return stats;
+		buffer[length] = '\0';
+
+		// The command name may hold spaces, fields are counted from the state after its closing parenthesis.
+		const char* field = strrchr(buffer, ')');
+		if (field == nullptr) return stats;
+		for (uint32 index = 2; *field != '\0'; index++)
+		{
+			while (*field == ' ' || *field == ')') field++;
+			if (index == 19) stats.threads = (uint32)strtoul(field, nullptr, 10);
+			if (index == 23)
+			{
+				stats.residentMiB = strtoull(field, nullptr, 10) * sysconf(_SC_PAGESIZE) / 1048576.0;
+				break;
+			}
+			while (*field != ' ' && *field != '\0') field++;
+		}
+#endif
+		return stats;
+	}
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+namespace Core
+{
+	struct ProcessStats
+	{
+		uint32 threads = 0;
+		double residentMiB = 0.0;
+	};
+
+	// Thread count and resident set of the process, zero where the platform has no /proc. Reads into the stack, so it is
+	// safe inside a step the allocation tracker holds to zero allocations.
+	ProcessStats ReadProcessStats();
+}
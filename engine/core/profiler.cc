@@ -0,0 +1,222 @@
+#include "config.h"
+#include "profiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+
+namespace Core
+{
+	namespace
+	{
+		const std::chrono::steady_clock::time_point ProfilerStart = std::chrono::steady_clock::now();
+		thread_local ProfileTimeline* LocalTimeline = nullptr;
+	}
+
+	Profiler& Profiler::getInstance()
+	{
+		static Profiler instance;
+		return instance;
+	}
+
+	int64 Profiler::Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - ProfilerStart).count();
+	}
+
+	ProfileTimeline& Profiler::ThreadTimeline()
+	{
+		if (LocalTimeline == nullptr)
+		{
+			std::lock_guard<std::mutex> guard(timelinesLock);
+			timelines.push_back(std::make_unique<ProfileTimeline>());
+			LocalTimeline = timelines.back().get();
+			LocalTimeline->threadId = timelines.size() - 1;
+			LocalTimeline->threadName = "Thread " + std::to_string(LocalTimeline->threadId);
+		}
+		return *LocalTimeline;
+	}
+
+	void Profiler::setThreadName(const char* name)
+	{
+		ProfileTimeline& timeline = ThreadTimeline();
+		std::lock_guard<std::mutex> guard(timelinesLock);
+		timeline.threadName = name;
+	}
+
+	uint32 Profiler::NextEpoch()
+	{
+		return epoch.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+	uint32 Profiler::CurrentEpoch()
+	{
+		return epoch.load(std::memory_order_relaxed);
+	}
+
+	void Profiler::EndFrame()
+	{
+		std::unordered_map<const char*, double> frameTotals;
+		{
+			std::lock_guard<std::mutex> guard(timelinesLock);
+			for (std::unique_ptr<ProfileTimeline>& timeline : timelines)
+			{
+				// Events the ring already overwrote are lost to the statistics.
+				timeline->frameRead = ReadTimeline(*timeline, timeline->frameRead);
+				for (const ProfileEvent& event : readBuffer)
+				{
+					frameTotals[event.name] += (event.end - event.start) * 1e-6;
+				}
+			}
+		}
+
+		// Keyed by the text, the same literal can live at different addresses in different translation units.
+		std::unordered_map<std::string, double> byName;
+		for (const auto& [name, total] : frameTotals)
+		{
+			byName[name] += total;
+		}
+		for (const auto& [name, total] : byName)
+		{
+			ZoneHistory& zone = history[name];
+			zone.frames[zone.next] = total;
+			zone.next = (zone.next + 1) % ZoneHistory::Length;
+			zone.count = std::min(zone.count + 1, ZoneHistory::Length);
+		}
+	}
+
+	std::vector<ProfileStats> Profiler::getStats()
+	{
+		std::vector<ProfileStats> stats;
+		std::vector<double> sorted;
+		for (const auto& [name, zone] : history)
+		{
+			if (zone.count == 0) continue;
+
+			sorted.assign(zone.frames, zone.frames + zone.count);
+			std::sort(sorted.begin(), sorted.end());
+
+			ProfileStats zoneStats;
+			zoneStats.name = name;
+			zoneStats.last = zone.frames[(zone.next + ZoneHistory::Length - 1) % ZoneHistory::Length];
+			zoneStats.min = sorted.front();
+			zoneStats.p99 = sorted[(size_t)(0.99 * (sorted.size() - 1))];
+			for (double frame : sorted)
+			{
+				zoneStats.avg += frame;
+			}
+			zoneStats.avg /= sorted.size();
+			stats.push_back(zoneStats);
+		}
+		std::sort(stats.begin(), stats.end(), [](const ProfileStats& a, const ProfileStats& b) { return a.name < b.name; });
+		return stats;
+	}
+
+	void Profiler::resetStats()
+	{
+		history.clear();
+	}
+
+	bool Profiler::exportChromeTrace(const char* path)
+	{
+		std::ofstream file(path);
+		if (!file.is_open())
+		{
+			printf("[ Profiler ] : ERROR : Could not open %s.\n", path);
+			return false;
+		}
+
+		std::lock_guard<std::mutex> guard(timelinesLock);
+		file << "{\"traceEvents\":[\n";
+		bool first = true;
+		for (std::unique_ptr<ProfileTimeline>& timeline : timelines)
+		{
+			file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << timeline->threadId
+				<< ",\"args\":{\"name\":\"" << timeline->threadName << "\"}}";
+			first = false;
+
+			ReadTimeline(*timeline, 0);
+			for (const ProfileEvent& event : readBuffer)
+			{
+				// Complete events, microseconds.
+				file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << timeline->threadId
+					<< ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << (event.end - event.start) / 1000.0 << "}";
+			}
+		}
+		file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+		return true;
+	}
+
+	uint64 Profiler::ReadTimeline(ProfileTimeline& timeline, uint64 first)
+	{
+		const uint64 head = timeline.head.load(std::memory_order_acquire);
+		const uint64 begin = std::max(first, head > ProfileTimeline::Capacity ? head - ProfileTimeline::Capacity : 0);
+		readBuffer.clear();
+		for (uint64 k = begin; k < head; k++)
+		{
+			// Field by field, the end of the newest event may be extended by a span while it is read.
+			ProfileEvent& slot = timeline.events[k % ProfileTimeline::Capacity];
+			ProfileEvent event;
+			event.name = slot.name;
+			event.start = slot.start;
+			event.end = std::atomic_ref<int64>(slot.end).load(std::memory_order_acquire);
+			event.depth = slot.depth;
+			event.epoch = slot.epoch;
+			readBuffer.push_back(event);
+		}
+
+		// Same reach as SampleRing::Read, event k shares its slot with k + Capacity and the writer may already be
+		// storing the event after the last one it published.
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64 after = timeline.head.load(std::memory_order_relaxed) + 1;
+		const uint64 firstValid = after >= ProfileTimeline::Capacity ? after - ProfileTimeline::Capacity + 1 : 0;
+		if (firstValid > begin)
+		{
+			readBuffer.erase(readBuffer.begin(), readBuffer.begin() + std::min<uint64>(firstValid - begin, readBuffer.size()));
+		}
+		return head;
+	}
+
+	ProfileScope::ProfileScope(const char* name) : timeline(Profiler::getInstance().ThreadTimeline()), name(name)
+	{
+		Profiler::getInstance().NextEpoch();
+		timeline.depth++;
+		start = Profiler::Now();
+	}
+
+	ProfileScope::~ProfileScope()
+	{
+		const int64 end = Profiler::Now();
+		timeline.depth--;
+
+		const uint64 head = timeline.head.load(std::memory_order_relaxed);
+		timeline.events[head % ProfileTimeline::Capacity] = { name, start, end, timeline.depth, Profiler::getInstance().NextEpoch() };
+		timeline.head.store(head + 1, std::memory_order_release);
+	}
+
+	ProfileSpan::ProfileSpan(const char* name) : name(name)
+	{
+		start = Profiler::Now();
+	}
+
+	ProfileSpan::~ProfileSpan()
+	{
+		const int64 end = Profiler::Now();
+		ProfileTimeline& timeline = Profiler::getInstance().ThreadTimeline();
+		const uint32 epoch = Profiler::getInstance().CurrentEpoch();
+
+		const uint64 head = timeline.head.load(std::memory_order_relaxed);
+		if (head > 0)
+		{
+			ProfileEvent& last = timeline.events[(head - 1) % ProfileTimeline::Capacity];
+			if (last.name == name && last.epoch == epoch && last.depth == timeline.depth)
+			{
+				// Already published, readers load the end with acquire.
+				std::atomic_ref<int64>(last.end).store(end, std::memory_order_release);
+				return;
+			}
+		}
+		timeline.events[head % ProfileTimeline::Capacity] = { name, start, end, timeline.depth, epoch };
+		timeline.head.store(head + 1, std::memory_order_release);
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+namespace Core
+{
+	// One finished zone on one thread, times are nanoseconds since the profiler started.
+	struct ProfileEvent
+	{
+		const char* name = nullptr;
+		int64 start = 0;
+		int64 end = 0; // a span merging items stores it again after publishing, access it through atomic_ref
+		uint32 depth = 0;
+		uint32 epoch = 0;
+	};
+
+	// Rolling statistics of a zone's total time per frame, in milliseconds.
+	struct ProfileStats
+	{
+		std::string name;
+		double last = 0.0;
+		double min = 0.0;
+		double avg = 0.0;
+		double p99 = 0.0;
+	};
+
+	// Ring of the most recent events of one thread. Only the owning thread writes, the head is published with a release
+	// store so readers on other threads never need a lock. Like SampleRing, readers drop what the writer lapped meanwhile.
+	struct ProfileTimeline
+	{
+		static constexpr uint32 Capacity = 1 << 16;
+
+		std::unique_ptr<ProfileEvent[]> events = std::make_unique<ProfileEvent[]>(Capacity);
+		std::atomic<uint64> head = 0;
+		uint64 frameRead = 0;
+		uint32 depth = 0;
+		uint32 threadId = 0;
+		std::string threadName;
+	};
+
+	class Profiler
+	{
+	public:
+		static Profiler& getInstance();
+
+		static int64 Now();
+
+		// The calling thread's timeline, registered the first time a thread records anything.
+		ProfileTimeline& ThreadTimeline();
+		void setThreadName(const char* name);
+
+		// Starts a new epoch, spans recorded in different epochs are never merged.
+		uint32 NextEpoch();
+		uint32 CurrentEpoch();
+
+		// Folds the events recorded since the last call into the per-zone history, call once per frame while the
+		// workers are idle.
+		void EndFrame();
+
+		std::vector<ProfileStats> getStats();
+		void resetStats();
+
+		// Chrome trace event JSON (chrome://tracing, Perfetto) of every event still in the rings.
+		bool exportChromeTrace(const char* path);
+
+	private:
+		Profiler() {};
+		Profiler(const Profiler& cpy) = delete;
+
+		struct ZoneHistory
+		{
+			static constexpr uint32 Length = 300;
+			double frames[Length] = {};
+			uint32 next = 0;
+			uint32 count = 0;
+		};
+
+		// Copies the events of timeline from first up to the head into readBuffer, without those the writer lapped
+		// during the copy. Returns the head the copy ran to.
+		uint64 ReadTimeline(ProfileTimeline& timeline, uint64 first);
+
+		std::mutex timelinesLock; // only taken to register a thread and by the readers
+		std::vector<ProfileEvent> readBuffer;
+		std::vector<std::unique_ptr<ProfileTimeline>> timelines;
+		std::atomic<uint32> epoch = 0;
+		std::unordered_map<std::string, ZoneHistory> history;
+	};
+
+	// Records a zone from construction to destruction, zones nest per thread.
+	class ProfileScope
+	{
+	public:
+		ProfileScope(const char* name);
+		~ProfileScope();
+
+	private:
+		ProfileTimeline& timeline;
+		const char* name;
+		int64 start;
+	};
+
+	// Per item zone for parallel loops, consecutive items of one thread in the same epoch extend a single event so the
+	// trace shows when each worker started and finished its share without one event per item.
+	class ProfileSpan
+	{
+	public:
+		ProfileSpan(const char* name);
+		~ProfileSpan();
+
+	private:
+		const char* name;
+		int64 start;
+	};
+}
+
+// Zones compile to nothing unless FLUIDSIM_PROFILER is defined.
+#ifdef FLUIDSIM_PROFILER
+#define PROFILE_JOIN_INNER(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_INNER(a, b)
+#define PROFILE_ZONE(name) Core::ProfileScope PROFILE_JOIN(profileZone, __LINE__)(name)
+#define PROFILE_SPAN(name) Core::ProfileSpan PROFILE_JOIN(profileSpan, __LINE__)(name)
+#define PROFILE_FRAME() Core::Profiler::getInstance().EndFrame()
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_SPAN(name)
+#define PROFILE_FRAME()
+#endif
@@ -0,0 +1,85 @@
+#include "config.h"
+#include "roofline.h"
+
+#include <vector>
+#include <chrono>
+#include <numeric>
+#include <thread>
+#include <execution>
+
+namespace Core
+{
+	namespace
+	{
+		constexpr uint32 StreamLength = 1 << 22; // 48 MB over the three arrays, past the last level cache
+		constexpr uint32 StreamChunk = 1 << 14;
+		constexpr uint32 FlopLanes = 16;
+		constexpr uint32 FlopIterations = 1 << 16;
+		constexpr uint32 Repeats = 3;
+
+		double Seconds(std::chrono::steady_clock::time_point start)
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+
+	MachineRoofline MeasureMachineRoofline()
+	{
+		MachineRoofline roofline;
+
+		std::vector<float> a(StreamLength, 0.0f);
+		std::vector<float> b(StreamLength, 1.0f);
+		std::vector<float> c(StreamLength, 2.0f);
+		std::vector<uint32> chunks(StreamLength / StreamChunk);
+		std::iota(chunks.begin(), chunks.end(), 0);
+
+		// a = b + s * c moves 12 bytes for 2 flops, the write allocate is not counted as in STREAM.
+		double best = 1e30;
+		for (uint32 repeat = 0; repeat < Repeats; repeat++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			std::for_each(std::execution::par, chunks.begin(), chunks.end(), [&](uint32 chunk)
+			{
+				const uint32 first = chunk * StreamChunk;
+				for (uint32 i = first; i < first + StreamChunk; i++)
+				{
+					a[i] = b[i] + 3.0f * c[i];
+				}
+			});
+			best = std::min(best, Seconds(start));
+		}
+		roofline.bandwidth = 12.0 * StreamLength / best * 1e-9;
+
+		// Independent lanes hide the add latency and let the compiler vectorise, the sink keeps the work alive.
+		const uint32 tasks = std::max(1u, std::thread::hardware_concurrency()) * 4;
+		std::vector<float> sinks(tasks, 0.0f);
+		std::vector<uint32> taskList(tasks);
+		std::iota(taskList.begin(), taskList.end(), 0);
+		best = 1e30;
+		for (uint32 repeat = 0; repeat < Repeats; repeat++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			std::for_each(std::execution::par, taskList.begin(), taskList.end(), [&](uint32 task)
+			{
+				float lanes[FlopLanes];
+				for (uint32 k = 0; k < FlopLanes; k++) lanes[k] = (float)(task + k);
+				const float scale = 0.999f;
+				const float offset = 0.001f * a[task];
+				for (uint32 iteration = 0; iteration < FlopIterations; iteration++)
+				{
+					for (uint32 k = 0; k < FlopLanes; k++)
+					{
+						lanes[k] = lanes[k] * scale + offset;
+					}
+				}
+				float sum = 0.0f;
+				for (uint32 k = 0; k < FlopLanes; k++) sum += lanes[k];
+				sinks[task] = sum;
+			});
+			best = std::min(best, Seconds(start));
+		}
+		roofline.peakFlops = 2.0 * FlopLanes * FlopIterations * tasks / best * 1e-9;
+
+		return roofline;
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <algorithm>
+
+namespace Core
+{
+	// The two roofs of this machine, bandwidth from a STREAM triad and peak from independent multiply-add chains, both
+	// run on every core.
+	struct MachineRoofline
+	{
+		double bandwidth = 0.0; // GB/s
+		double peakFlops = 0.0; // GFLOP/s
+
+		// Best performance a kernel of intensity flops per byte can reach, in GFLOP/s.
+		double Attainable(double intensity) const { return std::min(peakFlops, bandwidth * intensity); }
+	};
+
+	// Takes a few hundred milliseconds, keep the result.
+	MachineRoofline MeasureMachineRoofline();
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+namespace Core
+{
+	// Ring of the most recent samples with a single writer. The writer never waits and readers never block it, a
+	// reader copies what it wants and then drops every sample the writer may have overwritten during the copy.
+	template<typename T, uint32 Capacity>
+	class SampleRing
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "Samples are copied while the writer may be overwriting them.");
+
+	public:
+		void Push(const T& sample)
+		{
+			const uint64 index = written.load(std::memory_order_relaxed);
+			samples[index % Capacity] = sample;
+			written.store(index + 1, std::memory_order_release);
+		}
+
+		// Copies up to count of the newest samples into out, oldest first, and returns how many were copied.
+		uint32 Read(T* out, uint32 count) const
+		{
+			const uint64 end = written.load(std::memory_order_acquire);
+			const uint64 available = end < Capacity ? end : Capacity;
+			const uint64 begin = end - (count < available ? count : available);
+			for (uint64 i = begin; i < end; i++)
+			{
+				out[i - begin] = samples[i % Capacity];
+			}
+
+			// Sample i shares its slot with i + Capacity, and the writer may already be storing the sample after the
+			// last one it published, so the oldest samples within that reach may be torn.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64 after = written.load(std::memory_order_relaxed) + 1;
+			const uint64 firstValid = after >= Capacity ? after - Capacity + 1 : 0;
+			if (firstValid <= begin) return (uint32)(end - begin);
+			if (firstValid >= end) return 0;
+			for (uint64 i = firstValid; i < end; i++)
+			{
+				out[i - firstValid] = out[i - begin];
+			}
+			return (uint32)(end - firstValid);
+		}
+
+		// Total pushed since construction, tells a reader whether anything new arrived.
+		uint64 getWritten() const
+		{
+			return written.load(std::memory_order_acquire);
+		}
+
+	private:
+		T samples[Capacity] = {};
+		std::atomic<uint64> written = 0;
+	};
+}
@@ -0,0 +1,202 @@
+#include "config.h"
+#include "simulationArena.h"
+#include "allocationTracker.h"
+
+#include <new>
+#include <fstream>
+#include <algorithm>
+
+#if defined(FLUIDSIM_ARENA) && defined(__linux__)
+#include <sys/mman.h>
+#define ARENA_RESERVE
+#endif
+
+namespace Core
+{
+	namespace
+	{
+		size_t AlignUp(size_t value, size_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		void* HeapAllocate(size_t bytes)
+		{
+			return ::operator new(bytes, std::align_val_t(SimulationArena::Alignment));
+		}
+	}
+
+	SimulationArena& SimulationArena::getInstance()
+	{
+		// Never destroyed, singletons that outlive it would otherwise hand their buffers back to a dead free list.
+		static SimulationArena* instance = new SimulationArena();
+		return *instance;
+	}
+
+	void SimulationArena::Reserve()
+	{
+		reserveTried = true;
+#ifdef ARENA_RESERVE
+		// Address space only, pages are committed on first touch. Strict overcommit refuses large reservations even
+		// with MAP_NORESERVE, so the size backs off down to 256 MiB.
+		for (size_t size = sizeof(void*) == 8 ? (size_t)64 << 30 : (size_t)1 << 30; size >= ((size_t)256 << 20); size /= 2)
+		{
+			void* region = mmap(nullptr, size + HugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (region == MAP_FAILED) continue;
+
+			// Trim to a huge page aligned start so the alignment of the offsets carries over to the addresses.
+			char* aligned = (char*)AlignUp((size_t)region, HugePage);
+			const size_t head = aligned - (char*)region;
+			if (head > 0) munmap(region, head);
+			munmap(aligned + size, HugePage - head);
+
+			base = aligned;
+			reserved = size;
+			madvise(base, reserved, MADV_HUGEPAGE);
+			break;
+		}
+
+		if (base == nullptr)
+		{
+			hugePageStatus = "Reservation failed, using the heap";
+			printf("[ Simulation Arena ] : ERROR : Could not reserve the arena, falling back to the heap.\n");
+			return;
+		}
+
+		// "always [madvise] never", the bracketed entry is the active mode.
+		std::ifstream modeFile("/sys/kernel/mm/transparent_hugepage/enabled");
+		std::string modes;
+		std::getline(modeFile, modes);
+		const size_t open = modes.find('[');
+		const size_t close = modes.find(']');
+		hugePageStatus = open != std::string::npos && close != std::string::npos ? "THP " + modes.substr(open + 1, close - open - 1) : "THP unknown";
+#elif defined(FLUIDSIM_ARENA)
+		hugePageStatus = "No huge pages on this platform, using the heap";
+#else
+		hugePageStatus = "Built without FLUIDSIM_ARENA, using the heap";
+#endif
+	}
+
+	void* SimulationArena::Allocate(size_t bytes)
+	{
+		// The caller's block is what a step allocated, the free list nodes and the heap fallback below are not counted
+		// again on top of it.
+		AllocationTracker::RecordBlock(bytes, ALLOCATION_RETURN_ADDRESS());
+		UntrackedScope untracked;
+
+		bytes = AlignUp(bytes > 0 ? bytes : 1, Alignment);
+		std::lock_guard<std::mutex> guard(lock);
+		if (!reserveTried) Reserve();
+		if (base == nullptr) return HeapAllocate(bytes);
+
+		// Streams spanning a huge page start on one, the gap in front goes back to the free list.
+		const size_t alignment = bytes >= HugePage ? HugePage : Alignment;
+
+		size_t offset = reserved;
+		for (auto block = freeBlocks.begin(); block != freeBlocks.end(); block++)
+		{
+			const size_t start = AlignUp(block->first, alignment);
+			const size_t end = block->first + block->second;
+			if (start + bytes > end) continue;
+
+			const size_t blockStart = block->first;
+			freeBlocks.erase(block);
+			if (start > blockStart) freeBlocks[blockStart] = start - blockStart;
+			if (start + bytes < end) freeBlocks[start + bytes] = end - start - bytes;
+			offset = start;
+			break;
+		}
+
+		if (offset == reserved)
+		{
+			const size_t start = AlignUp(top, alignment);
+			if (start + bytes > reserved) return HeapAllocate(bytes);
+			if (start > top) freeBlocks[top] = start - top;
+			offset = start;
+			top = start + bytes;
+		}
+
+		inUse += bytes;
+		peak = std::max(peak, inUse);
+		blockCount++;
+		return base + offset;
+	}
+
+	void SimulationArena::Free(void* pointer, size_t bytes)
+	{
+		if (pointer == nullptr) return;
+		UntrackedScope untracked;
+		bytes = AlignUp(bytes > 0 ? bytes : 1, Alignment);
+
+		std::lock_guard<std::mutex> guard(lock);
+		if (base == nullptr || (char*)pointer < base || (char*)pointer >= base + reserved)
+		{
+			::operator delete(pointer, std::align_val_t(Alignment));
+			return;
+		}
+
+		inUse -= bytes;
+		blockCount--;
+		Release((char*)pointer - base, bytes);
+	}
+
+	void SimulationArena::Release(size_t offset, size_t bytes)
+	{
+		// Merge with the free neighbours on both sides.
+		auto next = freeBlocks.lower_bound(offset);
+		if (next != freeBlocks.begin())
+		{
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset)
+			{
+				offset = previous->first;
+				bytes += previous->second;
+				freeBlocks.erase(previous);
+			}
+		}
+		if (next != freeBlocks.end() && offset + bytes == next->first)
+		{
+			bytes += next->second;
+			freeBlocks.erase(next);
+		}
+
+#ifdef ARENA_RESERVE
+		// Whole huge pages go back to the kernel, a later allocation faults them in again.
+		const size_t pageStart = AlignUp(offset, HugePage);
+		const size_t pageEnd = (offset + bytes) / HugePage * HugePage;
+		if (pageEnd > pageStart) madvise(base + pageStart, pageEnd - pageStart, MADV_DONTNEED);
+#endif
+
+		if (offset + bytes == top)
+		{
+			top = offset;
+			return;
+		}
+		freeBlocks[offset] = bytes;
+	}
+
+	size_t SimulationArena::getReserved()
+	{
+		return reserved;
+	}
+
+	size_t SimulationArena::getInUse()
+	{
+		return inUse;
+	}
+
+	size_t SimulationArena::getPeak()
+	{
+		return peak;
+	}
+
+	uint32 SimulationArena::getBlockCount()
+	{
+		return blockCount;
+	}
+
+	const char* SimulationArena::getHugePageStatus()
+	{
+		return hugePageStatus.c_str();
+	}
+}
@@ -0,0 +1,113 @@
+#include "config.h"
+#include "statistics.h"
+
+#include <cmath>
+
+namespace Core
+{
+	namespace
+	{
+		// Continued fraction of the regularised incomplete beta function, modified Lentz.
+		double BetaContinuedFraction(double a, double b, double x)
+		{
+			const double tiny = 1e-300;
+			double c = 1.0;
+			double d = 1.0 - (a + b) * x / (a + 1.0);
+			d = 1.0 / (std::abs(d) < tiny ? tiny : d);
+			double result = d;
+			for (int m = 1; m <= 300; m++)
+			{
+				const double m2 = 2.0 * m;
+				double step = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+				d = 1.0 + step * d;
+				c = 1.0 + step / c;
+				d = 1.0 / (std::abs(d) < tiny ? tiny : d);
+				c = std::abs(c) < tiny ? tiny : c;
+				result *= d * c;
+
+				step = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+				d = 1.0 + step * d;
+				c = 1.0 + step / c;
+				d = 1.0 / (std::abs(d) < tiny ? tiny : d);
+				c = std::abs(c) < tiny ? tiny : c;
+				const double delta = d * c;
+				result *= delta;
+				if (std::abs(delta - 1.0) < 1e-12) break;
+			}
+			return result;
+		}
+
+		double IncompleteBeta(double a, double b, double x)
+		{
+			if (x <= 0.0) return 0.0;
+			if (x >= 1.0) return 1.0;
+			const double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) + b * std::log(1.0 - x));
+			// The fraction converges on the side of the mean.
+			if (x < (a + 1.0) / (a + b + 2.0)) return front * BetaContinuedFraction(a, b, x) / a;
+			return 1.0 - front * BetaContinuedFraction(b, a, 1.0 - x) / b;
+		}
+	}
+
+	SampleSummary Summarise(const double* values, uint32 count)
+	{
+		SampleSummary summary;
+		summary.count = count;
+		if (count == 0) return summary;
+
+		double sum = 0.0;
+		for (uint32 i = 0; i < count; i++) sum += values[i];
+		summary.mean = sum / count;
+
+		double squares = 0.0;
+		for (uint32 i = 0; i < count; i++) squares += (values[i] - summary.mean) * (values[i] - summary.mean);
+		summary.stddev = count > 1 ? std::sqrt(squares / (count - 1)) : 0.0;
+
+		const double margin = count > 1 ? StudentQuantile(0.975, count - 1.0) * summary.stddev / std::sqrt((double)count) : 0.0;
+		summary.ciLow = summary.mean - margin;
+		summary.ciHigh = summary.mean + margin;
+		return summary;
+	}
+
+	WelchResult WelchTest(const SampleSummary& a, const SampleSummary& b)
+	{
+		WelchResult result;
+		if (a.count < 2 || b.count < 2) return result;
+
+		const double varianceA = a.stddev * a.stddev / a.count;
+		const double varianceB = b.stddev * b.stddev / b.count;
+		const double variance = varianceA + varianceB;
+		if (variance <= 0.0)
+		{
+			// Two constant samples, either identical or certainly different.
+			result.p = a.mean == b.mean ? 1.0 : 0.0;
+			return result;
+		}
+
+		result.t = (b.mean - a.mean) / std::sqrt(variance);
+		result.dof = variance * variance / (varianceA * varianceA / (a.count - 1) + varianceB * varianceB / (b.count - 1));
+		result.p = StudentTwoSidedP(result.t, result.dof);
+		return result;
+	}
+
+	double StudentTwoSidedP(double t, double dof)
+	{
+		return IncompleteBeta(dof * 0.5, 0.5, dof / (dof + t * t));
+	}
+
+	double StudentQuantile(double probability, double dof)
+	{
+		if (probability <= 0.5) return probability == 0.5 ? 0.0 : -StudentQuantile(1.0 - probability, dof);
+
+		// Bisection on the two sided tail, which falls monotonically with t.
+		const double tail = 2.0 * (1.0 - probability);
+		double low = 0.0;
+		double high = 1e3;
+		for (int i = 0; i < 200; i++)
+		{
+			const double middle = 0.5 * (low + high);
+			if (StudentTwoSidedP(middle, dof) > tail) low = middle;
+			else high = middle;
+		}
+		return 0.5 * (low + high);
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+namespace Core
+{
+	// Mean, sample standard deviation and the 95% confidence interval of the mean from Student's t.
+	struct SampleSummary
+	{
+		uint32 count = 0;
+		double mean = 0.0;
+		double stddev = 0.0;
+		double ciLow = 0.0;
+		double ciHigh = 0.0;
+	};
+
+	SampleSummary Summarise(const double* values, uint32 count);
+
+	// Welch's unequal variance t-test of b against a, t is positive when b has the larger mean. p is two sided.
+	struct WelchResult
+	{
+		double t = 0.0;
+		double dof = 0.0;
+		double p = 1.0;
+	};
+
+	WelchResult WelchTest(const SampleSummary& a, const SampleSummary& b);
+
+	// Probability that |T| exceeds t, and the t below which the given fraction of the distribution lies.
+	double StudentTwoSidedP(double t, double dof);
+	double StudentQuantile(double probability, double dof);
+}
@@ -0,0 +1,120 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "physicsWorld.h"
+#include "core/profiler.h"
+
+#include <chrono>
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		namespace
+		{
+			struct AccuracySums
+			{
+				double densityError = 0.0;
+				float maxDensityError = 0.0f;
+				double kineticEnergy = 0.0;
+				double potentialEnergy = 0.0;
+				glm::dvec3 momentum = { 0,0,0 };
+				double mass = 0.0;
+				float maxSpeedSquared = 0.0f;
+
+				AccuracySums operator+(const AccuracySums& other) const
+				{
+					AccuracySums sum;
+					sum.densityError = densityError + other.densityError;
+					sum.maxDensityError = glm::max(maxDensityError, other.maxDensityError);
+					sum.kineticEnergy = kineticEnergy + other.kineticEnergy;
+					sum.potentialEnergy = potentialEnergy + other.potentialEnergy;
+					sum.momentum = momentum + other.momentum;
+					sum.mass = mass + other.mass;
+					sum.maxSpeedSquared = glm::max(maxSpeedSquared, other.maxSpeedSquared);
+					return sum;
+				}
+			};
+		}
+
+		void FluidSimulation::setAccuracyMetrics(bool status)
+		{
+			accuracyMetrics = status;
+			accuracy = AccuracyMetrics();
+		}
+
+		bool FluidSimulation::getAccuracyMetrics()
+		{
+			return accuracyMetrics;
+		}
+
+		const AccuracyMetrics& FluidSimulation::getAccuracy()
+		{
+			return accuracy;
+		}
+
+		void FluidSimulation::MeasureAccuracy(float deltatime)
+		{
+			PROFILE_ZONE("Accuracy Metrics");
+			auto AccuracyStart = std::chrono::steady_clock::now();
+
+			// One pass reads each particle's state once, the arrays are still warm from the solver's last phase.
+			const bool densityValid = solverType != SolverType::FLIP;
+			const float gravityAccel = gravity ? gravityScale : 0.0f;
+			const float floorHeight = boundPosition.y - 0.5f * BoundScale.y;
+			const AccuracySums sums = std::transform_reduce(std::execution::par, pList.begin(), pList.begin() + numParticles,
+				AccuracySums{}, std::plus<AccuracySums>(),
+				[this, densityValid, gravityAccel, floorHeight](uint32_t i)
+			{
+				const uint8_t phase = particlePhase[i];
+				const float mass = particleMass[i] * phaseDensityRatio[phase];
+				const glm::vec3& velo = velocity[i];
+				const float speedSquared = dot(velo, velo);
+
+				AccuracySums particle;
+				if (densityValid)
+				{
+					const float error = glm::abs(densities[i].x - phaseRestDensity[phase]) / phaseRestDensity[phase];
+					particle.densityError = error;
+					particle.maxDensityError = error;
+				}
+				particle.kineticEnergy = 0.5 * mass * speedSquared;
+				particle.potentialEnergy = mass * gravityAccel * (positions[i].y - floorHeight);
+				particle.momentum = glm::dvec3(velo) * (double)mass;
+				particle.mass = mass;
+				particle.maxSpeedSquared = speedSquared;
+				return particle;
+			});
+
+			accuracy.densityValid = densityValid && numParticles > 0;
+			accuracy.meanDensityError = numParticles > 0 ? (float)(sums.densityError / numParticles) : 0.0f;
+			accuracy.maxDensityError = sums.maxDensityError;
+			accuracy.kineticEnergy = sums.kineticEnergy;
+			accuracy.potentialEnergy = sums.potentialEnergy;
+			accuracy.momentumDrift = sums.mass > 0.0 ? (float)(glm::length(sums.momentum) / sums.mass) : 0.0f;
+			accuracy.maxSpeed = sqrtf(sums.maxSpeedSquared);
+			// DFSPH and FLIP pick their substeps adaptively, the mean substep stands in for all of them.
+			accuracy.cfl = accuracy.maxSpeed * (deltatime / glm::max(LastSubsteps(), 1)) / interactionRadius;
+
+			auto AccuracyEnd = std::chrono::steady_clock::now();
+			accuracy.ms = std::chrono::duration<double>(AccuracyEnd - AccuracyStart).count() * 1000.0;
+		}
+	}
+}
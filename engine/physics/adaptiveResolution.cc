@@ -0,0 +1,278 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+
+#include "kernels.h"
+
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		namespace
+		{
+			// Passes ResetResolution makes towards uniform resolution before resetting what is left in place.
+			constexpr int MaxResetPasses = 8;
+			constexpr int ResetRelaxIterations = 4;
+
+			// Fixed pseudo random direction per particle slot, the split only needs to break symmetry.
+			glm::vec3 SplitDirection(uint32 seed)
+			{
+				uint32 h = seed * 0x9E3779B9u + 0x7F4A7C15u;
+				glm::vec3 dir;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					h ^= h << 13;
+					h ^= h >> 17;
+					h ^= h << 5;
+					dir[axis] = (h & 0xFFFF) / 32767.5f - 1.0f;
+				}
+				float length = glm::length(dir);
+				return length > 0.0001f ? dir / length : glm::vec3(0, 1, 0);
+			}
+		}
+
+		void FluidSimulation::AdaptResolution()
+		{
+			if (!adaptiveResolution) return;
+			if (++adaptiveCounter < adaptiveInterval) return;
+			adaptiveCounter = 0;
+
+			adaptiveSplits = 0;
+			adaptiveMerges = 0;
+
+			ClassifyResolution();
+			MergeParticles();
+			adaptiveMerges = CompactParticles();
+			SplitParticles();
+
+			if (adaptiveSplits == 0 && adaptiveMerges == 0) return;
+
+			maxSmoothingScale = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), 1.0f,
+				[](float a, float b) { return glm::max(a, b); },
+				[this](uint32_t i) { return smoothingScale[i]; });
+
+			// Indices moved, the solvers that keep per-particle history have to start over.
+			dfsphStateValid = false;
+			spatialDirty = true;
+			UpdateSpatialLookup();
+		}
+
+		void FluidSimulation::ClassifyResolution()
+		{
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				adaptiveWish[i] = 0;
+				if (sleeping && blockAsleep[particleBlocks[i]]) return;
+
+				glm::vec3 vorticity = { 0,0,0 };
+				ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					if (neighborIndex == i || sqrDist == 0.0f) return;
+					if (densities[neighborIndex].x <= 0.0f) return;
+
+					float dist = sqrt(sqrDist);
+					glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, PairRadius(i, neighborIndex));
+					vorticity += particleMass[neighborIndex] / densities[neighborIndex].x * glm::cross(velocity[neighborIndex] - velocity[i], grad);
+				});
+
+				// The gap between the two thresholds keeps particles from flipping between levels every pass.
+				const float density = densities[i].x / phaseDensityRatio[particlePhase[i]];
+				const float curl = glm::length(vorticity);
+				const bool refine = density < adaptiveSurfaceRatio * TargetDensity || curl > adaptiveVorticity;
+				const bool coarsen = density > (adaptiveSurfaceRatio + 0.1f) * TargetDensity && curl < 0.5f * adaptiveVorticity;
+
+				if (refine && particleLevel[i] < adaptiveMaxRefine)
+				{
+					adaptiveWish[i] = 1;
+				}
+				else if (coarsen && particleLevel[i] > -adaptiveMaxCoarsen)
+				{
+					adaptiveWish[i] = -1;
+				}
+			});
+		}
+
+		void FluidSimulation::MergeParticles()
+		{
+			// Every candidate picks its nearest candidate of the same level and phase, mutual picks are merged.
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				mergePartners[i] = UINT32_MAX;
+				if (adaptiveWish[i] >= 0) return;
+
+				float nearest = FLT_MAX;
+				ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3&, float sqrDist)
+				{
+					if (neighborIndex == i || adaptiveWish[neighborIndex] >= 0) return;
+					if (particleLevel[neighborIndex] != particleLevel[i] || particlePhase[neighborIndex] != particlePhase[i]) return;
+
+					const float maxDist = 0.75f * PairRadius(i, neighborIndex);
+					if (sqrDist > maxDist * maxDist || sqrDist >= nearest) return;
+
+					nearest = sqrDist;
+					mergePartners[i] = neighborIndex;
+				});
+			});
+
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				const uint32 j = mergePartners[i];
+				if (j == UINT32_MAX || j < i || mergePartners[j] != i) return;
+
+				const float massI = particleMass[i];
+				const float massJ = particleMass[j];
+				const float mass = massI + massJ;
+
+				// Offsets instead of plain averages so pairs straddling a periodic axis merge between them.
+				const glm::vec3 offset = periodicActive ? PeriodicOffset(positions[j] - positions[i]) : positions[j] - positions[i];
+				const glm::vec3 predictedOffset = periodicActive ? PeriodicOffset(predictedPositions[j] - predictedPositions[i]) : predictedPositions[j] - predictedPositions[i];
+				positions[i] += offset * (massJ / mass);
+				predictedPositions[i] += predictedOffset * (massJ / mass);
+				velocity[i] = (velocity[i] * massI + velocity[j] * massJ) / mass;
+				densities[i] = (densities[i] * massI + densities[j] * massJ) / mass;
+				particleAccel[i] = glm::max(particleAccel[i], particleAccel[j]);
+				timeLevels[i] = glm::max(timeLevels[i], timeLevels[j]);
+
+				SetParticleLevel(i, particleLevel[i] - 1);
+				particleDead[j] = 1;
+			});
+		}
+
+		void FluidSimulation::SplitParticles()
+		{
+			const uint32 freeSlots = particleCapacity - numParticles;
+			if (freeSlots == 0) return;
+
+			auto candidatesEnd = std::copy_if(std::execution::par, pList.begin(), pList.end(), adaptiveCandidates.begin(),
+				[this](uint32_t i) { return adaptiveWish[i] > 0; });
+			const uint32 splitCount = glm::min((uint32)(candidatesEnd - adaptiveCandidates.begin()), freeSlots);
+			if (splitCount == 0) return;
+
+			// Children take the next free slots and are placed one child spacing apart around the parent.
+			std::for_each(std::execution::par, adaptiveCandidates.begin(), adaptiveCandidates.begin() + splitCount,
+				[this](uint32_t& parent)
+			{
+				const uint32 child = numParticles + (uint32)(&parent - adaptiveCandidates.data());
+				CopyParticle(parent, child);
+
+				const int level = particleLevel[parent] + 1;
+				SetParticleLevel(parent, level);
+				SetParticleLevel(child, level);
+
+				const float spacing = cbrtf(particleMass[parent] / TargetDensity);
+				const glm::vec3 offset = SplitDirection(parent) * (0.5f * spacing);
+
+				positions[parent] -= offset;
+				positions[child] += offset;
+				ClampToBound(positions[parent]);
+				ClampToBound(positions[child]);
+				predictedPositions[parent] = positions[parent];
+				predictedPositions[child] = positions[child];
+				OutPositions[parent] = glm::vec4(positions[parent], 0.34f * smoothingScale[parent]);
+				OutPositions[child] = glm::vec4(positions[child], 0.34f * smoothingScale[child]);
+			});
+
+			const uint32 oldCount = numParticles;
+			adaptiveSplits = splitCount;
+			numParticles += splitCount;
+			pList.resize(numParticles);
+			std::iota(pList.begin() + oldCount, pList.end(), oldCount);
+		}
+
+		void FluidSimulation::ResetResolution()
+		{
+			auto adapted = [this](uint32_t i) { return particleLevel[i] != 0; };
+			if (std::none_of(std::execution::par, pList.begin(), pList.end(), adapted)) return;
+
+			// Each pass takes particles one level towards uniform, coarse ones split while free slots last and refined
+			// ones merge with a neighbour of their level, so mass is kept wherever a slot or partner is found.
+			for (int pass = 0; pass < MaxResetPasses && std::any_of(std::execution::par, pList.begin(), pList.end(), adapted); pass++)
+			{
+				maxSmoothingScale = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), 1.0f,
+					[](float a, float b) { return glm::max(a, b); },
+					[this](uint32_t i) { return smoothingScale[i]; });
+				spatialDirty = true;
+				UpdateSpatialLookup();
+
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this](uint32_t i)
+				{
+					adaptiveWish[i] = particleLevel[i] < 0 ? 1 : particleLevel[i] > 0 ? -1 : 0;
+				});
+				MergeParticles();
+				const uint32 merges = CompactParticles();
+				adaptiveSplits = 0;
+				SplitParticles();
+				if (merges == 0 && adaptiveSplits == 0) break;
+			}
+
+			// Whatever found neither is taken to unit mass where it stands.
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				if (particleLevel[i] != 0) SetParticleLevel(i, 0);
+			});
+			maxSmoothingScale = 1.0f;
+			adaptiveSplits = 0;
+			adaptiveMerges = 0;
+			dfsphStateValid = false;
+
+			// Split children land wherever their direction points. A few PBF density projections move them out of
+			// their neighbours before the next solver turns the overlap into pressure, velocities are left alone.
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i) { predictedPositions[i] = positions[i]; });
+			spatialDirty = true;
+			UpdateSpatialLookup();
+			for (int iteration = 0; iteration < ResetRelaxIterations; iteration++)
+			{
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this](uint32_t i) { CalculatePBFLambda(i); });
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this](uint32_t i) { CalculatePBFDelta(i); });
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this](uint32_t i)
+				{
+					predictedPositions[i] += pbfDelta[i];
+					ClampToBound(predictedPositions[i]);
+				});
+			}
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				positions[i] = predictedPositions[i];
+				OutPositions[i] = glm::vec4(positions[i], 0.34f);
+			});
+			UpdateSpatialLookup();
+		}
+
+		void FluidSimulation::SetParticleLevel(uint32 i, int level)
+		{
+			particleLevel[i] = level;
+			particleMass[i] = ldexpf(1.0f, -level);
+			smoothingScale[i] = exp2f(-level / 3.0f);
+		}
+	}
+}
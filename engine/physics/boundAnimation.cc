@@ -0,0 +1,138 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+
+#include <algorithm>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		bool FluidSimulation::BoundAnimated()
+		{
+			return boundAnimation && !boundKeyframes.empty() && solverType != SolverType::FLIP;
+		}
+
+		glm::vec3 FluidSimulation::BoundVelocityAt(const glm::vec3& pos)
+		{
+			return boundLinearVelocity + glm::cross(boundAngularVelocity, pos - boundPosition);
+		}
+
+		void FluidSimulation::AdvanceBounds(float deltatime)
+		{
+			// The pose and wall velocity are evaluated once here, the collision only reads them.
+			glm::vec3 position = { 0,0,0 };
+			glm::quat rotation = glm::identity<glm::quat>();
+			glm::vec3 linear = { 0,0,0 };
+			glm::vec3 angular = { 0,0,0 };
+
+			if (BoundAnimated())
+			{
+				boundTime += deltatime;
+				const float duration = boundKeyframes.back().time;
+				const float time = duration > 0.0f ? fmodf(boundTime, duration) : 0.0f;
+
+				// The pose is held before the first and after the last keyframe.
+				auto next = std::upper_bound(boundKeyframes.begin(), boundKeyframes.end(), time,
+					[](float t, const BoundKeyframe& key) { return t < key.time; });
+				if (next == boundKeyframes.begin() || next == boundKeyframes.end())
+				{
+					const BoundKeyframe& key = next == boundKeyframes.begin() ? boundKeyframes.front() : boundKeyframes.back();
+					position = key.position;
+					rotation = key.rotation;
+				}
+				else
+				{
+					const BoundKeyframe& from = *(next - 1);
+					const BoundKeyframe& to = *next;
+					const float span = to.time - from.time;
+					const float s = (time - from.time) / span;
+
+					position = glm::mix(from.position, to.position, s);
+					rotation = glm::slerp(from.rotation, to.rotation, s);
+					linear = (to.position - from.position) / span;
+
+					// Slerp turns at a constant rate about a fixed axis, along the shorter arc.
+					glm::quat delta = to.rotation * glm::conjugate(from.rotation);
+					if (delta.w < 0.0f) delta = -delta;
+					const float sinHalf = sqrtf(glm::max(1.0f - delta.w * delta.w, 0.0f));
+					if (sinHalf > 1e-6f)
+					{
+						const float angle = 2.0f * acosf(glm::min(delta.w, 1.0f));
+						angular = glm::vec3(delta.x, delta.y, delta.z) / sinHalf * (angle / span);
+					}
+				}
+
+				if (linear != glm::vec3(0) || angular != glm::vec3(0))
+				{
+					WakeAll();
+				}
+			}
+
+			boundPosition = position;
+			boundRotation = rotation;
+			boundLinearVelocity = linear;
+			boundAngularVelocity = angular;
+			boundTransform = glm::translate(position) * glm::mat4_cast(rotation);
+		}
+
+		void FluidSimulation::setBoundKeyframes(const std::vector<BoundKeyframe>& keyframes)
+		{
+			boundKeyframes = keyframes;
+			std::stable_sort(boundKeyframes.begin(), boundKeyframes.end(),
+				[](const BoundKeyframe& a, const BoundKeyframe& b) { return a.time < b.time; });
+			for (BoundKeyframe& key : boundKeyframes)
+			{
+				key.rotation = glm::normalize(key.rotation);
+			}
+			WakeAll();
+		}
+
+		const std::vector<BoundKeyframe>& FluidSimulation::getBoundKeyframes()
+		{
+			return boundKeyframes;
+		}
+
+		void FluidSimulation::setBoundAnimation(bool status)
+		{
+			if (status != boundAnimation)
+			{
+				WakeAll();
+			}
+			boundAnimation = status;
+		}
+
+		bool FluidSimulation::getBoundAnimation()
+		{
+			return boundAnimation;
+		}
+
+		void FluidSimulation::resetBoundAnimation()
+		{
+			boundTime = 0.0f;
+			WakeAll();
+		}
+
+		glm::mat4 FluidSimulation::getBoundTransform()
+		{
+			return boundTransform;
+		}
+	}
+}
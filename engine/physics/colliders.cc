@@ -0,0 +1,179 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+
+#include <numeric>
+#include <algorithm>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		int FluidSimulation::addCollider(const std::vector<glm::vec3>& vertices, const std::vector<uint32>& indices, const glm::mat4& transform)
+		{
+			std::vector<glm::vec3> worldVertices(vertices.size());
+			std::transform(std::execution::par, vertices.begin(), vertices.end(), worldVertices.begin(),
+				[&transform](const glm::vec3& vertex) { return glm::vec3(transform * glm::vec4(vertex, 1.0f)); });
+
+			// The band has to reach past a broadphase cell's half diagonal plus colliderRadius, otherwise the
+			// clamped distances never get to the broadphase cull distance and every cell lists the collider.
+			// One collider cell on top covers the interpolation error near the band's edge.
+			const float broadphaseReach = 0.5f * sqrtf(3.0f) * broadphaseCellSize + colliderRadius + colliderCellSize;
+			SdfCollider collider;
+			if (!collider.Build(worldVertices, indices, colliderCellSize, glm::max(3.0f * colliderRadius, broadphaseReach)))
+			{
+				return -1;
+			}
+			colliders.push_back(std::move(collider));
+			RebuildColliderBroadphase();
+			ReserveRigidContacts();
+			WakeAll();
+			return (int)colliders.size() - 1;
+		}
+
+		int FluidSimulation::loadCollider(const char* path, const glm::mat4& transform)
+		{
+			std::vector<glm::vec3> vertices;
+			std::vector<uint32> indices;
+			if (!SdfCollider::LoadOBJ(path, vertices, indices))
+			{
+				return -1;
+			}
+			return addCollider(vertices, indices, transform);
+		}
+
+		void FluidSimulation::clearColliders()
+		{
+			colliders.clear();
+			RebuildColliderBroadphase();
+			WakeAll();
+		}
+
+		uint32 FluidSimulation::getColliderCount()
+		{
+			return colliders.size();
+		}
+
+		void FluidSimulation::setColliderCellSize(float value)
+		{
+			colliderCellSize = value;
+		}
+
+		float FluidSimulation::getColliderCellSize()
+		{
+			return colliderCellSize;
+		}
+
+		void FluidSimulation::setColliderRadius(float value)
+		{
+			if (value != colliderRadius)
+			{
+				WakeAll();
+			}
+			colliderRadius = value;
+			RebuildColliderBroadphase();
+		}
+
+		float FluidSimulation::getColliderRadius()
+		{
+			return colliderRadius;
+		}
+
+		void FluidSimulation::RebuildColliderBroadphase()
+		{
+			broadphaseCount = glm::ivec3(0, 0, 0);
+			broadphaseStart.clear();
+			broadphaseColliders.clear();
+			if (colliders.empty()) return;
+
+			glm::vec3 boundsMin = colliders[0].boundsMin;
+			glm::vec3 boundsMax = colliders[0].boundsMax;
+			for (const SdfCollider& collider : colliders)
+			{
+				boundsMin = glm::min(boundsMin, collider.boundsMin);
+				boundsMax = glm::max(boundsMax, collider.boundsMax);
+			}
+			broadphaseMin = boundsMin;
+			broadphaseCount = glm::max(glm::ivec3(glm::ceil((boundsMax - boundsMin) / broadphaseCellSize)), glm::ivec3(1));
+
+			const uint32 cellTotal = (uint32)broadphaseCount.x * broadphaseCount.y * broadphaseCount.z;
+			const float halfDiagonal = 0.5f * sqrtf(3.0f) * broadphaseCellSize;
+			std::vector<uint8_t> overlaps((size_t)cellTotal * colliders.size(), 0);
+			std::vector<uint32> cells(cellTotal);
+			std::iota(cells.begin(), cells.end(), 0);
+
+			// A collider is listed in a cell unless the distance at the cell centre puts its surface out of reach.
+			// Distances are clamped to the collider's band, so the cull only fires where the band covers the reach.
+			std::for_each(std::execution::par, cells.begin(), cells.end(),
+				[&](uint32_t cell)
+			{
+				const glm::ivec3 coord = { cell % broadphaseCount.x, (cell / broadphaseCount.x) % broadphaseCount.y, cell / (broadphaseCount.x * broadphaseCount.y) };
+				const glm::vec3 centre = broadphaseMin + (glm::vec3(coord) + 0.5f) * broadphaseCellSize;
+				for (uint32 c = 0; c < colliders.size(); c++)
+				{
+					if (glm::any(glm::lessThan(centre + halfDiagonal, colliders[c].boundsMin)) ||
+						glm::any(glm::greaterThan(centre - halfDiagonal, colliders[c].boundsMax))) continue;
+
+					float distance;
+					glm::vec3 gradient;
+					if (colliders[c].Sample(centre, distance, gradient) && distance >= halfDiagonal + colliderRadius) continue;
+					overlaps[(size_t)cell * colliders.size() + c] = 1;
+				}
+			});
+
+			broadphaseStart.assign(cellTotal + 1, 0);
+			for (uint32 cell = 0; cell < cellTotal; cell++)
+			{
+				broadphaseStart[cell] = broadphaseColliders.size();
+				for (uint32 c = 0; c < colliders.size(); c++)
+				{
+					if (overlaps[(size_t)cell * colliders.size() + c]) broadphaseColliders.push_back(c);
+				}
+			}
+			broadphaseStart[cellTotal] = broadphaseColliders.size();
+		}
+
+		void FluidSimulation::ResolveColliders(uint32 i)
+		{
+			if (broadphaseStart.empty()) return;
+
+			const glm::ivec3 cell = glm::ivec3(glm::floor((positions[i] - broadphaseMin) / broadphaseCellSize));
+			if (glm::any(glm::lessThan(cell, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(cell, broadphaseCount))) return;
+
+			const uint32 cellIndex = ((uint32)cell.z * broadphaseCount.y + cell.y) * broadphaseCount.x + cell.x;
+			for (uint32 k = broadphaseStart[cellIndex]; k < broadphaseStart[cellIndex + 1]; k++)
+			{
+				float distance;
+				glm::vec3 normal;
+				if (!colliders[broadphaseColliders[k]].Sample(positions[i], distance, normal)) continue;
+				if (distance >= colliderRadius) continue;
+
+				// Project out of the collider and drop the velocity into it, the tangential part slides freely.
+				positions[i] += normal * (colliderRadius - distance);
+				float normalVelocity = dot(velocity[i], normal);
+				if (normalVelocity < 0.0f)
+				{
+					velocity[i] -= normal * normalVelocity;
+				}
+			}
+		}
+	}
+}
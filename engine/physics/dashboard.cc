@@ -0,0 +1,142 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "physicsWorld.h"
+#include "core/profiler.h"
+#include "core/processStats.h"
+
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		namespace
+		{
+			struct HistogramCounts
+			{
+				uint32 neighbours[DashboardHistograms::NeighbourBins] = {};
+
+				HistogramCounts operator+(const HistogramCounts& other) const
+				{
+					HistogramCounts sum = *this;
+					for (uint32 bin = 0; bin < DashboardHistograms::NeighbourBins; bin++)
+					{
+						sum.neighbours[bin] += other.neighbours[bin];
+					}
+					return sum;
+				}
+			};
+		}
+
+		void FluidSimulation::setDashboard(bool status)
+		{
+			dashboard = status;
+			dashboardSteps = 0;
+		}
+
+		bool FluidSimulation::getDashboard()
+		{
+			return dashboard;
+		}
+
+		const Core::SampleRing<DashboardSample, FluidSimulation::DashboardLength>& FluidSimulation::getDashboardSamples()
+		{
+			return dashboardSamples;
+		}
+
+		const Core::SampleRing<DashboardHistograms, 4>& FluidSimulation::getDashboardHistograms()
+		{
+			return dashboardHistograms;
+		}
+
+		void FluidSimulation::RecordDashboard(double stepMs)
+		{
+			DashboardSample sample;
+			sample.phaseMs[(uint32)SimPhase::Gravity] = (float)ElapsedTimeGravity;
+			sample.phaseMs[(uint32)SimPhase::Spatial] = (float)ElapsedTimeSpatial;
+			sample.phaseMs[(uint32)SimPhase::Density] = (float)ElapsedTimeDensity;
+			sample.phaseMs[(uint32)SimPhase::Pressure] = (float)ElapsedTimePressure;
+			sample.phaseMs[(uint32)SimPhase::Viscosity] = (float)ElapsedTimeViscosity;
+			sample.phaseMs[(uint32)SimPhase::PositionNCollision] = (float)ElapsedTimePositionNCollision;
+			sample.rigidMs = (float)ElapsedTimeRigid;
+			sample.secondaryMs = (float)ElapsedTimeSecondary;
+			sample.stepMs = (float)stepMs;
+			sample.particles = numParticles;
+			sample.arenaMiB = (float)(Core::SimulationArena::getInstance().getInUse() / 1048576.0);
+			const Core::ProcessStats process = Core::ReadProcessStats();
+			sample.threads = process.threads;
+			sample.residentMiB = (float)process.residentMiB;
+			sample.densityError = accuracy.meanDensityError;
+			sample.cfl = accuracy.cfl;
+			dashboardSamples.Push(sample);
+
+			if (dashboardSteps++ % DashboardHistogramInterval == 0 && solverType != SolverType::FLIP && numParticles > 0)
+			{
+				DashboardHistograms histograms;
+				histograms.step = dashboardSteps;
+				CollectDashboardHistograms(histograms);
+				dashboardHistograms.Push(histograms);
+			}
+		}
+
+		void FluidSimulation::CollectDashboardHistograms(DashboardHistograms& histograms)
+		{
+			PROFILE_ZONE("Dashboard Histograms");
+			// Walks the lookup the step built, a particle's own entry is not counted as a neighbour.
+			const HistogramCounts counts = std::transform_reduce(std::execution::par, pList.begin(), pList.begin() + numParticles,
+				HistogramCounts{},
+				[](const HistogramCounts& a, const HistogramCounts& b) { return a + b; },
+				[this](uint32_t i)
+			{
+				uint32 neighbours = 0;
+				ForEachNeighbour(predictedPositions[i], [&neighbours, i](uint32_t j, const glm::vec3&, float)
+				{
+					neighbours += j != i;
+				});
+				HistogramCounts particle;
+				particle.neighbours[std::min(neighbours, DashboardHistograms::NeighbourBins - 1)] = 1;
+				return particle;
+			});
+			std::copy(counts.neighbours, counts.neighbours + DashboardHistograms::NeighbourBins, histograms.neighbours);
+			histograms.particles = numParticles;
+
+			// The lookup is sorted by key, each run of equal keys is one bucket. Keys span the whole pool, those no particle
+			// hashed to are empty.
+			uint32 occupied = 0;
+			for (uint32 start = 0; start < numParticles;)
+			{
+				const uint32 key = (uint32)spatialLookup[start].z;
+				const uint32 hash = (uint32)spatialLookup[start].y;
+				bool shared = false;
+				uint32 end = start + 1;
+				while (end < numParticles && (uint32)spatialLookup[end].z == key)
+				{
+					shared |= (uint32)spatialLookup[end].y != hash;
+					end++;
+				}
+				histograms.buckets[std::min(end - start, DashboardHistograms::BucketBins - 1)]++;
+				histograms.sharedBuckets += shared;
+				occupied++;
+				start = end;
+			}
+			histograms.buckets[0] = particleCapacity - occupied;
+		}
+	}
+}
@@ -0,0 +1,372 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "physicsWorld.h"
+
+#include "kernels.h"
+#include "core/profiler.h"
+
+#include <chrono>
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		void FluidSimulation::UpdateDFSPH(float deltatime)
+		{
+			PROFILE_ZONE("DFSPH Update");
+			ElapsedTimeGravity = 0.0;
+			ElapsedTimeSpatial = 0.0;
+			ElapsedTimeDensity = 0.0;
+			ElapsedTimePressure = 0.0;
+			ElapsedTimeViscosity = 0.0;
+			ElapsedTimePositionNCollision = 0.0;
+
+			if (!dfsphStateValid)
+			{
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this](uint32_t i)
+				{
+					predictedPositions[i] = positions[i];
+					dfsphKappa[i] = 0.0f;
+					dfsphKappaV[i] = 0.0f;
+				});
+				UpdateSpatialLookup();
+				ComputeDFSPHFactors();
+				dfsphStateValid = true;
+			}
+
+			// The pressure solve keeps the fluid incompressible, so the step is only limited by the CFL condition
+			// to keep neighbourhoods valid, no particle may travel more than a fraction of the radius per step.
+			const int maxSubsteps = 32;
+			float remaining = deltatime;
+			int densityIterations = 0;
+			int divergenceIterations = 0;
+			dfsphSubsteps = 0;
+			while (remaining > 1e-6f && dfsphSubsteps < maxSubsteps)
+			{
+				float maxSpeed = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), 0.0f,
+					[](float a, float b) { return glm::max(a, b); },
+					[this](uint32_t i)
+				{
+					return glm::length(velocity[i]);
+				});
+
+				float stepTime = glm::min(remaining, dfsphMaxTimeStep);
+				if (maxSpeed > 0.0f)
+				{
+					stepTime = glm::min(stepTime, dfsphCFLFactor * interactionRadius / maxSpeed);
+				}
+				// Split what is left evenly, a tiny trailing step makes the pressure solve very stiff.
+				stepTime = remaining / ceil(remaining / stepTime);
+				if (dfsphSubsteps == maxSubsteps - 1)
+				{
+					stepTime = remaining;
+				}
+
+				AdvanceBounds(stepTime);
+				StepDFSPH(stepTime);
+				remaining -= stepTime;
+				densityIterations += dfsphDensityIterations;
+				divergenceIterations += dfsphDivergenceIterations;
+				dfsphSubsteps++;
+			}
+			dfsphDensityIterations = densityIterations;
+			dfsphDivergenceIterations = divergenceIterations;
+		}
+
+		void FluidSimulation::StepDFSPH(float deltatime)
+		{
+			auto GravityStart = std::chrono::steady_clock::now();
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, deltatime](uint32_t i)
+			{
+				velocity[i] += CalculateExternalFoce(positions[i], velocity[i]) * deltatime;
+			});
+			auto GravityEnd = std::chrono::steady_clock::now();
+			ElapsedTimeGravity += std::chrono::duration<double>(GravityEnd - GravityStart).count() * 1000.0f;
+
+			auto ViscosityStart = std::chrono::steady_clock::now();
+			UpdateViscosity(pList, deltatime);
+			auto ViscosityEnd = std::chrono::steady_clock::now();
+			ElapsedTimeViscosity += std::chrono::duration<double>(ViscosityEnd - ViscosityStart).count() * 1000.0f;
+
+			auto PressureStart = std::chrono::steady_clock::now();
+			SolveDFSPHDensity(deltatime);
+			AccumulateDFSPHRigidPressure(dfsphKappa, deltatime);
+			auto PressureEnd = std::chrono::steady_clock::now();
+			ElapsedTimePressure += std::chrono::duration<double>(PressureEnd - PressureStart).count() * 1000.0f;
+
+			auto PosNCollStart = std::chrono::steady_clock::now();
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, deltatime](uint32_t i)
+			{
+				positions[i] += velocity[i] * deltatime;
+				ResolveBoundCollision(i);
+				predictedPositions[i] = positions[i];
+			});
+			auto PosNCollEnd = std::chrono::steady_clock::now();
+			ElapsedTimePositionNCollision += std::chrono::duration<double>(PosNCollEnd - PosNCollStart).count() * 1000.0f;
+
+			// Bodies move before the lookup is rebuilt, the divergence solve's reaction is applied on their next step.
+			StepRigidBodies(deltatime);
+
+			auto SpatialStart = std::chrono::steady_clock::now();
+			UpdateSpatialLookup();
+			auto SpatialEnd = std::chrono::steady_clock::now();
+			ElapsedTimeSpatial += std::chrono::duration<double>(SpatialEnd - SpatialStart).count() * 1000.0f;
+
+			auto DensityStart = std::chrono::steady_clock::now();
+			ComputeDFSPHFactors();
+			auto DensityEnd = std::chrono::steady_clock::now();
+			ElapsedTimeDensity += std::chrono::duration<double>(DensityEnd - DensityStart).count() * 1000.0f;
+
+			PressureStart = std::chrono::steady_clock::now();
+			SolveDFSPHDivergence(deltatime);
+			AccumulateDFSPHRigidPressure(dfsphKappaV, deltatime);
+			PressureEnd = std::chrono::steady_clock::now();
+			ElapsedTimePressure += std::chrono::duration<double>(PressureEnd - PressureStart).count() * 1000.0f;
+		}
+
+		void FluidSimulation::ComputeDFSPHFactors()
+		{
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				const glm::vec3& pos = predictedPositions[i];
+				float density = 0;
+				float nearDensity = 0;
+				glm::vec3 sumGrad = { 0,0,0 };
+				float sumSqrGrad = 0;
+
+				ForEachNeighbour(pos, [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					float dist = sqrt(sqrDist);
+					density += kernels::SmoothingPow2(dist, interactionRadius);
+					nearDensity += kernels::SmoothingPow3(dist, interactionRadius);
+
+					if (neighborIndex == i || dist <= 0) return;
+					glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+					sumGrad += grad;
+					sumSqrGrad += dot(grad, grad);
+				});
+
+				// The container walls act as a static boundary filled with fluid at rest density.
+				glm::vec4 bound = CalculateBoundDensity(pos) + CalculateRigidDensity(pos);
+				density += bound.x;
+				sumGrad += glm::vec3(bound.y, bound.z, bound.w);
+
+				densities[i] = { density, nearDensity };
+
+				float denominator = dot(sumGrad, sumGrad) + sumSqrGrad;
+				dfsphFactors[i] = denominator > 1e-6f ? density / denominator : 0.0f;
+			});
+		}
+
+		glm::vec4 FluidSimulation::CalculateBoundDensity(const glm::vec3& pos)
+		{
+			const glm::vec3 halfSize = BoundScale * 0.5f;
+			const glm::vec3 local = glm::conjugate(boundRotation) * (pos - boundPosition);
+			glm::vec3 gradient = { 0,0,0 };
+			float density = 0.0f;
+
+			// Particles are clamped onto the wall, so the boundary surface sits half a particle spacing further out.
+			const float wallOffset = 0.5f * powf(1.0f / TargetDensity, 1.0f / 3.0f);
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (periodicCells[axis] > 0) continue;
+				float dist = halfSize[axis] - abs(local[axis]) + wallOffset;
+				if (dist >= interactionRadius) continue;
+
+				density += TargetDensity * kernels::SmoothingPow2WallVolume(dist, interactionRadius);
+				// The gradient points into the wall, the inward wall normal is -sign(pos) in container space.
+				gradient[axis] -= TargetDensity * kernels::SmoothingPow2WallVolumeDerivative(dist, interactionRadius) * glm::sign(local[axis]);
+			}
+			gradient = boundRotation * gradient;
+			return glm::vec4(density, gradient);
+		}
+
+		void FluidSimulation::ApplyDFSPHPressure(const Core::ArenaVector<float>& kappa, float deltatime)
+		{
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, &kappa, deltatime](uint32_t i)
+			{
+				const float kappaI = kappa[i] / densities[i].x;
+				glm::vec3 deltaVelocity = { 0,0,0 };
+
+				ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					if (neighborIndex == i) return;
+					float dist = sqrt(sqrDist);
+					if (dist <= 0) return;
+
+					float kappaSum = kappaI + kappa[neighborIndex] / densities[neighborIndex].x;
+					glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+					deltaVelocity -= grad * kappaSum;
+				});
+
+				glm::vec4 bound = CalculateBoundDensity(predictedPositions[i]) + CalculateRigidDensity(predictedPositions[i]);
+				deltaVelocity -= glm::vec3(bound.y, bound.z, bound.w) * kappaI;
+
+				velocity2[i] = velocity[i] + deltaVelocity * deltatime;
+			});
+			std::swap(velocity, velocity2);
+		}
+
+		void FluidSimulation::SolveDFSPHDensity(float deltatime)
+		{
+			const float invDeltaSqr = 1.0f / (deltatime * deltatime);
+			const float numFluid = (float)pList.size();
+
+			// Rate of density change from the current velocities, predicted one step ahead.
+			auto predictDensity = [this, deltatime](uint32_t i)
+			{
+				const glm::vec3& velo = velocity[i];
+				float densityChange = 0;
+				ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					if (neighborIndex == i) return;
+					float dist = sqrt(sqrDist);
+					if (dist <= 0) return;
+					glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+					densityChange += dot(velo - velocity[neighborIndex], grad);
+				});
+				glm::vec4 bound = CalculateBoundDensity(predictedPositions[i]);
+				densityChange += dot(velo - BoundVelocityAt(predictedPositions[i]), glm::vec3(bound.y, bound.z, bound.w));
+				densityChange += CalculateRigidDensityChange(predictedPositions[i], velo);
+				dfsphDensityAdv[i] = glm::max(densities[i].x + deltatime * densityChange, TargetDensity);
+			};
+
+			// Warm start from last step's pressure where the fluid is still compressed, capped to
+			// what half the rest density would need so a large correction is not re-applied every step.
+			if (dfsphWarmStart)
+			{
+				std::for_each(std::execution::par, pList.begin(), pList.end(), predictDensity);
+			}
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, invDeltaSqr](uint32_t i)
+			{
+				bool compressed = dfsphWarmStart && dfsphDensityAdv[i] > TargetDensity;
+				dfsphKappa[i] = compressed ? glm::min(dfsphKappa[i], 0.5f * TargetDensity * dfsphFactors[i] * invDeltaSqr) : 0.0f;
+			});
+			if (dfsphWarmStart)
+			{
+				ApplyDFSPHPressure(dfsphKappa, deltatime);
+			}
+
+			dfsphDensityIterations = 0;
+			dfsphDensityError = 0.0f;
+			while (dfsphDensityIterations < dfsphMaxIterations)
+			{
+				std::for_each(std::execution::par, pList.begin(), pList.end(), predictDensity);
+
+				float errorSum = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), 0.0f, std::plus<float>(),
+					[this](uint32_t i)
+				{
+					return dfsphDensityAdv[i] - TargetDensity;
+				});
+				dfsphDensityError = errorSum / (numFluid * TargetDensity);
+
+				// DFSPH needs at least two iterations before the error estimate can be trusted.
+				if (dfsphDensityIterations >= 2 && dfsphDensityError <= dfsphDensityTolerance) break;
+
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this, invDeltaSqr](uint32_t i)
+				{
+					dfsphKappaStep[i] = (dfsphDensityAdv[i] - TargetDensity) * invDeltaSqr * dfsphFactors[i];
+					dfsphKappa[i] += dfsphKappaStep[i];
+				});
+				ApplyDFSPHPressure(dfsphKappaStep, deltatime);
+				dfsphDensityIterations++;
+			}
+		}
+
+		void FluidSimulation::SolveDFSPHDivergence(float deltatime)
+		{
+			const float invDelta = 1.0f / deltatime;
+			const float numFluid = (float)pList.size();
+
+			// A full neighbourhood holds about rest density times the kernel volume particles.
+			const float minNeighbours = 0.6f * 4.0f / 3.0f * glm::pi<float>() * powf(interactionRadius, 3) * TargetDensity;
+
+			auto densityChange = [this, minNeighbours](uint32_t i)
+			{
+				const glm::vec3& velo = velocity[i];
+				float change = 0;
+				int numNeighbours = 0;
+				ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					if (neighborIndex == i) return;
+					float dist = sqrt(sqrDist);
+					if (dist <= 0) return;
+					glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+					change += dot(velo - velocity[neighborIndex], grad);
+					numNeighbours++;
+				});
+				glm::vec4 bound = CalculateBoundDensity(predictedPositions[i]);
+				change += dot(velo - BoundVelocityAt(predictedPositions[i]), glm::vec3(bound.y, bound.z, bound.w));
+				change += CalculateRigidDensityChange(predictedPositions[i], velo);
+				// Only compression is corrected, and not at all for particles with a deficient neighbourhood
+				// such as spray, their factor is too large to give a stable correction.
+				dfsphDensityAdv[i] = numNeighbours < minNeighbours ? 0.0f : glm::max(change, 0.0f);
+			};
+
+			if (dfsphWarmStart)
+			{
+				std::for_each(std::execution::par, pList.begin(), pList.end(), densityChange);
+			}
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, invDelta](uint32_t i)
+			{
+				bool compressing = dfsphWarmStart && dfsphDensityAdv[i] > 0.0f;
+				dfsphKappaV[i] = compressing ? 0.5f * glm::min(dfsphKappaV[i], 0.5f * TargetDensity * dfsphFactors[i] * invDelta * invDelta) : 0.0f;
+			});
+			if (dfsphWarmStart)
+			{
+				ApplyDFSPHPressure(dfsphKappaV, deltatime);
+			}
+
+			dfsphDivergenceIterations = 0;
+			while (dfsphDivergenceIterations < dfsphMaxIterations)
+			{
+				std::for_each(std::execution::par, pList.begin(), pList.end(), densityChange);
+
+				float errorSum = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), 0.0f, std::plus<float>(),
+					[this](uint32_t i)
+				{
+					return dfsphDensityAdv[i];
+				});
+				float error = errorSum * deltatime / (numFluid * TargetDensity);
+
+				if (dfsphDivergenceIterations >= 1 && error <= dfsphDivergenceTolerance) break;
+
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this, invDelta](uint32_t i)
+				{
+					dfsphKappaStep[i] = dfsphDensityAdv[i] * invDelta * dfsphFactors[i];
+					dfsphKappaV[i] += dfsphKappaStep[i];
+				});
+				ApplyDFSPHPressure(dfsphKappaStep, deltatime);
+				dfsphDivergenceIterations++;
+			}
+		}
+	}
+}
@@ -0,0 +1,462 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "flipSolver.h"
+
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		void FlipSolver::Initialize(uint32 particleAmmount)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				affine[axis].assign(particleAmmount, glm::vec3(0, 0, 0));
+			}
+		}
+
+		void FlipSolver::CopyParticle(uint32 from, uint32 to)
+		{
+			if (to >= affine[0].size()) return;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				affine[axis][to] = affine[axis][from];
+			}
+		}
+
+		void FlipSolver::ResetParticle(uint32 i)
+		{
+			if (i >= affine[0].size()) return;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				affine[axis][i] = glm::vec3(0, 0, 0);
+			}
+		}
+
+		void FlipSolver::Step(Core::ArenaVector<glm::vec3>& positions, Core::ArenaVector<glm::vec3>& velocity, const Core::ArenaVector<uint32>& pList,
+			const glm::vec3& bound, const glm::vec3& gravityAccel, float deltatime)
+		{
+			ElapsedTimeTransfer = 0.0;
+			ElapsedTimePressure = 0.0;
+			ElapsedTimeAdvect = 0.0;
+			substeps = 0;
+			pressureIterations = 0;
+			if (pList.empty()) return;
+
+			ResizeGrid(bound);
+			if (affine[0].size() != positions.size())
+			{
+				Initialize(positions.size());
+			}
+
+			// Particles may not cross more than about a cell per step, otherwise the transfer smears the flow.
+			float remaining = deltatime;
+			int iterations = 0;
+			while (remaining > 1e-6f && substeps < maxSubsteps)
+			{
+				float maxSpeed = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), 0.0f,
+					[](float a, float b) { return glm::max(a, b); },
+					[&velocity](uint32_t i)
+				{
+					return glm::length(velocity[i]);
+				});
+
+				float stepTime = remaining;
+				if (maxSpeed > 0.0f)
+				{
+					float minCell = glm::min(dx.x, glm::min(dx.y, dx.z));
+					stepTime = glm::min(stepTime, cflFactor * minCell / maxSpeed);
+				}
+				stepTime = remaining / ceil(remaining / stepTime);
+				if (substeps == maxSubsteps - 1)
+				{
+					stepTime = remaining;
+				}
+
+				StepGrid(positions, velocity, pList, gravityAccel, stepTime);
+				remaining -= stepTime;
+				iterations += pressureIterations;
+				substeps++;
+			}
+			pressureIterations = iterations;
+		}
+
+		void FlipSolver::StepGrid(Core::ArenaVector<glm::vec3>& positions, Core::ArenaVector<glm::vec3>& velocity, const Core::ArenaVector<uint32>& pList,
+			const glm::vec3& gravityAccel, float deltatime)
+		{
+			auto TransferStart = std::chrono::steady_clock::now();
+			BinParticles(positions, pList);
+			TransferToGrid(positions, velocity);
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				faceVelocityOld[axis] = faceVelocity[axis];
+
+				// Faces on the domain boundary are solid walls and keep a zero normal velocity.
+				const float gravityStep = gravityAccel[axis] * deltatime;
+				std::for_each(std::execution::par, faces[axis].begin(), faces[axis].end(),
+					[this, axis, gravityStep](uint32_t f)
+				{
+					glm::ivec3 faceCount = cellCount;
+					faceCount[axis]++;
+					int along = axis == 0 ? f % faceCount.x : (axis == 1 ? (f / faceCount.x) % faceCount.y : f / (faceCount.x * faceCount.y));
+					if (along == 0 || along == cellCount[axis])
+					{
+						faceVelocity[axis][f] = 0.0f;
+						return;
+					}
+					faceVelocity[axis][f] += gravityStep;
+				});
+			}
+			auto TransferEnd = std::chrono::steady_clock::now();
+			ElapsedTimeTransfer += std::chrono::duration<double>(TransferEnd - TransferStart).count() * 1000.0f;
+
+			auto PressureStart = std::chrono::steady_clock::now();
+			SolvePressure();
+			auto PressureEnd = std::chrono::steady_clock::now();
+			ElapsedTimePressure += std::chrono::duration<double>(PressureEnd - PressureStart).count() * 1000.0f;
+
+			TransferStart = std::chrono::steady_clock::now();
+			TransferToParticles(velocity, positions, pList);
+			TransferEnd = std::chrono::steady_clock::now();
+			ElapsedTimeTransfer += std::chrono::duration<double>(TransferEnd - TransferStart).count() * 1000.0f;
+
+			auto AdvectStart = std::chrono::steady_clock::now();
+			const glm::vec3 lower = origin;
+			const glm::vec3 upper = -origin;
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[&positions, &velocity, lower, upper, deltatime](uint32_t i)
+			{
+				positions[i] = glm::clamp(positions[i] + velocity[i] * deltatime, lower, upper);
+			});
+			auto AdvectEnd = std::chrono::steady_clock::now();
+			ElapsedTimeAdvect += std::chrono::duration<double>(AdvectEnd - AdvectStart).count() * 1000.0f;
+		}
+
+		void FlipSolver::ResizeGrid(const glm::vec3& bound)
+		{
+			glm::ivec3 count = glm::max(glm::ivec3(glm::round(bound / cellSize)), glm::ivec3(2));
+			dx = bound / glm::vec3(count);
+			origin = -bound * 0.5f;
+			if (count == cellCount) return;
+
+			cellCount = count;
+			const uint32 numCells = count.x * count.y * count.z;
+			cells.resize(numCells);
+			std::iota(cells.begin(), cells.end(), 0);
+			cellStart.resize(numCells + 1);
+			fluidIndex.resize(numCells);
+
+			// The pressure system is resized to the fluid cells every step, at most every cell, so it never reallocates.
+			for (Core::ArenaVector<float>* system : { &divergence, &pressure, &residual, &search, &precond, &applied })
+			{
+				system->reserve(numCells);
+			}
+			fluidCells.reserve(numCells);
+			fluidList.reserve(numCells);
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				glm::ivec3 faceCount = count;
+				faceCount[axis]++;
+				const uint32 numFaces = faceCount.x * faceCount.y * faceCount.z;
+				faceVelocity[axis].assign(numFaces, 0.0f);
+				faceVelocityOld[axis].assign(numFaces, 0.0f);
+				faces[axis].resize(numFaces);
+				std::iota(faces[axis].begin(), faces[axis].end(), 0);
+			}
+		}
+
+		void FlipSolver::BinParticles(const Core::ArenaVector<glm::vec3>& positions, const Core::ArenaVector<uint32>& pList)
+		{
+			particleCells.resize(pList.size());
+			std::transform(std::execution::par, pList.begin(), pList.end(), particleCells.begin(),
+				[this, &positions](uint32_t i)
+			{
+				glm::ivec3 cell = glm::clamp(glm::ivec3(glm::floor((positions[i] - origin) / dx)), glm::ivec3(0), cellCount - 1);
+				return glm::uvec2(i, CellIndex(cell.x, cell.y, cell.z));
+			});
+			std::sort(std::execution::par, particleCells.begin(), particleCells.end(),
+				[](const glm::uvec2& a, const glm::uvec2& b) { return a.y < b.y; });
+
+			std::for_each(std::execution::par, cells.begin(), cells.end(),
+				[this](uint32_t c)
+			{
+				auto first = std::lower_bound(particleCells.begin(), particleCells.end(), c,
+					[](const glm::uvec2& a, uint32_t cell) { return a.y < cell; });
+				cellStart[c] = first - particleCells.begin();
+			});
+			cellStart[cells.size()] = particleCells.size();
+		}
+
+		void FlipSolver::TransferToGrid(const Core::ArenaVector<glm::vec3>& positions, const Core::ArenaVector<glm::vec3>& velocity)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				std::for_each(std::execution::par, faces[axis].begin(), faces[axis].end(),
+					[this, axis, &positions, &velocity](uint32_t f)
+				{
+					glm::ivec3 faceCount = cellCount;
+					faceCount[axis]++;
+					const glm::ivec3 face = { f % faceCount.x, (f / faceCount.x) % faceCount.y, f / (faceCount.x * faceCount.y) };
+
+					// A face is reached by particles in the two cells it separates and their neighbours sideways.
+					glm::ivec3 lo = face - 1;
+					glm::ivec3 hi = face + 1;
+					hi[axis] = face[axis];
+					lo = glm::max(lo, glm::ivec3(0));
+					hi = glm::min(hi, cellCount - 1);
+
+					float momentum = 0.0f;
+					float weight = 0.0f;
+					for (int z = lo.z; z <= hi.z; z++)
+					{
+						for (int y = lo.y; y <= hi.y; y++)
+						{
+							for (int x = lo.x; x <= hi.x; x++)
+							{
+								uint32 c = CellIndex(x, y, z);
+								for (uint32 k = cellStart[c]; k < cellStart[c + 1]; k++)
+								{
+									uint32 i = particleCells[k].x;
+									glm::vec3 offset = glm::vec3(face) - ToGrid(positions[i], axis);
+									glm::vec3 w = glm::max(1.0f - glm::abs(offset), 0.0f);
+									float wp = w.x * w.y * w.z;
+									if (wp <= 0.0f) continue;
+
+									momentum += wp * (velocity[i][axis] + dot(affine[axis][i], offset * dx));
+									weight += wp;
+								}
+							}
+						}
+					}
+					faceVelocity[axis][f] = weight > 0.0f ? momentum / weight : 0.0f;
+				});
+			}
+		}
+
+		void FlipSolver::SolvePressure()
+		{
+			// Cells holding particles are fluid, everything else inside the bounds is air at zero pressure.
+			fluidCells.clear();
+			for (uint32 c = 0; c < cells.size(); c++)
+			{
+				fluidIndex[c] = cellStart[c + 1] > cellStart[c] ? (int)fluidCells.size() : -1;
+				if (fluidIndex[c] >= 0)
+				{
+					fluidCells.push_back(c);
+				}
+			}
+			const uint32 numFluid = fluidCells.size();
+			fluidCellCount = numFluid;
+			fluidList.resize(numFluid);
+			std::iota(fluidList.begin(), fluidList.end(), 0);
+			divergence.resize(numFluid);
+			pressure.assign(numFluid, 0.0f);
+			residual.resize(numFluid);
+			search.resize(numFluid);
+			precond.resize(numFluid);
+			applied.resize(numFluid);
+
+			const glm::vec3 invDx = 1.0f / dx;
+			const glm::vec3 invDxSqr = invDx * invDx;
+			std::for_each(std::execution::par, fluidList.begin(), fluidList.end(),
+				[this, invDx, invDxSqr](uint32_t k)
+			{
+				uint32 c = fluidCells[k];
+				const glm::ivec3 cell = { c % cellCount.x, (c / cellCount.x) % cellCount.y, c / (cellCount.x * cellCount.y) };
+
+				float div = 0.0f;
+				float diagonal = 0.0f;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					glm::ivec3 upper = cell;
+					upper[axis]++;
+					div += (faceVelocity[axis][FaceIndex(axis, upper.x, upper.y, upper.z)] - faceVelocity[axis][FaceIndex(axis, cell.x, cell.y, cell.z)]) * invDx[axis];
+
+					// Walls are the only solids, every other neighbour couples to this cell.
+					diagonal += invDxSqr[axis] * ((cell[axis] > 0) + (cell[axis] < cellCount[axis] - 1));
+				}
+				divergence[k] = -div;
+				precond[k] = diagonal > 0.0f ? 1.0f / diagonal : 0.0f;
+			});
+
+			// Jacobi preconditioned conjugate gradient, every operation is a parallel loop over the fluid cells.
+			auto dotProduct = [this](const Core::ArenaVector<float>& a, const Core::ArenaVector<float>& b)
+			{
+				return std::transform_reduce(std::execution::par, a.begin(), a.end(), b.begin(), 0.0);
+			};
+
+			residual = divergence;
+			std::transform(std::execution::par, residual.begin(), residual.end(), precond.begin(), search.begin(), std::multiplies<float>());
+			double rz = dotProduct(residual, search);
+			const double targetResidual = pressureTolerance * pressureTolerance * dotProduct(divergence, divergence);
+
+			pressureIterations = 0;
+			double residualSqr = dotProduct(residual, residual);
+			while (pressureIterations < maxIterations && residualSqr > targetResidual && rz > 0.0)
+			{
+				ApplyPressureMatrix(search, applied);
+				double curvature = dotProduct(search, applied);
+				if (curvature <= 0.0) break;
+				const float alpha = rz / curvature;
+
+				std::for_each(std::execution::par, fluidList.begin(), fluidList.end(),
+					[this, alpha](uint32_t k)
+				{
+					pressure[k] += alpha * search[k];
+					residual[k] -= alpha * applied[k];
+				});
+
+				double rzNext = std::transform_reduce(std::execution::par, fluidList.begin(), fluidList.end(), 0.0, std::plus<double>(),
+					[this](uint32_t k)
+				{
+					return (double)residual[k] * residual[k] * precond[k];
+				});
+				const float beta = rzNext / rz;
+				rz = rzNext;
+
+				std::for_each(std::execution::par, fluidList.begin(), fluidList.end(),
+					[this, beta](uint32_t k)
+				{
+					search[k] = residual[k] * precond[k] + beta * search[k];
+				});
+
+				residualSqr = dotProduct(residual, residual);
+				pressureIterations++;
+			}
+			double divergenceSqr = dotProduct(divergence, divergence);
+			pressureResidual = divergenceSqr > 0.0 ? sqrt(residualSqr / divergenceSqr) : 0.0f;
+
+			// Subtract the pressure gradient on every face that touches fluid, air cells are at zero pressure.
+			for (int axis = 0; axis < 3; axis++)
+			{
+				std::for_each(std::execution::par, faces[axis].begin(), faces[axis].end(),
+					[this, axis, invDx](uint32_t f)
+				{
+					glm::ivec3 faceCount = cellCount;
+					faceCount[axis]++;
+					const glm::ivec3 face = { f % faceCount.x, (f / faceCount.x) % faceCount.y, f / (faceCount.x * faceCount.y) };
+					if (face[axis] == 0 || face[axis] == cellCount[axis]) return;
+
+					glm::ivec3 lower = face;
+					lower[axis]--;
+					int a = fluidIndex[CellIndex(lower.x, lower.y, lower.z)];
+					int b = fluidIndex[CellIndex(face.x, face.y, face.z)];
+					if (a < 0 && b < 0) return;
+
+					float pressureA = a >= 0 ? pressure[a] : 0.0f;
+					float pressureB = b >= 0 ? pressure[b] : 0.0f;
+					faceVelocity[axis][f] -= (pressureB - pressureA) * invDx[axis];
+				});
+			}
+		}
+
+		void FlipSolver::ApplyPressureMatrix(const Core::ArenaVector<float>& in, Core::ArenaVector<float>& out)
+		{
+			const glm::vec3 invDxSqr = 1.0f / (dx * dx);
+			std::for_each(std::execution::par, fluidList.begin(), fluidList.end(),
+				[this, &in, &out, invDxSqr](uint32_t k)
+			{
+				uint32 c = fluidCells[k];
+				const glm::ivec3 cell = { c % cellCount.x, (c / cellCount.x) % cellCount.y, c / (cellCount.x * cellCount.y) };
+
+				float result = in[k] / precond[k];
+				for (int axis = 0; axis < 3; axis++)
+				{
+					for (int side = -1; side <= 1; side += 2)
+					{
+						glm::ivec3 neighbour = cell;
+						neighbour[axis] += side;
+						if (neighbour[axis] < 0 || neighbour[axis] >= cellCount[axis]) continue;
+
+						int n = fluidIndex[CellIndex(neighbour.x, neighbour.y, neighbour.z)];
+						if (n >= 0)
+						{
+							result -= invDxSqr[axis] * in[n];
+						}
+					}
+				}
+				out[k] = result;
+			});
+		}
+
+		void FlipSolver::TransferToParticles(Core::ArenaVector<glm::vec3>& velocity, const Core::ArenaVector<glm::vec3>& positions, const Core::ArenaVector<uint32>& pList)
+		{
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, &velocity, &positions](uint32_t i)
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					glm::ivec3 faceCount = cellCount;
+					faceCount[axis]++;
+
+					glm::vec3 g = ToGrid(positions[i], axis);
+					glm::ivec3 base = glm::clamp(glm::ivec3(glm::floor(g)), glm::ivec3(0), faceCount - 2);
+					glm::vec3 frac = glm::clamp(g - glm::vec3(base), 0.0f, 1.0f);
+
+					float picVelocity = 0.0f;
+					float oldVelocity = 0.0f;
+					glm::vec3 gradient = { 0,0,0 };
+					for (int corner = 0; corner < 8; corner++)
+					{
+						glm::ivec3 o = { corner & 1, (corner >> 1) & 1, (corner >> 2) & 1 };
+						glm::vec3 w = glm::mix(1.0f - frac, frac, glm::vec3(o));
+						glm::vec3 dw = glm::mix(glm::vec3(-1), glm::vec3(1), glm::vec3(o)) / dx;
+
+						uint32 f = FaceIndex(axis, base.x + o.x, base.y + o.y, base.z + o.z);
+						float u = faceVelocity[axis][f];
+						picVelocity += w.x * w.y * w.z * u;
+						oldVelocity += w.x * w.y * w.z * faceVelocityOld[axis][f];
+						gradient += u * glm::vec3(dw.x * w.y * w.z, w.x * dw.y * w.z, w.x * w.y * dw.z);
+					}
+
+					float flipVelocity = velocity[i][axis] + picVelocity - oldVelocity;
+					velocity[i][axis] = glm::mix(picVelocity, flipVelocity, flipRatio);
+					affine[axis][i] = gradient;
+				}
+			});
+		}
+
+		glm::vec3 FlipSolver::ToGrid(const glm::vec3& pos, int axis)
+		{
+			// Faces along an axis sit on cell borders for that axis and on cell centres for the other two.
+			glm::vec3 g = (pos - origin) / dx - 0.5f;
+			g[axis] += 0.5f;
+			return g;
+		}
+
+		uint32 FlipSolver::CellIndex(int x, int y, int z)
+		{
+			return x + cellCount.x * (y + cellCount.y * z);
+		}
+
+		uint32 FlipSolver::FaceIndex(int axis, int x, int y, int z)
+		{
+			glm::ivec3 faceCount = cellCount;
+			faceCount[axis]++;
+			return x + faceCount.x * (y + faceCount.y * z);
+		}
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <vector>
+#include "core/simulationArena.h"
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		// Hybrid particle/grid solver, particle velocities are transferred to a MAC grid covering the
+		// bounds, made divergence free there and transferred back (APIC, optionally blended with FLIP).
+		class FlipSolver
+		{
+		public:
+			void Initialize(uint32 particleAmmount);
+
+			// Keep the per-particle APIC state in step with the particle pool.
+			void CopyParticle(uint32 from, uint32 to);
+			void ResetParticle(uint32 i);
+
+			void Step(Core::ArenaVector<glm::vec3>& positions, Core::ArenaVector<glm::vec3>& velocity, const Core::ArenaVector<uint32>& pList,
+				const glm::vec3& bound, const glm::vec3& gravityAccel, float deltatime);
+
+			float cellSize = 0.43f; // about two particle spacings at the default rest density
+			float flipRatio = 0.0f; // 0 is pure APIC, 1 is pure FLIP
+			float cflFactor = 1.0f;
+			int maxSubsteps = 8;
+			int maxIterations = 200;
+			float pressureTolerance = 1e-4f;
+
+			int substeps = 0;
+			int pressureIterations = 0;
+			float pressureResidual = 0.0f;
+			uint32 fluidCellCount = 0;
+
+			double ElapsedTimeTransfer = 0.0;
+			double ElapsedTimePressure = 0.0;
+			double ElapsedTimeAdvect = 0.0;
+
+		private:
+			void StepGrid(Core::ArenaVector<glm::vec3>& positions, Core::ArenaVector<glm::vec3>& velocity, const Core::ArenaVector<uint32>& pList,
+				const glm::vec3& gravityAccel, float deltatime);
+
+			void ResizeGrid(const glm::vec3& bound);
+			void BinParticles(const Core::ArenaVector<glm::vec3>& positions, const Core::ArenaVector<uint32>& pList);
+			void TransferToGrid(const Core::ArenaVector<glm::vec3>& positions, const Core::ArenaVector<glm::vec3>& velocity);
+			void SolvePressure();
+			void TransferToParticles(Core::ArenaVector<glm::vec3>& velocity, const Core::ArenaVector<glm::vec3>& positions, const Core::ArenaVector<uint32>& pList);
+
+			void ApplyPressureMatrix(const Core::ArenaVector<float>& in, Core::ArenaVector<float>& out);
+
+			glm::vec3 ToGrid(const glm::vec3& pos, int axis);
+			uint32 CellIndex(int x, int y, int z);
+			uint32 FaceIndex(int axis, int x, int y, int z);
+
+			glm::ivec3 cellCount = { 0,0,0 };
+			glm::vec3 origin = { 0,0,0 };
+			glm::vec3 dx = { 0,0,0 }; // cells are stretched slightly so the grid matches the bounds exactly
+
+			Core::ArenaVector<float> faceVelocity[3];
+			Core::ArenaVector<float> faceVelocityOld[3];
+			Core::ArenaVector<uint32> faces[3];
+
+			// Particles sorted by cell, cellStart[c] .. cellStart[c + 1] are the particles in cell c.
+			Core::ArenaVector<glm::uvec2> particleCells; // particle, cell
+			Core::ArenaVector<uint32> cellStart;
+			Core::ArenaVector<uint32> cells;
+
+			Core::ArenaVector<glm::vec3> affine[3]; // APIC velocity gradient, one row per velocity component
+
+			// Pressure system over the fluid cells only.
+			Core::ArenaVector<int> fluidIndex;
+			Core::ArenaVector<uint32> fluidCells;
+			Core::ArenaVector<uint32> fluidList;
+			Core::ArenaVector<float> divergence;
+			Core::ArenaVector<float> pressure;
+			Core::ArenaVector<float> residual;
+			Core::ArenaVector<float> search;
+			Core::ArenaVector<float> precond;
+			Core::ArenaVector<float> applied;
+		};
+	}
+}
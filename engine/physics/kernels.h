@@ -69,12 +69,36 @@ namespace Physics
 			return 0;
 		}
 
+		// Part of the density kernel volume that lies behind a flat wall at distance dist.
+		inline float SmoothingPow2WallVolume(float dist, float radius)
+		{
+			if (dist < radius)
+			{
+				float scale = 15.0f / powf(radius, 5);
+				float v = radius - glm::max(dist, 0.0f);
+				return v * v * v * v * (radius / 12.0f - v / 20.0f) * scale;
+			}
+			return 0;
+		}
+
+		// Derivative of the wall volume with respect to the distance to the wall.
+		inline float SmoothingPow2WallVolumeDerivative(float dist, float radius)
+		{
+			if (dist < radius)
+			{
+				float scale = 15.0f / powf(radius, 5);
+				float v = radius - glm::max(dist, 0.0f);
+				return -v * v * v * (radius / 3.0f - v / 4.0f) * scale;
+			}
+			return 0;
+		}
+
 		// Viscosity Kernel
 		inline float SmoothingViscoPoly6(float dist, float radius)
 		{
 			if (dist < radius)
 			{
-				float scale = 315 / (64 * glm::pi<float>() * powf(abs(radius), 9));
+				float scale = 315 / (64 * glm::pi<float>() * powf(glm::abs(radius), 9));
 				float v = radius * radius - dist * dist;
 				return v * v * v * scale;
 			}
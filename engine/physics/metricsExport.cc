@@ -0,0 +1,236 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "physicsWorld.h"
+#include "core/processStats.h"
+
+#include <chrono>
+#include <cstdarg>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		namespace
+		{
+			const char* MetricPhaseNames[(uint32)SimPhase::Count] = { "gravity", "spatial", "density", "pressure", "viscosity", "positions_collision" };
+			const char* MetricSolverNames[] = { "sph", "dfsph", "pbf", "flip" };
+			constexpr uint32 MetricsReadAttempts = 4;
+
+			void Append(std::string& out, const char* format, ...)
+			{
+				char line[512];
+				va_list args;
+				va_start(args, format);
+				vsnprintf(line, sizeof(line), format, args);
+				va_end(args);
+				out += line;
+			}
+
+			// Prometheus wants seconds and cumulative buckets, the step keeps milliseconds and plain counts.
+			void AppendHistogram(std::string& out, const char* name, const char* labels, const LatencyHistogram& histogram)
+			{
+				const char* separator = labels[0] != '\0' ? "," : "";
+				uint64 cumulative = 0;
+				for (uint32 bucket = 0; bucket < LatencyHistogram::Buckets; bucket++)
+				{
+					cumulative += histogram.counts[bucket];
+					Append(out, "%s_bucket{%s%sle=\"%g\"} %llu\n", name, labels, separator, LatencyHistogram::Bounds[bucket] / 1000.0,
+						(unsigned long long)cumulative);
+				}
+				Append(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, separator, (unsigned long long)histogram.count);
+				if (labels[0] != '\0')
+				{
+					Append(out, "%s_sum{%s} %.9g\n%s_count{%s} %llu\n", name, labels, histogram.sum / 1000.0, name, labels,
+						(unsigned long long)histogram.count);
+				}
+				else
+				{
+					Append(out, "%s_sum %.9g\n%s_count %llu\n", name, histogram.sum / 1000.0, name, (unsigned long long)histogram.count);
+				}
+			}
+
+			int64 MetricsNow()
+			{
+				return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+			}
+		}
+
+		bool FluidSimulation::startMetricsServer(uint16 port, const char* address)
+		{
+			// Totals restart with the server, a scraper sees a counter reset.
+			metrics = {};
+			metricsRateStart = MetricsNow();
+			metricsRateSteps = 0;
+			return metricsServer.Start(port, address, [this]() { return RenderMetrics(); });
+		}
+
+		void FluidSimulation::stopMetricsServer()
+		{
+			metricsServer.Stop();
+		}
+
+		bool FluidSimulation::getMetricsServer()
+		{
+			return metricsServer.getRunning();
+		}
+
+		const char* FluidSimulation::getMetricsServerStatus()
+		{
+			return metricsServer.getStatus();
+		}
+
+		uint64 FluidSimulation::getMetricsScrapes()
+		{
+			return metricsServer.getScrapes();
+		}
+
+		void FluidSimulation::PublishMetrics(double stepMs)
+		{
+			metrics.steps++;
+			metrics.step.Observe(stepMs);
+			const double phaseMs[(uint32)SimPhase::Count] = { ElapsedTimeGravity, ElapsedTimeSpatial, ElapsedTimeDensity,
+				ElapsedTimePressure, ElapsedTimeViscosity, ElapsedTimePositionNCollision };
+			for (uint32 phase = 0; phase < (uint32)SimPhase::Count; phase++)
+			{
+				// FLIP has no gravity, density or viscosity phase, an empty phase stays out of its histogram.
+				if (phaseMs[phase] > 0.0) metrics.phases[phase].Observe(phaseMs[phase]);
+			}
+
+			// Wall clock over windows of at least a second, so whatever the host does between steps counts too.
+			const int64 now = MetricsNow();
+			metricsRateSteps++;
+			if (now - metricsRateStart >= 1000000000)
+			{
+				metrics.stepsPerSecond = metricsRateSteps * 1e9 / (now - metricsRateStart);
+				metricsRateStart = now;
+				metricsRateSteps = 0;
+			}
+
+			metrics.solver = solverType;
+			metrics.particles = numParticles;
+			metrics.capacity = particleCapacity;
+			metrics.substeps = LastSubsteps();
+
+			const Core::ProcessStats process = Core::ReadProcessStats();
+			Core::SimulationArena& arena = Core::SimulationArena::getInstance();
+			metrics.threads = process.threads;
+			metrics.residentBytes = process.residentMiB * 1048576.0;
+			metrics.arenaBytes = (double)arena.getInUse();
+			metrics.arenaPeakBytes = (double)arena.getPeak();
+
+			metrics.densityError = solverType == SolverType::DFSPH ? dfsphDensityError : solverType == SolverType::PBF ? pbfDensityError : 0.0f;
+			metrics.densityIterations = solverType == SolverType::DFSPH ? dfsphDensityIterations : solverType == SolverType::PBF ? pbfIterations : 0;
+			metrics.divergenceIterations = solverType == SolverType::DFSPH ? dfsphDivergenceIterations : 0;
+			metrics.pressureIterations = solverType == SolverType::FLIP ? flipSolver.pressureIterations : 0;
+			metrics.pressureResidual = solverType == SolverType::FLIP ? flipSolver.pressureResidual : 0.0f;
+			metrics.viscosityIterations = implicitViscosity ? viscosityIterations : 0;
+			metrics.viscosityResidual = implicitViscosity ? viscosityResidual : 0.0f;
+			metrics.accuracy = accuracy;
+
+			metricsSnapshots.Push(metrics);
+		}
+
+		std::string FluidSimulation::RenderMetrics()
+		{
+			// A read the stepping thread lapped returns nothing, and zeros would look like a counter reset. A few retries
+			// are made, otherwise the last snapshot read whole is served again. Read may leave a torn copy behind, so it
+			// never writes to servedMetrics directly.
+			MetricsSnapshot snapshot;
+			for (uint32 attempt = 0; attempt < MetricsReadAttempts; attempt++)
+			{
+				if (metricsSnapshots.Read(&snapshot, 1) == 1)
+				{
+					servedMetrics = snapshot;
+					break;
+				}
+			}
+			snapshot = servedMetrics;
+
+			std::string out;
+			out.reserve(8192);
+			Append(out, "# HELP fluidsim_steps_total Simulation steps since the metrics server started.\n# TYPE fluidsim_steps_total counter\n");
+			Append(out, "fluidsim_steps_total %llu\n", (unsigned long long)snapshot.steps);
+			Append(out, "# HELP fluidsim_steps_per_second Steps per wall clock second over the last window of at least a second.\n# TYPE fluidsim_steps_per_second gauge\n");
+			Append(out, "fluidsim_steps_per_second %.6g\n", snapshot.stepsPerSecond);
+			Append(out, "# HELP fluidsim_solver_info The active solver.\n# TYPE fluidsim_solver_info gauge\n");
+			Append(out, "fluidsim_solver_info{solver=\"%s\"} 1\n", MetricSolverNames[(uint32)snapshot.solver]);
+
+			Append(out, "# HELP fluidsim_step_duration_seconds Duration of the whole simulation step.\n# TYPE fluidsim_step_duration_seconds histogram\n");
+			AppendHistogram(out, "fluidsim_step_duration_seconds", "", snapshot.step);
+			Append(out, "# HELP fluidsim_phase_duration_seconds Duration of each step phase.\n# TYPE fluidsim_phase_duration_seconds histogram\n");
+			for (uint32 phase = 0; phase < (uint32)SimPhase::Count; phase++)
+			{
+				char labels[64];
+				snprintf(labels, sizeof(labels), "phase=\"%s\"", MetricPhaseNames[phase]);
+				AppendHistogram(out, "fluidsim_phase_duration_seconds", labels, snapshot.phases[phase]);
+			}
+
+			Append(out, "# HELP fluidsim_particles Active fluid particles.\n# TYPE fluidsim_particles gauge\n");
+			Append(out, "fluidsim_particles %u\n", snapshot.particles);
+			Append(out, "# HELP fluidsim_particle_capacity Particle pool capacity.\n# TYPE fluidsim_particle_capacity gauge\n");
+			Append(out, "fluidsim_particle_capacity %u\n", snapshot.capacity);
+			Append(out, "# HELP fluidsim_substeps Substeps of the last step, the finest multi-rate level for SPH.\n# TYPE fluidsim_substeps gauge\n");
+			Append(out, "fluidsim_substeps %d\n", snapshot.substeps);
+
+			Append(out, "# HELP fluidsim_threads Threads of the process.\n# TYPE fluidsim_threads gauge\n");
+			Append(out, "fluidsim_threads %u\n", snapshot.threads);
+			Append(out, "# HELP fluidsim_resident_memory_bytes Resident set of the process.\n# TYPE fluidsim_resident_memory_bytes gauge\n");
+			Append(out, "fluidsim_resident_memory_bytes %.0f\n", snapshot.residentBytes);
+			Append(out, "# HELP fluidsim_arena_bytes Simulation buffers carved from the arena.\n# TYPE fluidsim_arena_bytes gauge\n");
+			Append(out, "fluidsim_arena_bytes %.0f\n", snapshot.arenaBytes);
+			Append(out, "# HELP fluidsim_arena_peak_bytes Arena high-water mark.\n# TYPE fluidsim_arena_peak_bytes gauge\n");
+			Append(out, "fluidsim_arena_peak_bytes %.0f\n", snapshot.arenaPeakBytes);
+
+			Append(out, "# HELP fluidsim_density_error_ratio Relative density error the last step converged to, DFSPH and PBF.\n# TYPE fluidsim_density_error_ratio gauge\n");
+			Append(out, "fluidsim_density_error_ratio %.6g\n", snapshot.densityError);
+			Append(out, "# HELP fluidsim_solver_iterations Iterations of each iterative solve in the last step.\n# TYPE fluidsim_solver_iterations gauge\n");
+			Append(out, "fluidsim_solver_iterations{solve=\"density\"} %d\n", snapshot.densityIterations);
+			Append(out, "fluidsim_solver_iterations{solve=\"divergence\"} %d\n", snapshot.divergenceIterations);
+			Append(out, "fluidsim_solver_iterations{solve=\"pressure\"} %d\n", snapshot.pressureIterations);
+			Append(out, "fluidsim_solver_iterations{solve=\"viscosity\"} %d\n", snapshot.viscosityIterations);
+			Append(out, "# HELP fluidsim_solver_residual Residual the conjugate gradient solves stopped at in the last step.\n# TYPE fluidsim_solver_residual gauge\n");
+			Append(out, "fluidsim_solver_residual{solve=\"pressure\"} %.6g\n", snapshot.pressureResidual);
+			Append(out, "fluidsim_solver_residual{solve=\"viscosity\"} %.6g\n", snapshot.viscosityResidual);
+
+			// Absent while accuracy metrics are off, or for FLIP's density error, rather than reading zero.
+			const AccuracyMetrics& quality = snapshot.accuracy;
+			if (quality.densityValid)
+			{
+				Append(out, "# HELP fluidsim_particle_density_error_ratio Relative deviation of the particle densities from the rest density.\n# TYPE fluidsim_particle_density_error_ratio gauge\n");
+				Append(out, "fluidsim_particle_density_error_ratio{stat=\"mean\"} %.6g\n", quality.meanDensityError);
+				Append(out, "fluidsim_particle_density_error_ratio{stat=\"max\"} %.6g\n", quality.maxDensityError);
+			}
+			if (quality.ms > 0.0)
+			{
+				Append(out, "# HELP fluidsim_energy Kinetic and gravitational potential energy of the fluid, in simulation units.\n# TYPE fluidsim_energy gauge\n");
+				Append(out, "fluidsim_energy{kind=\"kinetic\"} %.6g\n", quality.kineticEnergy);
+				Append(out, "fluidsim_energy{kind=\"potential\"} %.6g\n", quality.potentialEnergy);
+				Append(out, "# HELP fluidsim_momentum_drift Speed of the fluid's centre of mass.\n# TYPE fluidsim_momentum_drift gauge\n");
+				Append(out, "fluidsim_momentum_drift %.6g\n", quality.momentumDrift);
+				Append(out, "# HELP fluidsim_max_speed Fastest particle of the last step.\n# TYPE fluidsim_max_speed gauge\n");
+				Append(out, "fluidsim_max_speed %.6g\n", quality.maxSpeed);
+				Append(out, "# HELP fluidsim_cfl CFL number of the fastest particle over one substep.\n# TYPE fluidsim_cfl gauge\n");
+				Append(out, "fluidsim_cfl %.6g\n", quality.cfl);
+				Append(out, "# HELP fluidsim_accuracy_duration_seconds Cost of the accuracy reduction in the last step.\n# TYPE fluidsim_accuracy_duration_seconds gauge\n");
+				Append(out, "fluidsim_accuracy_duration_seconds %.6g\n", quality.ms / 1000.0);
+			}
+			return out;
+		}
+	}
+}
@@ -0,0 +1,175 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+#include "core/profiler.h"
+
+#include <chrono>
+#include <numeric>
+#include <functional>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		void FluidSimulation::UpdateMultiRate(float deltatime)
+		{
+			PROFILE_ZONE("Multi-Rate Update");
+			ElapsedTimeGravity = 0.0;
+			ElapsedTimeSpatial = 0.0;
+			ElapsedTimeDensity = 0.0;
+			ElapsedTimePressure = 0.0;
+			ElapsedTimeViscosity = 0.0;
+			ElapsedTimePositionNCollision = 0.0;
+
+			AssignTimeLevels(deltatime);
+
+			const int substeps = 1 << multiRateLevel;
+			const float fineStep = deltatime / substeps;
+			multiRateUpdates = 0;
+			activeList.resize(pList.size());
+
+			for (int substep = 0; substep < substeps; substep++)
+			{
+				const float time = substep * fineStep;
+				AdvanceBounds(fineStep);
+
+				// Every level is due on substep 0, so all particles finish the frame in sync.
+				auto activeEnd = std::copy_if(std::execution::par, pList.begin(), pList.end(), activeList.begin(),
+					[this, substep](uint32_t i)
+				{
+					return substep % (1 << (multiRateLevel - timeLevels[i])) == 0;
+				});
+				const uint32 numActive = activeEnd - activeList.begin();
+				multiRateUpdates += numActive;
+
+				auto GravityStart = std::chrono::steady_clock::now();
+				std::for_each(std::execution::par, activeList.begin(), activeEnd,
+					[this, deltatime](uint32_t i)
+				{
+					velocity2[i] = velocity[i];
+					velocity[i] += CalculateExternalFoce(positions[i], velocity[i]) * (deltatime / (1 << timeLevels[i]));
+				});
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this, time](uint32_t i)
+				{
+					glm::vec3 current = positions[i] + velocity[i] * (time - particleTime[i]);
+					predictedPositions[i] = current + velocity[i] * (1.0f / 120.0f);
+				});
+				auto GravityEnd = std::chrono::steady_clock::now();
+				ElapsedTimeGravity += std::chrono::duration<double>(GravityEnd - GravityStart).count() * 1000.0f;
+
+				auto SpatialStart = std::chrono::steady_clock::now();
+				UpdateSpatialLookup();
+				auto SpatialEnd = std::chrono::steady_clock::now();
+				ElapsedTimeSpatial += std::chrono::duration<double>(SpatialEnd - SpatialStart).count() * 1000.0f;
+
+				// Particles that are not due keep the density of their last update.
+				auto DensityStart = std::chrono::steady_clock::now();
+				std::for_each(std::execution::par, activeList.begin(), activeEnd,
+					[this](uint32_t i)
+				{
+					densities[i] = CalculateDensity(i);
+				});
+				auto DensityEnd = std::chrono::steady_clock::now();
+				ElapsedTimeDensity += std::chrono::duration<double>(DensityEnd - DensityStart).count() * 1000.0f;
+
+				auto PressureStart = std::chrono::steady_clock::now();
+				std::for_each(std::execution::par, activeList.begin(), activeEnd,
+					[this, deltatime](uint32_t i)
+				{
+					CalculatePressureForce(i, deltatime / (1 << timeLevels[i]));
+				});
+				auto PressureEnd = std::chrono::steady_clock::now();
+				ElapsedTimePressure += std::chrono::duration<double>(PressureEnd - PressureStart).count() * 1000.0f;
+
+				auto ViscosityStart = std::chrono::steady_clock::now();
+				std::for_each(std::execution::par, activeList.begin(), activeEnd,
+					[this, deltatime](uint32_t i)
+				{
+					CalculateViscosityForce(i, deltatime / (1 << timeLevels[i]));
+				});
+				auto ViscosityEnd = std::chrono::steady_clock::now();
+				ElapsedTimeViscosity += std::chrono::duration<double>(ViscosityEnd - ViscosityStart).count() * 1000.0f;
+
+				auto PosNCollStart = std::chrono::steady_clock::now();
+				std::for_each(std::execution::par, activeList.begin(), activeEnd,
+					[this, deltatime](uint32_t i)
+				{
+					const float stepTime = deltatime / (1 << timeLevels[i]);
+					positions[i] += velocity[i] * stepTime;
+					particleTime[i] += stepTime;
+					particleAccel[i] = glm::length(velocity[i] - velocity2[i]) / stepTime;
+					ResolveBoundCollision(i);
+				});
+				auto PosNCollEnd = std::chrono::steady_clock::now();
+				ElapsedTimePositionNCollision += std::chrono::duration<double>(PosNCollEnd - PosNCollStart).count() * 1000.0f;
+			}
+
+			std::fill(std::execution::par, particleTime.begin(), particleTime.end(), 0.0f);
+
+			// Bodies take the whole frame at once, pushed by the pressure the fluid ends the frame with.
+			AccumulateRigidPressure(deltatime);
+			StepRigidBodies(deltatime);
+		}
+
+		void FluidSimulation::AssignTimeLevels(float deltatime)
+		{
+			// A particle should not travel more than a fraction of the radius per step, nor pick up the
+			// speed to do so within one step (acceleration from its last update), each level halves the step.
+			auto levelFor = [this, deltatime](uint32_t i)
+			{
+				float steps = deltatime * glm::length(velocity[i]) / (multiRateCFL * interactionRadius);
+				steps = glm::max(steps, deltatime * sqrtf(particleAccel[i] / (multiRateCFL * interactionRadius)));
+				return steps > 1.0f ? (int)ceil(log2(steps)) : 0;
+			};
+
+			int maxLevel = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), 0,
+				[](int a, int b) { return glm::max(a, b); }, levelFor);
+			multiRateLevel = glm::clamp(maxLevel, 0, glm::clamp(multiRateMaxLevel, 0, 7));
+
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, &levelFor](uint32_t i)
+			{
+				timeLevels[i] = glm::min(levelFor(i), multiRateLevel);
+			});
+
+			// Neighbours may differ by at most one level, a slow particle next to a fast one has to
+			// see it often enough for the pressure between them to stay stable. Each pass raises a level
+			// by at most one, so the smoothing settles within multiRateLevel passes.
+			for (int pass = 0; pass < multiRateLevel; pass++)
+			{
+				const bool changed = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), false,
+					std::logical_or<bool>(), [this](uint32_t i)
+				{
+					int level = timeLevels[i];
+					ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3&, float)
+					{
+						level = glm::max(level, timeLevels[neighborIndex] - 1);
+					});
+					timeLevelsScratch[i] = level;
+					return level != timeLevels[i];
+				});
+				std::swap(timeLevels, timeLevelsScratch);
+				if (!changed) break;
+			}
+		}
+	}
+}
@@ -0,0 +1,220 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+#include "core/profiler.h"
+
+#include <atomic>
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		void FluidSimulation::UpdateParticlePool(float deltatime)
+		{
+			PROFILE_ZONE("Particle Pool");
+			spawnedCount = 0;
+			killedCount = 0;
+			if (emitters.empty() && sinks.empty()) return;
+
+			KillParticles();
+			killedCount = CompactParticles();
+
+			for (ParticleEmitter& emitter : emitters)
+			{
+				SpawnParticles(emitter, deltatime);
+			}
+
+			if (spawnedCount == 0 && killedCount == 0) return;
+
+			// The changed slots are flagged, so the lookup patches them in like particles that changed cell.
+			UpdateSpatialLookup();
+		}
+
+		void FluidSimulation::SpawnParticles(ParticleEmitter& emitter, float deltatime)
+		{
+			if (!emitter.enabled) return;
+
+			// Whatever doesn't fit in the pool is dropped rather than spawned in a burst later.
+			emitter.accumulator += emitter.rate * deltatime;
+			const uint32 requested = (uint32)emitter.accumulator;
+			emitter.accumulator -= requested;
+			const uint32 count = glm::min(requested, particleCapacity - numParticles);
+			if (count == 0) return;
+
+			const uint8_t phase = emitter.phase < MaxFluidPhases ? emitter.phase : 0;
+			const uint32 first = numParticles;
+			numParticles += count;
+			pList.resize(numParticles);
+			std::iota(pList.begin() + first, pList.end(), first);
+			poolSeed++;
+
+			std::for_each(std::execution::par, pList.begin() + first, pList.end(),
+				[this, &emitter, phase](uint32_t i)
+			{
+				uint32 state = ((i * 0x9E3779B9u) ^ (poolSeed * 0x85EBCA6Bu)) | 1u;
+				glm::vec3 u = { PoolRandom(state), PoolRandom(state), PoolRandom(state) };
+
+				glm::vec3 pos;
+				if (emitter.shape == PoolShape::Box)
+				{
+					pos = emitter.centre + (u * 2.0f - 1.0f) * emitter.size;
+				}
+				else
+				{
+					float z = u.x * 2.0f - 1.0f;
+					float phi = u.y * 2.0f * glm::pi<float>();
+					float planar = sqrtf(1.0f - z * z);
+					pos = emitter.centre + glm::vec3(planar * cosf(phi), planar * sinf(phi), z) * (emitter.size.x * cbrtf(u.z));
+				}
+				ClampToBound(pos);
+
+				positions[i] = pos;
+				predictedPositions[i] = pos;
+				OutPositions[i] = glm::vec4(pos, 0.34f);
+				velocity[i] = emitter.velocity;
+				velocity2[i] = glm::vec3(0, 0, 0);
+				densities[i] = glm::vec2(phaseRestDensity[phase], 0.0f);
+				particlePhase[i] = phase;
+				dfsphFactors[i] = 0.0f;
+				dfsphDensityAdv[i] = 0.0f;
+				dfsphKappa[i] = 0.0f;
+				dfsphKappaV[i] = 0.0f;
+				dfsphKappaStep[i] = 0.0f;
+				pbfLambda[i] = 0.0f;
+				pbfDelta[i] = glm::vec3(0, 0, 0);
+				timeLevels[i] = 0;
+				particleTime[i] = 0.0f;
+				particleAccel[i] = 0.0f;
+				particleBlocks[i] = BlockSlot(pos);
+				particleDead[i] = 0;
+				cellChanged[i] = 1;
+				SetParticleLevel(i, 0);
+				viscosityDelta[i] = glm::vec3(0, 0, 0);
+				flipSolver.ResetParticle(i);
+				WakeParticleBlock(i);
+			});
+
+			spawnedCount += count;
+		}
+
+		void FluidSimulation::KillParticles()
+		{
+			bool anySink = false;
+			for (const ParticleSink& sink : sinks)
+			{
+				anySink |= sink.enabled;
+			}
+			if (!anySink) return;
+
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				for (const ParticleSink& sink : sinks)
+				{
+					if (!sink.enabled || !InsideShape(sink.shape, sink.centre, sink.size, positions[i])) continue;
+
+					particleDead[i] = 1;
+					WakeParticleBlock(i);
+					return;
+				}
+			});
+		}
+
+		uint32 FluidSimulation::CompactParticles()
+		{
+			const uint32 deadCount = (uint32)std::count(std::execution::par, particleDead.begin(), particleDead.begin() + numParticles, 1);
+			if (deadCount == 0) return 0;
+
+			// Live particles past the new end fill the holes before it, one for one.
+			const uint32 liveCount = numParticles - deadCount;
+			std::copy_if(std::execution::par, pList.begin(), pList.begin() + liveCount, compactHoles.begin(),
+				[this](uint32_t i) { return particleDead[i] != 0; });
+			auto moversEnd = std::copy_if(std::execution::par, pList.begin() + liveCount, pList.end(), compactMovers.begin(),
+				[this](uint32_t i) { return particleDead[i] == 0; });
+
+			std::for_each(std::execution::par, compactMovers.begin(), moversEnd,
+				[this](uint32_t& from)
+			{
+				CopyParticle(from, compactHoles[&from - compactMovers.data()]);
+			});
+
+			std::fill(std::execution::par, particleDead.begin(), particleDead.begin() + numParticles, 0);
+			std::fill(std::execution::par, OutPositions.begin() + liveCount, OutPositions.begin() + numParticles, glm::vec4(0));
+
+			numParticles = liveCount;
+			pList.resize(numParticles);
+			return deadCount;
+		}
+
+		void FluidSimulation::CopyParticle(uint32 from, uint32 to)
+		{
+			positions[to] = positions[from];
+			OutPositions[to] = OutPositions[from];
+			velocity[to] = velocity[from];
+			velocity2[to] = velocity2[from];
+			predictedPositions[to] = predictedPositions[from];
+			densities[to] = densities[from];
+			dfsphFactors[to] = dfsphFactors[from];
+			dfsphDensityAdv[to] = dfsphDensityAdv[from];
+			dfsphKappa[to] = dfsphKappa[from];
+			dfsphKappaV[to] = dfsphKappaV[from];
+			dfsphKappaStep[to] = dfsphKappaStep[from];
+			pbfLambda[to] = pbfLambda[from];
+			pbfDelta[to] = pbfDelta[from];
+			timeLevels[to] = timeLevels[from];
+			particleTime[to] = particleTime[from];
+			particleAccel[to] = particleAccel[from];
+			particleBlocks[to] = particleBlocks[from];
+			particleMass[to] = particleMass[from];
+			smoothingScale[to] = smoothingScale[from];
+			particleLevel[to] = particleLevel[from];
+			particlePhase[to] = particlePhase[from];
+			viscosityDelta[to] = viscosityDelta[from];
+			cellChanged[to] = 1;
+			flipSolver.CopyParticle(from, to);
+		}
+
+		void FluidSimulation::WakeParticleBlock(uint32 i)
+		{
+			if (!sleeping) return;
+
+			// Same corner test as UpdateSleepState, spawns and kills disturb every block within a radius.
+			for (int corner = 0; corner < 8; corner++)
+			{
+				glm::vec3 offset = { corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, corner & 4 ? 1 : -1 };
+				uint32 slot = BlockSlot(positions[i] + offset * interactionRadius);
+				std::atomic_ref<uint8_t>(blockAsleep[slot]).store(0, std::memory_order_relaxed);
+				std::atomic_ref<uint16_t>(blockCalm[slot]).store(0, std::memory_order_relaxed);
+			}
+		}
+
+		bool FluidSimulation::InsideShape(PoolShape shape, const glm::vec3& centre, const glm::vec3& size, const glm::vec3& pos)
+		{
+			const glm::vec3 offset = pos - centre;
+			if (shape == PoolShape::Box)
+			{
+				return glm::all(glm::lessThanEqual(glm::abs(offset), size));
+			}
+			return glm::dot(offset, offset) <= size.x * size.x;
+		}
+	}
+}
@@ -0,0 +1,218 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+
+#include "kernels.h"
+#include "core/profiler.h"
+
+#include <chrono>
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		void FluidSimulation::UpdatePBF(float deltatime)
+		{
+			PROFILE_ZONE("PBF Update");
+			// The solve is unconditionally stable but not time-step independent, a slow frame
+			// slows the preview down instead of taking a step the constraints can't recover from.
+			const float stepTime = glm::min(deltatime, pbfTimeStep);
+			if (stepTime <= 0.0f) return;
+			AdvanceBounds(stepTime);
+
+			auto GravityStart = std::chrono::steady_clock::now();
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, stepTime](uint32_t i)
+			{
+				velocity[i] += CalculateExternalFoce(positions[i], velocity[i]) * stepTime;
+				predictedPositions[i] = positions[i] + velocity[i] * stepTime;
+				ClampToBound(predictedPositions[i]);
+			});
+			auto GravityEnd = std::chrono::steady_clock::now();
+			ElapsedTimeGravity = std::chrono::duration<double>(GravityEnd - GravityStart).count() * 1000.0f;
+
+			auto SpatialStart = std::chrono::steady_clock::now();
+			UpdateSpatialLookup();
+			auto SpatialEnd = std::chrono::steady_clock::now();
+			ElapsedTimeSpatial = std::chrono::duration<double>(SpatialEnd - SpatialStart).count() * 1000.0f;
+
+			// Neighbourhoods are found once per step, the iterations only move particles a fraction of the radius.
+			ElapsedTimeDensity = 0.0;
+			ElapsedTimePressure = 0.0;
+			for (int iteration = 0; iteration < pbfIterations; iteration++)
+			{
+				auto DensityStart = std::chrono::steady_clock::now();
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this](uint32_t i)
+				{
+					CalculatePBFLambda(i);
+				});
+				auto DensityEnd = std::chrono::steady_clock::now();
+				ElapsedTimeDensity += std::chrono::duration<double>(DensityEnd - DensityStart).count() * 1000.0f;
+
+				auto PressureStart = std::chrono::steady_clock::now();
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this](uint32_t i)
+				{
+					CalculatePBFDelta(i);
+				});
+				AccumulatePBFRigidPressure(stepTime);
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this](uint32_t i)
+				{
+					predictedPositions[i] += pbfDelta[i];
+					ClampToBound(predictedPositions[i]);
+				});
+				auto PressureEnd = std::chrono::steady_clock::now();
+				ElapsedTimePressure += std::chrono::duration<double>(PressureEnd - PressureStart).count() * 1000.0f;
+			}
+
+			float errorSum = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), 0.0f, std::plus<float>(),
+				[this](uint32_t i)
+			{
+				return glm::max(densities[i].x - TargetDensity, 0.0f);
+			});
+			pbfDensityError = pList.empty() ? 0.0f : errorSum / (pList.size() * TargetDensity);
+
+			auto ViscosityStart = std::chrono::steady_clock::now();
+			const float invStep = 1.0f / stepTime;
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, invStep](uint32_t i)
+			{
+				velocity[i] = (predictedPositions[i] - positions[i]) * invStep;
+			});
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				ApplyPBFViscosity(i);
+			});
+			std::swap(velocity, velocity2);
+			auto ViscosityEnd = std::chrono::steady_clock::now();
+			ElapsedTimeViscosity = std::chrono::duration<double>(ViscosityEnd - ViscosityStart).count() * 1000.0f;
+
+			auto PosNCollStart = std::chrono::steady_clock::now();
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				positions[i] = predictedPositions[i];
+				ResolveBoundCollision(i);
+			});
+			auto PosNCollEnd = std::chrono::steady_clock::now();
+			ElapsedTimePositionNCollision = std::chrono::duration<double>(PosNCollEnd - PosNCollStart).count() * 1000.0f;
+
+			StepRigidBodies(stepTime);
+		}
+
+		void FluidSimulation::CalculatePBFLambda(uint32 particleIndex)
+		{
+			const glm::vec3& pos = predictedPositions[particleIndex];
+			// The lookup is only built once per step, so the particle itself is added explicitly in case it moved out of its cell.
+			float density = kernels::SmoothingPow2(0.0f, interactionRadius);
+			glm::vec3 sumGrad = { 0,0,0 };
+			float sumSqrGrad = 0;
+
+			ForEachNeighbour(pos, [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+			{
+				if (neighborIndex == particleIndex) return;
+				float dist = sqrt(sqrDist);
+				density += kernels::SmoothingPow2(dist, interactionRadius);
+
+				if (dist <= 0) return;
+				glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+				sumGrad += grad;
+				sumSqrGrad += dot(grad, grad);
+			});
+
+			glm::vec4 bound = CalculateBoundDensity(pos) + CalculateRigidDensity(pos);
+			density += bound.x;
+			sumGrad += glm::vec3(bound.y, bound.z, bound.w);
+
+			densities[particleIndex] = { density, 0.0f };
+
+			// Only compression is a constraint violation, letting it pull particles together clumps the surface.
+			float constraint = glm::max(density / TargetDensity - 1.0f, 0.0f);
+			float gradSqr = (dot(sumGrad, sumGrad) + sumSqrGrad) / (TargetDensity * TargetDensity);
+			pbfLambda[particleIndex] = -constraint / (gradSqr + pbfRelaxation);
+		}
+
+		void FluidSimulation::CalculatePBFDelta(uint32 particleIndex)
+		{
+			const glm::vec3& pos = predictedPositions[particleIndex];
+			const float lambda = pbfLambda[particleIndex];
+
+			// Artificial pressure, a small repulsion that keeps particles from clustering in under-dense regions.
+			const float tensileDistance = 0.2f * interactionRadius;
+			const float tensileScale = 1.0f / kernels::SmoothingPow2(tensileDistance, interactionRadius);
+
+			glm::vec3 delta = { 0,0,0 };
+			ForEachNeighbour(pos, [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+			{
+				if (neighborIndex == particleIndex) return;
+				float dist = sqrt(sqrDist);
+				if (dist <= 0) return;
+
+				float ratio = kernels::SmoothingPow2(dist, interactionRadius) * tensileScale;
+				float tensile = -pbfTensileStrength * ratio * ratio * ratio * ratio;
+
+				glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+				delta += grad * (lambda + pbfLambda[neighborIndex] + tensile);
+			});
+
+			glm::vec4 bound = CalculateBoundDensity(pos) + CalculateRigidDensity(pos);
+			delta += glm::vec3(bound.y, bound.z, bound.w) * lambda;
+
+			// Limit the correction so a badly overlapping start can't throw particles out of their neighbourhood.
+			delta /= TargetDensity;
+			const float maxDelta = 0.25f * interactionRadius;
+			float deltaLength = glm::length(delta);
+			pbfDelta[particleIndex] = deltaLength > maxDelta ? delta * (maxDelta / deltaLength) : delta;
+		}
+
+		void FluidSimulation::ApplyPBFViscosity(uint32 particleIndex)
+		{
+			// XSPH, blends each velocity towards the average of its neighbourhood.
+			const glm::vec3& velo = velocity[particleIndex];
+			glm::vec3 viscosity = { 0,0,0 };
+
+			ForEachNeighbour(predictedPositions[particleIndex], [&](uint32_t neighborIndex, const glm::vec3&, float sqrDist)
+			{
+				if (neighborIndex == particleIndex) return;
+				float weight = kernels::SmoothingPow2(sqrt(sqrDist), interactionRadius) / densities[neighborIndex].x;
+				viscosity += (velocity[neighborIndex] - velo) * weight;
+			});
+
+			velocity2[particleIndex] = velo + viscosity * pbfXSPHViscosity;
+		}
+
+		void FluidSimulation::ClampToBound(glm::vec3& pos)
+		{
+			const glm::vec3 halfSize = BoundScale * 0.5f;
+			glm::vec3 local = glm::conjugate(boundRotation) * (pos - boundPosition);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (periodicCells[axis] > 0) continue;
+				local[axis] = glm::clamp(local[axis], -halfSize[axis], halfSize[axis]);
+			}
+			pos = boundPosition + boundRotation * local;
+		}
+	}
+}
@@ -0,0 +1,84 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		namespace
+		{
+			const char* PhaseNames[(uint32)SimPhase::Count] = { "Gravity", "Spatial", "Density", "Pressure", "Viscosity", "Positions & Collision" };
+		}
+
+		bool FluidSimulation::setHardwareCounters(bool status)
+		{
+			hardwareCounters = Core::PerfCounters::getInstance().setEnabled(status) && status;
+			if (hardwareCounters)
+			{
+				Core::PerfCounters::getInstance().AttachNewThreads();
+			}
+			for (Core::PerfValues& counters : phaseCounters)
+			{
+				counters = {};
+			}
+			return hardwareCounters == status;
+		}
+
+		bool FluidSimulation::getHardwareCounters()
+		{
+			return hardwareCounters;
+		}
+
+		const char* FluidSimulation::getHardwareCounterStatus()
+		{
+			return Core::PerfCounters::getInstance().getStatus();
+		}
+
+		const Core::PerfValues& FluidSimulation::getPhaseCounters(SimPhase phase)
+		{
+			return phaseCounters[(uint32)phase];
+		}
+
+		uint32 FluidSimulation::getPhaseCounterParticles()
+		{
+			return phaseCounterParticles;
+		}
+
+		Core::PerfValues FluidSimulation::BeginPhaseCounters()
+		{
+			Core::AllocationTracker::getInstance().BeginPhase(PhaseNames[0]);
+			if (!hardwareCounters) return {};
+			return Core::PerfCounters::getInstance().Read();
+		}
+
+		void FluidSimulation::CountPhase(SimPhase phase, Core::PerfValues& start)
+		{
+			// Whatever follows the last phase goes back to the step as a whole.
+			const uint32 next = (uint32)phase + 1;
+			Core::AllocationTracker::getInstance().BeginPhase(next < (uint32)SimPhase::Count ? PhaseNames[next] : "Update");
+			if (!hardwareCounters) return;
+
+			Core::PerfValues now = Core::PerfCounters::getInstance().Read();
+			phaseCounters[(uint32)phase] = now - start;
+			start = now;
+		}
+	}
+}
@@ -20,9 +20,11 @@
 
 #include "kernels.h"
 #include "core/random.h"
+#include "core/profiler.h"
 
 #include <chrono>
 #include <thread>
+#include <numeric>
 #include <execution>
 
 namespace Physics
@@ -36,88 +38,246 @@ namespace Physics
 			return instance;
 		}
 
-		void FluidSimulation::Update(float deltatime)
+		template<typename Func>
+		void FluidSimulation::ForEachTask([[maybe_unused]] const char* span, const Core::ArenaVector<uint32>& list, Func&& func)
 		{
+			const uint32 count = (uint32)list.size();
+			const uint32 chunks = (count + TaskChunkSize - 1) / TaskChunkSize;
+			std::for_each(std::execution::par, taskChunks.begin(), taskChunks.begin() + chunks,
+				[span, &list, &func, count](uint32 chunk)
+			{
+				PROFILE_SPAN(span);
+				const uint32 end = glm::min((chunk + 1) * TaskChunkSize, count);
+				for (uint32 k = chunk * TaskChunkSize; k < end; k++)
+				{
+					func(list[k]);
+				}
+			});
+		}
+
+		bool FluidSimulation::Update(float deltatime)
+		{
+			PROFILE_ZONE("Fluid Update");
+			// The worker pool starts its threads lazily. The scan of /proc allocates, so it runs before the tracked step
+			// opens, on every warmup step and then every CounterRescanInterval steps.
+			if (hardwareCounters && (stepsSinceInitialize < AllocationWarmupSteps || stepsSinceInitialize % CounterRescanInterval == 0))
+			{
+				Core::PerfCounters::getInstance().AttachNewThreads();
+			}
+			Core::AllocationStep allocationStep(stepsSinceInitialize++ >= AllocationWarmupSteps);
+			auto StepStart = std::chrono::steady_clock::now();
+			Step(deltatime);
+			const double stepMs = std::chrono::duration<double>(std::chrono::steady_clock::now() - StepStart).count() * 1000.0;
+			if (accuracyMetrics)
+			{
+				MeasureAccuracy(deltatime);
+			}
+			if (dashboard)
+			{
+				RecordDashboard(stepMs);
+			}
+			if (metricsServer.getRunning())
+			{
+				PublishMetrics(stepMs);
+			}
+			return allocationStep.End();
+		}
+
+		void FluidSimulation::Step(float deltatime)
+		{
+			phaseCounterParticles = 0;
+			rooflineParticles = 0;
+			UpdatePhaseTable();
+			UpdateParticlePool(deltatime);
+			UpdateSecondaryParticles(deltatime);
+
+			if (solverType == SolverType::DFSPH)
+			{
+				UpdateDFSPH(deltatime);
+				return;
+			}
+			if (solverType == SolverType::PBF)
+			{
+				UpdatePBF(deltatime);
+				return;
+			}
+			if (solverType == SolverType::FLIP)
+			{
+				UpdateFLIP(deltatime);
+				return;
+			}
+
+			AdaptResolution();
+
+			if (multiRate)
+			{
+				UpdateMultiRate(deltatime);
+				return;
+			}
+
+			AdvanceBounds(deltatime);
+
+			// Sleeping particles keep their state and are only read as neighbours.
+			BuildAwakeList();
+			const Core::ArenaVector<uint32>& workList = sleeping ? awakeList : pList;
+
+			phaseCounterParticles = (uint32)workList.size();
+			Core::PerfValues counters = BeginPhaseCounters();
+
 			auto GravityStart = std::chrono::steady_clock::now();
-			std::for_each(std::execution::par, pList.begin(), pList.end(),
-				[this, deltatime](uint32_t i)
 			{
-				velocity[i] += CalculateExternalFoce(positions[i], velocity[i]) * deltatime;
+				PROFILE_ZONE("Gravity");
+				ForEachTask("Gravity Task", workList,
+					[this, deltatime](uint32_t i)
+				{
+					velocity[i] += CalculateExternalFoce(positions[i], velocity[i]) * deltatime;
 
-				predictedPositions[i] = positions[i] + velocity[i] * (1.0f / 120.0f);
-			});
+					predictedPositions[i] = positions[i] + velocity[i] * (1.0f / 120.0f);
+				});
+			}
+			CountPhase(SimPhase::Gravity, counters);
 			auto GravityEnd = std::chrono::steady_clock::now();
 			ElapsedTimeGravity = std::chrono::duration<double>(GravityEnd - GravityStart).count() * 1000.0f;
 
 			auto SpatialStart = std::chrono::steady_clock::now();
-			UpdateSpatialLookup();
+			{
+				PROFILE_ZONE("Spatial Lookup");
+				UpdateSpatialLookup();
+			}
+			CountPhase(SimPhase::Spatial, counters);
 			auto SpatialEnd = std::chrono::steady_clock::now();
 			ElapsedTimeSpatial = std::chrono::duration<double>(SpatialEnd - SpatialStart).count() * 1000.0f;
 
 			auto DensityStart = std::chrono::steady_clock::now();
-			updateDensities();
+			{
+				PROFILE_ZONE("Density");
+				ForEachTask("Density Task", workList,
+					[this](uint32_t i)
+				{
+					densities[i] = CalculateDensity(i);
+				});
+			}
+			CountPhase(SimPhase::Density, counters);
 			auto DensityEnd = std::chrono::steady_clock::now();
 			ElapsedTimeDensity = std::chrono::duration<double>(DensityEnd - DensityStart).count() * 1000.0f;
 
 			auto PressureStart = std::chrono::steady_clock::now();
-			std::for_each(std::execution::par, pList.begin(), pList.end(),
-				[this, deltatime](uint32_t i)
 			{
-				CalculatePressureForce(i, deltatime);
-			});
+				PROFILE_ZONE("Pressure");
+				ForEachTask("Pressure Task", workList,
+					[this, deltatime](uint32_t i)
+				{
+					CalculatePressureForce(i, deltatime);
+				});
+				AccumulateRigidPressure(deltatime);
+			}
+			CountPhase(SimPhase::Pressure, counters);
 			auto PressureEnd = std::chrono::steady_clock::now();
 			ElapsedTimePressure = std::chrono::duration<double>(PressureEnd - PressureStart).count() * 1000.0f;
 
 			auto ViscosityStart = std::chrono::steady_clock::now();
-			std::for_each(std::execution::par, pList.begin(), pList.end(),
-				[this, deltatime](uint32_t i)
 			{
-				CalculateViscosityForce(i, deltatime);
-			});
+				PROFILE_ZONE("Viscosity");
+				UpdateViscosity(workList, deltatime);
+			}
+			CountPhase(SimPhase::Viscosity, counters);
 			auto ViscosityEnd = std::chrono::steady_clock::now();
 			ElapsedTimeViscosity = std::chrono::duration<double>(ViscosityEnd - ViscosityStart).count() * 1000.0f;
 
 			auto PosNCollStart = std::chrono::steady_clock::now();
-			std::for_each(std::execution::par, pList.begin(), pList.end(),
-				[this, deltatime](uint32_t i)
 			{
-				positions[i] += velocity[i] * deltatime;
-				
-				// Edge collision check
-				const float dampFactor = 0.95f;
-				const glm::vec3 halfSize = BoundScale * 0.5f;
-				glm::vec3 edgeDst = halfSize - abs(positions[i]);
-
-				if (edgeDst.x <= 0)
+				PROFILE_ZONE("Positions & Collision");
+				ForEachTask("Positions & Collision Task", workList,
+					[this, deltatime](uint32_t i)
 				{
-					positions[i].x = halfSize.x * glm::sign(positions[i].x);
-					velocity[i].x *= -1 * dampFactor;
-				}
-				if (edgeDst.y <= 0)
-				{
-					positions[i].y = halfSize.y * glm::sign(positions[i].y);
-					velocity[i].y *= -1 * dampFactor;
-				}
+					positions[i] += velocity[i] * deltatime;
+					ResolveBoundCollision(i);
+				});
+				UpdateSleepState();
+			}
+			CountPhase(SimPhase::PositionNCollision, counters);
+			auto PosNCollEnd = std::chrono::steady_clock::now();
+			ElapsedTimePositionNCollision = std::chrono::duration<double>(PosNCollEnd - PosNCollStart).count() * 1000.0f;
 
-				if (edgeDst.z <= 0)
-				{
-					positions[i].z = halfSize.z * glm::sign(positions[i].z);
-					velocity[i].z *= -1 * dampFactor;
-				}
-				OutPositions[i] = glm::vec4(positions[i], 0.34f);
+			if (rooflineAnalysis)
+			{
+				AnalyseRoofline(workList);
+			}
+
+			StepRigidBodies(deltatime);
+		}
+		void FluidSimulation::UpdateFLIP(float deltatime)
+		{
+			PROFILE_ZONE("FLIP Update");
+			AdvanceBounds(deltatime);
+			flipSolver.Step(positions, velocity, pList, BoundScale, CalculateExternalFoce(glm::vec3(0), glm::vec3(0)), deltatime);
+			// The grid doesn't see the bodies, they only push particles out of themselves.
+			StepRigidBodies(deltatime);
+
+			ElapsedTimeGravity = 0.0;
+			ElapsedTimeSpatial = flipSolver.ElapsedTimeTransfer;
+			ElapsedTimeDensity = 0.0;
+			ElapsedTimePressure = flipSolver.ElapsedTimePressure;
+			ElapsedTimeViscosity = 0.0;
+
+			auto PosNCollStart = std::chrono::steady_clock::now();
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				ResolveBoundCollision(i);
 			});
 			auto PosNCollEnd = std::chrono::steady_clock::now();
-			ElapsedTimePositionNCollision = std::chrono::duration<double>(PosNCollEnd - PosNCollStart).count() * 1000.0f;
+			ElapsedTimePositionNCollision = flipSolver.ElapsedTimeAdvect + std::chrono::duration<double>(PosNCollEnd - PosNCollStart).count() * 1000.0f;
+		}
+
+		void FluidSimulation::ResolveBoundCollision(uint32 i)
+		{
+			ResolveColliders(i);
+			ResolveRigidBodies(i);
+			if (periodicActive) WrapPosition(positions[i]);
+
+			// Edge collision in container space, relative to the moving wall. The axes that hit are selected with
+			// a mask instead of branches, so all three axes go through the same vector instructions.
+			const float dampFactor = 0.95f;
+			const glm::vec3 halfSize = BoundScale * 0.5f;
+			const glm::vec3 wallMask = glm::vec3(glm::equal(periodicCells, glm::ivec3(0)));
+			const glm::vec3 arm = positions[i] - boundPosition;
+			const glm::vec3 wallVelocity = BoundVelocityAt(positions[i]);
+			const glm::quat toLocal = glm::conjugate(boundRotation);
+
+			glm::vec3 localPos = toLocal * arm;
+			glm::vec3 localVel = toLocal * (velocity[i] - wallVelocity);
+			const glm::vec3 hit = glm::vec3(glm::greaterThanEqual(abs(localPos), halfSize)) * wallMask;
+
+			localPos = glm::mix(localPos, halfSize * glm::sign(localPos), hit);
+			localVel *= 1.0f - hit * (1.0f + dampFactor);
+
+			positions[i] = boundPosition + boundRotation * localPos;
+			velocity[i] = wallVelocity + boundRotation * localVel;
+			OutPositions[i] = glm::vec4(positions[i], 0.34f * smoothingScale[i]);
 		}
-		void FluidSimulation::InitializeData(int particleAmmount, glm::vec3 Centre)
+
+		void FluidSimulation::InitializeData(int particleAmmount, glm::vec3 Centre, int activeAmmount)
 		{
-			numParticles = particleAmmount;
+			numParticles = activeAmmount < 0 ? particleAmmount : glm::min(activeAmmount, particleAmmount);
+			particleCapacity = particleAmmount;
+			stepsSinceInitialize = 0;
 
+			// pList keeps its full capacity when shrunk, so the pool can grow back without allocating.
 			pList.resize(particleAmmount);
 			for (int i = 0; i < particleAmmount; i++)
 			{
 				pList[i] = i;
 			}
+			pList.resize(numParticles);
+			taskChunks.resize(particleAmmount / TaskChunkSize + 1);
+			std::iota(taskChunks.begin(), taskChunks.end(), 0);
+			awakeList.reserve(particleAmmount);
+			activeList.reserve(particleAmmount);
+			neighbourStart.reserve(particleAmmount + 1);
+			neighbourList.resize(size_t(particleAmmount) * ViscosityNeighbourBudget);
+			viscosityWeights.resize(size_t(particleAmmount) * ViscosityNeighbourBudget);
+			viscosityEdgeCount = 0;
 
 			positions.resize(particleAmmount);
 			OutPositions.resize(particleAmmount);
@@ -125,27 +285,94 @@ namespace Physics
 			velocity2.resize(particleAmmount);
 			predictedPositions.resize(particleAmmount);
 			densities.resize(particleAmmount);
+			dfsphFactors.resize(particleAmmount);
+			dfsphDensityAdv.resize(particleAmmount);
+			dfsphKappa.resize(particleAmmount);
+			dfsphKappaV.resize(particleAmmount);
+			dfsphKappaStep.resize(particleAmmount);
+			pbfLambda.resize(particleAmmount);
+			pbfDelta.resize(particleAmmount);
+			timeLevels.assign(particleAmmount, 0);
+			timeLevelsScratch.assign(particleAmmount, 0);
+			particleTime.assign(particleAmmount, 0.0f);
+			particleAccel.assign(particleAmmount, 0.0f);
+			particleBlocks.assign(particleAmmount, 0);
+			blockSlots.resize(particleAmmount);
+			std::iota(blockSlots.begin(), blockSlots.end(), 0);
+			blockRestless.assign(particleAmmount, 0);
+			blockWake.assign(particleAmmount, 0);
+			blockOccupied.assign(particleAmmount, 0);
+			blockAsleep.assign(particleAmmount, 0);
+			blockCalm.assign(particleAmmount, 0);
+			particleMass.assign(particleAmmount, 1.0f);
+			smoothingScale.assign(particleAmmount, 1.0f);
+			particleLevel.assign(particleAmmount, 0);
+			particlePhase.assign(particleAmmount, 0);
+			UpdatePhaseTable();
+			adaptiveWish.assign(particleAmmount, 0);
+			mergePartners.assign(particleAmmount, UINT32_MAX);
+			particleDead.assign(particleAmmount, 0);
+			viscosityDelta.assign(particleAmmount, glm::vec3(0, 0, 0));
+			adaptiveCandidates.resize(particleAmmount);
+			compactHoles.resize(particleAmmount);
+			compactMovers.resize(particleAmmount);
+			spawnedCount = 0;
+			killedCount = 0;
+			secondaryCount = 0;
+			for (ParticleEmitter& emitter : emitters)
+			{
+				emitter.accumulator = 0.0f;
+			}
+			maxSmoothingScale = 1.0f;
+			adaptiveCounter = 0;
+			adaptiveSplits = 0;
+			adaptiveMerges = 0;
 
-			for (size_t i = 0; i < particleAmmount; i++)
+			for (int i = 0; i < particleAmmount; i++)
 			{
 				positions[i] = glm::zero<glm::vec3>();
-				OutPositions[i] = { 0,0,0, 0.25f };
+				OutPositions[i] = { 0,0,0, 0.0f };
 				velocity[i] = glm::zero<glm::vec3>();
 				velocity2[i] = glm::zero<glm::vec3>();
 				predictedPositions[i] = glm::zero<glm::vec3>();
 				densities[i] = glm::zero<glm::vec2>();
+				dfsphKappa[i] = 0.0f;
+				dfsphKappaV[i] = 0.0f;
 			}
+			dfsphStateValid = false;
+			flipSolver.Initialize(particleAmmount);
 
-			int RowSize = ceil(powf(particleAmmount, (1.0f / 3.0f)));
+			int RowSize = ceil(powf(numParticles, (1.0f / 3.0f)));
 			float gap = 0.215f;
 
 			GridArrangement(RowSize, gap);
 
+			spatialDirty = true;
 			UpdateSpatialLookup();
 			updateDensities();
 
 		}
 
+		void FluidSimulation::setSolverType(SolverType type)
+		{
+			if (type != solverType)
+			{
+				// Only SPH reads particle masses and smoothing scales.
+				if (solverType == SolverType::SPH)
+				{
+					ResetResolution();
+				}
+				dfsphStateValid = false;
+				flipSolver.Initialize(positions.size());
+			}
+			solverType = type;
+		}
+
+		SolverType FluidSimulation::getSolverType()
+		{
+			return solverType;
+		}
+
 		glm::vec3 FluidSimulation::getPosition(uint32 particleIndex)
 		{
 			if (particleIndex >= numParticles) return glm::zero<glm::vec3>();
@@ -223,6 +450,10 @@ namespace Physics
 
 		void FluidSimulation::setGravity(bool status)
 		{
+			if (status != gravity)
+			{
+				WakeAll();
+			}
 			gravity = status;
 		}
 
@@ -233,6 +464,10 @@ namespace Physics
 
 		void FluidSimulation::setInteractionRadius(float value)
 		{
+			if (value != interactionRadius)
+			{
+				WakeAll();
+			}
 			interactionRadius = value;
 		}
 
@@ -243,6 +478,10 @@ namespace Physics
 
 		void FluidSimulation::setDensityTarget(float value)
 		{
+			if (value != TargetDensity)
+			{
+				WakeAll();
+			}
 			TargetDensity = value;
 		}
 
@@ -253,6 +492,10 @@ namespace Physics
 
 		void FluidSimulation::setPressureMultiplier(float value)
 		{
+			if (value != pressureMultiplier)
+			{
+				WakeAll();
+			}
 			pressureMultiplier = value;
 		}
 
@@ -263,6 +506,10 @@ namespace Physics
 
 		void FluidSimulation::setNearPressureMultiplier(float value)
 		{
+			if (value != nearPressureMultiplier)
+			{
+				WakeAll();
+			}
 			nearPressureMultiplier = value;
 		}
 
@@ -273,6 +520,10 @@ namespace Physics
 
 		void FluidSimulation::setViscosityStrength(float value)
 		{
+			if (value != viscosityStrength)
+			{
+				WakeAll();
+			}
 			viscosityStrength = value;
 		}
 
@@ -283,6 +534,10 @@ namespace Physics
 
 		void FluidSimulation::setGravityScale(float value)
 		{
+			if (value != gravityScale)
+			{
+				WakeAll();
+			}
 			gravityScale = value;
 		}
 
@@ -291,8 +546,65 @@ namespace Physics
 			return gravityScale;
 		}
 
+		void FluidSimulation::setPhase(uint32 phase, const FluidPhase& value)
+		{
+			if (phase >= MaxFluidPhases)
+			{
+				printf("[ Fluid Phase ] : ERROR : Phase %u out of range.\n", phase);
+				return;
+			}
+			if (value.densityRatio <= 0.0f)
+			{
+				printf("[ Fluid Phase ] : ERROR : Density ratio has to be positive.\n");
+				return;
+			}
+			phases[phase] = value;
+			WakeAll();
+		}
+
+		FluidPhase FluidSimulation::getPhase(uint32 phase)
+		{
+			return phases[glm::min(phase, MaxFluidPhases - 1)];
+		}
+
+		void FluidSimulation::setPhaseTension(uint32 a, uint32 b, float value)
+		{
+			if (a >= MaxFluidPhases || b >= MaxFluidPhases)
+			{
+				printf("[ Fluid Phase ] : ERROR : Phase pair %u, %u out of range.\n", a, b);
+				return;
+			}
+			phaseTension[a * MaxFluidPhases + b] = value;
+			phaseTension[b * MaxFluidPhases + a] = value;
+			WakeAll();
+		}
+
+		float FluidSimulation::getPhaseTension(uint32 a, uint32 b)
+		{
+			return phaseTension[glm::min(a, MaxFluidPhases - 1) * MaxFluidPhases + glm::min(b, MaxFluidPhases - 1)];
+		}
+
+		void FluidSimulation::setParticlePhase(uint32 particleIndex, uint8_t phase)
+		{
+			if (particleIndex >= numParticles || phase >= MaxFluidPhases)
+			{
+				printf("[ Fluid Phase ] : ERROR : Particle %u or phase %u out of range.\n", particleIndex, phase);
+				return;
+			}
+			particlePhase[particleIndex] = phase;
+		}
+
+		uint8_t FluidSimulation::getParticlePhase(uint32 particleIndex)
+		{
+			return particleIndex < numParticles ? particlePhase[particleIndex] : 0;
+		}
+
 		void FluidSimulation::setBound(const glm::vec3& value)
 		{
+			if (value != BoundScale)
+			{
+				WakeAll();
+			}
 			BoundScale = value;
 		}
 
@@ -301,12 +613,423 @@ namespace Physics
 			return BoundScale;
 		}
 
+		void FluidSimulation::setPeriodic(const glm::bvec3& value)
+		{
+			if (value != periodic)
+			{
+				WakeAll();
+			}
+			periodic = value;
+		}
+
+		glm::bvec3 FluidSimulation::getPeriodic()
+		{
+			return periodic;
+		}
+
+		void FluidSimulation::setIncrementalSpatial(bool status)
+		{
+			incrementalSpatial = status;
+			spatialDirty = true;
+		}
+
+		bool FluidSimulation::getIncrementalSpatial()
+		{
+			return incrementalSpatial;
+		}
+
+		void FluidSimulation::setSpatialChurnThreshold(float value)
+		{
+			spatialChurnThreshold = value;
+		}
+
+		float FluidSimulation::getSpatialChurnThreshold()
+		{
+			return spatialChurnThreshold;
+		}
+
+		uint32 FluidSimulation::getSpatialMoverCount()
+		{
+			return spatialMoverCount;
+		}
+
+		bool FluidSimulation::getSpatialFullRebuild()
+		{
+			return spatialFullRebuild;
+		}
+
+		void FluidSimulation::setDFSPHMaxIterations(int value)
+		{
+			dfsphMaxIterations = value;
+		}
+
+		int FluidSimulation::getDFSPHMaxIterations()
+		{
+			return dfsphMaxIterations;
+		}
+
+		void FluidSimulation::setDFSPHDensityTolerance(float value)
+		{
+			dfsphDensityTolerance = value;
+		}
+
+		float FluidSimulation::getDFSPHDensityTolerance()
+		{
+			return dfsphDensityTolerance;
+		}
+
+		void FluidSimulation::setDFSPHDivergenceTolerance(float value)
+		{
+			dfsphDivergenceTolerance = value;
+		}
+
+		float FluidSimulation::getDFSPHDivergenceTolerance()
+		{
+			return dfsphDivergenceTolerance;
+		}
+
+		void FluidSimulation::setDFSPHMaxTimeStep(float value)
+		{
+			dfsphMaxTimeStep = value;
+		}
+
+		float FluidSimulation::getDFSPHMaxTimeStep()
+		{
+			return dfsphMaxTimeStep;
+		}
+
+		void FluidSimulation::setDFSPHWarmStart(bool status)
+		{
+			dfsphWarmStart = status;
+		}
+
+		bool FluidSimulation::getDFSPHWarmStart()
+		{
+			return dfsphWarmStart;
+		}
+
+		int FluidSimulation::getDFSPHDensityIterations()
+		{
+			return dfsphDensityIterations;
+		}
+
+		int FluidSimulation::getDFSPHDivergenceIterations()
+		{
+			return dfsphDivergenceIterations;
+		}
+
+		int FluidSimulation::getDFSPHSubsteps()
+		{
+			return dfsphSubsteps;
+		}
+
+		int FluidSimulation::LastSubsteps()
+		{
+			if (solverType == SolverType::DFSPH) return dfsphSubsteps;
+			if (solverType == SolverType::FLIP) return flipSolver.substeps;
+			return multiRate ? 1 << multiRateLevel : 1;
+		}
+
+		float FluidSimulation::getDFSPHDensityError()
+		{
+			return dfsphDensityError;
+		}
+
+		void FluidSimulation::setPBFIterations(int value)
+		{
+			pbfIterations = value;
+		}
+
+		int FluidSimulation::getPBFIterations()
+		{
+			return pbfIterations;
+		}
+
+		void FluidSimulation::setPBFTimeStep(float value)
+		{
+			pbfTimeStep = value;
+		}
+
+		float FluidSimulation::getPBFTimeStep()
+		{
+			return pbfTimeStep;
+		}
+
+		void FluidSimulation::setPBFRelaxation(float value)
+		{
+			pbfRelaxation = value;
+		}
+
+		float FluidSimulation::getPBFRelaxation()
+		{
+			return pbfRelaxation;
+		}
+
+		void FluidSimulation::setPBFXSPHViscosity(float value)
+		{
+			pbfXSPHViscosity = value;
+		}
+
+		float FluidSimulation::getPBFXSPHViscosity()
+		{
+			return pbfXSPHViscosity;
+		}
+
+		void FluidSimulation::setPBFTensileStrength(float value)
+		{
+			pbfTensileStrength = value;
+		}
+
+		float FluidSimulation::getPBFTensileStrength()
+		{
+			return pbfTensileStrength;
+		}
+
+		float FluidSimulation::getPBFDensityError()
+		{
+			return pbfDensityError;
+		}
+
+		FlipSolver& FluidSimulation::getFlipSolver()
+		{
+			return flipSolver;
+		}
+
+		void FluidSimulation::setImplicitViscosity(bool status)
+		{
+			implicitViscosity = status;
+		}
+
+		bool FluidSimulation::getImplicitViscosity()
+		{
+			return implicitViscosity;
+		}
+
+		void FluidSimulation::setViscosityMaxIterations(int value)
+		{
+			viscosityMaxIterations = value;
+		}
+
+		int FluidSimulation::getViscosityMaxIterations()
+		{
+			return viscosityMaxIterations;
+		}
+
+		void FluidSimulation::setViscosityTolerance(float value)
+		{
+			viscosityTolerance = value;
+		}
+
+		float FluidSimulation::getViscosityTolerance()
+		{
+			return viscosityTolerance;
+		}
+
+		int FluidSimulation::getViscosityIterations()
+		{
+			return viscosityIterations;
+		}
+
+		float FluidSimulation::getViscosityResidual()
+		{
+			return viscosityResidual;
+		}
+
+		void FluidSimulation::setMultiRate(bool status)
+		{
+			multiRate = status;
+		}
+
+		bool FluidSimulation::getMultiRate()
+		{
+			return multiRate;
+		}
+
+		void FluidSimulation::setMultiRateMaxLevel(int value)
+		{
+			multiRateMaxLevel = value;
+		}
+
+		int FluidSimulation::getMultiRateMaxLevel()
+		{
+			return multiRateMaxLevel;
+		}
+
+		void FluidSimulation::setMultiRateCFL(float value)
+		{
+			multiRateCFL = value;
+		}
+
+		float FluidSimulation::getMultiRateCFL()
+		{
+			return multiRateCFL;
+		}
+
+		int FluidSimulation::getMultiRateLevel()
+		{
+			return multiRateLevel;
+		}
+
+		uint32 FluidSimulation::getMultiRateUpdates()
+		{
+			return multiRateUpdates;
+		}
+
+		void FluidSimulation::setSleeping(bool status)
+		{
+			if (status != sleeping)
+			{
+				WakeAll();
+			}
+			sleeping = status;
+		}
+
+		bool FluidSimulation::getSleeping()
+		{
+			return sleeping;
+		}
+
+		void FluidSimulation::setSleepVelocity(float value)
+		{
+			sleepVelocity = value;
+		}
+
+		float FluidSimulation::getSleepVelocity()
+		{
+			return sleepVelocity;
+		}
+
+		void FluidSimulation::setSleepDensityError(float value)
+		{
+			sleepDensityError = value;
+		}
+
+		float FluidSimulation::getSleepDensityError()
+		{
+			return sleepDensityError;
+		}
+
+		void FluidSimulation::setSleepSteps(int value)
+		{
+			sleepSteps = value;
+		}
+
+		int FluidSimulation::getSleepSteps()
+		{
+			return sleepSteps;
+		}
+
+		uint32 FluidSimulation::getAwakeCount()
+		{
+			return sleeping ? awakeCount : (uint32)pList.size();
+		}
+
+		void FluidSimulation::setAdaptiveResolution(bool status)
+		{
+			adaptiveResolution = status;
+		}
+
+		bool FluidSimulation::getAdaptiveResolution()
+		{
+			return adaptiveResolution;
+		}
+
+		void FluidSimulation::setAdaptiveMaxRefine(int value)
+		{
+			adaptiveMaxRefine = value;
+		}
+
+		int FluidSimulation::getAdaptiveMaxRefine()
+		{
+			return adaptiveMaxRefine;
+		}
+
+		void FluidSimulation::setAdaptiveMaxCoarsen(int value)
+		{
+			adaptiveMaxCoarsen = value;
+		}
+
+		int FluidSimulation::getAdaptiveMaxCoarsen()
+		{
+			return adaptiveMaxCoarsen;
+		}
+
+		void FluidSimulation::setAdaptiveSurfaceRatio(float value)
+		{
+			adaptiveSurfaceRatio = value;
+		}
+
+		float FluidSimulation::getAdaptiveSurfaceRatio()
+		{
+			return adaptiveSurfaceRatio;
+		}
+
+		void FluidSimulation::setAdaptiveVorticity(float value)
+		{
+			adaptiveVorticity = value;
+		}
+
+		float FluidSimulation::getAdaptiveVorticity()
+		{
+			return adaptiveVorticity;
+		}
+
+		void FluidSimulation::setAdaptiveInterval(int value)
+		{
+			adaptiveInterval = value;
+		}
+
+		int FluidSimulation::getAdaptiveInterval()
+		{
+			return adaptiveInterval;
+		}
+
+		uint32 FluidSimulation::getParticleCount()
+		{
+			return numParticles;
+		}
+
+		uint32 FluidSimulation::getParticleCapacity()
+		{
+			return particleCapacity;
+		}
+
+		std::vector<ParticleEmitter>& FluidSimulation::getEmitters()
+		{
+			return emitters;
+		}
+
+		std::vector<ParticleSink>& FluidSimulation::getSinks()
+		{
+			return sinks;
+		}
+
+		uint32 FluidSimulation::getSpawnedCount()
+		{
+			return spawnedCount;
+		}
+
+		uint32 FluidSimulation::getKilledCount()
+		{
+			return killedCount;
+		}
+
+		uint32 FluidSimulation::getAdaptiveSplits()
+		{
+			return adaptiveSplits;
+		}
+
+		uint32 FluidSimulation::getAdaptiveMerges()
+		{
+			return adaptiveMerges;
+		}
+
 		void FluidSimulation::updateDensities()
 		{
 			std::for_each(std::execution::par, pList.begin(), pList.end(),
 				[this](uint32_t i)
 			{
-				densities[i] = CalculateDensity(predictedPositions[i]);
+				densities[i] = CalculateDensity(i);
 			});
 		}
 
@@ -322,166 +1045,173 @@ namespace Physics
 			return gravityAccel;
 		}
 
-		glm::vec2 FluidSimulation::CalculateDensity(const glm::vec3& pos)
+		void FluidSimulation::UpdatePhaseTable()
+		{
+			// Flattened once per step so the neighbour loops only gather, a single phase scene reads the same entry.
+			for (uint32 p = 0; p < MaxFluidPhases; p++)
+			{
+				phaseDensityRatio[p] = phases[p].densityRatio;
+				phaseRestDensity[p] = TargetDensity * phases[p].densityRatio;
+				phasePressure[p] = pressureMultiplier * phases[p].pressureScale;
+				phaseViscosity[p] = phases[p].viscosityScale;
+			}
+		}
+
+		glm::vec2 FluidSimulation::CalculateDensity(uint32 particleIndex)
 		{
-			const glm::vec3& originCell = PositionToCellCoord(pos);
 			float density = 0;
 			float NearDensity = 0;
 
-			for (int i = 0; i < 27; i++)
+			ForEachNeighbour(predictedPositions[particleIndex], [&](uint32_t neighborIndex, const glm::vec3&, float sqrDist)
 			{
-				// Fetch neighbor cells
-				uint32_t hash = HashCell(originCell + offsets[i]);
-				uint32_t key = GetKeyFromHash(hash, numParticles);
-				uint32 currIndex = startIndices[key];
-
-				// Loop over neigbor particles in neighbor cell
-				while (currIndex < numParticles)
-				{
-					const glm::vec3& index = spatialLookup[currIndex];
-					currIndex++;
-					if (index.z != key) break;
-
-
-					if (index.y != hash) continue;
-
-					if (index.x >= numParticles) break;
-
-
-					uint32_t neighborIndex = index.x;
-
-					const glm::vec3& neighbourPos = predictedPositions[neighborIndex];
-					const glm::vec3& offsetToNeighbour = neighbourPos - pos;
-					float sqrDist = dot(offsetToNeighbour, offsetToNeighbour);
+				float dist = sqrt(sqrDist);
+				float radius = PairRadius(particleIndex, neighborIndex);
+				density += particleMass[neighborIndex] * kernels::SmoothingPow2(dist, radius);
+				NearDensity += particleMass[neighborIndex] * kernels::SmoothingPow3(dist, radius);
+			});
 
-					if (sqrDist > sqrRadius) continue;
+			// Rigid bodies' boundary particles count as fluid with their Akinci volume at the reference rest density.
+			ForEachBoundaryNeighbour(predictedPositions[particleIndex], [&](uint32_t boundaryIndex, const glm::vec3&, float sqrDist)
+			{
+				float dist = sqrt(sqrDist);
+				float radius = interactionRadius * 0.5f * (smoothingScale[particleIndex] + 1.0f);
+				float psi = TargetDensity * boundaryVolumes[boundaryIndex];
+				density += psi * kernels::SmoothingPow2(dist, radius);
+				NearDensity += psi * kernels::SmoothingPow3(dist, radius);
+			});
 
-					float dist = sqrt(sqrDist);
-					density += kernels::SmoothingPow2(dist, interactionRadius);
-					NearDensity += kernels::SmoothingPow3(dist, interactionRadius);
-				}
-			}
-			return { density, NearDensity };
+			// Densities are summed as volumes and scaled by the particle's own phase (Solenthaler & Pajarola 2008),
+			// so a sharp density contrast doesn't smear across the interface.
+			const float ratio = phaseDensityRatio[particlePhase[particleIndex]];
+			return { density * ratio, NearDensity * ratio };
 		}
 
 		void FluidSimulation::CalculatePressureForce(uint32 particleIndex, float deltatime)
 		{
 			const float density = densities[particleIndex].x;
 			const float nearDensity = densities[particleIndex].y;
-			const float pressure = (density - TargetDensity) * pressureMultiplier;
+			const uint8_t phase = particlePhase[particleIndex];
+			const float pressure = (density - phaseRestDensity[phase]) * phasePressure[phase];
 			const float nearPressure = nearDensity * nearPressureMultiplier;
+			const float* tension = phaseTension + phase * MaxFluidPhases;
 			glm::vec3 pressureForce = { 0,0, 0 };
+			glm::vec3 tensionForce = { 0,0,0 };
 
 			const glm::vec3& pos = predictedPositions[particleIndex];
-			const glm::vec3& originCell = PositionToCellCoord(pos);
 
-			for (int i = 0; i < 27; i++)
+			ForEachNeighbour(pos, [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
 			{
-				// Fetch neighbor cells
-				uint32_t hash = HashCell(originCell + offsets[i]);
-				uint32_t key = GetKeyFromHash(hash, numParticles);
-				int currIndex = startIndices[key];
-
-				// Loop over neigbor particles in neighbor cell
-				while (currIndex < numParticles)
-				{
-					const glm::vec3& index = spatialLookup[currIndex];
-					currIndex++;
-					if (index.z != key) break;
-
+				if (neighborIndex == particleIndex) return;
 
-					if (index.y != hash) continue;
+				const uint8_t neighborPhase = particlePhase[neighborIndex];
+				float neighborDensity = densities[neighborIndex].x;
+				float neighborNearDensity = densities[neighborIndex].y;
+				float neighborPressure = (neighborDensity - phaseRestDensity[neighborPhase]) * phasePressure[neighborPhase];
+				float neighborNearPressure = neighborNearDensity * nearPressureMultiplier;
 
-					uint32_t neighborIndex = index.x;
-					if (neighborIndex == particleIndex) continue;
+				float sharedPressure = (pressure + neighborPressure) * 0.5f;
+				float sharedNearPressure = (nearPressure + neighborNearPressure) * 0.5f;
 
-					glm::vec3 neighbourPos = predictedPositions[neighborIndex];
-					glm::vec3 offsetToNeighbour = neighbourPos-pos;
-					float sqrDist = dot(offsetToNeighbour, offsetToNeighbour);
+				float dist = sqrt(sqrDist);
+				glm::vec3 dir = dist > 0 ? offsetToNeighbour / dist : glm::vec3(0, 1, 0);
+				float radius = PairRadius(particleIndex, neighborIndex);
+				float mass = particleMass[neighborIndex] * phaseDensityRatio[neighborPhase];
 
-					if (sqrDist > sqrRadius) continue;
-
-
-					float neighborDensity = densities[neighborIndex].x;
-					float neighborNearDensity = densities[neighborIndex].y;
-					float neighborPressure = (neighborDensity - TargetDensity) * pressureMultiplier;
-					float neighborNearPressure = neighborNearDensity * nearPressureMultiplier;
-
-					float sharedPressure = (pressure + neighborPressure) * 0.5f;
-					float sharedNearPressure = (nearPressure + neighborNearPressure) * 0.5f;
-
-					float dist = sqrt(sqrDist);
-					glm::vec3 dir = dist > 0 ? offsetToNeighbour / dist : glm::vec3(0, 1, 0);
+				pressureForce += dir * kernels::SmoothingDerivativePow2(dist, radius) * sharedPressure * mass / neighborDensity;
+				pressureForce += dir * kernels::SmoothingDerivativePow3(dist, radius) * sharedNearPressure * mass / neighborNearDensity;
+				tensionForce += dir * (tension[neighborPhase] * mass * kernels::SmoothingViscoPoly6(dist, radius));
+			});
 
-					pressureForce += dir * kernels::SmoothingDerivativePow2(dist, interactionRadius) * sharedPressure / neighborDensity;
-					pressureForce += dir * kernels::SmoothingDerivativePow3(dist, interactionRadius) * sharedNearPressure / neighborNearDensity;
-				}
-			}
+			// Boundary particles mirror this particle's pressure (Akinci et al. 2012) but never pull on it.
+			const float boundaryPressure = glm::max(pressure, 0.0f);
+			ForEachBoundaryNeighbour(pos, [&](uint32_t boundaryIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+			{
+				float dist = sqrt(sqrDist);
+				if (dist <= 0) return;
+				glm::vec3 dir = offsetToNeighbour / dist;
+				float radius = interactionRadius * 0.5f * (smoothingScale[particleIndex] + 1.0f);
+				float psi = TargetDensity * boundaryVolumes[boundaryIndex];
+
+				pressureForce += dir * kernels::SmoothingDerivativePow2(dist, radius) * boundaryPressure * psi / density;
+				pressureForce += dir * kernels::SmoothingDerivativePow3(dist, radius) * nearPressure * psi / nearDensity;
+			});
 
-			velocity[particleIndex] += (pressureForce / density) * deltatime;
+			velocity[particleIndex] += (pressureForce / density + tensionForce) * deltatime;
 		}
 
 		void FluidSimulation::CalculateViscosityForce(uint32 particleIndex, float deltatime)
 		{
 			const glm::vec3& pos = predictedPositions[particleIndex];
-			const glm::vec3& originCell = PositionToCellCoord(pos);
 
 			glm::vec3 viscosityForce = { 0,0,0 };
 			const glm::vec3& velo = velocity[particleIndex];
+			const float viscosity = phaseViscosity[particlePhase[particleIndex]];
 
-			for (int i = 0; i < 27; i++)
+			ForEachNeighbour(pos, [&](uint32_t neighborIndex, const glm::vec3&, float sqrDist)
 			{
-				// Fetch neighbor cells
-				uint32_t hash = HashCell(originCell + offsets[i]);
-				uint32_t key = GetKeyFromHash(hash, numParticles);
-				int currIndex = startIndices[key];
-
-				// Loop over neigbor particles in neighbor cell
-				while (currIndex < numParticles)
-				{
-					const glm::vec3& index = spatialLookup[currIndex];
-					currIndex++;
-					if (index.z != key) break;
-
-
-					if (index.y != hash) continue;
-
-					uint32_t neighborIndex = index.x;
-					if (neighborIndex == particleIndex) continue;
-
-					const glm::vec3& neighbourPos = predictedPositions[neighborIndex];
-					glm::vec3 offsetToNeighbour = neighbourPos - pos;
-					float sqrDist = dot(offsetToNeighbour, offsetToNeighbour);
+				if (neighborIndex == particleIndex) return;
 
-					if (sqrDist > sqrRadius) continue;
-
-					float dist = sqrt(sqrDist);
-					float influence = kernels::SmoothingViscoPoly6(dist, interactionRadius);
-					viscosityForce += (velocity[neighborIndex] - velo) * influence;
-				}
-			}
+				// The mean of both phases' viscosities keeps the exchange symmetric.
+				float dist = sqrt(sqrDist);
+				float pairViscosity = 0.5f * (viscosity + phaseViscosity[particlePhase[neighborIndex]]);
+				float influence = particleMass[neighborIndex] * pairViscosity * kernels::SmoothingViscoPoly6(dist, PairRadius(particleIndex, neighborIndex));
+				viscosityForce += (velocity[neighborIndex] - velo) * influence;
+			});
 			velocity[particleIndex] += viscosityForce * viscosityStrength * deltatime;
 		}
 
 		void FluidSimulation::UpdateSpatialLookup()
 		{
-			if (spatialLookup.size() == 0 || spatialLookup.size() < numParticles)
+			// Sized for the whole pool so spawning never reallocates the lookup.
+			if (spatialLookup.size() == 0 || spatialLookup.size() < particleCapacity)
 			{
-				spatialLookup.resize(numParticles);
-				startIndices.resize(numParticles);
+				spatialLookup.resize(particleCapacity);
+				startIndices.resize(particleCapacity);
+				cellHashes.resize(particleCapacity);
+				cellChanged.resize(particleCapacity);
+				spatialMovers.reserve(particleCapacity);
+				spatialScratch.resize(particleCapacity);
+				spatialDirty = true;
 			}
+
+			// The sorted lookup is only reusable if the cell size and key range are unchanged.
+			neighbourRadius = interactionRadius * maxSmoothingScale;
+			UpdatePeriodicCells();
+			UpdateBoundaryLookup();
+			if (spatialCellSize != neighbourRadius)
+			{
+				spatialDirty = true;
+			}
+
+			if (incrementalSpatial && !spatialDirty && PatchSpatialLookup())
+			{
+				spatialFullRebuild = false;
+				return;
+			}
+
+			RebuildSpatialLookup();
+			spatialFullRebuild = true;
+			spatialDirty = false;
+			spatialCellSize = neighbourRadius;
+		}
+
+		void FluidSimulation::RebuildSpatialLookup()
+		{
+			// Keys span the whole pool, so spawning and killing leave every other particle's key as it is.
+			std::fill(std::execution::par, startIndices.begin(), startIndices.begin() + particleCapacity, INT_MAX);
 			std::for_each(std::execution::par, pList.begin(), pList.end(),
 				[this](uint32_t i)
 			{
 				if (i >= numParticles) return;
 				glm::vec3 cellPos = PositionToCellCoord(predictedPositions[i]);
 				uint32_t hash = HashCell(cellPos);
-				uint32_t cellKey = GetKeyFromHash(hash, numParticles);
+				uint32_t cellKey = GetKeyFromHash(hash, particleCapacity);
 				spatialLookup[i] = { i, hash, cellKey };
-				startIndices[i] = INT_MAX;
+				cellHashes[i] = hash;
+				cellChanged[i] = 0;
 			});
 
-			std::sort(spatialLookup.begin(), spatialLookup.end(), compareByKey);
+			std::sort(spatialLookup.begin(), spatialLookup.begin() + numParticles, compareByKey);
 
 			std::for_each(std::execution::par, pList.begin(), pList.end(),
 				[this](uint32_t i)
@@ -495,13 +1225,148 @@ namespace Physics
 				}
 			});
 
+			spatialEntryCount = numParticles;
+			spatialMoverCount = numParticles;
+		}
+
+		bool FluidSimulation::PatchSpatialLookup()
+		{
+			// Slots the particle pool spawned into or compacted onto come in already flagged, their old entries belong
+			// to another particle.
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				uint32_t hash = HashCell(PositionToCellCoord(predictedPositions[i]));
+				cellChanged[i] |= hash != cellHashes[i];
+				cellHashes[i] = hash;
+			});
+
+			spatialMoverCount = (uint32)std::count(std::execution::par, cellChanged.begin(), cellChanged.begin() + numParticles, 1);
+			if (spatialMoverCount > numParticles * spatialChurnThreshold)
+			{
+				return false;
+			}
+			if (spatialMoverCount == 0 && spatialEntryCount == numParticles)
+			{
+				return true;
+			}
+
+			// Entries of movers and of particles past the end go, the lookup can still hold more than numParticles.
+			auto stale = [this](const glm::vec3& entry)
+			{
+				const uint32_t index = (uint32_t)entry.x;
+				return index >= numParticles || cellChanged[index] != 0;
+			};
+			const auto entriesEnd = spatialLookup.begin() + spatialEntryCount;
+
+			// Cells the movers left may now be empty, clear their start before the entries go away.
+			std::for_each(std::execution::par, spatialLookup.begin(), entriesEnd,
+				[this, &stale](const glm::vec3& entry)
+			{
+				if (stale(entry))
+				{
+					startIndices[(uint32_t)entry.z] = INT_MAX;
+				}
+			});
+
+			uint32 firstDirty = spatialEntryCount;
+			for (uint32 i = 0; i < spatialEntryCount; i++)
+			{
+				if (stale(spatialLookup[i]))
+				{
+					firstDirty = i;
+					break;
+				}
+			}
+			// The start of a cleared cell has to be rewritten even if its first entry stays put.
+			while (firstDirty > 0 && firstDirty < spatialEntryCount && spatialLookup[firstDirty - 1].z == spatialLookup[firstDirty].z)
+			{
+				firstDirty--;
+			}
+
+			auto keptEnd = std::remove_if(spatialLookup.begin(), entriesEnd, stale);
+
+			spatialMovers.clear();
+			for (uint32 i = 0; i < numParticles; i++)
+			{
+				if (!cellChanged[i]) continue;
+				spatialMovers.push_back({ i, cellHashes[i], GetKeyFromHash(cellHashes[i], particleCapacity) });
+				cellChanged[i] = 0;
+			}
+			std::sort(spatialMovers.begin(), spatialMovers.end(), compareByKey);
+
+			// Entries before both the first removal and the first insertion keep their index.
+			if (!spatialMovers.empty())
+			{
+				uint32 firstInsert = std::upper_bound(spatialLookup.begin(), keptEnd, spatialMovers[0], compareByKey) - spatialLookup.begin();
+				firstDirty = std::min(firstDirty, firstInsert);
+			}
+			firstDirty = std::min(firstDirty, numParticles);
+			spatialEntryCount = numParticles;
+
+			std::merge(spatialLookup.begin(), keptEnd, spatialMovers.begin(), spatialMovers.end(), spatialScratch.begin(), compareByKey);
+			std::swap(spatialLookup, spatialScratch);
+
+			std::for_each(std::execution::par, pList.begin() + firstDirty, pList.end(),
+				[this](uint32_t i)
+			{
+				uint32_t key = spatialLookup[i].z;
+				uint32_t keyPrev = i == 0 ? UINT32_MAX : spatialLookup[i - 1].z;
+				if (key != keyPrev)
+				{
+					startIndices[key] = i;
+				}
+			});
+
+			return true;
 		}
 		glm::vec3 FluidSimulation::PositionToCellCoord(const glm::vec3& pos)
 		{
-			glm::vec3 cell = floor(pos / interactionRadius);
+			glm::vec3 cell = floor(pos / neighbourRadius);
+			if (periodicActive)
+			{
+				// Periodic axes count cells from the lower wall so they tile the bound exactly.
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (periodicCells[axis] == 0) continue;
+					float wrapped = floor((pos[axis] + 0.5f * BoundScale[axis]) / periodicCellSize[axis]);
+					cell[axis] = wrapped - periodicCells[axis] * floor(wrapped / periodicCells[axis]);
+				}
+			}
 			return { (int)cell.x, (int)cell.y, (int)cell.z };
 		}
 
+		void FluidSimulation::UpdatePeriodicCells()
+		{
+			glm::ivec3 cells = { 0,0,0 };
+			glm::vec3 cellSize = { 0,0,0 };
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (!periodic[axis] || BoundAnimated()) continue;
+				int count = (int)floor(BoundScale[axis] / neighbourRadius);
+				if (count < 3) continue;
+				cells[axis] = count;
+				cellSize[axis] = BoundScale[axis] / count;
+			}
+
+			if (cells != periodicCells || cellSize != periodicCellSize)
+			{
+				spatialDirty = true;
+			}
+			periodicCells = cells;
+			periodicCellSize = cellSize;
+			periodicActive = cells != glm::ivec3(0, 0, 0);
+		}
+
+		void FluidSimulation::WrapPosition(glm::vec3& pos)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (periodicCells[axis] == 0) continue;
+				pos[axis] -= BoundScale[axis] * floor((pos[axis] + 0.5f * BoundScale[axis]) / BoundScale[axis]);
+			}
+		}
+
 		uint32_t FluidSimulation::HashCell(const glm::vec3& inCell)
 		{
 			uint32_t a = (uint32_t)inCell.x * 15823;
@@ -17,23 +17,237 @@
 // THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
-#include <vector>s
+#include <vector>
+#include "flipSolver.h"
+#include "sdfCollider.h"
+#include "rigidBody.h"
+#include "core/perfCounters.h"
+#include "core/roofline.h"
+#include "core/allocationTracker.h"
+#include "core/simulationArena.h"
+#include "core/sampleRing.h"
+#include "core/metricsServer.h"
 
 namespace Physics
 {
 	
 	namespace Fluid
 	{
+		enum class SolverType
+		{
+			SPH,
+			DFSPH,
+			PBF,
+			FLIP
+		};
+
+		enum class PoolShape
+		{
+			Box,
+			Sphere
+		};
+
+		enum class SecondaryType : uint8_t
+		{
+			Spray,
+			Foam,
+			Bubble
+		};
+
+		// The timed phases of the SPH step, in the order they run.
+		enum class SimPhase : uint32
+		{
+			Gravity,
+			Spatial,
+			Density,
+			Pressure,
+			Viscosity,
+			PositionNCollision,
+			Count
+		};
+
+		// Work of one phase in the last analysed step. Counts are exact, bytes and flops come from a per candidate,
+		// per neighbour and per particle cost model of the code (sqrt and pow count as one flop).
+		struct PhaseRoofline
+		{
+			double candidates = 0.0; // lookup entries visited
+			double neighbours = 0.0; // candidates within the neighbour radius
+			double kernelEvaluations = 0.0;
+			double bytes = 0.0;
+			double flops = 0.0;
+			double ms = 0.0;
+			double intensity = 0.0; // flops per byte
+			double achieved = 0.0; // GFLOP/s
+			double bandwidth = 0.0; // GB/s
+			double attainable = 0.0; // GFLOP/s under the machine's roofline
+		};
+
+		// Lookup entries visited, distance tests and accepted neighbours of neighbour walks.
+		struct NeighbourCensus
+		{
+			uint64 visited = 0;
+			uint64 tested = 0;
+			uint64 accepted = 0;
+
+			NeighbourCensus operator+(const NeighbourCensus& other) const
+			{
+				return { visited + other.visited, tested + other.tested, accepted + other.accepted };
+			}
+		};
+
+		// Solution quality of the last step from one fused reduction over the live particles, so speedups like larger steps,
+		// sleeping or fewer iterations show what they cost. Free surface particles lack neighbours and read as under-dense,
+		// compare the density error between runs of one scene rather than against zero.
+		struct AccuracyMetrics
+		{
+			float meanDensityError = 0.0f; // |density - rest density| / rest density of the densities the solver last computed
+			float maxDensityError = 0.0f;
+			bool densityValid = false; // FLIP keeps no particle densities
+			double kineticEnergy = 0.0;
+			double potentialEnergy = 0.0; // gravity, above the floor of the container
+			float momentumDrift = 0.0f; // speed of the centre of mass, pair forces cancel so a settled fluid reads zero
+			float maxSpeed = 0.0f;
+			float cfl = 0.0f; // maxSpeed * substep / interactionRadius
+			double ms = 0.0; // cost of the reduction itself
+		};
+
+		// One step as the live dashboard sees it, times in milliseconds. The step time covers the whole Update, what the
+		// phases don't account for is pools, bounds and bookkeeping.
+		struct DashboardSample
+		{
+			float phaseMs[(uint32)SimPhase::Count] = {};
+			float rigidMs = 0.0f;
+			float secondaryMs = 0.0f;
+			float stepMs = 0.0f;
+			uint32 particles = 0;
+			uint32 threads = 0; // threads of the process, the solver's workers included
+			float residentMiB = 0.0f;
+			float arenaMiB = 0.0f;
+			float densityError = 0.0f; // mean, from AccuracyMetrics
+			float cfl = 0.0f;
+		};
+
+		// Neighbours per particle and particles per spatial lookup key, the last bin of each collects everything above it.
+		struct DashboardHistograms
+		{
+			static constexpr uint32 NeighbourBins = 64;
+			static constexpr uint32 BucketBins = 16;
+
+			uint32 neighbours[NeighbourBins] = {};
+			uint32 buckets[BucketBins] = {};
+			uint32 sharedBuckets = 0; // keys holding particles of more than one cell
+			uint32 particles = 0;
+			uint64 step = 0;
+		};
+
+		// Latency histogram in Prometheus' layout, in milliseconds. Bucket i counts the observations at or below
+		// Bounds[i] that fell in no earlier bucket, the exporter makes them cumulative.
+		struct LatencyHistogram
+		{
+			static constexpr uint32 Buckets = 14;
+			static constexpr double Bounds[Buckets] = { 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 25.0, 50.0, 100.0, 250.0, 500.0, 1000.0, 2500.0 };
+
+			uint64 counts[Buckets] = {};
+			uint64 overflow = 0;
+			uint64 count = 0;
+			double sum = 0.0;
+
+			void Observe(double ms)
+			{
+				uint32 bucket = 0;
+				while (bucket < Buckets && ms > Bounds[bucket]) bucket++;
+				if (bucket < Buckets) counts[bucket]++;
+				else overflow++;
+				count++;
+				sum += ms;
+			}
+		};
+
+		// Everything the metrics endpoint exports, totals since the server started and gauges of the last step.
+		struct MetricsSnapshot
+		{
+			uint64 steps = 0;
+			double stepsPerSecond = 0.0;
+			LatencyHistogram step;
+			LatencyHistogram phases[(uint32)SimPhase::Count];
+			SolverType solver = SolverType::SPH;
+			uint32 particles = 0;
+			uint32 capacity = 0;
+			int substeps = 1;
+			uint32 threads = 0;
+			double residentBytes = 0.0;
+			double arenaBytes = 0.0;
+			double arenaPeakBytes = 0.0;
+			float densityError = 0.0f; // relative, DFSPH and PBF
+			int densityIterations = 0; // DFSPH density solve, PBF constraint iterations
+			int divergenceIterations = 0;
+			int pressureIterations = 0; // FLIP pressure CG
+			float pressureResidual = 0.0f;
+			int viscosityIterations = 0; // implicit viscosity CG
+			float viscosityResidual = 0.0f;
+			AccuracyMetrics accuracy;
+		};
+
+		constexpr uint32 MaxFluidPhases = 4;
+
+		// Defined by the fluidmicro target, reaches the private building blocks of the neighbour search to time them in
+		// isolation.
+		struct MicrobenchmarkAccess;
+
+		// Parameters of one fluid phase relative to the global settings, phase 0 is the default fluid.
+		struct FluidPhase
+		{
+			float densityRatio = 1.0f;
+			float pressureScale = 1.0f;
+			float viscosityScale = 1.0f;
+		};
+
+		// Spawns rate particles per second inside the shape, size is the half extents of a box or the radius of a sphere in x.
+		struct ParticleEmitter
+		{
+			PoolShape shape = PoolShape::Sphere;
+			glm::vec3 centre = { 0,0,0 };
+			glm::vec3 size = { 0.3f, 0.3f, 0.3f };
+			glm::vec3 velocity = { 0,0,0 };
+			float rate = 200.0f;
+			float accumulator = 0.0f;
+			uint8_t phase = 0;
+			bool enabled = true;
+		};
+
+		// Removes every particle inside the shape.
+		struct ParticleSink
+		{
+			PoolShape shape = PoolShape::Box;
+			glm::vec3 centre = { 0,0,0 };
+			glm::vec3 size = { 0.5f, 0.5f, 0.5f };
+			bool enabled = true;
+		};
+
+		// Rigid pose of the container at time seconds into its animation.
+		struct BoundKeyframe
+		{
+			float time = 0.0f;
+			glm::vec3 position = { 0,0,0 };
+			glm::quat rotation = glm::identity<glm::quat>();
+		};
 
 		class FluidSimulation
 		{
+			friend struct MicrobenchmarkAccess;
+
 		public:
 
 			static FluidSimulation& getInstance();
 
-			void Update(float deltatime);
+			// False when strict allocation tracking failed the step, so a benchmark or test can fail the run on it.
+			bool Update(float deltatime);
 
-			void InitializeData(int particleAmmount, glm::vec3 Centre = { 0,0 ,0});
+			// particleAmmount is the pool capacity, activeAmmount (all if negative) of them start out alive.
+			void InitializeData(int particleAmmount, glm::vec3 Centre = { 0,0 ,0}, int activeAmmount = -1);
+
+			void setSolverType(SolverType type);
+			SolverType getSolverType();
 
 			glm::vec3 getPosition(uint32 particleIndex);
 			glm::vec3 getVelocity(uint32 particleIndex);
@@ -48,6 +262,51 @@ namespace Physics
 			double getElapsedTimePressure();
 			double getElapsedTimeViscosity();
 			double getElapsedTimePosNColl();
+			double getElapsedTimeRigid();
+			double getElapsedTimeSecondary();
+
+			// Hardware counters of each SPH phase, summed over every thread. Needs Linux perf events, setHardwareCounters
+			// returns false and getHardwareCounterStatus says why when the counters can not be opened.
+			// Only the single-rate SPH path is counted, getPhaseCounterParticles reads zero on the steps of the other
+			// solvers and of multi-rate stepping.
+			bool setHardwareCounters(bool status);
+			bool getHardwareCounters();
+			const char* getHardwareCounterStatus();
+			const Core::PerfValues& getPhaseCounters(SimPhase phase);
+			uint32 getPhaseCounterParticles();
+
+			// Roofline of the spatial rebuild, density, pressure and explicit viscosity. Enabling it measures the machine
+			// once, every SPH step then adds a counting pass over the neighbour walks after the timed phases.
+			void setRooflineAnalysis(bool status);
+			bool getRooflineAnalysis();
+			void measureMachineRoofline();
+			const Core::MachineRoofline& getMachineRoofline();
+			const PhaseRoofline& getPhaseRoofline(SimPhase phase);
+			uint32 getRooflineParticles();
+			bool exportRooflineReport(const char* path);
+
+			// Live dashboard. Every step pushes its phase times, threads and memory into a ring, the neighbour and lookup
+			// histograms follow every DashboardHistogramInterval steps. Readers copy from the rings without stopping the
+			// solver, FLIP steps carry no histograms since the grid keeps no spatial lookup.
+			static constexpr uint32 DashboardLength = 600;
+			static constexpr uint32 DashboardHistogramInterval = 30;
+			void setDashboard(bool status);
+			bool getDashboard();
+			const Core::SampleRing<DashboardSample, DashboardLength>& getDashboardSamples();
+			const Core::SampleRing<DashboardHistograms, 4>& getDashboardHistograms();
+
+			// Accuracy metrics of every step, on by default since the reduction costs well under 2% of a step.
+			void setAccuracyMetrics(bool status);
+			bool getAccuracyMetrics();
+			const AccuracyMetrics& getAccuracy();
+
+			// Prometheus metrics over HTTP for long unattended runs, GET /metrics on address:port. Every step publishes a
+			// snapshot into a ring and the server thread formats the newest one, so a scrape never stalls the solver.
+			bool startMetricsServer(uint16 port, const char* address = "127.0.0.1");
+			void stopMetricsServer();
+			bool getMetricsServer();
+			const char* getMetricsServerStatus();
+			uint64 getMetricsScrapes();
 
 			void setSimulationTime(float time);
 			float getSimulationTime();
@@ -73,28 +332,303 @@ namespace Physics
 			void setGravityScale(float value);
 			float getGravityScale();
 
+			// Multiphase SPH, every particle belongs to one of MaxFluidPhases phases. Tension pulls the particles of
+			// two phases together, a cross-phase value below the same-phase ones keeps the phases apart.
+			void setPhase(uint32 phase, const FluidPhase& value);
+			FluidPhase getPhase(uint32 phase);
+			void setPhaseTension(uint32 a, uint32 b, float value);
+			float getPhaseTension(uint32 a, uint32 b);
+			void setParticlePhase(uint32 particleIndex, uint8_t phase);
+			uint8_t getParticlePhase(uint32 particleIndex);
+
 			void setBound(const glm::vec3& value);
 			glm::vec3 getBounds();
 
-			std::vector<glm::vec3> positions;
-			std::vector<glm::vec4> OutPositions;
+			void setPeriodic(const glm::bvec3& value);
+			glm::bvec3 getPeriodic();
+
+			// Keyframed container motion, poses are interpolated linearly and loop over the last keyframe's time.
+			// The FLIP grid stays axis aligned and periodic axes get their walls back while the bound animates.
+			void setBoundKeyframes(const std::vector<BoundKeyframe>& keyframes);
+			const std::vector<BoundKeyframe>& getBoundKeyframes();
+			void setBoundAnimation(bool status);
+			bool getBoundAnimation();
+			void resetBoundAnimation();
+			glm::mat4 getBoundTransform();
+
+			// Static colliders, the mesh is transformed to world space and converted to a distance grid once.
+			int addCollider(const std::vector<glm::vec3>& vertices, const std::vector<uint32>& indices, const glm::mat4& transform = glm::mat4(1));
+			int loadCollider(const char* path, const glm::mat4& transform = glm::mat4(1));
+			void clearColliders();
+			uint32 getColliderCount();
+
+			// Dynamic rigid bodies, coupled both ways with the SPH, DFSPH and PBF solvers through boundary particles.
+			// Returns the body's index or -1.
+			int addRigidBody(RigidShape shape, const glm::vec3& size, const glm::vec3& position,
+				const glm::quat& rotation = glm::identity<glm::quat>(), float relativeDensity = 0.5f);
+			void clearRigidBodies();
+			const std::vector<RigidBody>& getRigidBodies();
+			uint32 getBoundaryParticleCount();
+			uint32 getRigidContactCount();
+
+			// Whitewater (Ihmsen et al. 2012), spray, foam and bubbles seeded where the fluid traps air or breaks into a
+			// crest. They only sample the fluid's velocity through the spatial lookup and never act back on it.
+			void setSecondaryParticles(bool status);
+			bool getSecondaryParticles();
+			void setSecondaryCapacity(uint32 value);
+			uint32 getSecondaryCapacity();
+			void setSecondaryTrappedAirRate(float value);
+			float getSecondaryTrappedAirRate();
+			void setSecondaryWaveCrestRate(float value);
+			float getSecondaryWaveCrestRate();
+			void setSecondaryLifetime(float value);
+			float getSecondaryLifetime();
+			void setSecondaryBuoyancy(float value);
+			float getSecondaryBuoyancy();
+			void setSecondaryDrag(float value);
+			float getSecondaryDrag();
+			uint32 getSecondaryCount();
+			const Core::ArenaVector<glm::vec4>& getSecondaryPositions(); // xyz and render size, the first getSecondaryCount() are alive
+			const Core::ArenaVector<uint8_t>& getSecondaryTypes(); // SecondaryType
+			bool exportSecondaryParticles(const char* path); // binary PLY with position and type
+
+			void setColliderCellSize(float value);
+			float getColliderCellSize();
+
+			void setColliderRadius(float value);
+			float getColliderRadius();
+
+			void setIncrementalSpatial(bool status);
+			bool getIncrementalSpatial();
+
+			void setSpatialChurnThreshold(float value);
+			float getSpatialChurnThreshold();
+
+			uint32 getSpatialMoverCount();
+			bool getSpatialFullRebuild();
+
+			void setDFSPHMaxIterations(int value);
+			int getDFSPHMaxIterations();
+
+			void setDFSPHDensityTolerance(float value);
+			float getDFSPHDensityTolerance();
+
+			void setDFSPHDivergenceTolerance(float value);
+			float getDFSPHDivergenceTolerance();
+
+			void setDFSPHMaxTimeStep(float value);
+			float getDFSPHMaxTimeStep();
+
+			void setDFSPHWarmStart(bool status);
+			bool getDFSPHWarmStart();
+
+			int getDFSPHDensityIterations();
+			int getDFSPHDivergenceIterations();
+			int getDFSPHSubsteps();
+			float getDFSPHDensityError();
+
+			void setPBFIterations(int value);
+			int getPBFIterations();
+
+			void setPBFTimeStep(float value);
+			float getPBFTimeStep();
+
+			void setPBFRelaxation(float value);
+			float getPBFRelaxation();
+
+			void setPBFXSPHViscosity(float value);
+			float getPBFXSPHViscosity();
+
+			void setPBFTensileStrength(float value);
+			float getPBFTensileStrength();
+
+			float getPBFDensityError();
+
+			FlipSolver& getFlipSolver();
+
+			void setImplicitViscosity(bool status);
+			bool getImplicitViscosity();
+
+			void setViscosityMaxIterations(int value);
+			int getViscosityMaxIterations();
+
+			void setViscosityTolerance(float value);
+			float getViscosityTolerance();
+
+			int getViscosityIterations();
+			float getViscosityResidual();
+
+			void setMultiRate(bool status);
+			bool getMultiRate();
+
+			void setMultiRateMaxLevel(int value);
+			int getMultiRateMaxLevel();
+
+			void setMultiRateCFL(float value);
+			float getMultiRateCFL();
+
+			int getMultiRateLevel();
+			uint32 getMultiRateUpdates();
+
+			void setSleeping(bool status);
+			bool getSleeping();
+
+			void setSleepVelocity(float value);
+			float getSleepVelocity();
+
+			void setSleepDensityError(float value);
+			float getSleepDensityError();
+
+			void setSleepSteps(int value);
+			int getSleepSteps();
+
+			uint32 getAwakeCount();
+
+			void setAdaptiveResolution(bool status);
+			bool getAdaptiveResolution();
+
+			void setAdaptiveMaxRefine(int value);
+			int getAdaptiveMaxRefine();
+
+			void setAdaptiveMaxCoarsen(int value);
+			int getAdaptiveMaxCoarsen();
+
+			void setAdaptiveSurfaceRatio(float value);
+			float getAdaptiveSurfaceRatio();
+
+			void setAdaptiveVorticity(float value);
+			float getAdaptiveVorticity();
+
+			void setAdaptiveInterval(int value);
+			int getAdaptiveInterval();
+
+			uint32 getParticleCount();
+			uint32 getParticleCapacity();
+
+			std::vector<ParticleEmitter>& getEmitters();
+			std::vector<ParticleSink>& getSinks();
+			uint32 getSpawnedCount();
+			uint32 getKilledCount();
+			uint32 getAdaptiveSplits();
+			uint32 getAdaptiveMerges();
+
+			Core::ArenaVector<glm::vec3> positions;
+			Core::ArenaVector<glm::vec4> OutPositions;
 		private:
 
 			void updateDensities();
 
 			glm::vec3 CalculateExternalFoce(const glm::vec3& pos, const glm::vec3& vel);
 
-			glm::vec2 CalculateDensity(const glm::vec3& pos);
+			glm::vec2 CalculateDensity(uint32 particleIndex);
 			float ConvertDensityToPressure(float density);
 			float ConvertNearDensityToPressure(float nearDensity);
 
 			void CalculatePressureForce(uint32 particleIndex, float deltatime);
 			void CalculateViscosityForce(uint32 particleIndex, float deltatime);
 
+			// Implicit viscosity, see viscositySolver.cc
+			void UpdateViscosity(const Core::ArenaVector<uint32>& workList, float deltatime);
+			void BuildNeighbourGraph();
+			void SolveImplicitViscosity(float deltatime);
+			void ApplyViscosityMatrix(const Core::ArenaVector<glm::vec3>& in, Core::ArenaVector<glm::vec3>& out, float scale);
+
+			void ResolveBoundCollision(uint32 i);
+			void ResolveColliders(uint32 i);
+			void RebuildColliderBroadphase();
+
+			// Rigid bodies, see rigidBodies.cc
+			void StepRigidBodies(float deltatime);
+			void ReserveRigidContacts();
+			void FindRigidContacts();
+			void SolveRigidContacts(float deltatime);
+			void UpdateBoundaryParticles();
+			void UpdateBoundaryLookup();
+			void ResolveRigidBodies(uint32 i);
+			glm::vec4 CalculateRigidDensity(const glm::vec3& pos); // density, gradient
+			float CalculateRigidDensityChange(const glm::vec3& pos, const glm::vec3& velo);
+			void AccumulateRigidPressure(float deltatime);
+			void AccumulateDFSPHRigidPressure(const Core::ArenaVector<float>& kappa, float deltatime);
+			void AccumulatePBFRigidPressure(float deltatime);
+
+			template<bool Census = false, typename Func>
+			void ForEachBoundaryNeighbour(const glm::vec3& pos, Func&& func, NeighbourCensus* census = nullptr);
+
+			// Container animation, see boundAnimation.cc
+			void AdvanceBounds(float deltatime);
+			bool BoundAnimated();
+			glm::vec3 BoundVelocityAt(const glm::vec3& pos);
+
+			// DFSPH (Bender & Koschier), see dfsphSolver.cc
+			void UpdateDFSPH(float deltatime);
+			void StepDFSPH(float deltatime);
+			void ComputeDFSPHFactors();
+			void SolveDFSPHDensity(float deltatime);
+			void SolveDFSPHDivergence(float deltatime);
+			void ApplyDFSPHPressure(const Core::ArenaVector<float>& kappa, float deltatime);
+			glm::vec4 CalculateBoundDensity(const glm::vec3& pos); // density, gradient
+
+			// Position Based Fluids (Macklin & Mueller), see pbfSolver.cc
+			void UpdatePBF(float deltatime);
+			void CalculatePBFLambda(uint32 particleIndex);
+			void CalculatePBFDelta(uint32 particleIndex);
+			void ApplyPBFViscosity(uint32 particleIndex);
+			void ClampToBound(glm::vec3& pos);
+
+			void Step(float deltatime);
+			void UpdateFLIP(float deltatime);
+
+			// Multi-rate stepping for the SPH path, see multiRate.cc
+			void UpdateMultiRate(float deltatime);
+			void AssignTimeLevels(float deltatime);
+
+			// Sleeping regions for the SPH path, see sleepRegions.cc
+			void BuildAwakeList();
+			void UpdateSleepState();
+			void WakeAll();
+			uint32 BlockSlot(const glm::vec3& pos);
+
+			// Adaptive particle resolution for the SPH path, see adaptiveResolution.cc
+			void AdaptResolution();
+			void ClassifyResolution();
+			void MergeParticles();
+			void SplitParticles();
+			void SetParticleLevel(uint32 i, int level);
+			void ResetResolution();
+			float PairRadius(uint32 i, uint32 j);
+
+			// Secondary particles, see secondaryParticles.cc
+			void UpdateSecondaryParticles(float deltatime);
+			void ResizeSecondaryCells();
+			void BuildSecondaryCells();
+			void AdvectSecondaryParticles(float deltatime);
+			void CompactSecondaryParticles();
+			void SeedSecondaryParticles(float deltatime);
+			glm::vec4 SampleSecondaryCells(const glm::vec3& pos); // mean velocity, particle count
+
+			// Particle pool, see particlePool.cc
+			void UpdateParticlePool(float deltatime);
+			uint32 CompactParticles();
+			void CopyParticle(uint32 from, uint32 to);
+			void SpawnParticles(ParticleEmitter& emitter, float deltatime);
+			void KillParticles();
+			void WakeParticleBlock(uint32 i);
+			bool InsideShape(PoolShape shape, const glm::vec3& centre, const glm::vec3& size, const glm::vec3& pos);
+
+			// Census walks count their work into census, the flag is compile time so the normal walks pay nothing.
+			template<bool Census = false, typename Func>
+			void ForEachNeighbour(const glm::vec3& pos, Func&& func, NeighbourCensus* census = nullptr);
+
+			// Parallel loop over list in chunks of TaskChunkSize, the profiler records one span per chunk, not per item.
+			template<typename Func>
+			void ForEachTask(const char* span, const Core::ArenaVector<uint32>& list, Func&& func);
+
 			void UpdateSpatialLookup();
+			void RebuildSpatialLookup();
+			bool PatchSpatialLookup();
 
-			const float sqrRadius = 0.35f * 0.35f;
 			float interactionRadius = 0.35f;
+			float neighbourRadius = 0.35f; // interactionRadius scaled to the largest particle
 			float TargetDensity = 99.7f;
 			float pressureMultiplier = 300.0f;
 			float nearPressureMultiplier = 20.0f;
@@ -102,6 +636,8 @@ namespace Physics
 
 			float simTime = 0.0f;
 
+			SolverType solverType = SolverType::SPH;
+
 			bool gravity = false;
 			float gravityScale = 10.0f;
 
@@ -111,22 +647,237 @@ namespace Physics
 			double ElapsedTimePressure = 0.0;
 			double ElapsedTimeViscosity = 0.0;
 			double ElapsedTimePositionNCollision = 0.0;
+			double ElapsedTimeRigid = 0.0;
+			double ElapsedTimeSecondary = 0.0;
 
 			uint32 numParticles;
-			std::vector<uint32> pList;
+			Core::ArenaVector<uint32> pList;
+			static constexpr uint32 TaskChunkSize = 256;
+			Core::ArenaVector<uint32> taskChunks; // chunk indices for ForEachTask, enough for particleCapacity
+
+			Core::ArenaVector<glm::vec3> predictedPositions;
+			Core::ArenaVector<glm::vec3> velocity;
+			Core::ArenaVector<glm::vec3> velocity2;
+
+			Core::ArenaVector<glm::vec2> densities; // density, neardensity
+
+			// Implicit viscosity solves (I + dt * strength * L) v' = v for the new velocities v' with conjugate gradient. L is
+			// the graph Laplacian of the neighbour graph, (L v)_i = sum_j w_ij (v_i - v_j), with the weights stored per edge.
+			bool implicitViscosity = false;
+			int viscosityMaxIterations = 50;
+			float viscosityTolerance = 0.001f;
+			int viscosityIterations = 0;
+			float viscosityResidual = 0.0f;
+			static constexpr uint32 ViscosityNeighbourBudget = 64; // edges reserved per particle, well above rest density
+			Core::ArenaVector<uint32> neighbourStart; // neighbourStart[i] .. neighbourStart[i + 1] index neighbourList
+			Core::ArenaVector<uint32> neighbourList; // first viscosityEdgeCount entries are in use
+			Core::ArenaVector<float> viscosityWeights;
+			uint32 viscosityEdgeCount = 0;
+			Core::ArenaVector<float> viscosityPrecond;
+			Core::ArenaVector<glm::vec3> viscosityRhs;
+			Core::ArenaVector<glm::vec3> viscosityResiduals;
+			Core::ArenaVector<glm::vec3> viscositySearch;
+			Core::ArenaVector<glm::vec3> viscosityApplied;
+			Core::ArenaVector<glm::vec3> viscosityDelta; // last solve's velocity change, used as the initial guess
+
+			// DFSPH state, kappa is kept between steps to warm start the next solve.
+			int dfsphMaxIterations = 100;
+			float dfsphDensityTolerance = 0.001f;
+			float dfsphDivergenceTolerance = 0.01f;
+			float dfsphMaxTimeStep = 1.0f / 20.0f;
+			float dfsphCFLFactor = 0.4f;
+			bool dfsphWarmStart = true;
+			bool dfsphStateValid = false;
+			int dfsphDensityIterations = 0;
+			int dfsphDivergenceIterations = 0;
+			int dfsphSubsteps = 0;
+			float dfsphDensityError = 0.0f;
+			Core::ArenaVector<float> dfsphFactors;
+			Core::ArenaVector<float> dfsphDensityAdv;
+			Core::ArenaVector<float> dfsphKappa;
+			Core::ArenaVector<float> dfsphKappaV;
+			Core::ArenaVector<float> dfsphKappaStep;
+
+			// PBF state, steps are clamped to pbfTimeStep and always run a fixed number of iterations.
+			int pbfIterations = 4;
+			float pbfTimeStep = 1.0f / 30.0f;
+			float pbfRelaxation = 1.0f;
+			float pbfXSPHViscosity = 0.05f;
+			float pbfTensileStrength = 0.001f; // same units as lambda
+			float pbfDensityError = 0.0f;
+			Core::ArenaVector<float> pbfLambda;
+			Core::ArenaVector<glm::vec3> pbfDelta;
+
+			// Multi-rate stepping, particle i steps every 2^(multiRateLevel - timeLevels[i]) fine substeps
+			// and neighbours see its position extrapolated from particleTime[i] to the current substep.
+			bool multiRate = false;
+			int multiRateMaxLevel = 4;
+			float multiRateCFL = 0.1f;
+			int multiRateLevel = 0;
+			uint32 multiRateUpdates = 0;
+			Core::ArenaVector<uint8_t> timeLevels;
+			Core::ArenaVector<uint8_t> timeLevelsScratch;
+			Core::ArenaVector<float> particleTime;
+			Core::ArenaVector<float> particleAccel;
+			Core::ArenaVector<uint32> activeList;
+
+			// Sleeping regions, blocks of sleepBlockCells^3 spatial cells hashed into a table like the spatial lookup.
+			// A block falls asleep after sleepSteps calm steps, collisions in the table only keep blocks awake longer.
+			bool sleeping = false;
+			float sleepVelocity = 1.0f;
+			float sleepDensityError = 0.5f;
+			int sleepSteps = 30;
+			int sleepBlockCells = 2;
+			uint32 awakeCount = 0;
+			Core::ArenaVector<uint32> awakeList;
+			Core::ArenaVector<uint32> particleBlocks;
+			Core::ArenaVector<uint32> blockSlots;
+			Core::ArenaVector<uint8_t> blockRestless;
+			Core::ArenaVector<uint8_t> blockWake;
+			Core::ArenaVector<uint8_t> blockOccupied;
+			Core::ArenaVector<uint8_t> blockAsleep;
+			Core::ArenaVector<uint16_t> blockCalm;
+
+			// Adaptive resolution, a particle at level l has mass 2^-l and smoothing length interactionRadius * 2^(-l/3).
+			// Interior particles merge in pairs and the freed slots are spent splitting surface and vortical ones,
+			// so the live count never exceeds the capacity given to InitializeData.
+			bool adaptiveResolution = false;
+			int adaptiveMaxRefine = 1;
+			int adaptiveMaxCoarsen = 1;
+			float adaptiveSurfaceRatio = 0.8f;
+			float adaptiveVorticity = 4.0f;
+			int adaptiveInterval = 10;
+			int adaptiveCounter = 0;
+			uint32 adaptiveSplits = 0;
+			uint32 adaptiveMerges = 0;
+			uint32 particleCapacity = 0;
+			float maxSmoothingScale = 1.0f;
+			Core::ArenaVector<float> particleMass;
+			Core::ArenaVector<float> smoothingScale;
+			Core::ArenaVector<int8_t> particleLevel;
+			Core::ArenaVector<int8_t> adaptiveWish; // 1 split, -1 merge
+			Core::ArenaVector<uint32> mergePartners;
+			Core::ArenaVector<uint8_t> particleDead;
+			Core::ArenaVector<uint32> adaptiveCandidates;
+			Core::ArenaVector<uint32> compactHoles;
+			Core::ArenaVector<uint32> compactMovers;
 
-			std::vector<glm::vec3> predictedPositions;
-			std::vector<glm::vec3> velocity;
-			std::vector<glm::vec3> velocity2;
+			// The neighbour loops gather from the flat tables below by the neighbour's phase instead of branching, they
+			// are refreshed from phases and the global settings once per step.
+			Core::ArenaVector<uint8_t> particlePhase;
+			FluidPhase phases[MaxFluidPhases];
+			float phaseTension[MaxFluidPhases * MaxFluidPhases] = {};
+			alignas(16) float phaseRestDensity[MaxFluidPhases] = {};
+			alignas(16) float phasePressure[MaxFluidPhases] = {};
+			alignas(16) float phaseDensityRatio[MaxFluidPhases] = {};
+			alignas(16) float phaseViscosity[MaxFluidPhases] = {};
+			void UpdatePhaseTable();
 
-			std::vector<glm::vec2> densities; // density, neardensity
+			// Particle pool, live particles are always the dense prefix [0, numParticles) of every per-particle array
+			// and the free slots are the tail up to particleCapacity, so spawning and killing never reallocates.
+			std::vector<ParticleEmitter> emitters;
+			std::vector<ParticleSink> sinks;
+			uint32 spawnedCount = 0;
+			uint32 killedCount = 0;
+			uint32 poolSeed = 0;
+
+			// Secondary particles, the live ones are the dense prefix [0, secondaryCount) like the particle pool. Their view
+			// of the fluid is a dense grid of the lookup's cells holding mean velocity and particle count, built once per step.
+			bool secondaryParticles = false;
+			uint32 secondaryCapacity = 1 << 20;
+			uint32 secondaryCount = 0;
+			uint32 secondarySeed = 0;
+			float secondaryTrappedAirRate = 40.0f;
+			float secondaryWaveCrestRate = 40.0f;
+			float secondaryLifetime = 3.0f;
+			float secondaryBuoyancy = 2.0f;
+			float secondaryDrag = 0.5f;
+			Core::ArenaVector<glm::vec4> secondaryPositions;
+			Core::ArenaVector<glm::vec3> secondaryVelocities;
+			Core::ArenaVector<float> secondaryLifetimes;
+			Core::ArenaVector<uint8_t> secondaryTypes;
+			Core::ArenaVector<uint8_t> secondaryDead;
+			Core::ArenaVector<uint32> secondaryList;
+			Core::ArenaVector<uint32> secondaryHoles;
+			Core::ArenaVector<uint32> secondaryMovers;
+			Core::ArenaVector<glm::vec4> secondaryCells; // mean velocity, particle count
+			glm::ivec3 secondaryGridMin = { 0,0,0 };
+			glm::ivec3 secondaryGridSize = { 0,0,0 };
+			glm::ivec3 secondaryGridCapacity = { 0,0,0 }; // the allocated grid, secondaryGridSize never exceeds it
+			glm::vec3 secondaryGridOrigin = { 0,0,0 };
+			glm::vec3 secondaryCellSize = { 1,1,1 };
+			glm::vec3 secondaryInvCellSize = { 1,1,1 };
+
+			// Counter deltas of the last SPH step, each phase ends where the next one starts. The same marks switch the
+			// allocation tracker's phase.
+			bool hardwareCounters = false;
+			static constexpr uint32 CounterRescanInterval = 60;
+			Core::PerfValues phaseCounters[(uint32)SimPhase::Count];
+			uint32 phaseCounterParticles = 0;
+			Core::PerfValues BeginPhaseCounters();
+			void CountPhase(SimPhase phase, Core::PerfValues& start);
+
+			bool rooflineAnalysis = false;
+			Core::MachineRoofline machineRoofline;
+			PhaseRoofline phaseRooflines[(uint32)SimPhase::Count];
+			uint32 rooflineParticles = 0;
+			void AnalyseRoofline(const Core::ArenaVector<uint32>& workList);
+
+			bool accuracyMetrics = true;
+			AccuracyMetrics accuracy;
+			void MeasureAccuracy(float deltatime);
+			// Substeps the solver took in the last step, the finest multi-rate level for SPH.
+			int LastSubsteps();
+
+			bool dashboard = false;
+			uint64 dashboardSteps = 0;
+			Core::SampleRing<DashboardSample, DashboardLength> dashboardSamples;
+			Core::SampleRing<DashboardHistograms, 4> dashboardHistograms;
+			void RecordDashboard(double stepMs);
+			void CollectDashboardHistograms(DashboardHistograms& histograms);
+
+			// Only the stepping thread touches metrics, the server reads the ring. The server is declared last so its
+			// thread is joined before the ring goes away.
+			MetricsSnapshot metrics;
+			int64 metricsRateStart = 0;
+			uint64 metricsRateSteps = 0;
+			Core::SampleRing<MetricsSnapshot, 4> metricsSnapshots;
+			MetricsSnapshot servedMetrics; // the server thread's last whole read
+			Core::MetricsServer metricsServer;
+			void PublishMetrics(double stepMs);
+			std::string RenderMetrics();
+
+			// The first steps after InitializeData size the lookups and scratch buffers, the allocation tracker only
+			// holds later steps to zero allocations.
+			static constexpr uint32 AllocationWarmupSteps = 3;
+			uint32 stepsSinceInitialize = 0;
+
+			// Grid engine, shares positions and velocity with the particle solvers.
+			FlipSolver flipSolver;
 
 			glm::vec3 PositionToCellCoord(const glm::vec3& pos);
+			void UpdatePeriodicCells();
+			void WrapPosition(glm::vec3& pos);
+			glm::vec3 WrapCell(glm::vec3 cell);
+			glm::vec3 PeriodicOffset(glm::vec3 offset);
 			uint32_t HashCell(const glm::vec3& inCell);
 			uint32_t GetKeyFromHash(const uint32_t hash, const uint32_t spatialLength);
 
-			std::vector<glm::vec3> spatialLookup; // index, hash, key
-			std::vector<uint32_t> startIndices;
+			Core::ArenaVector<glm::vec3> spatialLookup; // index, hash, key
+			Core::ArenaVector<uint32_t> startIndices;
+
+			// Incremental spatial lookup, only particles that changed cell are re-sorted.
+			bool incrementalSpatial = true;
+			bool spatialDirty = true;
+			float spatialChurnThreshold = 0.1f;
+			float spatialCellSize = 0.0f;
+			uint32 spatialMoverCount = 0;
+			uint32 spatialEntryCount = 0; // entries the lookup holds, numParticles until the pool changes the count
+			bool spatialFullRebuild = true;
+			Core::ArenaVector<uint32_t> cellHashes;
+			Core::ArenaVector<uint8_t> cellChanged;
+			Core::ArenaVector<glm::vec3> spatialMovers;
+			Core::ArenaVector<glm::vec3> spatialScratch;
 
 			const glm::vec3 offsets[27] = { 
 				{-1, -1, -1}, {-1, -1, 0}, {-1, -1, 1}, 
@@ -142,9 +893,54 @@ namespace Physics
 				{1, 1, -1}, {1, 1, 0}, {1, 1, 1}
 			};
 
+			// Periodic axes wrap positions and the neighbour search instead of reflecting off the walls. An axis needs
+			// at least three cells across the bound, otherwise the stencil would visit a cell twice and it keeps its walls.
+			glm::bvec3 periodic = { false, false, false };
+			glm::ivec3 periodicCells = { 0,0,0 }; // 0 on axes with walls
+			glm::vec3 periodicCellSize = { 0,0,0 };
+			bool periodicActive = false;
+
+			// Colliders keep particles colliderRadius outside their surface. The broadphase is a uniform grid over the
+			// colliders' bounds listing, per cell, the colliders whose surface can be within reach of the cell.
+			std::vector<SdfCollider> colliders;
+			float colliderCellSize = 0.05f;
+			float colliderRadius = 0.1f;
+			float broadphaseCellSize = 0.5f;
+			glm::vec3 broadphaseMin = { 0,0,0 };
+			glm::ivec3 broadphaseCount = { 0,0,0 };
+			std::vector<uint32> broadphaseStart; // broadphaseStart[c] .. broadphaseStart[c + 1] index broadphaseColliders
+			std::vector<uint32> broadphaseColliders;
+
+			// Boundary particles sample the rigid bodies' surfaces. They hash into the same cells as the fluid but live in
+			// a table of their own, rebuilt with every lookup, so the incremental fluid lookup is left untouched.
+			std::vector<RigidBody> rigidBodies;
+			std::vector<RigidContact> rigidContacts;
+			RigidBvh rigidBvh;
+			std::vector<glm::vec3> rigidBoxMin;
+			std::vector<glm::vec3> rigidBoxMax;
+			float rigidFriction = 0.4f;
+			float rigidRestitution = 0.2f;
+			int rigidIterations = 8;
+			Core::ArenaVector<uint32> boundaryList;
+			Core::ArenaVector<uint32> boundaryBodies;
+			Core::ArenaVector<glm::vec3> boundaryLocal;
+			Core::ArenaVector<glm::vec3> boundaryPositions;
+			Core::ArenaVector<glm::vec3> boundaryVelocities;
+			Core::ArenaVector<glm::vec3> boundaryImpulses;
+			Core::ArenaVector<float> boundaryVolumes; // Akinci, the inverse kernel sum over the body's own boundary particles
+			Core::ArenaVector<uint32> boundaryHashes;
+			Core::ArenaVector<uint32> boundarySorted;
+			Core::ArenaVector<uint32> boundaryStart; // boundaryStart[key] .. boundaryStart[key + 1] index boundarySorted
+
 			glm::vec3 BoundScale = { 20, 20, 20 };
 			glm::mat4 boundTransform = glm::mat4(1);
 			glm::quat boundRotation = glm::identity<glm::quat>();
+			glm::vec3 boundPosition = { 0,0,0 };
+			glm::vec3 boundLinearVelocity = { 0,0,0 };
+			glm::vec3 boundAngularVelocity = { 0,0,0 };
+			std::vector<BoundKeyframe> boundKeyframes;
+			bool boundAnimation = false;
+			float boundTime = 0.0f;
 
 			void GridArrangement(int particlesPerAxel, float gap, const glm::vec3& centre = glm::vec3(0, 0, 0));
 
@@ -159,4 +955,120 @@ namespace Physics
 	{
 		return a.z < b.z;
 	}
+
+	namespace Fluid
+	{
+		// Uniform [0, 1) from a per-slot xorshift state, safe to call from the parallel loops.
+		inline float PoolRandom(uint32& state)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return (state & 0xFFFFFF) / 16777216.0f;
+		}
+
+		template<bool Census, typename Func>
+		inline void FluidSimulation::ForEachNeighbour(const glm::vec3& pos, Func&& func, NeighbourCensus* census)
+		{
+			const glm::vec3& originCell = PositionToCellCoord(pos);
+
+			for (int i = 0; i < 27; i++)
+			{
+				// Fetch neighbor cells
+				glm::vec3 cell = originCell + offsets[i];
+				if (periodicActive) cell = WrapCell(cell);
+				uint32_t hash = HashCell(cell);
+				uint32_t key = GetKeyFromHash(hash, particleCapacity);
+				uint32 currIndex = startIndices[key];
+
+				// Loop over neigbor particles in neighbor cell
+				while (currIndex < numParticles)
+				{
+					const glm::vec3& index = spatialLookup[currIndex];
+					currIndex++;
+					if constexpr (Census) census->visited++;
+					if (index.z != key) break;
+
+					if (index.y != hash) continue;
+
+					if (index.x >= numParticles) break;
+
+					uint32_t neighborIndex = index.x;
+
+					if constexpr (Census) census->tested++;
+					glm::vec3 offsetToNeighbour = predictedPositions[neighborIndex] - pos;
+					if (periodicActive) offsetToNeighbour = PeriodicOffset(offsetToNeighbour);
+					float sqrDist = dot(offsetToNeighbour, offsetToNeighbour);
+
+					if (sqrDist > neighbourRadius * neighbourRadius) continue;
+
+					if constexpr (Census) census->accepted++;
+					func(neighborIndex, offsetToNeighbour, sqrDist);
+				}
+			}
+		}
+
+		template<bool Census, typename Func>
+		inline void FluidSimulation::ForEachBoundaryNeighbour(const glm::vec3& pos, Func&& func, NeighbourCensus* census)
+		{
+			if (boundaryPositions.empty()) return;
+
+			const glm::vec3& originCell = PositionToCellCoord(pos);
+			const uint32 tableSize = boundaryPositions.size();
+
+			for (int i = 0; i < 27; i++)
+			{
+				glm::vec3 cell = originCell + offsets[i];
+				if (periodicActive) cell = WrapCell(cell);
+				uint32_t hash = HashCell(cell);
+				uint32_t key = GetKeyFromHash(hash, tableSize);
+
+				for (uint32 k = boundaryStart[key]; k < boundaryStart[key + 1]; k++)
+				{
+					uint32 boundaryIndex = boundarySorted[k];
+					if constexpr (Census) census->visited++;
+					if (boundaryHashes[boundaryIndex] != hash) continue;
+
+					if constexpr (Census) census->tested++;
+					glm::vec3 offsetToNeighbour = boundaryPositions[boundaryIndex] - pos;
+					if (periodicActive) offsetToNeighbour = PeriodicOffset(offsetToNeighbour);
+					float sqrDist = dot(offsetToNeighbour, offsetToNeighbour);
+
+					if (sqrDist > neighbourRadius * neighbourRadius) continue;
+
+					if constexpr (Census) census->accepted++;
+					func(boundaryIndex, offsetToNeighbour, sqrDist);
+				}
+			}
+		}
+
+		inline float FluidSimulation::PairRadius(uint32 i, uint32 j)
+		{
+			return interactionRadius * 0.5f * (smoothingScale[i] + smoothingScale[j]);
+		}
+
+		inline glm::vec3 FluidSimulation::WrapCell(glm::vec3 cell)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (periodicCells[axis] == 0) continue;
+				if (cell[axis] < 0) cell[axis] += periodicCells[axis];
+				else if (cell[axis] >= periodicCells[axis]) cell[axis] -= periodicCells[axis];
+			}
+			return cell;
+		}
+
+		// Minimum image of an offset across the periodic axes.
+		inline glm::vec3 FluidSimulation::PeriodicOffset(glm::vec3 offset)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (periodicCells[axis] == 0) continue;
+				// Both points are inside the bound, so one period is always enough.
+				if (offset[axis] > 0.5f * BoundScale[axis]) offset[axis] -= BoundScale[axis];
+				else if (offset[axis] < -0.5f * BoundScale[axis]) offset[axis] += BoundScale[axis];
+			}
+			return offset;
+		}
+	}
 }
\ No newline at end of file
@@ -0,0 +1,499 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+#include "kernels.h"
+#include "core/profiler.h"
+
+#include <atomic>
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		int FluidSimulation::addRigidBody(RigidShape shape, const glm::vec3& size, const glm::vec3& position, const glm::quat& rotation, float relativeDensity)
+		{
+			const glm::vec3 extent = shape == RigidShape::Sphere ? glm::vec3(size.x) : size;
+			if (glm::any(glm::lessThanEqual(extent, glm::vec3(0))) || relativeDensity <= 0.0f)
+			{
+				printf("[ Rigid Body ] : ERROR : Size and density have to be positive.\n");
+				return -1;
+			}
+
+			RigidBody body;
+			body.shape = shape;
+			body.size = extent;
+			body.relativeDensity = relativeDensity;
+			body.position = position;
+			body.rotation = glm::normalize(rotation);
+			body.UpdateMass(TargetDensity);
+
+			// Sampled a little denser than the fluid rests so no particle fits between the samples. Fluid settles about
+			// a particle spacing away from them, so they sit half of one inside and the surface is where fluid ends.
+			const float restSpacing = powf(1.0f / TargetDensity, 1.0f / 3.0f);
+			body.boundaryInset = glm::min(0.5f * restSpacing, 0.5f * glm::min(extent.x, glm::min(extent.y, extent.z)));
+			std::vector<glm::vec3> points;
+			body.SampleSurface(0.5f * interactionRadius, body.boundaryInset, points);
+			body.firstBoundary = boundaryLocal.size();
+			body.boundaryCount = points.size();
+
+			// Akinci et al. 2012, a boundary particle's volume is the inverse of its kernel sum over the body's own
+			// samples. The body is rigid, so this is computed once.
+			std::vector<float> volumes(points.size());
+			std::transform(std::execution::par, points.begin(), points.end(), volumes.begin(),
+				[this, &points](const glm::vec3& point)
+			{
+				float kernelSum = 0.0f;
+				for (const glm::vec3& other : points)
+				{
+					kernelSum += kernels::SmoothingPow2(glm::length(other - point), interactionRadius);
+				}
+				return 1.0f / kernelSum;
+			});
+
+			const uint32 bodyIndex = rigidBodies.size();
+			rigidBodies.push_back(body);
+			boundaryLocal.insert(boundaryLocal.end(), points.begin(), points.end());
+			boundaryVolumes.insert(boundaryVolumes.end(), volumes.begin(), volumes.end());
+			boundaryBodies.resize(boundaryLocal.size(), bodyIndex);
+
+			const uint32 boundaryCount = boundaryLocal.size();
+			boundaryPositions.resize(boundaryCount);
+			boundaryVelocities.resize(boundaryCount);
+			boundaryImpulses.resize(boundaryCount, glm::vec3(0));
+			boundaryHashes.resize(boundaryCount);
+			boundarySorted.resize(boundaryCount);
+			boundaryStart.resize(boundaryCount + 1);
+			boundaryList.resize(boundaryCount);
+			std::iota(boundaryList.begin(), boundaryList.end(), 0);
+
+			UpdateBoundaryParticles();
+			UpdateBoundaryLookup();
+			ReserveRigidContacts();
+			WakeAll();
+			return bodyIndex;
+		}
+
+		void FluidSimulation::clearRigidBodies()
+		{
+			rigidBodies.clear();
+			rigidContacts.clear();
+			rigidBoxMin.clear();
+			rigidBoxMax.clear();
+			rigidBvh.Build(rigidBoxMin, rigidBoxMax);
+			boundaryList.clear();
+			boundaryBodies.clear();
+			boundaryLocal.clear();
+			boundaryPositions.clear();
+			boundaryVelocities.clear();
+			boundaryImpulses.clear();
+			boundaryVolumes.clear();
+			boundaryHashes.clear();
+			boundarySorted.clear();
+			boundaryStart.clear();
+			WakeAll();
+		}
+
+		const std::vector<RigidBody>& FluidSimulation::getRigidBodies()
+		{
+			return rigidBodies;
+		}
+
+		uint32 FluidSimulation::getBoundaryParticleCount()
+		{
+			return boundaryPositions.size();
+		}
+
+		uint32 FluidSimulation::getRigidContactCount()
+		{
+			return rigidContacts.size();
+		}
+
+		double FluidSimulation::getElapsedTimeRigid()
+		{
+			return ElapsedTimeRigid;
+		}
+
+		void FluidSimulation::StepRigidBodies(float deltatime)
+		{
+			PROFILE_ZONE("Rigid Bodies");
+			if (rigidBodies.empty() || deltatime <= 0.0f)
+			{
+				ElapsedTimeRigid = 0.0;
+				return;
+			}
+			auto RigidStart = std::chrono::steady_clock::now();
+
+			// The fluid's impulses on the boundary particles are reduced to a linear and angular impulse per body.
+			for (RigidBody& body : rigidBodies)
+			{
+				auto first = boundaryList.begin() + body.firstBoundary;
+				auto last = first + body.boundaryCount;
+				body.impulse += std::transform_reduce(std::execution::par, first, last, glm::vec3(0), std::plus<glm::vec3>(),
+					[this](uint32_t b) { return boundaryImpulses[b]; });
+				body.angularImpulse += std::transform_reduce(std::execution::par, first, last, glm::vec3(0), std::plus<glm::vec3>(),
+					[this, &body](uint32_t b) { return glm::cross(boundaryPositions[b] - body.position, boundaryImpulses[b]); });
+			}
+			std::fill(std::execution::par, boundaryImpulses.begin(), boundaryImpulses.end(), glm::vec3(0));
+
+			const glm::vec3 gravityAccel = CalculateExternalFoce(glm::vec3(0), glm::vec3(0));
+			for (RigidBody& body : rigidBodies)
+			{
+				body.linearVelocity += gravityAccel * deltatime + body.impulse * body.invMass;
+				body.angularVelocity += body.ApplyInvInertia(body.angularImpulse);
+				body.impulse = glm::vec3(0);
+				body.angularImpulse = glm::vec3(0);
+			}
+
+			FindRigidContacts();
+			SolveRigidContacts(deltatime);
+
+			for (RigidBody& body : rigidBodies)
+			{
+				body.position += body.linearVelocity * deltatime;
+				const glm::quat spin = glm::quat(0.0f, body.angularVelocity.x, body.angularVelocity.y, body.angularVelocity.z);
+				body.rotation = glm::normalize(body.rotation + spin * body.rotation * (0.5f * deltatime));
+			}
+			UpdateBoundaryParticles();
+
+			// A moving body disturbs the fluid around it, so the blocks it passes through are woken.
+			if (sleeping && !blockSlots.empty())
+			{
+				std::for_each(std::execution::par, boundaryList.begin(), boundaryList.end(),
+					[this](uint32_t b)
+				{
+					if (glm::length(boundaryVelocities[b]) <= sleepVelocity) return;
+					for (int corner = 0; corner < 8; corner++)
+					{
+						glm::vec3 offset = { corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, corner & 4 ? 1 : -1 };
+						uint32 slot = BlockSlot(boundaryPositions[b] + offset * interactionRadius);
+						std::atomic_ref<uint8_t>(blockAsleep[slot]).store(0, std::memory_order_relaxed);
+						std::atomic_ref<uint16_t>(blockCalm[slot]).store(0, std::memory_order_relaxed);
+					}
+				});
+			}
+
+			auto RigidEnd = std::chrono::steady_clock::now();
+			ElapsedTimeRigid = std::chrono::duration<double>(RigidEnd - RigidStart).count() * 1000.0f;
+		}
+
+		void FluidSimulation::UpdateBoundaryParticles()
+		{
+			std::for_each(std::execution::par, boundaryList.begin(), boundaryList.end(),
+				[this](uint32_t b)
+			{
+				const RigidBody& body = rigidBodies[boundaryBodies[b]];
+				boundaryPositions[b] = body.position + body.rotation * boundaryLocal[b];
+				boundaryVelocities[b] = body.VelocityAt(boundaryPositions[b]);
+			});
+
+			// The hierarchy is used by the next step's contacts and by the fluid's penetration fallback in between.
+			rigidBoxMin.resize(rigidBodies.size());
+			rigidBoxMax.resize(rigidBodies.size());
+			for (uint32 k = 0; k < rigidBodies.size(); k++)
+			{
+				const float radius = rigidBodies[k].BoundingRadius();
+				rigidBoxMin[k] = rigidBodies[k].position - radius;
+				rigidBoxMax[k] = rigidBodies[k].position + radius;
+			}
+			rigidBvh.Build(rigidBoxMin, rigidBoxMax);
+		}
+
+		void FluidSimulation::UpdateBoundaryLookup()
+		{
+			if (boundaryPositions.empty()) return;
+
+			const uint32 tableSize = boundaryPositions.size();
+			std::for_each(std::execution::par, boundaryList.begin(), boundaryList.end(),
+				[this](uint32_t b)
+			{
+				boundaryHashes[b] = HashCell(PositionToCellCoord(boundaryPositions[b]));
+			});
+
+			// Counting sort by key, boundaryStart ends up holding where each key's run begins.
+			std::fill(boundaryStart.begin(), boundaryStart.end(), 0);
+			for (uint32 b = 0; b < tableSize; b++)
+			{
+				boundaryStart[GetKeyFromHash(boundaryHashes[b], tableSize) + 1]++;
+			}
+			std::inclusive_scan(boundaryStart.begin(), boundaryStart.end(), boundaryStart.begin());
+			for (uint32 b = 0; b < tableSize; b++)
+			{
+				boundarySorted[boundaryStart[GetKeyFromHash(boundaryHashes[b], tableSize)]++] = b;
+			}
+			// Filling advanced every start to the next key's, shift them back.
+			for (uint32 key = tableSize; key > 0; key--)
+			{
+				boundaryStart[key] = boundaryStart[key - 1];
+			}
+			boundaryStart[0] = 0;
+		}
+
+		void FluidSimulation::ReserveRigidContacts()
+		{
+			// Every boundary particle touches at most three walls, each collider and each other body once, so the
+			// contacts are found without reallocating inside the step.
+			const size_t perBoundary = 3 + colliders.size() + (rigidBodies.empty() ? 0 : rigidBodies.size() - 1);
+			rigidContacts.reserve(boundaryLocal.size() * perBoundary);
+		}
+
+		void FluidSimulation::FindRigidContacts()
+		{
+			rigidContacts.clear();
+
+			// Boundary particles double as contact points, each one closer than its inset to other geometry is a contact.
+			const glm::vec3 halfSize = BoundScale * 0.5f;
+			const glm::quat toContainer = glm::conjugate(boundRotation);
+			for (uint32 a = 0; a < rigidBodies.size(); a++)
+			{
+				const RigidBody& body = rigidBodies[a];
+				for (uint32 b = body.firstBoundary; b < body.firstBoundary + body.boundaryCount; b++)
+				{
+					const glm::vec3& point = boundaryPositions[b];
+
+					// The container walls, bodies never wrap so periodic axes keep theirs.
+					const glm::vec3 local = toContainer * (point - boundPosition);
+					const glm::vec3 over = abs(local) - halfSize;
+					for (int axis = 0; axis < 3; axis++)
+					{
+						if (over[axis] + body.boundaryInset <= 0.0f) continue;
+						glm::vec3 normal = { 0,0,0 };
+						normal[axis] = local[axis] < 0.0f ? 1.0f : -1.0f;
+						rigidContacts.push_back({ a, RigidContact::noBody, point, boundRotation * normal, over[axis] + body.boundaryInset, BoundVelocityAt(point) });
+					}
+
+					for (const SdfCollider& collider : colliders)
+					{
+						float distance;
+						glm::vec3 normal;
+						if (!collider.Sample(point, distance, normal) || distance >= body.boundaryInset) continue;
+						rigidContacts.push_back({ a, RigidContact::noBody, point, normal, body.boundaryInset - distance, glm::vec3(0) });
+					}
+				}
+
+				// Other bodies, each pair is tested once from the lower index and both ways.
+				rigidBvh.Query(rigidBoxMin[a], rigidBoxMax[a], [&](uint32 other)
+				{
+					if (other <= a) return;
+					const uint32 pair[2] = { a, other };
+					for (int side = 0; side < 2; side++)
+					{
+						const RigidBody& shape = rigidBodies[pair[side]];
+						const RigidBody& sampled = rigidBodies[pair[1 - side]];
+						const glm::quat toShape = glm::conjugate(shape.rotation);
+						for (uint32 b = sampled.firstBoundary; b < sampled.firstBoundary + sampled.boundaryCount; b++)
+						{
+							glm::vec3 gradient;
+							float distance = shape.LocalDistance(toShape * (boundaryPositions[b] - shape.position), gradient);
+							if (distance >= sampled.boundaryInset) continue;
+							rigidContacts.push_back({ pair[1 - side], pair[side], boundaryPositions[b], shape.rotation * gradient, sampled.boundaryInset - distance, glm::vec3(0) });
+						}
+					}
+				});
+			}
+		}
+
+		void FluidSimulation::SolveRigidContacts(float deltatime)
+		{
+			// Sequential impulses, penetration is removed by a velocity bias instead of moving bodies directly.
+			const float slop = 0.01f;
+			const float biasFactor = 0.2f / deltatime;
+			auto relativeVelocity = [this](const RigidContact& contact)
+			{
+				glm::vec3 other = contact.bodyB == RigidContact::noBody ? contact.staticVelocity : rigidBodies[contact.bodyB].VelocityAt(contact.point);
+				return rigidBodies[contact.bodyA].VelocityAt(contact.point) - other;
+			};
+			auto effectiveMass = [this](const RigidContact& contact, const glm::vec3& direction)
+			{
+				const RigidBody& bodyA = rigidBodies[contact.bodyA];
+				glm::vec3 armA = contact.point - bodyA.position;
+				float inverse = bodyA.invMass + dot(direction, glm::cross(bodyA.ApplyInvInertia(glm::cross(armA, direction)), armA));
+				if (contact.bodyB != RigidContact::noBody)
+				{
+					const RigidBody& bodyB = rigidBodies[contact.bodyB];
+					glm::vec3 armB = contact.point - bodyB.position;
+					inverse += bodyB.invMass + dot(direction, glm::cross(bodyB.ApplyInvInertia(glm::cross(armB, direction)), armB));
+				}
+				return inverse > 0.0f ? 1.0f / inverse : 0.0f;
+			};
+			auto applyImpulse = [this](const RigidContact& contact, const glm::vec3& impulse)
+			{
+				RigidBody& bodyA = rigidBodies[contact.bodyA];
+				bodyA.linearVelocity += impulse * bodyA.invMass;
+				bodyA.angularVelocity += bodyA.ApplyInvInertia(glm::cross(contact.point - bodyA.position, impulse));
+				if (contact.bodyB == RigidContact::noBody) return;
+				RigidBody& bodyB = rigidBodies[contact.bodyB];
+				bodyB.linearVelocity -= impulse * bodyB.invMass;
+				bodyB.angularVelocity -= bodyB.ApplyInvInertia(glm::cross(contact.point - bodyB.position, impulse));
+			};
+
+			// Bounce only off fast impacts, resting contacts would jitter.
+			for (RigidContact& contact : rigidContacts)
+			{
+				float approach = dot(relativeVelocity(contact), contact.normal);
+				float bounce = approach < -1.0f ? -rigidRestitution * approach : 0.0f;
+				contact.targetVelocity = glm::max(bounce, biasFactor * glm::max(contact.depth - slop, 0.0f));
+			}
+
+			for (int iteration = 0; iteration < rigidIterations; iteration++)
+			{
+				for (RigidContact& contact : rigidContacts)
+				{
+					glm::vec3 velocity = relativeVelocity(contact);
+					float lambda = (contact.targetVelocity - dot(velocity, contact.normal)) * effectiveMass(contact, contact.normal);
+					float accumulated = glm::max(contact.normalImpulse + lambda, 0.0f);
+					lambda = accumulated - contact.normalImpulse;
+					contact.normalImpulse = accumulated;
+					applyImpulse(contact, contact.normal * lambda);
+
+					// Coulomb friction against the sliding direction, bounded by this contact's normal impulse.
+					velocity = relativeVelocity(contact);
+					glm::vec3 tangent = velocity - contact.normal * dot(velocity, contact.normal);
+					float slide = glm::length(tangent);
+					if (slide < 1e-6f) continue;
+					tangent /= slide;
+					float friction = glm::min(slide * effectiveMass(contact, tangent), rigidFriction * contact.normalImpulse);
+					applyImpulse(contact, -tangent * friction);
+				}
+			}
+		}
+
+		void FluidSimulation::ResolveRigidBodies(uint32 i)
+		{
+			if (rigidBodies.empty()) return;
+
+			// The boundary pressure keeps the fluid off the surface, this only catches particles that got through anyway.
+			const glm::vec3 pos = positions[i];
+			rigidBvh.Query(pos, pos, [&](uint32 k)
+			{
+				const RigidBody& body = rigidBodies[k];
+				glm::vec3 gradient;
+				float distance = body.LocalDistance(glm::conjugate(body.rotation) * (positions[i] - body.position), gradient);
+				if (distance >= 0.0f) return;
+
+				const glm::vec3 normal = body.rotation * gradient;
+				positions[i] -= normal * distance;
+				float normalVelocity = dot(velocity[i] - body.VelocityAt(positions[i]), normal);
+				if (normalVelocity < 0.0f)
+				{
+					velocity[i] -= normal * normalVelocity;
+				}
+			});
+		}
+
+		glm::vec4 FluidSimulation::CalculateRigidDensity(const glm::vec3& pos)
+		{
+			glm::vec4 rigid = { 0,0,0,0 };
+			ForEachBoundaryNeighbour(pos, [&](uint32_t b, const glm::vec3& offsetToNeighbour, float sqrDist)
+			{
+				float dist = sqrt(sqrDist);
+				float psi = TargetDensity * boundaryVolumes[b];
+				rigid.x += psi * kernels::SmoothingPow2(dist, interactionRadius);
+				if (dist <= 0) return;
+				glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius) * psi;
+				rigid += glm::vec4(0.0f, grad);
+			});
+			return rigid;
+		}
+
+		float FluidSimulation::CalculateRigidDensityChange(const glm::vec3& pos, const glm::vec3& velo)
+		{
+			float change = 0.0f;
+			ForEachBoundaryNeighbour(pos, [&](uint32_t b, const glm::vec3& offsetToNeighbour, float sqrDist)
+			{
+				float dist = sqrt(sqrDist);
+				if (dist <= 0) return;
+				glm::vec3 grad = -offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+				change += TargetDensity * boundaryVolumes[b] * dot(velo - boundaryVelocities[b], grad);
+			});
+			return change;
+		}
+
+		// The reaction passes run over the boundary particles and gather the fluid's side of every pair, so each
+		// boundary particle owns its sum and no atomics are needed.
+
+		void FluidSimulation::AccumulateRigidPressure(float deltatime)
+		{
+			std::for_each(std::execution::par, boundaryList.begin(), boundaryList.end(),
+				[this, deltatime](uint32_t b)
+			{
+				const float psi = TargetDensity * boundaryVolumes[b];
+				glm::vec3 impulse = { 0,0,0 };
+				ForEachNeighbour(boundaryPositions[b], [&](uint32_t i, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					float dist = sqrt(sqrDist);
+					if (dist <= 0) return;
+
+					// Same terms as the boundary part of CalculatePressureForce, seen from the other side.
+					const float density = densities[i].x;
+					const float nearDensity = densities[i].y;
+					const uint8_t phase = particlePhase[i];
+					const float pressure = glm::max((density - phaseRestDensity[phase]) * phasePressure[phase], 0.0f);
+					const float nearPressure = nearDensity * nearPressureMultiplier;
+					const float radius = interactionRadius * 0.5f * (smoothingScale[i] + 1.0f);
+					const glm::vec3 dir = -offsetToNeighbour / dist;
+
+					glm::vec3 force = dir * kernels::SmoothingDerivativePow2(dist, radius) * pressure * psi / density;
+					force += dir * kernels::SmoothingDerivativePow3(dist, radius) * nearPressure * psi / nearDensity;
+					impulse -= force / density * particleMass[i] * deltatime;
+				});
+				boundaryImpulses[b] += impulse;
+			});
+		}
+
+		void FluidSimulation::AccumulateDFSPHRigidPressure(const Core::ArenaVector<float>& kappa, float deltatime)
+		{
+			std::for_each(std::execution::par, boundaryList.begin(), boundaryList.end(),
+				[this, &kappa, deltatime](uint32_t b)
+			{
+				const float psi = TargetDensity * boundaryVolumes[b];
+				glm::vec3 impulse = { 0,0,0 };
+				ForEachNeighbour(boundaryPositions[b], [&](uint32_t i, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					float dist = sqrt(sqrDist);
+					if (dist <= 0) return;
+					glm::vec3 grad = offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+					impulse += grad * (psi * kappa[i] / densities[i].x * deltatime);
+				});
+				boundaryImpulses[b] += impulse;
+			});
+		}
+
+		void FluidSimulation::AccumulatePBFRigidPressure(float deltatime)
+		{
+			std::for_each(std::execution::par, boundaryList.begin(), boundaryList.end(),
+				[this, deltatime](uint32_t b)
+			{
+				const float psi = TargetDensity * boundaryVolumes[b];
+				glm::vec3 shift = { 0,0,0 };
+				ForEachNeighbour(boundaryPositions[b], [&](uint32_t i, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					float dist = sqrt(sqrDist);
+					if (dist <= 0) return;
+					glm::vec3 grad = offsetToNeighbour / dist * kernels::SmoothingDerivativePow2(dist, interactionRadius);
+					shift += grad * (psi * pbfLambda[i] / TargetDensity);
+				});
+				// The fluid's velocity changes by its correction over the step, the body takes the opposite momentum.
+				boundaryImpulses[b] -= shift / deltatime;
+			});
+		}
+	}
+}
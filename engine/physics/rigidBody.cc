@@ -0,0 +1,179 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "rigidBody.h"
+
+#include <numeric>
+#include <algorithm>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		void RigidBody::UpdateMass(float fluidDensity)
+		{
+			glm::vec3 inertia;
+			if (shape == RigidShape::Sphere)
+			{
+				const float radius = size.x;
+				mass = relativeDensity * fluidDensity * 4.0f / 3.0f * glm::pi<float>() * radius * radius * radius;
+				inertia = glm::vec3(0.4f * mass * radius * radius);
+			}
+			else
+			{
+				const glm::vec3 sqr = size * size;
+				mass = relativeDensity * fluidDensity * 8.0f * size.x * size.y * size.z;
+				inertia = mass / 3.0f * glm::vec3(sqr.y + sqr.z, sqr.x + sqr.z, sqr.x + sqr.y);
+			}
+			invMass = mass > 0.0f ? 1.0f / mass : 0.0f;
+			invInertia = glm::vec3(
+				inertia.x > 0.0f ? 1.0f / inertia.x : 0.0f,
+				inertia.y > 0.0f ? 1.0f / inertia.y : 0.0f,
+				inertia.z > 0.0f ? 1.0f / inertia.z : 0.0f);
+		}
+
+		float RigidBody::LocalDistance(const glm::vec3& local, glm::vec3& gradient) const
+		{
+			if (shape == RigidShape::Sphere)
+			{
+				const float length = glm::length(local);
+				gradient = length > 0.0f ? local / length : glm::vec3(0, 1, 0);
+				return length - size.x;
+			}
+
+			const glm::vec3 side = glm::vec3(local.x < 0.0f ? -1.0f : 1.0f, local.y < 0.0f ? -1.0f : 1.0f, local.z < 0.0f ? -1.0f : 1.0f);
+			const glm::vec3 q = abs(local) - size;
+			const glm::vec3 outside = glm::max(q, 0.0f);
+			const float outsideLength = glm::length(outside);
+			if (outsideLength > 0.0f)
+			{
+				gradient = outside / outsideLength * side;
+				return outsideLength;
+			}
+
+			// Inside, the closest face is the one with the largest (least negative) q.
+			const int axis = q.x > q.y ? (q.x > q.z ? 0 : 2) : (q.y > q.z ? 1 : 2);
+			gradient = glm::vec3(0, 0, 0);
+			gradient[axis] = side[axis];
+			return q[axis];
+		}
+
+		void RigidBody::SampleSurface(float spacing, float inset, std::vector<glm::vec3>& points) const
+		{
+			points.clear();
+			const glm::vec3 extent = glm::max(size - inset, 0.0f);
+			if (shape == RigidShape::Sphere)
+			{
+				// Fibonacci lattice, evenly spread with no clustering at the poles.
+				const float radius = extent.x;
+				const int count = glm::max((int)ceil(4.0f * glm::pi<float>() * radius * radius / (spacing * spacing)), 12);
+				const float golden = glm::pi<float>() * (3.0f - sqrtf(5.0f));
+				for (int k = 0; k < count; k++)
+				{
+					const float y = 1.0f - 2.0f * (k + 0.5f) / count;
+					const float ring = sqrtf(glm::max(1.0f - y * y, 0.0f));
+					points.push_back(radius * glm::vec3(cosf(golden * k) * ring, y, sinf(golden * k) * ring));
+				}
+				return;
+			}
+
+			// Lattice points on the faces of the box, edges and corners are shared so nothing is sampled twice.
+			const glm::ivec3 cells = glm::max(glm::ivec3(glm::ceil(2.0f * extent / spacing)), glm::ivec3(1));
+			const glm::vec3 step = 2.0f * extent / glm::vec3(cells);
+			for (int x = 0; x <= cells.x; x++)
+			{
+				for (int y = 0; y <= cells.y; y++)
+				{
+					for (int z = 0; z <= cells.z; z++)
+					{
+						const bool face = x == 0 || x == cells.x || y == 0 || y == cells.y || z == 0 || z == cells.z;
+						if (!face) continue;
+						points.push_back(-extent + step * glm::vec3(x, y, z));
+					}
+				}
+			}
+		}
+
+		glm::vec3 RigidBody::VelocityAt(const glm::vec3& pos) const
+		{
+			return linearVelocity + glm::cross(angularVelocity, pos - position);
+		}
+
+		glm::vec3 RigidBody::ApplyInvInertia(const glm::vec3& value) const
+		{
+			return rotation * (invInertia * (glm::conjugate(rotation) * value));
+		}
+
+		float RigidBody::BoundingRadius() const
+		{
+			return shape == RigidShape::Sphere ? size.x : glm::length(size);
+		}
+
+		void RigidBvh::Build(const std::vector<glm::vec3>& boxMin, const std::vector<glm::vec3>& boxMax)
+		{
+			nodes.clear();
+			items.resize(boxMin.size());
+			std::iota(items.begin(), items.end(), 0);
+			if (items.empty()) return;
+			BuildNode(0, items.size(), boxMin, boxMax);
+		}
+
+		uint32 RigidBvh::BuildNode(uint32 first, uint32 count, const std::vector<glm::vec3>& boxMin, const std::vector<glm::vec3>& boxMax)
+		{
+			const uint32 index = nodes.size();
+			nodes.push_back({});
+
+			glm::vec3 min = boxMin[items[first]];
+			glm::vec3 max = boxMax[items[first]];
+			glm::vec3 centreMin = 0.5f * (min + max);
+			glm::vec3 centreMax = centreMin;
+			for (uint32 k = first + 1; k < first + count; k++)
+			{
+				min = glm::min(min, boxMin[items[k]]);
+				max = glm::max(max, boxMax[items[k]]);
+				const glm::vec3 centre = 0.5f * (boxMin[items[k]] + boxMax[items[k]]);
+				centreMin = glm::min(centreMin, centre);
+				centreMax = glm::max(centreMax, centre);
+			}
+			nodes[index].min = min;
+			nodes[index].max = max;
+
+			const uint32 leafSize = 2;
+			if (count <= leafSize)
+			{
+				nodes[index].first = first;
+				nodes[index].count = count;
+				return index;
+			}
+
+			// Median split along the axis the centres spread most on, so both halves are never empty.
+			const glm::vec3 extent = centreMax - centreMin;
+			const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+			const uint32 half = count / 2;
+			std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+				[&](uint32 a, uint32 b) { return boxMin[a][axis] + boxMax[a][axis] < boxMin[b][axis] + boxMax[b][axis]; });
+
+			BuildNode(first, half, boxMin, boxMax);
+			const uint32 right = BuildNode(first + half, count - half, boxMin, boxMax);
+			nodes[index].first = right;
+			nodes[index].count = 0;
+			return index;
+		}
+	}
+}
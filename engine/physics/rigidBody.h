@@ -0,0 +1,138 @@
+#pragma once
+
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <vector>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		enum class RigidShape
+		{
+			Box,
+			Sphere
+		};
+
+		// Dynamic rigid body, size is the half extents of a box or the radius of a sphere in x. The surface is sampled
+		// with boundary particles owned by the simulation, firstBoundary .. firstBoundary + boundaryCount.
+		struct RigidBody
+		{
+			RigidShape shape = RigidShape::Box;
+			glm::vec3 size = { 0.5f, 0.5f, 0.5f };
+			float relativeDensity = 0.5f; // to the fluid's rest density
+
+			float mass = 1.0f;
+			float invMass = 1.0f;
+			glm::vec3 invInertia = { 1,1,1 }; // diagonal, in body space
+
+			glm::vec3 position = { 0,0,0 };
+			glm::quat rotation = glm::identity<glm::quat>();
+			glm::vec3 linearVelocity = { 0,0,0 };
+			glm::vec3 angularVelocity = { 0,0,0 };
+
+			// Accumulated over a step from the fluid, applied and cleared when the body is integrated.
+			glm::vec3 impulse = { 0,0,0 };
+			glm::vec3 angularImpulse = { 0,0,0 };
+
+			uint32 firstBoundary = 0;
+			uint32 boundaryCount = 0;
+			float boundaryInset = 0.0f; // how far inside the surface the boundary particles sit
+
+			void UpdateMass(float fluidDensity);
+
+			// Negative inside, gradient is the outward normal. Both in body space.
+			float LocalDistance(const glm::vec3& local, glm::vec3& gradient) const;
+
+			// Points on the surface shrunk by inset, no further than spacing apart, in body space.
+			void SampleSurface(float spacing, float inset, std::vector<glm::vec3>& points) const;
+
+			glm::vec3 VelocityAt(const glm::vec3& pos) const;
+			glm::vec3 ApplyInvInertia(const glm::vec3& value) const; // world space
+			float BoundingRadius() const;
+		};
+
+		// bodyA is pushed along the normal and bodyB, or the static geometry if it is noBody, against it.
+		struct RigidContact
+		{
+			static constexpr uint32 noBody = UINT32_MAX;
+
+			uint32 bodyA;
+			uint32 bodyB;
+			glm::vec3 point;
+			glm::vec3 normal;
+			float depth;
+			glm::vec3 staticVelocity; // of the static geometry at the point
+			float targetVelocity = 0.0f;
+			float normalImpulse = 0.0f;
+		};
+
+		// Bounding volume hierarchy over boxes, rebuilt from scratch whenever the boxes move.
+		class RigidBvh
+		{
+		public:
+			void Build(const std::vector<glm::vec3>& boxMin, const std::vector<glm::vec3>& boxMax);
+
+			// Calls func(item) for every box overlapping [queryMin, queryMax].
+			template<typename Func>
+			void Query(const glm::vec3& queryMin, const glm::vec3& queryMax, Func&& func) const;
+
+		private:
+			struct Node
+			{
+				glm::vec3 min;
+				glm::vec3 max;
+				uint32 first; // leaves: first item, inner nodes: right child, the left child is the next node
+				uint32 count; // 0 for inner nodes
+			};
+
+			uint32 BuildNode(uint32 first, uint32 count, const std::vector<glm::vec3>& boxMin, const std::vector<glm::vec3>& boxMax);
+
+			std::vector<Node> nodes;
+			std::vector<uint32> items;
+		};
+
+		template<typename Func>
+		inline void RigidBvh::Query(const glm::vec3& queryMin, const glm::vec3& queryMax, Func&& func) const
+		{
+			if (nodes.empty()) return;
+
+			// Fixed stack so concurrent queries share no state, median splits keep the depth logarithmic.
+			uint32 pending[64];
+			uint32 top = 0;
+			pending[top++] = 0;
+			while (top > 0)
+			{
+				const Node& node = nodes[pending[--top]];
+				if (glm::any(glm::lessThan(queryMax, node.min)) || glm::any(glm::greaterThan(queryMin, node.max))) continue;
+
+				if (node.count > 0)
+				{
+					for (uint32 k = node.first; k < node.first + node.count; k++)
+					{
+						func(items[k]);
+					}
+					continue;
+				}
+				const uint32 left = &node - nodes.data() + 1;
+				pending[top++] = left;
+				pending[top++] = node.first;
+			}
+		}
+	}
+}
@@ -0,0 +1,203 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		namespace
+		{
+			// What one neighbour loop costs beyond the shared walk. Bytes are what the code loads and stores, caches
+			// may serve much of it, so a phase above the bandwidth roof is running from cache.
+			struct PhaseCostModel
+			{
+				double particleBytes;
+				double particleFlops;
+				double neighbourBytes;
+				double neighbourFlops;
+				double neighbourKernels;
+				double boundaryFlops;
+				double boundaryKernels;
+				bool skipsSelf;
+			};
+
+			// Density: mass and smoothing scale per neighbour, two kernels (7 flops each) plus the radius and sums.
+			// Pressure: density pair, phase, mass and scale per neighbour, two derivative kernels and the tension kernel.
+			// Viscosity: velocity, phase, mass and scale per neighbour, one poly6 kernel.
+			// Every particle also reads its 27 cell starts and its own state.
+			constexpr PhaseCostModel DensityCost = { 25 + 108, 8, 8, 22, 2, 22, 2, false };
+			constexpr PhaseCostModel PressureCost = { 49 + 108, 19, 17, 64, 3, 33, 2, true };
+			constexpr PhaseCostModel ViscosityCost = { 41 + 108, 13, 21, 27, 1, 0, 0, true };
+
+			// A visited lookup entry is 12 bytes, a distance test loads a position and takes 8 flops.
+			constexpr double EntryBytes = 12;
+			constexpr double BoundaryEntryBytes = 8;
+			constexpr double TestBytes = 12;
+			constexpr double TestFlops = 8;
+			constexpr double BoundaryNeighbourBytes = 4;
+
+			struct ParticleCensus
+			{
+				NeighbourCensus fluid;
+				NeighbourCensus boundary;
+
+				ParticleCensus operator+(const ParticleCensus& other) const
+				{
+					return { fluid + other.fluid, boundary + other.boundary };
+				}
+			};
+		}
+
+		void FluidSimulation::setRooflineAnalysis(bool status)
+		{
+			rooflineAnalysis = status;
+			if (status && machineRoofline.bandwidth <= 0.0)
+			{
+				measureMachineRoofline();
+			}
+		}
+
+		bool FluidSimulation::getRooflineAnalysis()
+		{
+			return rooflineAnalysis;
+		}
+
+		void FluidSimulation::measureMachineRoofline()
+		{
+			machineRoofline = Core::MeasureMachineRoofline();
+		}
+
+		const Core::MachineRoofline& FluidSimulation::getMachineRoofline()
+		{
+			return machineRoofline;
+		}
+
+		const PhaseRoofline& FluidSimulation::getPhaseRoofline(SimPhase phase)
+		{
+			return phaseRooflines[(uint32)phase];
+		}
+
+		uint32 FluidSimulation::getRooflineParticles()
+		{
+			return rooflineParticles;
+		}
+
+		void FluidSimulation::AnalyseRoofline(const Core::ArenaVector<uint32>& workList)
+		{
+			// Runs after the step with the same predicted positions and lookup, so the walks match the timed ones.
+			const ParticleCensus census = std::transform_reduce(std::execution::par, workList.begin(), workList.end(), ParticleCensus{},
+				[](const ParticleCensus& a, const ParticleCensus& b) { return a + b; },
+				[this](uint32_t i)
+			{
+				ParticleCensus particle;
+				ForEachNeighbour<true>(predictedPositions[i], [](uint32_t, const glm::vec3&, float) {}, &particle.fluid);
+				ForEachBoundaryNeighbour<true>(predictedPositions[i], [](uint32_t, const glm::vec3&, float) {}, &particle.boundary);
+				return particle;
+			});
+
+			const double particles = (double)workList.size();
+			rooflineParticles = (uint32)workList.size();
+
+			auto Finish = [this](PhaseRoofline& roofline, double ms)
+			{
+				roofline.ms = ms;
+				roofline.intensity = roofline.bytes > 0.0 ? roofline.flops / roofline.bytes : 0.0;
+				roofline.achieved = ms > 0.0 ? roofline.flops / (ms * 1e6) : 0.0;
+				roofline.bandwidth = ms > 0.0 ? roofline.bytes / (ms * 1e6) : 0.0;
+				roofline.attainable = machineRoofline.Attainable(roofline.intensity);
+			};
+
+			auto Model = [&](const PhaseCostModel& cost, double ms)
+			{
+				// Pressure and viscosity accept themselves in the walk and return straight away.
+				const double pairs = census.fluid.accepted - (cost.skipsSelf ? particles : 0.0);
+				const double boundaryPairs = cost.boundaryKernels > 0 ? (double)census.boundary.accepted : 0.0;
+
+				PhaseRoofline roofline;
+				roofline.candidates = (double)census.fluid.visited;
+				roofline.neighbours = pairs;
+				roofline.kernelEvaluations = pairs * cost.neighbourKernels + boundaryPairs * cost.boundaryKernels;
+				roofline.bytes = particles * cost.particleBytes + census.fluid.visited * EntryBytes + census.fluid.tested * TestBytes + pairs * cost.neighbourBytes;
+				roofline.flops = particles * cost.particleFlops + census.fluid.tested * TestFlops + pairs * cost.neighbourFlops;
+				if (cost.boundaryKernels > 0)
+				{
+					roofline.candidates += census.boundary.visited;
+					roofline.neighbours += boundaryPairs;
+					roofline.bytes += census.boundary.visited * BoundaryEntryBytes + census.boundary.tested * TestBytes + boundaryPairs * BoundaryNeighbourBytes;
+					roofline.flops += census.boundary.tested * TestFlops + boundaryPairs * cost.boundaryFlops;
+				}
+				Finish(roofline, ms);
+				return roofline;
+			};
+
+			phaseRooflines[(uint32)SimPhase::Density] = Model(DensityCost, ElapsedTimeDensity);
+			phaseRooflines[(uint32)SimPhase::Pressure] = Model(PressureCost, ElapsedTimePressure);
+			// The implicit solve's matrix-vector products follow a different model, only the explicit loop is covered.
+			phaseRooflines[(uint32)SimPhase::Viscosity] = implicitViscosity ? PhaseRoofline{} : Model(ViscosityCost, ElapsedTimeViscosity);
+
+			// The rebuild hashes every particle (3 divides and floors) and sorts 12 byte entries, the incremental patch
+			// streams the lookup a few times and only sorts the movers.
+			PhaseRoofline spatial;
+			const double n = numParticles;
+			const double movers = spatialMoverCount;
+			if (spatialFullRebuild)
+			{
+				spatial.bytes = n * (12 + 12 + 4 + 4) + n * std::log2(std::max(n, 2.0)) * 24 + n * (12 + 4);
+			}
+			else
+			{
+				spatial.bytes = n * (12 + 8 + 1 + 1) + n * (12 + 24 + 24 + 16) + movers * std::log2(std::max(movers, 2.0)) * 24;
+			}
+			spatial.flops = n * 6;
+			Finish(spatial, ElapsedTimeSpatial);
+			phaseRooflines[(uint32)SimPhase::Spatial] = spatial;
+		}
+
+		bool FluidSimulation::exportRooflineReport(const char* path)
+		{
+			std::ofstream file(path);
+			if (!file.is_open())
+			{
+				printf("[ Roofline ] : ERROR : Could not open %s.\n", path);
+				return false;
+			}
+
+			const char* names[] = { "gravity", "spatial", "density", "pressure", "viscosity", "positions" };
+			file << "# bandwidth " << machineRoofline.bandwidth << " GB/s, peak " << machineRoofline.peakFlops << " GFLOP/s, "
+				<< rooflineParticles << " particles\n";
+			file << "phase,candidates,neighbours,kernel_evaluations,bytes,flops,ms,flops_per_byte,gflops,gbytes_per_s,attainable_gflops\n";
+			for (uint32 phase = 0; phase < (uint32)SimPhase::Count; phase++)
+			{
+				const PhaseRoofline& roofline = phaseRooflines[phase];
+				if (roofline.bytes <= 0.0) continue;
+				file << names[phase] << "," << roofline.candidates << "," << roofline.neighbours << "," << roofline.kernelEvaluations << ","
+					<< roofline.bytes << "," << roofline.flops << "," << roofline.ms << "," << roofline.intensity << ","
+					<< roofline.achieved << "," << roofline.bandwidth << "," << roofline.attainable << "\n";
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,352 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "sdfCollider.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <numeric>
+#include <unordered_map>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		namespace
+		{
+			// Closest point on triangle abc (Ericson, Real-Time Collision Detection 5.1.5). feature is 0 for the
+			// face, 1..3 for the vertices a, b, c and 4..6 for the edges ab, bc, ca.
+			glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, int& feature)
+			{
+				const glm::vec3 ab = b - a;
+				const glm::vec3 ac = c - a;
+				const glm::vec3 ap = p - a;
+				const float d1 = dot(ab, ap);
+				const float d2 = dot(ac, ap);
+				if (d1 <= 0 && d2 <= 0) { feature = 1; return a; }
+
+				const glm::vec3 bp = p - b;
+				const float d3 = dot(ab, bp);
+				const float d4 = dot(ac, bp);
+				if (d3 >= 0 && d4 <= d3) { feature = 2; return b; }
+
+				const float vc = d1 * d4 - d3 * d2;
+				if (vc <= 0 && d1 >= 0 && d3 <= 0) { feature = 4; return a + ab * (d1 / (d1 - d3)); }
+
+				const glm::vec3 cp = p - c;
+				const float d5 = dot(ab, cp);
+				const float d6 = dot(ac, cp);
+				if (d6 >= 0 && d5 <= d6) { feature = 3; return c; }
+
+				const float vb = d5 * d2 - d1 * d6;
+				if (vb <= 0 && d2 >= 0 && d6 <= 0) { feature = 6; return a + ac * (d2 / (d2 - d6)); }
+
+				const float va = d3 * d6 - d5 * d4;
+				if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) { feature = 5; return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))); }
+
+				const float denom = 1.0f / (va + vb + vc);
+				feature = 0;
+				return a + ab * (vb * denom) + ac * (vc * denom);
+			}
+		}
+
+		bool SdfCollider::Build(const std::vector<glm::vec3>& vertices, const std::vector<uint32>& indices, float inCellSize, float inBandWidth)
+		{
+			const uint32 triangleCount = indices.size() / 3;
+			if (indices.size() % 3 != 0)
+			{
+				printf("[ Collider ] : ERROR : Index count %zu is not a multiple of 3.\n", indices.size());
+				return false;
+			}
+			if (triangleCount == 0)
+			{
+				printf("[ Collider ] : ERROR : Mesh has no triangles.\n");
+				return false;
+			}
+			if (inCellSize <= 0.0f)
+			{
+				printf("[ Collider ] : ERROR : Cell size must be positive, got %f.\n", inCellSize);
+				return false;
+			}
+			for (uint32 index : indices)
+			{
+				if (index >= vertices.size())
+				{
+					printf("[ Collider ] : ERROR : Triangle index %u out of range.\n", index);
+					return false;
+				}
+			}
+
+			cellSize = inCellSize;
+			bandWidth = glm::max(inBandWidth, 2.0f * cellSize);
+
+			glm::vec3 meshMin = vertices[indices[0]];
+			glm::vec3 meshMax = meshMin;
+			for (uint32 index : indices)
+			{
+				meshMin = glm::min(meshMin, vertices[index]);
+				meshMax = glm::max(meshMax, vertices[index]);
+			}
+			const glm::vec3 extent = glm::max(meshMax - meshMin, glm::vec3(1e-6f));
+
+			// Exporters often split vertices along seams, the normals are accumulated over welded positions
+			// so every corner and edge sees all of its triangles.
+			std::unordered_map<uint64, uint32> weldMap;
+			std::vector<uint32> welded(indices.size());
+			for (size_t k = 0; k < indices.size(); k++)
+			{
+				const glm::u64vec3 quantized = glm::u64vec3(glm::round((vertices[indices[k]] - meshMin) / extent * 2097151.0f));
+				const uint64 key = quantized.x | (quantized.y << 21) | (quantized.z << 42);
+				welded[k] = weldMap.emplace(key, (uint32)weldMap.size()).first->second;
+			}
+
+			// Angle weighted pseudo normals (Baerentzen & Aanaes) give the right sign on edges and corners too.
+			std::vector<glm::vec3> faceNormals(triangleCount);
+			std::vector<glm::vec3> vertexNormals(weldMap.size(), glm::vec3(0, 0, 0));
+			std::vector<glm::vec3> edgeNormals(triangleCount * 3);
+			std::vector<glm::vec3> triangleMin(triangleCount);
+			std::vector<glm::vec3> triangleMax(triangleCount);
+			std::unordered_map<uint64, glm::vec3> edgeSums;
+			auto edgeKey = [](uint32 a, uint32 b) { return ((uint64)glm::min(a, b) << 32) | glm::max(a, b); };
+
+			for (uint32 t = 0; t < triangleCount; t++)
+			{
+				const glm::vec3 corner[3] = { vertices[indices[t * 3]], vertices[indices[t * 3 + 1]], vertices[indices[t * 3 + 2]] };
+				triangleMin[t] = glm::min(glm::min(corner[0], corner[1]), corner[2]);
+				triangleMax[t] = glm::max(glm::max(corner[0], corner[1]), corner[2]);
+
+				// Degenerate triangles are covered by their neighbours and skipped entirely.
+				glm::vec3 normal = cross(corner[1] - corner[0], corner[2] - corner[0]);
+				float area = glm::length(normal);
+				faceNormals[t] = area > 1e-7f * dot(extent, extent) ? normal / area : glm::vec3(0, 0, 0);
+				if (faceNormals[t] == glm::vec3(0, 0, 0)) continue;
+
+				for (int k = 0; k < 3; k++)
+				{
+					glm::vec3 e0 = corner[(k + 1) % 3] - corner[k];
+					glm::vec3 e1 = corner[(k + 2) % 3] - corner[k];
+					float angle = acosf(glm::clamp(dot(e0, e1) / (glm::length(e0) * glm::length(e1)), -1.0f, 1.0f));
+					vertexNormals[welded[t * 3 + k]] += faceNormals[t] * angle;
+					edgeSums[edgeKey(welded[t * 3 + k], welded[t * 3 + (k + 1) % 3])] += faceNormals[t];
+				}
+			}
+			for (uint32 t = 0; t < triangleCount; t++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					edgeNormals[t * 3 + k] = edgeSums[edgeKey(welded[t * 3 + k], welded[t * 3 + (k + 1) % 3])];
+				}
+			}
+
+			// One band plus a cell of padding keeps every node on the grid border outside the mesh.
+			const float padding = bandWidth + cellSize;
+			origin = meshMin - padding;
+			nodeCount = glm::ivec3(glm::ceil((meshMax - meshMin + 2.0f * padding) / cellSize)) + 1;
+			boundsMin = origin;
+			boundsMax = origin + glm::vec3(nodeCount - 1) * cellSize;
+
+			const uint32 nodeTotal = (uint32)nodeCount.x * nodeCount.y * nodeCount.z;
+			distances.assign(nodeTotal, FLT_MAX);
+			gradients.assign(nodeTotal, glm::vec3(0, 0, 0));
+
+			// Triangles are binned into bricks of nodes by their bounds grown by the band, so each node
+			// only tests the triangles that can be within the band of it.
+			const int brickSize = 4;
+			const glm::ivec3 brickCount = (nodeCount + brickSize - 1) / brickSize;
+			std::vector<std::vector<uint32>> brickTriangles((size_t)brickCount.x * brickCount.y * brickCount.z);
+			for (uint32 t = 0; t < triangleCount; t++)
+			{
+				if (faceNormals[t] == glm::vec3(0, 0, 0)) continue;
+				glm::ivec3 first = glm::clamp(glm::ivec3(glm::floor((triangleMin[t] - bandWidth - origin) / cellSize)) / brickSize, glm::ivec3(0), brickCount - 1);
+				glm::ivec3 last = glm::clamp(glm::ivec3(glm::ceil((triangleMax[t] + bandWidth - origin) / cellSize)) / brickSize, glm::ivec3(0), brickCount - 1);
+				for (int z = first.z; z <= last.z; z++)
+					for (int y = first.y; y <= last.y; y++)
+						for (int x = first.x; x <= last.x; x++)
+						{
+							brickTriangles[(z * brickCount.y + y) * brickCount.x + x].push_back(t);
+						}
+			}
+
+			std::vector<uint32> bricks(brickTriangles.size());
+			std::iota(bricks.begin(), bricks.end(), 0);
+			std::for_each(std::execution::par, bricks.begin(), bricks.end(),
+				[&](uint32_t brick)
+			{
+				const std::vector<uint32>& triangles = brickTriangles[brick];
+				if (triangles.empty()) return;
+
+				const glm::ivec3 brickCoord = { brick % brickCount.x, (brick / brickCount.x) % brickCount.y, brick / (brickCount.x * brickCount.y) };
+				const glm::ivec3 first = brickCoord * brickSize;
+				const glm::ivec3 last = glm::min(first + brickSize, nodeCount);
+				for (int z = first.z; z < last.z; z++)
+					for (int y = first.y; y < last.y; y++)
+						for (int x = first.x; x < last.x; x++)
+						{
+							// Only the band is searched, the triangle bounds reject most candidates before the exact test.
+							const glm::vec3 pos = origin + glm::vec3(x, y, z) * cellSize;
+							float nearest = bandWidth * bandWidth;
+							float sign = 0.0f;
+							for (uint32 t : triangles)
+							{
+								glm::vec3 boxOffset = glm::max(glm::max(triangleMin[t] - pos, pos - triangleMax[t]), 0.0f);
+								if (dot(boxOffset, boxOffset) >= nearest) continue;
+
+								int feature;
+								const uint32* tri = &indices[t * 3];
+								glm::vec3 closest = ClosestPointOnTriangle(pos, vertices[tri[0]], vertices[tri[1]], vertices[tri[2]], feature);
+								glm::vec3 offset = pos - closest;
+								float sqrDist = dot(offset, offset);
+								if (sqrDist >= nearest) continue;
+
+								glm::vec3 pseudoNormal = feature == 0 ? faceNormals[t] : feature <= 3 ? vertexNormals[welded[t * 3 + feature - 1]] : edgeNormals[t * 3 + feature - 4];
+								nearest = sqrDist;
+								sign = dot(offset, pseudoNormal) < 0.0f ? -1.0f : 1.0f;
+							}
+							if (sign != 0.0f)
+							{
+								distances[NodeIndex(x, y, z)] = sign * sqrtf(nearest);
+							}
+						}
+			});
+
+			// Nodes without a triangle within the band take the sign of the last known node along their row,
+			// rows start outside and every crossing of the surface passes through the band.
+			std::vector<uint32> rows((size_t)nodeCount.y * nodeCount.z);
+			std::iota(rows.begin(), rows.end(), 0);
+			std::for_each(std::execution::par, rows.begin(), rows.end(),
+				[this](uint32_t row)
+			{
+				const int y = row % nodeCount.y;
+				const int z = row / nodeCount.y;
+				float sign = 1.0f;
+				for (int x = 0; x < nodeCount.x; x++)
+				{
+					float& distance = distances[NodeIndex(x, y, z)];
+					if (distance == FLT_MAX)
+					{
+						distance = sign * bandWidth;
+					}
+					else
+					{
+						sign = distance < 0.0f ? -1.0f : 1.0f;
+					}
+				}
+			});
+
+			std::vector<uint32> nodes(nodeTotal);
+			std::iota(nodes.begin(), nodes.end(), 0);
+			std::for_each(std::execution::par, nodes.begin(), nodes.end(),
+				[this](uint32_t node)
+			{
+				const glm::ivec3 coord = { node % nodeCount.x, (node / nodeCount.x) % nodeCount.y, node / (nodeCount.x * nodeCount.y) };
+				glm::vec3 gradient;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					glm::ivec3 low = coord;
+					glm::ivec3 high = coord;
+					low[axis] = glm::max(coord[axis] - 1, 0);
+					high[axis] = glm::min(coord[axis] + 1, nodeCount[axis] - 1);
+					gradient[axis] = (distances[NodeIndex(high.x, high.y, high.z)] - distances[NodeIndex(low.x, low.y, low.z)]) / ((high[axis] - low[axis]) * cellSize);
+				}
+				float length = glm::length(gradient);
+				gradients[node] = length > 0.0f ? gradient / length : glm::vec3(0, 0, 0);
+			});
+
+			return true;
+		}
+
+		bool SdfCollider::Sample(const glm::vec3& pos, float& distance, glm::vec3& gradient) const
+		{
+			const glm::vec3 grid = (pos - origin) / cellSize;
+			const glm::ivec3 base = glm::ivec3(glm::floor(grid));
+			if (glm::any(glm::lessThan(base, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(base, nodeCount - 1))) return false;
+
+			const glm::vec3 t = grid - glm::vec3(base);
+			distance = 0.0f;
+			gradient = glm::vec3(0, 0, 0);
+			for (int corner = 0; corner < 8; corner++)
+			{
+				const glm::ivec3 offset = { corner & 1, (corner >> 1) & 1, (corner >> 2) & 1 };
+				const glm::vec3 weights = glm::mix(1.0f - t, t, glm::vec3(offset));
+				const float weight = weights.x * weights.y * weights.z;
+				const uint32 node = NodeIndex(base.x + offset.x, base.y + offset.y, base.z + offset.z);
+				distance += distances[node] * weight;
+				gradient += gradients[node] * weight;
+			}
+			return true;
+		}
+
+		uint32 SdfCollider::NodeIndex(int x, int y, int z) const
+		{
+			return ((uint32)z * nodeCount.y + y) * nodeCount.x + x;
+		}
+
+		bool SdfCollider::LoadOBJ(const char* path, std::vector<glm::vec3>& vertices, std::vector<uint32>& indices)
+		{
+			std::ifstream file(path);
+			if (!file.is_open())
+			{
+				printf("[ Collider ] : ERROR : Could not open %s.\n", path);
+				return false;
+			}
+
+			vertices.clear();
+			indices.clear();
+			std::string line;
+			std::vector<uint32> face;
+			while (std::getline(file, line))
+			{
+				std::istringstream stream(line);
+				std::string type;
+				stream >> type;
+				if (type == "v")
+				{
+					glm::vec3 vertex;
+					stream >> vertex.x >> vertex.y >> vertex.z;
+					vertices.push_back(vertex);
+				}
+				else if (type == "f")
+				{
+					// Only the position index is used, negative indices count back from the last vertex.
+					face.clear();
+					std::string token;
+					while (stream >> token)
+					{
+						int index = atoi(token.c_str());
+						if (index < 0) index += (int)vertices.size() + 1;
+						if (index <= 0 || index > (int)vertices.size())
+						{
+							printf("[ Collider ] : ERROR : Bad face index in %s.\n", path);
+							return false;
+						}
+						face.push_back(index - 1);
+					}
+					for (size_t k = 2; k < face.size(); k++)
+					{
+						indices.push_back(face[0]);
+						indices.push_back(face[k - 1]);
+						indices.push_back(face[k]);
+					}
+				}
+			}
+			return !indices.empty();
+		}
+	}
+}
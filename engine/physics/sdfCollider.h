@@ -0,0 +1,54 @@
+#pragma once
+
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <vector>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		// Static collider, a triangle mesh converted once into a signed distance grid. Distances are exact within
+		// bandWidth of the surface and clamped to it further away, negative inside. The mesh has to be closed.
+		class SdfCollider
+		{
+		public:
+			bool Build(const std::vector<glm::vec3>& vertices, const std::vector<uint32>& indices, float cellSize, float bandWidth);
+
+			// Reads the vertices and faces of a Wavefront OBJ, polygons are split into triangle fans.
+			static bool LoadOBJ(const char* path, std::vector<glm::vec3>& vertices, std::vector<uint32>& indices);
+
+			// Trilinear distance and cached gradient, false outside the grid.
+			bool Sample(const glm::vec3& pos, float& distance, glm::vec3& gradient) const;
+
+			glm::vec3 boundsMin = { 0,0,0 };
+			glm::vec3 boundsMax = { 0,0,0 };
+
+		private:
+			uint32 NodeIndex(int x, int y, int z) const;
+
+			glm::ivec3 nodeCount = { 0,0,0 };
+			glm::vec3 origin = { 0,0,0 };
+			float cellSize = 0.0f;
+			float bandWidth = 0.0f;
+
+			std::vector<float> distances;
+			std::vector<glm::vec3> gradients;
+		};
+	}
+}
@@ -0,0 +1,447 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+#include "kernels.h"
+#include "core/profiler.h"
+
+#include <chrono>
+#include <atomic>
+#include <fstream>
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		namespace
+		{
+			// A secondary particle is spray below this fraction of a cell's rest particle count and a bubble above the other.
+			constexpr float SprayRatio = 0.2f;
+			constexpr float BubbleRatio = 0.8f;
+			constexpr float SecondarySizes[] = { 0.06f, 0.1f, 0.05f };
+
+			// Ihmsen et al.'s clamped ramp that maps a potential to [0, 1].
+			float Ramp(float value, float low, float high)
+			{
+				return glm::clamp((value - low) / (high - low), 0.0f, 1.0f);
+			}
+		}
+
+		void FluidSimulation::setSecondaryParticles(bool status)
+		{
+			secondaryParticles = status;
+			secondaryCount = 0;
+		}
+
+		bool FluidSimulation::getSecondaryParticles()
+		{
+			return secondaryParticles;
+		}
+
+		void FluidSimulation::setSecondaryCapacity(uint32 value)
+		{
+			secondaryCapacity = value;
+		}
+
+		uint32 FluidSimulation::getSecondaryCapacity()
+		{
+			return secondaryCapacity;
+		}
+
+		void FluidSimulation::setSecondaryTrappedAirRate(float value)
+		{
+			secondaryTrappedAirRate = value;
+		}
+
+		float FluidSimulation::getSecondaryTrappedAirRate()
+		{
+			return secondaryTrappedAirRate;
+		}
+
+		void FluidSimulation::setSecondaryWaveCrestRate(float value)
+		{
+			secondaryWaveCrestRate = value;
+		}
+
+		float FluidSimulation::getSecondaryWaveCrestRate()
+		{
+			return secondaryWaveCrestRate;
+		}
+
+		void FluidSimulation::setSecondaryLifetime(float value)
+		{
+			secondaryLifetime = value;
+		}
+
+		float FluidSimulation::getSecondaryLifetime()
+		{
+			return secondaryLifetime;
+		}
+
+		void FluidSimulation::setSecondaryBuoyancy(float value)
+		{
+			secondaryBuoyancy = value;
+		}
+
+		float FluidSimulation::getSecondaryBuoyancy()
+		{
+			return secondaryBuoyancy;
+		}
+
+		void FluidSimulation::setSecondaryDrag(float value)
+		{
+			secondaryDrag = value;
+		}
+
+		float FluidSimulation::getSecondaryDrag()
+		{
+			return secondaryDrag;
+		}
+
+		uint32 FluidSimulation::getSecondaryCount()
+		{
+			return secondaryCount;
+		}
+
+		const Core::ArenaVector<glm::vec4>& FluidSimulation::getSecondaryPositions()
+		{
+			return secondaryPositions;
+		}
+
+		const Core::ArenaVector<uint8_t>& FluidSimulation::getSecondaryTypes()
+		{
+			return secondaryTypes;
+		}
+
+		double FluidSimulation::getElapsedTimeSecondary()
+		{
+			return ElapsedTimeSecondary;
+		}
+
+		bool FluidSimulation::exportSecondaryParticles(const char* path)
+		{
+			std::ofstream file(path, std::ios::binary);
+			if (!file.is_open())
+			{
+				printf("[ Secondary ] : ERROR : Could not open %s.\n", path);
+				return false;
+			}
+
+			file << "ply\nformat binary_little_endian 1.0\nelement vertex " << secondaryCount << "\n";
+			file << "property float x\nproperty float y\nproperty float z\nproperty uchar type\nend_header\n";
+			for (uint32 s = 0; s < secondaryCount; s++)
+			{
+				file.write((const char*)&secondaryPositions[s], 3 * sizeof(float));
+				file.write((const char*)&secondaryTypes[s], 1);
+			}
+			return true;
+		}
+
+		void FluidSimulation::UpdateSecondaryParticles(float deltatime)
+		{
+			PROFILE_ZONE("Secondary Particles");
+			// The FLIP grid keeps no spatial lookup to sample.
+			if (!secondaryParticles || solverType == SolverType::FLIP || deltatime <= 0.0f)
+			{
+				ElapsedTimeSecondary = 0.0;
+				return;
+			}
+
+			auto SecondaryStart = std::chrono::steady_clock::now();
+			if (secondaryPositions.size() != secondaryCapacity)
+			{
+				secondaryPositions.resize(secondaryCapacity, glm::vec4(0));
+				secondaryVelocities.resize(secondaryCapacity);
+				secondaryLifetimes.resize(secondaryCapacity);
+				secondaryTypes.resize(secondaryCapacity);
+				secondaryDead.assign(secondaryCapacity, 0);
+				secondaryList.resize(secondaryCapacity);
+				std::iota(secondaryList.begin(), secondaryList.end(), 0);
+				secondaryHoles.resize(secondaryCapacity);
+				secondaryMovers.resize(secondaryCapacity);
+				secondaryCount = glm::min(secondaryCount, secondaryCapacity);
+			}
+
+			// The state sampled is the one the previous step left, including its spatial lookup.
+			const bool fluidReady = numParticles > 0 && spatialLookup.size() >= numParticles;
+			if (fluidReady)
+			{
+				ResizeSecondaryCells();
+				BuildSecondaryCells();
+			}
+			else
+			{
+				secondaryGridSize = { 0,0,0 };
+			}
+			AdvectSecondaryParticles(deltatime);
+			CompactSecondaryParticles();
+			if (fluidReady)
+			{
+				SeedSecondaryParticles(deltatime);
+			}
+			auto SecondaryEnd = std::chrono::steady_clock::now();
+			ElapsedTimeSecondary = std::chrono::duration<double>(SecondaryEnd - SecondaryStart).count() * 1000.0f;
+		}
+
+		void FluidSimulation::ResizeSecondaryCells()
+		{
+			// Same cells as PositionToCellCoord, counted from the lower wall on periodic axes.
+			secondaryCellSize = glm::vec3(neighbourRadius);
+			secondaryGridOrigin = { 0,0,0 };
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (periodicCells[axis] == 0) continue;
+				secondaryCellSize[axis] = periodicCellSize[axis];
+				secondaryGridOrigin[axis] = -0.5f * BoundScale[axis];
+			}
+			secondaryInvCellSize = 1.0f / secondaryCellSize;
+
+			// The fluid never spans more than the bound, or its diagonal once the bound can turn. Two extra cells cover an
+			// extent straddling cell borders, so the grid only reallocates when the radius or the bound changes.
+			const glm::vec3 span = BoundAnimated() ? glm::vec3(glm::length(BoundScale)) : BoundScale;
+			glm::ivec3 capacity = glm::ivec3(ceil(span / secondaryCellSize)) + 2;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (periodicCells[axis] > 0) capacity[axis] = periodicCells[axis];
+			}
+			if (capacity != secondaryGridCapacity)
+			{
+				secondaryGridCapacity = capacity;
+				secondaryCells.resize((size_t)capacity.x * capacity.y * capacity.z);
+			}
+		}
+
+		void FluidSimulation::BuildSecondaryCells()
+		{
+			// A dense grid over the fluid's extent, nothing outside it can be near any fluid.
+			const glm::vec3 low = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), glm::vec3(FLT_MAX),
+				[](const glm::vec3& a, const glm::vec3& b) { return glm::min(a, b); },
+				[this](uint32_t i) { return predictedPositions[i]; });
+			const glm::vec3 high = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), glm::vec3(-FLT_MAX),
+				[](const glm::vec3& a, const glm::vec3& b) { return glm::max(a, b); },
+				[this](uint32_t i) { return predictedPositions[i]; });
+			secondaryGridMin = glm::ivec3(floor((low - secondaryGridOrigin) / secondaryCellSize));
+			secondaryGridSize = glm::ivec3(floor((high - secondaryGridOrigin) / secondaryCellSize)) - secondaryGridMin + 1;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (periodicCells[axis] == 0) continue;
+				secondaryGridMin[axis] = 0;
+				secondaryGridSize[axis] = periodicCells[axis];
+			}
+			// Anything past the allocated grid is sampled as empty.
+			secondaryGridSize = glm::clamp(secondaryGridSize, glm::ivec3(1), secondaryGridCapacity);
+			const size_t cellCount = (size_t)secondaryGridSize.x * secondaryGridSize.y * secondaryGridSize.z;
+
+			// Each cell is filled from its run in the spatial lookup, entries of other cells sharing the key are skipped.
+			std::for_each(std::execution::par, secondaryCells.begin(), secondaryCells.begin() + cellCount,
+				[this](glm::vec4& cell)
+			{
+				const uint32 index = &cell - secondaryCells.data();
+				const glm::vec3 coord = secondaryGridMin + glm::ivec3(index % secondaryGridSize.x,
+					(index / secondaryGridSize.x) % secondaryGridSize.y, index / (secondaryGridSize.x * secondaryGridSize.y));
+				const uint32_t hash = HashCell(coord);
+				const uint32_t key = GetKeyFromHash(hash, particleCapacity);
+
+				cell = { 0,0,0,0 };
+				for (uint32 k = startIndices[key]; k < numParticles && spatialLookup[k].z == key; k++)
+				{
+					if (spatialLookup[k].y != hash) continue;
+					cell += glm::vec4(velocity[(uint32_t)spatialLookup[k].x], 1.0f);
+				}
+				if (cell.w > 0.0f)
+				{
+					cell = glm::vec4(glm::vec3(cell) / cell.w, cell.w);
+				}
+			});
+		}
+
+		glm::vec4 FluidSimulation::SampleSecondaryCells(const glm::vec3& pos)
+		{
+			// Trilinear between the cell centres, weighted by how many particles each cell holds. The two cells and weights
+			// per axis are resolved first, a cell outside the grid gets no weight.
+			const glm::vec3 coord = (pos - secondaryGridOrigin) * secondaryInvCellSize - 0.5f;
+			int cells[3][2];
+			float weights[3][2];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				// Truncation corrected below zero is floor without the libm call.
+				int base = (int)coord[axis];
+				base -= coord[axis] < base;
+				const float t = coord[axis] - base;
+				const int size = secondaryGridSize[axis];
+				for (int side = 0; side < 2; side++)
+				{
+					int cell = base - secondaryGridMin[axis] + side;
+					if (periodicCells[axis] > 0)
+					{
+						cell += cell < 0 ? size : cell >= size ? -size : 0;
+					}
+					const bool inside = cell >= 0 && cell < size;
+					cells[axis][side] = inside ? cell : 0;
+					weights[axis][side] = inside ? (side ? t : 1.0f - t) : 0.0f;
+				}
+			}
+
+			glm::vec3 velocitySum = { 0,0,0 };
+			float count = 0.0f;
+			for (int z = 0; z < 2; z++)
+			{
+				for (int y = 0; y < 2; y++)
+				{
+					const size_t row = ((size_t)cells[2][z] * secondaryGridSize.y + cells[1][y]) * secondaryGridSize.x;
+					const float weightZY = weights[2][z] * weights[1][y];
+					for (int x = 0; x < 2; x++)
+					{
+						const glm::vec4& data = secondaryCells[row + cells[0][x]];
+						const float weight = weightZY * weights[0][x] * data.w;
+						velocitySum += glm::vec3(data) * weight;
+						count += weight;
+					}
+				}
+			}
+			return { count > 0.0f ? velocitySum / count : glm::vec3(0), count };
+		}
+
+		void FluidSimulation::AdvectSecondaryParticles(float deltatime)
+		{
+			// Ihmsen et al. 2012, spray is ballistic, foam follows the fluid and bubbles rise against its drag.
+			const float restCount = TargetDensity * neighbourRadius * neighbourRadius * neighbourRadius;
+			std::for_each(std::execution::par, secondaryList.begin(), secondaryList.begin() + secondaryCount,
+				[this, deltatime, restCount](uint32_t s)
+			{
+				glm::vec3 pos = secondaryPositions[s];
+				glm::vec3 velo = secondaryVelocities[s];
+				const glm::vec4 fluid = SampleSecondaryCells(pos);
+				const float ratio = fluid.w / restCount;
+				const SecondaryType type = ratio < SprayRatio ? SecondaryType::Spray : ratio > BubbleRatio ? SecondaryType::Bubble : SecondaryType::Foam;
+
+				if (type == SecondaryType::Spray)
+				{
+					velo += CalculateExternalFoce(pos, velo) * deltatime;
+				}
+				else if (type == SecondaryType::Foam)
+				{
+					velo = glm::vec3(fluid);
+					secondaryLifetimes[s] -= deltatime;
+				}
+				else
+				{
+					velo += -secondaryBuoyancy * CalculateExternalFoce(pos, velo) * deltatime + secondaryDrag * (glm::vec3(fluid) - velo);
+				}
+				pos += velo * deltatime;
+				if (periodicActive) WrapPosition(pos);
+
+				// Spray that reaches a wall without landing in the fluid is gone.
+				glm::vec3 clamped = pos;
+				ClampToBound(clamped);
+				secondaryDead[s] = secondaryLifetimes[s] <= 0.0f || (type == SecondaryType::Spray && clamped != pos);
+
+				secondaryPositions[s] = glm::vec4(clamped, SecondarySizes[(int)type]);
+				secondaryVelocities[s] = velo;
+				secondaryTypes[s] = (uint8_t)type;
+			});
+		}
+
+		void FluidSimulation::CompactSecondaryParticles()
+		{
+			// Same hole filling as CompactParticles.
+			const uint32 deadCount = (uint32)std::count(std::execution::par, secondaryDead.begin(), secondaryDead.begin() + secondaryCount, 1);
+			if (deadCount == 0) return;
+
+			const uint32 liveCount = secondaryCount - deadCount;
+			std::copy_if(std::execution::par, secondaryList.begin(), secondaryList.begin() + liveCount, secondaryHoles.begin(),
+				[this](uint32_t s) { return secondaryDead[s] != 0; });
+			auto moversEnd = std::copy_if(std::execution::par, secondaryList.begin() + liveCount, secondaryList.begin() + secondaryCount, secondaryMovers.begin(),
+				[this](uint32_t s) { return secondaryDead[s] == 0; });
+
+			std::for_each(std::execution::par, secondaryMovers.begin(), moversEnd,
+				[this](uint32_t& from)
+			{
+				uint32 to = secondaryHoles[&from - secondaryMovers.data()];
+				secondaryPositions[to] = secondaryPositions[from];
+				secondaryVelocities[to] = secondaryVelocities[from];
+				secondaryLifetimes[to] = secondaryLifetimes[from];
+				secondaryTypes[to] = secondaryTypes[from];
+			});
+
+			std::fill(std::execution::par, secondaryDead.begin(), secondaryDead.begin() + secondaryCount, 0);
+			secondaryCount = liveCount;
+		}
+
+		void FluidSimulation::SeedSecondaryParticles(float deltatime)
+		{
+			// Ihmsen et al. 2012, energetic particles emit where they trap air against a neighbour or lead a crest out of
+			// the surface. Calm particles skip the neighbour loop.
+			secondarySeed++;
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, deltatime](uint32_t i)
+			{
+				const glm::vec3& velo = velocity[i];
+				const float speedSqr = dot(velo, velo);
+				const float energy = Ramp(0.5f * particleMass[i] * speedSqr, 0.5f, 5.0f);
+				if (energy <= 0.0f) return;
+
+				float trappedAir = 0.0f;
+				glm::vec3 normal = { 0,0,0 };
+				ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3& offsetToNeighbour, float sqrDist)
+				{
+					float dist = sqrt(sqrDist);
+					if (neighborIndex == i || dist <= 0) return;
+
+					glm::vec3 dir = offsetToNeighbour / dist;
+					float radius = PairRadius(i, neighborIndex);
+					glm::vec3 relative = velo - velocity[neighborIndex];
+					float relativeSpeed = glm::length(relative);
+					if (relativeSpeed > 0)
+					{
+						trappedAir += relativeSpeed * (1.0f + dot(relative / relativeSpeed, dir)) * glm::max(1.0f - dist / radius, 0.0f);
+					}
+					// Points away from the neighbours, out of the fluid at the surface.
+					normal += dir * (particleMass[neighborIndex] / densities[neighborIndex].x * kernels::SmoothingDerivativePow2(dist, radius));
+				});
+
+				const float normalLength = glm::length(normal);
+				const float surface = glm::clamp(1.0f - densities[i].x / phaseRestDensity[particlePhase[i]], 0.0f, 1.0f);
+				const bool leading = normalLength > 0 && dot(velo, normal) > 0.6f * normalLength * sqrt(speedSqr);
+				const float rate = secondaryTrappedAirRate * Ramp(trappedAir, 5.0f, 20.0f) + secondaryWaveCrestRate * Ramp(leading ? surface : 0.0f, 0.1f, 0.5f);
+
+				uint32 state = ((i * 0x9E3779B9u) ^ (secondarySeed * 0x85EBCA6Bu)) | 1u;
+				const uint32 count = (uint32)(rate * energy * deltatime + PoolRandom(state));
+				if (count == 0) return;
+
+				const uint32 first = std::atomic_ref<uint32>(secondaryCount).fetch_add(count, std::memory_order_relaxed);
+				const uint32 last = glm::min(first + count, secondaryCapacity);
+				const float spacing = cbrtf(particleMass[i] / TargetDensity);
+				for (uint32 s = first; s < last; s++)
+				{
+					glm::vec3 u = { PoolRandom(state), PoolRandom(state), PoolRandom(state) };
+					glm::vec3 pos = positions[i] + (u * 2.0f - 1.0f) * 0.5f * spacing;
+					ClampToBound(pos);
+					secondaryPositions[s] = glm::vec4(pos, SecondarySizes[(int)SecondaryType::Foam]);
+					secondaryVelocities[s] = velo;
+					secondaryLifetimes[s] = secondaryLifetime * (0.5f + u.x);
+					secondaryTypes[s] = (uint8_t)SecondaryType::Foam;
+				}
+			});
+			secondaryCount = glm::min(secondaryCount, secondaryCapacity);
+		}
+	}
+}
@@ -0,0 +1,114 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+
+#include <atomic>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		void FluidSimulation::BuildAwakeList()
+		{
+			if (!sleeping) return;
+
+			awakeList.resize(pList.size());
+			auto awakeEnd = std::copy_if(std::execution::par, pList.begin(), pList.end(), awakeList.begin(),
+				[this](uint32_t i)
+			{
+				return !blockAsleep[particleBlocks[i]];
+			});
+			awakeList.resize(awakeEnd - awakeList.begin());
+			awakeCount = awakeList.size();
+		}
+
+		void FluidSimulation::UpdateSleepState()
+		{
+			if (!sleeping) return;
+
+			std::fill(std::execution::par, blockRestless.begin(), blockRestless.end(), 0);
+			std::fill(std::execution::par, blockWake.begin(), blockWake.end(), 0);
+			std::fill(std::execution::par, blockOccupied.begin(), blockOccupied.end(), 0);
+
+			// Sleeping particles don't move, so only awake ones can change block or disturb one.
+			std::for_each(std::execution::par, awakeList.begin(), awakeList.end(),
+				[this](uint32_t i)
+			{
+				uint32 slot = BlockSlot(positions[i]);
+				particleBlocks[i] = slot;
+				std::atomic_ref<uint8_t>(blockOccupied[slot]).store(1, std::memory_order_relaxed);
+
+				bool restless = glm::length(velocity[i]) > sleepVelocity ||
+					densities[i].x - phaseRestDensity[particlePhase[i]] > sleepDensityError * phaseRestDensity[particlePhase[i]];
+				if (!restless) return;
+
+				std::atomic_ref<uint8_t>(blockRestless[slot]).store(1, std::memory_order_relaxed);
+
+				// Wake every block within the interaction radius, the corners of that box cover them
+				// as long as a block is at least one radius wide.
+				for (int corner = 0; corner < 8; corner++)
+				{
+					glm::vec3 offset = { corner & 1 ? 1 : -1, corner & 2 ? 1 : -1, corner & 4 ? 1 : -1 };
+					uint32 neighbourSlot = BlockSlot(positions[i] + offset * interactionRadius);
+					std::atomic_ref<uint8_t>(blockWake[neighbourSlot]).store(1, std::memory_order_relaxed);
+				}
+			});
+
+			std::for_each(std::execution::par, blockSlots.begin(), blockSlots.end(),
+				[this](uint32_t slot)
+			{
+				if (blockWake[slot] || blockRestless[slot])
+				{
+					blockCalm[slot] = 0;
+					blockAsleep[slot] = 0;
+				}
+				else if (blockOccupied[slot])
+				{
+					blockCalm[slot] = glm::min(blockCalm[slot] + 1, sleepSteps);
+					blockAsleep[slot] = blockCalm[slot] >= sleepSteps;
+				}
+			});
+
+			// Particles going to sleep settle completely, so they wake up at rest.
+			std::for_each(std::execution::par, awakeList.begin(), awakeList.end(),
+				[this](uint32_t i)
+			{
+				if (blockAsleep[particleBlocks[i]])
+				{
+					velocity[i] = glm::vec3(0, 0, 0);
+					predictedPositions[i] = positions[i];
+				}
+			});
+		}
+
+		void FluidSimulation::WakeAll()
+		{
+			std::fill(blockAsleep.begin(), blockAsleep.end(), 0);
+			std::fill(blockCalm.begin(), blockCalm.end(), 0);
+		}
+
+		uint32 FluidSimulation::BlockSlot(const glm::vec3& pos)
+		{
+			glm::vec3 block = floor(pos / (interactionRadius * sleepBlockCells));
+			return GetKeyFromHash(HashCell(block), blockSlots.size());
+		}
+	}
+}
@@ -0,0 +1,201 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "config.h"
+#include "physicsWorld.h"
+
+#include "kernels.h"
+
+#include <numeric>
+#include <execution>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		void FluidSimulation::UpdateViscosity(const Core::ArenaVector<uint32>& workList, float deltatime)
+		{
+			// The implicit solve couples every particle, so it always runs over the whole of pList.
+			if (!implicitViscosity)
+			{
+				std::for_each(std::execution::par, workList.begin(), workList.end(),
+					[this, deltatime](uint32_t i)
+				{
+					CalculateViscosityForce(i, deltatime);
+				});
+				viscosityIterations = 0;
+				viscosityResidual = 0.0f;
+				return;
+			}
+
+			BuildNeighbourGraph();
+			SolveImplicitViscosity(deltatime);
+		}
+
+		void FluidSimulation::BuildNeighbourGraph()
+		{
+			neighbourStart.resize(numParticles + 1);
+			std::fill(std::execution::par, neighbourStart.begin(), neighbourStart.end(), 0);
+
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				uint32 count = 0;
+				ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3&, float)
+				{
+					if (neighborIndex != i) count++;
+				});
+				neighbourStart[i] = count;
+			});
+			std::exclusive_scan(neighbourStart.begin(), neighbourStart.end(), neighbourStart.begin(), 0u);
+
+			// Sized for the budget in InitializeData, only a pile-up denser than that grows the edge arrays.
+			viscosityEdgeCount = neighbourStart[numParticles];
+			if (viscosityEdgeCount > neighbourList.size())
+			{
+				neighbourList.resize(viscosityEdgeCount);
+				viscosityWeights.resize(viscosityEdgeCount);
+			}
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				uint32 k = neighbourStart[i];
+				ForEachNeighbour(predictedPositions[i], [&](uint32_t neighborIndex, const glm::vec3&, float sqrDist)
+				{
+					if (neighborIndex == i) return;
+					neighbourList[k] = neighborIndex;
+					// Harmonic mean of the masses keeps the matrix symmetric with adaptive resolution.
+					float mass = 2.0f * particleMass[i] * particleMass[neighborIndex] / (particleMass[i] + particleMass[neighborIndex]);
+					float pairViscosity = 0.5f * (phaseViscosity[particlePhase[i]] + phaseViscosity[particlePhase[neighborIndex]]);
+					viscosityWeights[k] = mass * pairViscosity * kernels::SmoothingViscoPoly6(sqrt(sqrDist), PairRadius(i, neighborIndex));
+					k++;
+				});
+			});
+		}
+
+		void FluidSimulation::ApplyViscosityMatrix(const Core::ArenaVector<glm::vec3>& in, Core::ArenaVector<glm::vec3>& out, float scale)
+		{
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, &in, &out, scale](uint32_t i)
+			{
+				glm::vec3 laplacian = { 0,0,0 };
+				for (uint32 k = neighbourStart[i]; k < neighbourStart[i + 1]; k++)
+				{
+					laplacian += (in[i] - in[neighbourList[k]]) * viscosityWeights[k];
+				}
+				out[i] = in[i] + laplacian * scale;
+			});
+		}
+
+		void FluidSimulation::SolveImplicitViscosity(float deltatime)
+		{
+			// Backward Euler on the same blend CalculateViscosityForce applies explicitly, the system
+			// is symmetric positive definite so it stays stable for any strength and step size.
+			const float scale = viscosityStrength * deltatime;
+
+			// Sized for the whole pool, so spawning and killing neither reallocates nor drops the warm start.
+			viscosityPrecond.resize(particleCapacity);
+			viscosityRhs.resize(particleCapacity);
+			viscosityResiduals.resize(particleCapacity);
+			viscositySearch.resize(particleCapacity);
+			viscosityApplied.resize(particleCapacity);
+
+			// Start from the previous step's velocities plus the change the last solve made to them.
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this, scale](uint32_t i)
+			{
+				float diagonal = 1.0f;
+				for (uint32 k = neighbourStart[i]; k < neighbourStart[i + 1]; k++)
+				{
+					diagonal += viscosityWeights[k] * scale;
+				}
+				viscosityPrecond[i] = 1.0f / diagonal;
+				viscosityRhs[i] = velocity[i];
+				velocity[i] += viscosityDelta[i];
+			});
+
+			auto dotProduct = [this](const Core::ArenaVector<glm::vec3>& a, const Core::ArenaVector<glm::vec3>& b)
+			{
+				return std::transform_reduce(std::execution::par, pList.begin(), pList.end(), glm::dvec3(0), std::plus<glm::dvec3>(),
+					[&a, &b](uint32_t i)
+				{
+					return glm::dvec3(a[i] * b[i]);
+				});
+			};
+
+			ApplyViscosityMatrix(velocity, viscosityApplied, scale);
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				viscosityResiduals[i] = viscosityRhs[i] - viscosityApplied[i];
+				viscositySearch[i] = viscosityResiduals[i] * viscosityPrecond[i];
+			});
+
+			// The three velocity components share the matrix and are solved side by side.
+			glm::dvec3 rz = dotProduct(viscosityResiduals, viscositySearch);
+			glm::dvec3 rhsSqr = dotProduct(viscosityRhs, viscosityRhs);
+			const double targetSqr = viscosityTolerance * viscosityTolerance * glm::max(rhsSqr.x + rhsSqr.y + rhsSqr.z, 1e-12);
+			glm::dvec3 residualSqr = dotProduct(viscosityResiduals, viscosityResiduals);
+
+			viscosityIterations = 0;
+			while (viscosityIterations < viscosityMaxIterations && residualSqr.x + residualSqr.y + residualSqr.z > targetSqr)
+			{
+				ApplyViscosityMatrix(viscositySearch, viscosityApplied, scale);
+				glm::dvec3 curvature = dotProduct(viscositySearch, viscosityApplied);
+				glm::vec3 alpha = glm::vec3(
+					curvature.x > 0.0 ? rz.x / curvature.x : 0.0,
+					curvature.y > 0.0 ? rz.y / curvature.y : 0.0,
+					curvature.z > 0.0 ? rz.z / curvature.z : 0.0);
+
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this, alpha](uint32_t i)
+				{
+					velocity[i] += alpha * viscositySearch[i];
+					viscosityResiduals[i] -= alpha * viscosityApplied[i];
+				});
+
+				glm::dvec3 rzNext = std::transform_reduce(std::execution::par, pList.begin(), pList.end(), glm::dvec3(0), std::plus<glm::dvec3>(),
+					[this](uint32_t i)
+				{
+					return glm::dvec3(viscosityResiduals[i] * viscosityResiduals[i] * viscosityPrecond[i]);
+				});
+				glm::vec3 beta = glm::vec3(
+					rz.x > 0.0 ? rzNext.x / rz.x : 0.0,
+					rz.y > 0.0 ? rzNext.y / rz.y : 0.0,
+					rz.z > 0.0 ? rzNext.z / rz.z : 0.0);
+				rz = rzNext;
+
+				std::for_each(std::execution::par, pList.begin(), pList.end(),
+					[this, beta](uint32_t i)
+				{
+					viscositySearch[i] = viscosityResiduals[i] * viscosityPrecond[i] + beta * viscositySearch[i];
+				});
+
+				residualSqr = dotProduct(viscosityResiduals, viscosityResiduals);
+				viscosityIterations++;
+			}
+			viscosityResidual = sqrt((residualSqr.x + residualSqr.y + residualSqr.z) / glm::max(rhsSqr.x + rhsSqr.y + rhsSqr.z, 1e-12));
+
+			std::for_each(std::execution::par, pList.begin(), pList.end(),
+				[this](uint32_t i)
+			{
+				viscosityDelta[i] = velocity[i] - viscosityRhs[i];
+			});
+		}
+	}
+}
@@ -0,0 +1,311 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "baseline.h"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <cstdarg>
+#include <cmath>
+
+#ifdef __linux__
+#include <sys/utsname.h>
+#endif
+
+namespace Bench
+{
+	namespace
+	{
+		void Append(std::string& out, const char* format, ...)
+		{
+			char line[512];
+			va_list args;
+			va_start(args, format);
+			vsnprintf(line, sizeof(line), format, args);
+			va_end(args);
+			out += line;
+		}
+
+		bool Counted(const PhaseResult& result)
+		{
+			return result.ipc >= 0.0 || result.llcMissesPerParticle >= 0.0 || result.branchMissesPerParticle >= 0.0;
+		}
+
+		std::string CpuName()
+		{
+#ifdef __linux__
+			std::ifstream cpuInfo("/proc/cpuinfo");
+			std::string line;
+			while (std::getline(cpuInfo, line))
+			{
+				if (line.rfind("model name", 0) != 0) continue;
+				const size_t colon = line.find(':');
+				if (colon != std::string::npos) return line.substr(line.find_first_not_of(' ', colon + 1));
+			}
+#endif
+			return "unknown";
+		}
+	}
+
+	const char* Baseline::Find(const char* key) const
+	{
+		for (const std::pair<std::string, std::string>& entry : header)
+		{
+			if (entry.first == key) return entry.second.c_str();
+		}
+		return nullptr;
+	}
+
+	std::vector<std::pair<std::string, std::string>> MachineFingerprint()
+	{
+		std::vector<std::pair<std::string, std::string>> fingerprint;
+		fingerprint.push_back({ "cpu", CpuName() });
+		fingerprint.push_back({ "logical cores", std::to_string(std::thread::hardware_concurrency()) });
+#ifdef __linux__
+		utsname system;
+		if (uname(&system) == 0) fingerprint.push_back({ "os", std::string(system.sysname) + " " + system.release });
+#elif defined(_WIN32)
+		fingerprint.push_back({ "os", "Windows" });
+#endif
+#if defined(__clang__)
+		fingerprint.push_back({ "compiler", "Clang " __clang_version__ });
+#elif defined(__GNUC__)
+		fingerprint.push_back({ "compiler", "GCC " __VERSION__ });
+#elif defined(_MSC_VER)
+		fingerprint.push_back({ "compiler", "MSVC " + std::to_string(_MSC_VER) });
+#endif
+		std::string build;
+#ifdef NDEBUG
+		build = "release";
+#else
+		build = "debug";
+#endif
+#ifdef FLUIDSIM_ARENA
+		build += ", arena";
+#endif
+#ifdef FLUIDSIM_PROFILER
+		build += ", profiler";
+#endif
+		fingerprint.push_back({ "build", build });
+		return fingerprint;
+	}
+
+	bool SaveBaseline(const char* path, const Baseline& baseline)
+	{
+		std::ofstream file(path);
+		if (!file.is_open())
+		{
+			printf("[ Benchmark ] : ERROR : Could not open %s.\n", path);
+			return false;
+		}
+
+		file << "# FluidSim benchmark baseline\n";
+		for (const std::pair<std::string, std::string>& entry : baseline.header)
+		{
+			file << "# " << entry.first << ": " << entry.second << "\n";
+		}
+		file << "scene,phase,samples,mean_ms,stddev_ms,ci_low_ms,ci_high_ms,ipc,llc_miss_per_particle,branch_miss_per_particle\n";
+		file.precision(9);
+		for (const PhaseResult& result : baseline.results)
+		{
+			file << result.scene << "," << result.phase << "," << result.summary.count << "," << result.summary.mean << ","
+				<< result.summary.stddev << "," << result.summary.ciLow << "," << result.summary.ciHigh << "," << result.ipc << ","
+				<< result.llcMissesPerParticle << "," << result.branchMissesPerParticle << "\n";
+		}
+		if (baseline.accuracy.empty()) return true;
+
+		file << "scene,metric,mean,max\n";
+		for (const AccuracyResult& result : baseline.accuracy)
+		{
+			file << result.scene << "," << result.metric << "," << result.mean << "," << result.max << "\n";
+		}
+		return true;
+	}
+
+	bool LoadBaseline(const char* path, Baseline& baseline)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			printf("[ Benchmark ] : ERROR : Could not open %s.\n", path);
+			return false;
+		}
+
+		baseline = {};
+		std::string line;
+		bool accuracySection = false;
+		while (std::getline(file, line))
+		{
+			if (!line.empty() && line.back() == '\r') line.pop_back();
+			if (line.rfind("scene,", 0) == 0)
+			{
+				accuracySection = line.rfind("scene,metric,", 0) == 0;
+				continue;
+			}
+			if (line.empty()) continue;
+			if (line[0] == '#')
+			{
+				const size_t colon = line.find(": ");
+				if (colon != std::string::npos) baseline.header.push_back({ line.substr(2, colon - 2), line.substr(colon + 2) });
+				continue;
+			}
+
+			std::stringstream row(line);
+			if (accuracySection)
+			{
+				AccuracyResult result;
+				std::string mean, max;
+				std::getline(row, result.scene, ',');
+				std::getline(row, result.metric, ',');
+				if (!std::getline(row, mean, ',') || !std::getline(row, max, ','))
+				{
+					printf("[ Benchmark ] : ERROR : Malformed row in %s: %s\n", path, line.c_str());
+					return false;
+				}
+				result.mean = atof(mean.c_str());
+				result.max = atof(max.c_str());
+				baseline.accuracy.push_back(result);
+				continue;
+			}
+
+			PhaseResult result;
+			std::string field;
+			std::getline(row, result.scene, ',');
+			std::getline(row, result.phase, ',');
+			double values[5] = {};
+			uint32 parsed = 0;
+			while (parsed < 5 && std::getline(row, field, ','))
+			{
+				values[parsed++] = atof(field.c_str());
+			}
+			if (parsed < 5)
+			{
+				printf("[ Benchmark ] : ERROR : Malformed row in %s: %s\n", path, line.c_str());
+				return false;
+			}
+			result.summary = { (uint32)values[0], values[1], values[2], values[3], values[4] };
+
+			// Baselines from before the counter columns end here.
+			double* counters[3] = { &result.ipc, &result.llcMissesPerParticle, &result.branchMissesPerParticle };
+			for (double* counter : counters)
+			{
+				if (std::getline(row, field, ',') && !field.empty()) *counter = atof(field.c_str());
+			}
+			baseline.results.push_back(result);
+		}
+		return true;
+	}
+
+	uint32 CompareBaselines(const Baseline& baseline, const Baseline& current, const CompareOptions& options, std::string& report)
+	{
+		// Numbers from another machine or build only compare loosely, say so up front.
+		for (const std::pair<std::string, std::string>& entry : baseline.header)
+		{
+			const char* now = current.Find(entry.first.c_str());
+			if (now != nullptr && entry.second != now)
+			{
+				Append(report, "WARNING: %s differs, baseline \"%s\", now \"%s\"\n", entry.first.c_str(), entry.second.c_str(), now);
+			}
+		}
+
+		Append(report, "%-28s %-10s %10s %8s %10s %8s %8s %9s  %s\n", "scene", "phase", "base ms", "+-95%", "now ms", "+-95%", "change", "p", "verdict");
+		uint32 regressions = 0;
+		uint32 improvements = 0;
+		uint32 compared = 0;
+		for (const PhaseResult& base : baseline.results)
+		{
+			const PhaseResult* now = nullptr;
+			for (const PhaseResult& result : current.results)
+			{
+				if (result.scene == base.scene && result.phase == base.phase) now = &result;
+			}
+			if (now == nullptr)
+			{
+				Append(report, "%-28s %-10s %10.3f %8.3f %10s %8s %8s %9s  missing\n", base.scene.c_str(), base.phase.c_str(), base.summary.mean,
+					base.summary.ciHigh - base.summary.mean, "-", "-", "-", "-");
+				continue;
+			}
+
+			const Core::WelchResult test = Core::WelchTest(base.summary, now->summary);
+			const double delta = now->summary.mean - base.summary.mean;
+			const double change = base.summary.mean > 0.0 ? delta / base.summary.mean : 0.0;
+			const bool significant = test.p < options.alpha && std::abs(change) > options.threshold && std::abs(delta) >= options.minimumMs;
+			const char* verdict = !significant ? "" : delta > 0.0 ? "REGRESSION" : "improved";
+			regressions += significant && delta > 0.0;
+			improvements += significant && delta < 0.0;
+			compared++;
+
+			Append(report, "%-28s %-10s %10.3f %8.3f %10.3f %8.3f %+7.1f%% %9.2g  %s\n", base.scene.c_str(), base.phase.c_str(), base.summary.mean,
+				base.summary.ciHigh - base.summary.mean, now->summary.mean, now->summary.ciHigh - now->summary.mean, change * 100.0, test.p, verdict);
+		}
+
+		// Counters explain a timing change, they are listed where both runs have them and never fail a run.
+		bool countersHeader = false;
+		for (const PhaseResult& base : baseline.results)
+		{
+			const PhaseResult* now = nullptr;
+			for (const PhaseResult& result : current.results)
+			{
+				if (result.scene == base.scene && result.phase == base.phase) now = &result;
+			}
+			if (now == nullptr || !Counted(base) || !Counted(*now)) continue;
+			if (!countersHeader)
+			{
+				Append(report, "\n%-28s %-10s %8s %8s %12s %12s %12s %12s\n", "scene", "phase", "base IPC", "now IPC", "base LLC/p", "now LLC/p",
+					"base br/p", "now br/p");
+				countersHeader = true;
+			}
+			char values[6][16];
+			const double columns[6] = { base.ipc, now->ipc, base.llcMissesPerParticle, now->llcMissesPerParticle, base.branchMissesPerParticle,
+				now->branchMissesPerParticle };
+			for (uint32 column = 0; column < 6; column++)
+			{
+				if (columns[column] < 0.0) snprintf(values[column], sizeof(values[column]), "-");
+				else snprintf(values[column], sizeof(values[column]), "%.3f", columns[column]);
+			}
+			Append(report, "%-28s %-10s %8s %8s %12s %12s %12s %12s\n", base.scene.c_str(), base.phase.c_str(), values[0], values[1], values[2],
+				values[3], values[4], values[5]);
+		}
+
+		if (!baseline.accuracy.empty())
+		{
+			Append(report, "\n%-28s %-20s %12s %12s %8s %12s %12s\n", "scene", "accuracy", "base mean", "now mean", "change", "base max", "now max");
+		}
+		for (const AccuracyResult& base : baseline.accuracy)
+		{
+			const AccuracyResult* now = nullptr;
+			for (const AccuracyResult& result : current.accuracy)
+			{
+				if (result.scene == base.scene && result.metric == base.metric) now = &result;
+			}
+			if (now == nullptr)
+			{
+				Append(report, "%-28s %-20s %12.4g %12s %8s %12.4g %12s\n", base.scene.c_str(), base.metric.c_str(), base.mean, "-", "-", base.max, "-");
+				continue;
+			}
+			const double change = base.mean != 0.0 ? (now->mean - base.mean) / std::abs(base.mean) : 0.0;
+			Append(report, "%-28s %-20s %12.4g %12.4g %+7.1f%% %12.4g %12.4g\n", base.scene.c_str(), base.metric.c_str(), base.mean, now->mean,
+				change * 100.0, base.max, now->max);
+		}
+
+		Append(report, "%u regressions, %u improvements over %u phases (threshold %.1f%%, alpha %g).\n", regressions, improvements, compared,
+			options.threshold * 100.0, options.alpha);
+		return regressions;
+	}
+}
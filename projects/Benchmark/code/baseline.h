@@ -0,0 +1,76 @@
+#pragma once
+
+
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <vector>
+#include <string>
+#include <utility>
+#include "core/statistics.h"
+
+namespace Bench
+{
+	struct PhaseResult
+	{
+		std::string scene;
+		std::string phase;
+		Core::SampleSummary summary; // milliseconds
+		// From the hardware counters of the SPH phases over the measured steps, negative when not counted.
+		double ipc = -1.0;
+		double llcMissesPerParticle = -1.0;
+		double branchMissesPerParticle = -1.0;
+	};
+
+	// A solution quality metric of a scene over the measured steps, from FluidSimulation::getAccuracy.
+	struct AccuracyResult
+	{
+		std::string scene;
+		std::string metric;
+		double mean = 0.0;
+		double max = 0.0;
+	};
+
+	// Results of one run of the scene matrix and what they were measured on. The header holds the machine fingerprint
+	// and the run settings as key, value pairs.
+	struct Baseline
+	{
+		std::vector<std::pair<std::string, std::string>> header;
+		std::vector<PhaseResult> results;
+		std::vector<AccuracyResult> accuracy;
+
+		const char* Find(const char* key) const;
+	};
+
+	// CPU, core count, OS, compiler and build options of this binary.
+	std::vector<std::pair<std::string, std::string>> MachineFingerprint();
+
+	// CSV, one row per scene and phase, the header as "# key: value" comment lines above it. The accuracy metrics follow
+	// as a second table with its own column row.
+	bool SaveBaseline(const char* path, const Baseline& baseline);
+	bool LoadBaseline(const char* path, Baseline& baseline);
+
+	struct CompareOptions
+	{
+		double threshold = 0.05; // relative change of the mean that counts
+		double alpha = 0.01; // significance level of Welch's t-test
+		double minimumMs = 0.02; // smaller absolute changes are below the timer's resolution
+	};
+
+	// Writes a per-phase report of current against baseline and returns the number of regressions, phases whose mean
+	// grew by more than the threshold with a significant difference. Accuracy is listed beside it but never fails a run,
+	// whether a speedup's accuracy cost is acceptable is for the reader to judge.
+	uint32 CompareBaselines(const Baseline& baseline, const Baseline& current, const CompareOptions& options, std::string& report);
+}
@@ -0,0 +1,201 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "benchmarkScenes.h"
+#include "core/allocationTracker.h"
+
+#include <chrono>
+
+namespace Bench
+{
+	namespace
+	{
+		const char* PhaseNames[] = { "Gravity", "Spatial", "Density", "Pressure", "Viscosity", "PosNColl", "Rigid", "Secondary", "Accuracy", "Step" };
+		constexpr uint32 PhaseCount = sizeof(PhaseNames) / sizeof(PhaseNames[0]);
+
+		const char* AccuracyNames[] = { "density_error_mean", "density_error_max", "kinetic_energy", "potential_energy", "momentum_drift",
+			"max_speed", "cfl" };
+		constexpr uint32 AccuracyCount = sizeof(AccuracyNames) / sizeof(AccuracyNames[0]);
+
+		// The pool, collider, rigid body and secondary paths, which none of the other scenes reach.
+		void SetupStream(Physics::Fluid::FluidSimulation& simulation, const glm::vec3& bound, float particleScale)
+		{
+			const glm::vec3 half = bound * 0.5f;
+
+			Physics::Fluid::ParticleEmitter emitter;
+			emitter.centre = { -half.x + 1.0f, half.y * 0.5f, 0.0f };
+			emitter.size = { 0.6f, 0.6f, 0.6f };
+			emitter.velocity = { 3.0f, 0.0f, 0.0f };
+			emitter.rate = 1500.0f * particleScale;
+			simulation.getEmitters().push_back(emitter);
+
+			Physics::Fluid::ParticleSink sink;
+			sink.shape = Physics::Fluid::PoolShape::Box;
+			sink.centre = { half.x - 0.5f, -half.y + 0.5f, 0.0f };
+			sink.size = { 0.5f, 0.5f, half.z };
+			simulation.getSinks().push_back(sink);
+
+			// A weir across the floor, a unit cube scaled into place. The faces wind counter clockwise seen from outside.
+			const std::vector<glm::vec3> vertices = { { 0,0,0 }, { 1,0,0 }, { 0,1,0 }, { 1,1,0 }, { 0,0,1 }, { 1,0,1 }, { 0,1,1 }, { 1,1,1 } };
+			const std::vector<uint32> indices = { 0,4,6, 0,6,2, 1,3,7, 1,7,5, 0,1,5, 0,5,4, 2,6,7, 2,7,3, 0,2,3, 0,3,1, 4,5,7, 4,7,6 };
+			const glm::vec3 weirSize = { 0.5f, 0.2f * bound.y, bound.z };
+			simulation.addCollider(vertices, indices, glm::translate(glm::vec3(0.5f * half.x, -half.y, -half.z)) * glm::scale(weirSize));
+
+			simulation.addRigidBody(Physics::Fluid::RigidShape::Box, { 0.6f, 0.3f, 0.6f }, { -0.5f * half.x, 0.0f, 0.0f },
+				glm::identity<glm::quat>(), 0.5f);
+			simulation.setSecondaryParticles(true);
+		}
+	}
+
+	const std::vector<BenchmarkScene>& getBenchmarkScenes()
+	{
+		using Physics::Fluid::SolverType;
+		static const std::vector<BenchmarkScene> scenes = {
+			{ "sph_10k", SolverType::SPH, 10000, { 10, 20, 10 } },
+			{ "sph_multirate_10k", SolverType::SPH, 10000, { 10, 20, 10 }, true },
+			{ "sph_sleeping_10k", SolverType::SPH, 10000, { 10, 20, 10 }, false, true },
+			{ "sph_implicit_viscosity_10k", SolverType::SPH, 10000, { 10, 20, 10 }, false, false, true },
+			{ "sph_adaptive_10k", SolverType::SPH, 10000, { 10, 20, 10 }, false, false, false, true },
+			{ "sph_stream_10k", SolverType::SPH, 10000, { 10, 20, 10 }, false, false, false, false, true },
+			{ "dfsph_10k", SolverType::DFSPH, 10000, { 10, 20, 10 } },
+			{ "pbf_10k", SolverType::PBF, 10000, { 10, 20, 10 } },
+			{ "flip_10k", SolverType::FLIP, 10000, { 10, 20, 10 } },
+		};
+		return scenes;
+	}
+
+	uint32 RunScene(const BenchmarkScene& scene, const RunSettings& settings, std::vector<PhaseResult>& results,
+		std::vector<AccuracyResult>& accuracy)
+	{
+		Physics::Fluid::FluidSimulation& simulation = Physics::Fluid::FluidSimulation::getInstance();
+		simulation.setSolverType(scene.solver);
+		simulation.setMultiRate(scene.multiRate);
+		simulation.setSleeping(scene.sleeping);
+		simulation.setImplicitViscosity(scene.implicitViscosity);
+		simulation.setAdaptiveResolution(scene.adaptiveResolution);
+		simulation.setAccuracyMetrics(true);
+		simulation.setGravity(true);
+		simulation.setBound(scene.bound);
+		simulation.getEmitters().clear();
+		simulation.getSinks().clear();
+		simulation.clearColliders();
+		simulation.clearRigidBodies();
+		simulation.setSecondaryParticles(false);
+		const int particles = std::max(1, (int)(scene.particles * settings.particleScale));
+		simulation.InitializeData(particles, { 0,0,0 }, scene.stream ? std::max(1, particles / 2) : -1);
+		if (scene.stream)
+		{
+			SetupStream(simulation, scene.bound, settings.particleScale);
+		}
+
+		// Warmup steps may still size buffers, only the measured steps have to be allocation free.
+		Core::AllocationTracker& tracker = Core::AllocationTracker::getInstance();
+		tracker.setEnabled(true);
+		tracker.setStrict(false);
+		for (uint32 step = 0; step < settings.warmupSteps; step++)
+		{
+			simulation.Update(settings.deltatime);
+		}
+		tracker.setStrict(true);
+		uint32 failedSteps = 0;
+
+		constexpr uint32 CountedPhases = (uint32)Physics::Fluid::SimPhase::Count;
+		Core::PerfValues counterSums[CountedPhases];
+		bool countersAvailable = simulation.getHardwareCounters();
+		double counterParticles = 0.0;
+
+		std::vector<double> samples[PhaseCount];
+		for (std::vector<double>& phase : samples)
+		{
+			phase.reserve(settings.measuredSteps);
+		}
+		double accuracySum[AccuracyCount] = {};
+		double accuracyMax[AccuracyCount] = {};
+		for (uint32 step = 0; step < settings.measuredSteps; step++)
+		{
+			auto StepStart = std::chrono::steady_clock::now();
+			failedSteps += simulation.Update(settings.deltatime) ? 0 : 1;
+			auto StepEnd = std::chrono::steady_clock::now();
+
+			// Only the single-rate SPH path counts, one uncounted step leaves the scene without counters.
+			countersAvailable &= simulation.getPhaseCounterParticles() > 0;
+			if (countersAvailable)
+			{
+				counterParticles += simulation.getPhaseCounterParticles();
+				for (uint32 phase = 0; phase < CountedPhases; phase++)
+				{
+					const Core::PerfValues& counters = simulation.getPhaseCounters((Physics::Fluid::SimPhase)phase);
+					for (uint32 i = 0; i < Core::PerfValues::Count; i++)
+					{
+						counterSums[phase].value[i] += counters.value[i];
+						counterSums[phase].available[i] = step == 0 ? counters.available[i] : counterSums[phase].available[i] && counters.available[i];
+					}
+				}
+			}
+
+			samples[0].push_back(simulation.getElapsedTimeGravity());
+			samples[1].push_back(simulation.getElapsedTimeSpatial());
+			samples[2].push_back(simulation.getElapsedTimeDensity());
+			samples[3].push_back(simulation.getElapsedTimePressure());
+			samples[4].push_back(simulation.getElapsedTimeViscosity());
+			samples[5].push_back(simulation.getElapsedTimePosNColl());
+			samples[6].push_back(simulation.getElapsedTimeRigid());
+			samples[7].push_back(simulation.getElapsedTimeSecondary());
+			samples[9].push_back(std::chrono::duration<double>(StepEnd - StepStart).count() * 1000.0);
+
+			const Physics::Fluid::AccuracyMetrics& metrics = simulation.getAccuracy();
+			samples[8].push_back(metrics.ms);
+			const double values[AccuracyCount] = { metrics.meanDensityError, metrics.maxDensityError, metrics.kineticEnergy,
+				metrics.potentialEnergy, metrics.momentumDrift, metrics.maxSpeed, metrics.cfl };
+			for (uint32 metric = 0; metric < AccuracyCount; metric++)
+			{
+				accuracySum[metric] += values[metric];
+				accuracyMax[metric] = step == 0 ? values[metric] : std::max(accuracyMax[metric], values[metric]);
+			}
+		}
+
+		// FLIP keeps no particle densities, its density error stays out rather than reading zero.
+		const bool densityValid = simulation.getAccuracy().densityValid;
+		for (uint32 metric = densityValid ? 0 : 2; metric < AccuracyCount; metric++)
+		{
+			accuracy.push_back({ scene.name, AccuracyNames[metric], accuracySum[metric] / settings.measuredSteps, accuracyMax[metric] });
+		}
+
+		for (uint32 phase = 0; phase < PhaseCount; phase++)
+		{
+			// Phases the solver doesn't have read zero on every step.
+			const Core::SampleSummary summary = Core::Summarise(samples[phase].data(), (uint32)samples[phase].size());
+			if (summary.mean <= 0.0) continue;
+			PhaseResult result = { scene.name, PhaseNames[phase], summary };
+			if (countersAvailable && phase < CountedPhases)
+			{
+				const Core::PerfValues& counters = counterSums[phase];
+				if (counters.has(Core::PerfEvent::Cycles) && counters.has(Core::PerfEvent::Instructions) && counters.get(Core::PerfEvent::Cycles) > 0.0)
+				{
+					result.ipc = counters.get(Core::PerfEvent::Instructions) / counters.get(Core::PerfEvent::Cycles);
+				}
+				if (counters.has(Core::PerfEvent::LLCMisses)) result.llcMissesPerParticle = counters.get(Core::PerfEvent::LLCMisses) / counterParticles;
+				if (counters.has(Core::PerfEvent::BranchMisses)) result.branchMissesPerParticle = counters.get(Core::PerfEvent::BranchMisses) / counterParticles;
+			}
+			results.push_back(result);
+		}
+
+		tracker.setStrict(false);
+		return failedSteps;
+	}
+}
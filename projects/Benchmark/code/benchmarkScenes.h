@@ -0,0 +1,58 @@
+#pragma once
+
+
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <vector>
+#include <string>
+#include "physics/physicsWorld.h"
+#include "baseline.h"
+
+namespace Bench
+{
+	// One entry of the scene matrix. Every toggle is applied when the scene starts, so no scene inherits the settings
+	// of the one before it.
+	struct BenchmarkScene
+	{
+		const char* name;
+		Physics::Fluid::SolverType solver;
+		int particles;
+		glm::vec3 bound;
+		bool multiRate = false;
+		bool sleeping = false;
+		bool implicitViscosity = false;
+		bool adaptiveResolution = false;
+		// Half the particles start active, an emitter feeds a sink past a weir collider with a body floating on top and
+		// secondary particles on.
+		bool stream = false;
+	};
+
+	struct RunSettings
+	{
+		uint32 warmupSteps = 20;
+		uint32 measuredSteps = 100;
+		float particleScale = 1.0f;
+		float deltatime = 1.0f / 60.0f;
+	};
+
+	const std::vector<BenchmarkScene>& getBenchmarkScenes();
+
+	// Steps the scene and appends one result per phase that ran, from the FluidSimulation phase timers, plus the whole
+	// Update as "Step" and the accuracy reduction as "Accuracy". The accuracy metrics of the measured steps go to accuracy.
+	// The measured steps run under strict allocation tracking, returns how many of them allocated.
+	uint32 RunScene(const BenchmarkScene& scene, const RunSettings& settings, std::vector<PhaseResult>& results,
+		std::vector<AccuracyResult>& accuracy);
+}
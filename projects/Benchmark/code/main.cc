@@ -0,0 +1,212 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "benchmarkScenes.h"
+#include "baseline.h"
+
+#include <cstring>
+#include <ctime>
+
+namespace
+{
+	void PrintUsage()
+	{
+		printf("Usage: fluidbench record <baseline.csv> [options]\n");
+		printf("       fluidbench compare <baseline.csv> [options]\n");
+		printf("       fluidbench list\n");
+		printf("Options:\n");
+		printf("  --scene <text>     only scenes whose name contains text, repeatable\n");
+		printf("  --quick            a quarter of the particles and a third of the steps\n");
+		printf("  --steps <n>        measured steps per scene (100)\n");
+		printf("  --warmup <n>       unmeasured steps after initialising each scene (20)\n");
+		printf("  --threshold <pct>  relative change that counts as a regression (5)\n");
+		printf("  --alpha <p>        significance level of the comparison (0.01)\n");
+		printf("  --report <path>    also write the comparison report to a file\n");
+		printf("  --no-counters      leave the hardware counters of the SPH phases off\n");
+	}
+
+	// One line per scene of what the measured steps cost in accuracy, and what measuring it cost in time.
+	void PrintAccuracy(const Bench::Baseline& current, const char* scene)
+	{
+		double accuracyMs = 0.0, stepMs = 0.0;
+		for (const Bench::PhaseResult& result : current.results)
+		{
+			if (result.scene != scene) continue;
+			if (result.phase == "Accuracy") accuracyMs = result.summary.mean;
+			if (result.phase == "Step") stepMs = result.summary.mean;
+		}
+		std::string line;
+		for (const Bench::AccuracyResult& result : current.accuracy)
+		{
+			if (result.scene != scene) continue;
+			char metric[96];
+			snprintf(metric, sizeof(metric), "%s %.4g", result.metric.c_str(), result.mean);
+			line += (line.empty() ? "  " : ", ") + std::string(metric);
+		}
+		printf("%s\n  accuracy pass %.3f ms, %.2f%% of the step\n", line.c_str(), accuracyMs, stepMs > 0.0 ? accuracyMs * 100.0 / stepMs : 0.0);
+	}
+
+	bool SceneSelected(const char* name, const std::vector<const char*>& filters)
+	{
+		if (filters.empty()) return true;
+		for (const char* filter : filters)
+		{
+			if (strstr(name, filter) != nullptr) return true;
+		}
+		return false;
+	}
+}
+
+// Exit code 0 when no phase regressed and no measured step allocated, 1 when either happened, 2 on usage or file errors.
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "list") == 0)
+	{
+		for (const Bench::BenchmarkScene& scene : Bench::getBenchmarkScenes())
+		{
+			printf("%s\n", scene.name);
+		}
+		return 0;
+	}
+	if (argc < 3 || (strcmp(argv[1], "record") != 0 && strcmp(argv[1], "compare") != 0))
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	const bool record = strcmp(argv[1], "record") == 0;
+	const char* baselinePath = argv[2];
+	const char* reportPath = nullptr;
+	std::vector<const char*> filters;
+	Bench::RunSettings settings;
+	Bench::CompareOptions options;
+	bool settingsGiven = false;
+	bool counters = true;
+	for (int i = 3; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--quick") == 0)
+		{
+			settings.particleScale = 0.25f;
+			settings.measuredSteps = 30;
+			settings.warmupSteps = 10;
+			settingsGiven = true;
+		}
+		else if (strcmp(argv[i], "--scene") == 0 && hasValue) filters.push_back(argv[++i]);
+		else if (strcmp(argv[i], "--steps") == 0 && hasValue)
+		{
+			settings.measuredSteps = (uint32)std::max(2, atoi(argv[++i]));
+			settingsGiven = true;
+		}
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+		{
+			settings.warmupSteps = (uint32)std::max(0, atoi(argv[++i]));
+			settingsGiven = true;
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && hasValue) options.threshold = atof(argv[++i]) / 100.0;
+		else if (strcmp(argv[i], "--alpha") == 0 && hasValue) options.alpha = atof(argv[++i]);
+		else if (strcmp(argv[i], "--report") == 0 && hasValue) reportPath = argv[++i];
+		else if (strcmp(argv[i], "--no-counters") == 0) counters = false;
+		else
+		{
+			printf("[ Benchmark ] : ERROR : Unknown option %s.\n", argv[i]);
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	Bench::Baseline baseline;
+	if (!record && !Bench::LoadBaseline(baselinePath, baseline)) return 2;
+	std::erase_if(baseline.results, [&filters](const Bench::PhaseResult& result) { return !SceneSelected(result.scene.c_str(), filters); });
+	std::erase_if(baseline.accuracy, [&filters](const Bench::AccuracyResult& result) { return !SceneSelected(result.scene.c_str(), filters); });
+
+	// Comparisons rerun the scenes the baseline holds with the settings it was recorded with, unless overridden above.
+	const char* recordedSettings = baseline.Find("settings");
+	if (!settingsGiven && recordedSettings != nullptr)
+	{
+		sscanf(recordedSettings, "%u measured, %u warmup, %f particle scale", &settings.measuredSteps, &settings.warmupSteps, &settings.particleScale);
+	}
+
+	Bench::Baseline current;
+	current.header = Bench::MachineFingerprint();
+	char settingsText[128];
+	snprintf(settingsText, sizeof(settingsText), "%u measured, %u warmup, %.2f particle scale", settings.measuredSteps, settings.warmupSteps,
+		settings.particleScale);
+	current.header.push_back({ "settings", settingsText });
+
+	// Counters are optional, a machine without perf events still benchmarks, only the counter columns stay empty.
+	Physics::Fluid::FluidSimulation& simulation = Physics::Fluid::FluidSimulation::getInstance();
+	if (counters) simulation.setHardwareCounters(true);
+	current.header.push_back({ "counters", counters ? simulation.getHardwareCounterStatus() : "Disabled" });
+
+	uint32 allocatingSteps = 0;
+
+	for (const Bench::BenchmarkScene& scene : Bench::getBenchmarkScenes())
+	{
+		if (!SceneSelected(scene.name, filters)) continue;
+		bool inBaseline = record;
+		for (const Bench::PhaseResult& result : baseline.results)
+		{
+			inBaseline |= result.scene == scene.name;
+		}
+		if (!inBaseline) continue;
+
+		printf("Running %s...\n", scene.name);
+		fflush(stdout);
+		const uint32 failed = Bench::RunScene(scene, settings, current.results, current.accuracy);
+		PrintAccuracy(current, scene.name);
+		if (failed > 0)
+		{
+			printf("[ Benchmark ] : ERROR : %u measured steps of %s allocated.\n", failed, scene.name);
+			allocatingSteps += failed;
+		}
+	}
+
+	if (record)
+	{
+		char recorded[64];
+		const time_t now = time(nullptr);
+		strftime(recorded, sizeof(recorded), "%Y-%m-%d %H:%M:%S", localtime(&now));
+		current.header.insert(current.header.begin(), { "recorded", recorded });
+		if (!Bench::SaveBaseline(baselinePath, current)) return 2;
+		printf("Recorded %zu phase timings to %s.\n", current.results.size(), baselinePath);
+		return allocatingSteps > 0 ? 1 : 0;
+	}
+
+	std::string report;
+	const char* recordedAt = baseline.Find("recorded");
+	report += std::string("Baseline ") + baselinePath + (recordedAt != nullptr ? std::string(", recorded ") + recordedAt : std::string()) + "\n";
+	const uint32 regressions = Bench::CompareBaselines(baseline, current, options, report);
+	if (allocatingSteps > 0)
+	{
+		report += std::to_string(allocatingSteps) + " measured steps allocated under strict allocation tracking.\n";
+	}
+	printf("%s", report.c_str());
+	if (reportPath != nullptr)
+	{
+		FILE* file = fopen(reportPath, "w");
+		if (file == nullptr)
+		{
+			printf("[ Benchmark ] : ERROR : Could not open %s.\n", reportPath);
+			return 2;
+		}
+		fputs(report.c_str(), file);
+		fclose(file);
+	}
+	return regressions > 0 || allocatingSteps > 0 ? 1 : 0;
+}
@@ -0,0 +1,94 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "distributions.h"
+
+#include <cmath>
+
+namespace Micro
+{
+	namespace
+	{
+		struct Xorshift
+		{
+			uint32 state;
+
+			float Uniform()
+			{
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				return (state & 0xFFFFFF) / 16777216.0f;
+			}
+
+			float Gaussian()
+			{
+				// Box-Muller, the second value is thrown away.
+				const float u = std::max(Uniform(), 1e-7f);
+				const float v = Uniform();
+				return sqrtf(-2.0f * logf(u)) * cosf(2.0f * glm::pi<float>() * v);
+			}
+		};
+	}
+
+	const char* DistributionName(Distribution distribution)
+	{
+		const char* names[] = { "uniform", "clumped", "sheet" };
+		return names[(uint32)distribution];
+	}
+
+	std::vector<glm::vec3> GenerateDistribution(Distribution distribution, uint32 count, float spacing, uint32 seed)
+	{
+		Xorshift random = { seed * 2654435761u + 1u };
+		std::vector<glm::vec3> positions(count);
+
+		// Same volume per particle in every distribution, only its arrangement changes.
+		const float side = spacing * cbrtf((float)count);
+		if (distribution == Distribution::Uniform)
+		{
+			for (glm::vec3& position : positions)
+			{
+				position = (glm::vec3(random.Uniform(), random.Uniform(), random.Uniform()) - 0.5f) * side;
+			}
+		}
+		else if (distribution == Distribution::Clumped)
+		{
+			constexpr uint32 Clusters = 8;
+			glm::vec3 centres[Clusters];
+			for (glm::vec3& centre : centres)
+			{
+				centre = (glm::vec3(random.Uniform(), random.Uniform(), random.Uniform()) - 0.5f) * side * 2.0f;
+			}
+			// Each cluster holds its share at about twice the rest density in its core.
+			const float sigma = spacing * cbrtf((float)count / Clusters) * 0.25f;
+			for (uint32 i = 0; i < count; i++)
+			{
+				positions[i] = centres[i % Clusters] + glm::vec3(random.Gaussian(), random.Gaussian(), random.Gaussian()) * sigma;
+			}
+		}
+		else
+		{
+			const float width = spacing * sqrtf(count * 0.5f);
+			for (glm::vec3& position : positions)
+			{
+				position = { (random.Uniform() - 0.5f) * width, random.Uniform() * spacing * 2.0f, (random.Uniform() - 0.5f) * width };
+			}
+		}
+		return positions;
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <vector>
+
+namespace Micro
+{
+	enum class Distribution
+	{
+		Uniform, // a cube filled at rest spacing
+		Clumped, // gaussian clusters with empty space between them
+		Sheet, // a slab two particles thick
+		Count
+	};
+
+	const char* DistributionName(Distribution distribution);
+
+	// Particle positions around the origin at the given spacing, the same seed gives the same positions.
+	std::vector<glm::vec3> GenerateDistribution(Distribution distribution, uint32 count, float spacing, uint32 seed = 1);
+}
@@ -0,0 +1,201 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "microbenchmarks.h"
+#include "core/allocationTracker.h"
+
+#include <cstring>
+#include <cmath>
+
+namespace
+{
+	void PrintUsage()
+	{
+		printf("Usage: fluidmicro [options]\n");
+		printf("       fluidmicro list\n");
+		printf("Options:\n");
+		printf("  --filter <text>        only benchmarks whose group/name contains text, repeatable\n");
+		printf("  --distribution <name>  uniform, clumped or sheet, repeatable (all)\n");
+		printf("  --particles <n>        particles in each distribution (20000)\n");
+		printf("  --repetitions <n>      timed repetitions per benchmark (9)\n");
+		printf("  --min-time <ms>        shortest repetition, passes are added until it is reached (10)\n");
+		printf("  --csv <path>           also write the results to a file\n");
+	}
+
+	std::string FullName(const Micro::Microbenchmark& benchmark)
+	{
+		return std::string(benchmark.group) + "/" + benchmark.name;
+	}
+
+	bool Selected(const Micro::Microbenchmark& benchmark, const std::vector<const char*>& filters)
+	{
+		if (filters.empty()) return true;
+		const std::string name = FullName(benchmark);
+		for (const char* filter : filters)
+		{
+			if (strstr(name.c_str(), filter) != nullptr) return true;
+		}
+		return false;
+	}
+
+	// Per operation, or a dash for an event the machine doesn't count.
+	void FormatCounter(char* text, size_t size, const Micro::MicroResult& result, Core::PerfEvent event)
+	{
+		if (!result.counters.has(event) || result.totalOps == 0) snprintf(text, size, "-");
+		else snprintf(text, size, "%.3f", result.counters.get(event) / result.totalOps);
+	}
+
+	void FormatIpc(char* text, size_t size, const Micro::MicroResult& result)
+	{
+		const Core::PerfValues& counters = result.counters;
+		if (!counters.has(Core::PerfEvent::Cycles) || !counters.has(Core::PerfEvent::Instructions) || counters.get(Core::PerfEvent::Cycles) <= 0) snprintf(text, size, "-");
+		else snprintf(text, size, "%.2f", counters.get(Core::PerfEvent::Instructions) / counters.get(Core::PerfEvent::Cycles));
+	}
+
+	const Micro::MicroResult* FindResult(const std::vector<Micro::MicroResult>& results, const char* group, const char* name)
+	{
+		for (const Micro::MicroResult& result : results)
+		{
+			if (strcmp(result.benchmark->group, group) == 0 && strcmp(result.benchmark->name, name) == 0) return &result;
+		}
+		return nullptr;
+	}
+}
+
+// Exit code 0 when every alternative matched its reference, 1 when a checksum differed, 2 on usage or file errors.
+int main(int argc, char** argv)
+{
+	if (argc >= 2 && strcmp(argv[1], "list") == 0)
+	{
+		for (const Micro::Microbenchmark& benchmark : Micro::getMicrobenchmarks())
+		{
+			printf("%s%s%s\n", FullName(benchmark).c_str(), benchmark.reference != nullptr ? ", compared with " : "",
+				benchmark.reference != nullptr ? benchmark.reference : "");
+		}
+		return 0;
+	}
+
+	std::vector<const char*> filters;
+	std::vector<Micro::Distribution> distributions;
+	uint32 particles = 20000;
+	const char* csvPath = nullptr;
+	Micro::MeasureSettings settings;
+	for (int i = 1; i < argc; i++)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--filter") == 0 && hasValue) filters.push_back(argv[++i]);
+		else if (strcmp(argv[i], "--particles") == 0 && hasValue) particles = (uint32)std::max(64, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--repetitions") == 0 && hasValue) settings.repetitions = (uint32)std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--min-time") == 0 && hasValue) settings.minimumRepetitionMs = std::max(0.1, atof(argv[++i]));
+		else if (strcmp(argv[i], "--csv") == 0 && hasValue) csvPath = argv[++i];
+		else if (strcmp(argv[i], "--distribution") == 0 && hasValue)
+		{
+			const char* name = argv[++i];
+			uint32 d = 0;
+			while (d < (uint32)Micro::Distribution::Count && strcmp(Micro::DistributionName((Micro::Distribution)d), name) != 0) d++;
+			if (d == (uint32)Micro::Distribution::Count)
+			{
+				printf("[ Microbench ] : ERROR : Unknown distribution %s.\n", name);
+				return 2;
+			}
+			distributions.push_back((Micro::Distribution)d);
+		}
+		else
+		{
+			printf("[ Microbench ] : ERROR : Unknown option %s.\n", argv[i]);
+			PrintUsage();
+			return 2;
+		}
+	}
+	if (distributions.empty())
+	{
+		for (uint32 d = 0; d < (uint32)Micro::Distribution::Count; d++) distributions.push_back((Micro::Distribution)d);
+	}
+
+	FILE* csv = nullptr;
+	if (csvPath != nullptr)
+	{
+		csv = fopen(csvPath, "w");
+		if (csv == nullptr)
+		{
+			printf("[ Microbench ] : ERROR : Could not open %s.\n", csvPath);
+			return 2;
+		}
+		fprintf(csv, "distribution,particles,benchmark,reference,median_ns,min_ns,mean_ns,ci_low_ns,ci_high_ns,relative,ipc,llc_misses_per_op,branch_misses_per_op,allocation_free,checksum_match\n");
+	}
+
+	Core::AllocationTracker::getInstance().setEnabled(true);
+	Core::PerfCounters& counters = Core::PerfCounters::getInstance();
+	counters.setEnabled(true);
+	printf("Perf counters: %s\n", counters.getStatus());
+
+	uint32 mismatches = 0;
+	for (Micro::Distribution distribution : distributions)
+	{
+		Micro::Workload workload;
+		Micro::PrepareWorkload(distribution, particles, workload);
+		counters.AttachNewThreads();
+		printf("\n%s, %u particles, %.1f neighbours per particle\n", Micro::DistributionName(distribution), particles,
+			(double)workload.distances.size() / particles);
+		printf("%-30s %10s %10s %18s %9s %6s %8s %8s %6s\n", "benchmark", "median ns", "min ns", "95% CI", "relative", "IPC", "LLC/op", "br/op", "alloc");
+
+		std::vector<Micro::MicroResult> results;
+		for (const Micro::Microbenchmark& benchmark : Micro::getMicrobenchmarks())
+		{
+			if (!Selected(benchmark, filters)) continue;
+			results.push_back(Micro::Measure(benchmark, workload, settings));
+			const Micro::MicroResult& result = results.back();
+
+			// Relative is reference time over this time, above 1 is faster. The reference only counts if it ran too.
+			const Micro::MicroResult* reference = benchmark.reference != nullptr ? FindResult(results, benchmark.group, benchmark.reference) : nullptr;
+			char relative[16] = "-";
+			bool match = true;
+			if (reference != nullptr)
+			{
+				snprintf(relative, sizeof(relative), "%.2fx", reference->medianNs / result.medianNs);
+				match = fabs(reference->checksum - result.checksum) <= 1e-4 * std::max(1.0, fabs(reference->checksum));
+				mismatches += match ? 0 : 1;
+			}
+
+			char ci[32], ipc[16], llc[16], branches[16];
+			snprintf(ci, sizeof(ci), "%.2f-%.2f", result.nsPerOp.ciLow, result.nsPerOp.ciHigh);
+			FormatIpc(ipc, sizeof(ipc), result);
+			FormatCounter(llc, sizeof(llc), result, Core::PerfEvent::LLCMisses);
+			FormatCounter(branches, sizeof(branches), result, Core::PerfEvent::BranchMisses);
+			printf("%-30s %10.2f %10.2f %18s %9s %6s %8s %8s %6s%s\n", FullName(benchmark).c_str(), result.medianNs, result.minimumNs, ci,
+				relative, ipc, llc, branches, result.allocationFree ? "none" : "YES", match ? "" : "  CHECKSUM MISMATCH");
+			fflush(stdout);
+
+			if (csv != nullptr)
+			{
+				fprintf(csv, "%s,%u,%s,%s,%.4f,%.4f,%.4f,%.4f,%.4f,%s,%s,%s,%s,%d,%d\n", Micro::DistributionName(distribution), particles,
+					FullName(benchmark).c_str(), benchmark.reference != nullptr ? benchmark.reference : "", result.medianNs, result.minimumNs,
+					result.nsPerOp.mean, result.nsPerOp.ciLow, result.nsPerOp.ciHigh, relative, ipc, llc, branches,
+					result.allocationFree ? 1 : 0, match ? 1 : 0);
+			}
+		}
+	}
+
+	if (csv != nullptr) fclose(csv);
+	if (mismatches > 0)
+	{
+		printf("[ Microbench ] : ERROR : %u alternative implementations disagree with their reference.\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,339 @@
+// 
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include "config.h"
+#include "microbenchmarks.h"
+#include "physics/physicsWorld.h"
+#include "physics/kernels.h"
+#include "core/allocationTracker.h"
+
+#include <chrono>
+#include <algorithm>
+
+namespace Physics
+{
+	namespace Fluid
+	{
+		// The neighbour search building blocks are private to the solver, these forward to them unchanged.
+		struct MicrobenchmarkAccess
+		{
+			static void Place(FluidSimulation& simulation, const std::vector<glm::vec3>& positions)
+			{
+				std::copy(positions.begin(), positions.end(), simulation.positions.begin());
+				std::copy(positions.begin(), positions.end(), simulation.predictedPositions.begin());
+				simulation.UpdatePhaseTable();
+				simulation.spatialDirty = true;
+				simulation.UpdateSpatialLookup();
+			}
+
+			static glm::vec3 CellOf(FluidSimulation& simulation, const glm::vec3& pos) { return simulation.PositionToCellCoord(pos); }
+			static uint32 Hash(FluidSimulation& simulation, const glm::vec3& cell) { return simulation.HashCell(cell); }
+			static uint32 Key(FluidSimulation& simulation, uint32 hash, uint32 length) { return simulation.GetKeyFromHash(hash, length); }
+			static glm::vec2 Density(FluidSimulation& simulation, uint32 i) { return simulation.CalculateDensity(i); }
+			static float PairRadius(FluidSimulation& simulation, uint32 i, uint32 j) { return simulation.PairRadius(i, j); }
+			static float NeighbourRadius(FluidSimulation& simulation) { return simulation.neighbourRadius; }
+
+			template<typename Func>
+			static void ForEachNeighbour(FluidSimulation& simulation, uint32 i, Func&& func)
+			{
+				simulation.ForEachNeighbour(simulation.predictedPositions[i], func);
+			}
+		};
+	}
+}
+
+namespace Micro
+{
+	namespace
+	{
+		using Access = Physics::Fluid::MicrobenchmarkAccess;
+
+		Physics::Fluid::FluidSimulation& Simulation()
+		{
+			return Physics::Fluid::FluidSimulation::getInstance();
+		}
+
+		template<float(*Kernel)(float, float)>
+		uint64 KernelPass(Workload& workload, double& checksum)
+		{
+			float sum = 0.0f;
+			const uint32 count = (uint32)workload.distances.size();
+			for (uint32 i = 0; i < count; i++)
+			{
+				sum += Kernel(workload.distances[i], workload.radii[i]);
+			}
+			checksum += sum;
+			return count;
+		}
+
+		// SmoothingPow2 with the normalisation recomputed only when the radius changes, most pairs share one.
+		uint64 CachedVolumePow2Pass(Workload& workload, double& checksum)
+		{
+			float sum = 0.0f;
+			float cachedRadius = -1.0f;
+			float volume = 0.0f;
+			const uint32 count = (uint32)workload.distances.size();
+			for (uint32 i = 0; i < count; i++)
+			{
+				const float radius = workload.radii[i];
+				const float dist = workload.distances[i];
+				if (radius != cachedRadius)
+				{
+					cachedRadius = radius;
+					volume = 15 / (2 * glm::pi<float>() * powf(radius, 5));
+				}
+				if (dist < radius)
+				{
+					float v = radius - dist;
+					sum += v * v * volume;
+				}
+			}
+			checksum += sum;
+			return count;
+		}
+
+		uint64 CellCoordPass(Workload& workload, double& checksum)
+		{
+			Physics::Fluid::FluidSimulation& simulation = Simulation();
+			glm::vec3 sum = { 0,0,0 };
+			for (const glm::vec3& position : workload.positions)
+			{
+				sum += Access::CellOf(simulation, position);
+			}
+			checksum += sum.x + sum.y + sum.z;
+			return workload.positions.size();
+		}
+
+		uint64 HashCellPass(Workload& workload, double& checksum)
+		{
+			Physics::Fluid::FluidSimulation& simulation = Simulation();
+			uint32 mix = 0;
+			for (const glm::vec3& cell : workload.cells)
+			{
+				mix ^= Access::Hash(simulation, cell);
+			}
+			checksum += mix;
+			return workload.cells.size();
+		}
+
+		uint64 KeyFromHashPass(Workload& workload, double& checksum)
+		{
+			Physics::Fluid::FluidSimulation& simulation = Simulation();
+			uint64 sum = 0;
+			for (uint32 hash : workload.hashes)
+			{
+				sum += Access::Key(simulation, hash, workload.particles);
+			}
+			checksum += sum;
+			return workload.hashes.size();
+		}
+
+		// The whole chain RebuildSpatialLookup runs per particle.
+		uint64 PositionToKeyPass(Workload& workload, double& checksum)
+		{
+			Physics::Fluid::FluidSimulation& simulation = Simulation();
+			uint64 sum = 0;
+			for (const glm::vec3& position : workload.positions)
+			{
+				sum += Access::Key(simulation, Access::Hash(simulation, Access::CellOf(simulation, position)), workload.particles);
+			}
+			checksum += sum;
+			return workload.positions.size();
+		}
+
+		// Order sensitive, so a sort that leaves a key out of place changes it. Entries that share a key may come out in
+		// any order, only the keys are summed.
+		double KeySequenceChecksum(const std::vector<glm::vec3>& lookup)
+		{
+			double sum = 0.0;
+			for (uint32 i = 0; i < lookup.size(); i++)
+			{
+				sum += (double)lookup[i].z * ((i & 15) + 1);
+			}
+			return sum;
+		}
+
+		uint64 EngineSortPass(Workload& workload, double& checksum)
+		{
+			std::copy(workload.unsortedLookup.begin(), workload.unsortedLookup.end(), workload.sortScratch.begin());
+			std::sort(workload.sortScratch.begin(), workload.sortScratch.end(), Physics::compareByKey);
+			checksum += KeySequenceChecksum(workload.sortScratch);
+			return workload.sortScratch.size();
+		}
+
+		// Keys are below the particle count, so a counting sort orders them in two linear passes.
+		uint64 CountingSortPass(Workload& workload, double& checksum)
+		{
+			std::vector<uint32>& counts = workload.keyCounts;
+			std::fill(counts.begin(), counts.end(), 0);
+			for (const glm::vec3& entry : workload.unsortedLookup)
+			{
+				counts[(uint32)entry.z + 1]++;
+			}
+			for (uint32 key = 1; key < counts.size(); key++)
+			{
+				counts[key] += counts[key - 1];
+			}
+			for (const glm::vec3& entry : workload.unsortedLookup)
+			{
+				workload.sortOutput[counts[(uint32)entry.z]++] = entry;
+			}
+			checksum += KeySequenceChecksum(workload.sortOutput);
+			return workload.sortOutput.size();
+		}
+
+		uint64 CalculateDensityPass(Workload& workload, double& checksum)
+		{
+			Physics::Fluid::FluidSimulation& simulation = Simulation();
+			double sum = 0.0;
+			for (uint32 i = 0; i < workload.particles; i++)
+			{
+				sum += Access::Density(simulation, i).x;
+			}
+			checksum += sum;
+			return workload.particles;
+		}
+
+		// The same traversal with no kernel work, the difference to CalculateDensity is what the kernels cost.
+		uint64 TraversalOnlyPass(Workload& workload, double& checksum)
+		{
+			Physics::Fluid::FluidSimulation& simulation = Simulation();
+			uint64 visited = 0;
+			for (uint32 i = 0; i < workload.particles; i++)
+			{
+				Access::ForEachNeighbour(simulation, i, [&](uint32_t, const glm::vec3&, float) { visited++; });
+			}
+			checksum += visited;
+			return workload.particles;
+		}
+
+		double NowMs()
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	void PrepareWorkload(Distribution distribution, uint32 particles, Workload& workload)
+	{
+		Physics::Fluid::FluidSimulation& simulation = Simulation();
+		simulation.setSolverType(Physics::Fluid::SolverType::SPH);
+		simulation.setAdaptiveResolution(false);
+		simulation.setBound({ 1000, 1000, 1000 });
+		simulation.InitializeData((int)particles);
+
+		// Half the interaction radius is about the rest spacing at the default target density.
+		workload = Workload();
+		workload.distribution = distribution;
+		workload.particles = particles;
+		workload.positions = GenerateDistribution(distribution, particles, simulation.getInteractionRadius() * 0.5f);
+		Access::Place(simulation, workload.positions);
+
+		workload.cells.resize(particles);
+		workload.hashes.resize(particles);
+		workload.unsortedLookup.resize(particles);
+		for (uint32 i = 0; i < particles; i++)
+		{
+			workload.cells[i] = Access::CellOf(simulation, workload.positions[i]);
+			workload.hashes[i] = Access::Hash(simulation, workload.cells[i]);
+			workload.unsortedLookup[i] = { i, workload.hashes[i], Access::Key(simulation, workload.hashes[i], particles) };
+		}
+		workload.sortScratch.resize(particles);
+		workload.sortOutput.resize(particles);
+		workload.keyCounts.resize(particles + 1);
+
+		for (uint32 i = 0; i < particles; i++)
+		{
+			Access::ForEachNeighbour(simulation, i, [&](uint32_t j, const glm::vec3&, float sqrDist)
+			{
+				workload.distances.push_back(sqrtf(sqrDist));
+				workload.radii.push_back(Access::PairRadius(simulation, i, j));
+			});
+		}
+	}
+
+	const std::vector<Microbenchmark>& getMicrobenchmarks()
+	{
+		using namespace Physics::kernels;
+		static const std::vector<Microbenchmark> benchmarks = {
+			{ "kernel", "pow2", KernelPass<SmoothingPow2> },
+			{ "kernel", "pow2_cached_volume", CachedVolumePow2Pass, "pow2" },
+			{ "kernel", "pow3", KernelPass<SmoothingPow3> },
+			{ "kernel", "derivative_pow2", KernelPass<SmoothingDerivativePow2> },
+			{ "kernel", "derivative_pow3", KernelPass<SmoothingDerivativePow3> },
+			{ "kernel", "visco_poly6", KernelPass<SmoothingViscoPoly6> },
+			{ "hash", "cell_coord", CellCoordPass },
+			{ "hash", "hash_cell", HashCellPass },
+			{ "hash", "key_from_hash", KeyFromHashPass },
+			{ "hash", "position_to_key", PositionToKeyPass },
+			{ "sort", "std_sort", EngineSortPass },
+			{ "sort", "counting_sort", CountingSortPass, "std_sort" },
+			{ "density", "calculate_density", CalculateDensityPass },
+			{ "density", "traversal_only", TraversalOnlyPass },
+		};
+		return benchmarks;
+	}
+
+	MicroResult Measure(const Microbenchmark& benchmark, Workload& workload, const MeasureSettings& settings)
+	{
+		MicroResult result;
+		result.benchmark = &benchmark;
+
+		// One untimed pass warms the caches and gives the checksum, then the passes per repetition double until a
+		// repetition lasts long enough for the clock.
+		result.opsPerRepetition = benchmark.pass(workload, result.checksum);
+		uint32 passes = 1;
+		for (;;)
+		{
+			double discard = 0.0;
+			const double start = NowMs();
+			for (uint32 p = 0; p < passes; p++) benchmark.pass(workload, discard);
+			if (NowMs() - start >= settings.minimumRepetitionMs || passes >= (1u << 20)) break;
+			passes *= 2;
+		}
+		result.opsPerRepetition *= passes;
+
+		Core::AllocationTracker& tracker = Core::AllocationTracker::getInstance();
+		Core::PerfCounters& counters = Core::PerfCounters::getInstance();
+		std::vector<double> samples(settings.repetitions);
+		for (uint32 r = 0; r < settings.repetitions; r++)
+		{
+			double discard = 0.0;
+			tracker.BeginStep(true);
+			const Core::PerfValues before = counters.Read();
+			const double start = NowMs();
+			for (uint32 p = 0; p < passes; p++) benchmark.pass(workload, discard);
+			const double elapsed = NowMs() - start;
+			const Core::PerfValues delta = counters.Read() - before;
+			tracker.EndStep();
+
+			result.allocationFree &= tracker.getLastAllocatingStepIndex() != tracker.getSteps();
+			samples[r] = elapsed * 1e6 / result.opsPerRepetition;
+			for (uint32 i = 0; i < Core::PerfValues::Count; i++)
+			{
+				result.counters.value[i] += delta.value[i];
+				result.counters.available[i] = r == 0 ? delta.available[i] : result.counters.available[i] && delta.available[i];
+			}
+		}
+		result.totalOps = result.opsPerRepetition * settings.repetitions;
+
+		result.nsPerOp = Core::Summarise(samples.data(), (uint32)samples.size());
+		std::sort(samples.begin(), samples.end());
+		result.minimumNs = samples.front();
+		result.medianNs = samples[samples.size() / 2];
+		return result;
+	}
+}
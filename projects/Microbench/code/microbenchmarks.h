@@ -0,0 +1,83 @@
+#pragma once
+
+
+// Copyright 2023 Alexander Marklund (Allkams02@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this softwareand associated
+// documentation files(the Software), to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense, and /or sell copies of the Software,
+// and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+// The above copyright noticeand this permission notice shall be included in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+// INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN 
+// AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR
+// THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+#include <vector>
+#include "core/statistics.h"
+#include "core/perfCounters.h"
+#include "distributions.h"
+
+namespace Micro
+{
+	// Everything one distribution's benchmarks read, gathered once from a simulation that holds the particles. The
+	// scratch buffers are sized up front so a timed pass never allocates.
+	struct Workload
+	{
+		Distribution distribution = Distribution::Uniform;
+		uint32 particles = 0;
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> cells;
+		std::vector<uint32> hashes;
+		std::vector<float> distances; // of every neighbour pair, with the smoothing radius of the pair beside it
+		std::vector<float> radii;
+		std::vector<glm::vec3> unsortedLookup; // index, hash, key, as the engine builds it before sorting
+		std::vector<glm::vec3> sortScratch;
+		std::vector<glm::vec3> sortOutput;
+		std::vector<uint32> keyCounts;
+	};
+
+	// Places the distribution in the simulation, builds its lookup and gathers the workload.
+	void PrepareWorkload(Distribution distribution, uint32 particles, Workload& workload);
+
+	// One timed pass over the workload. Returns the number of operations the pass made and adds a value derived from
+	// every result to checksum, so nothing is optimised away and alternatives can be checked against the engine.
+	using MicrobenchmarkPass = uint64(*)(Workload& workload, double& checksum);
+
+	// An alternative implementation names the engine's as its reference, it is timed relative to it and its checksum
+	// has to match.
+	struct Microbenchmark
+	{
+		const char* group;
+		const char* name;
+		MicrobenchmarkPass pass;
+		const char* reference = nullptr;
+	};
+
+	const std::vector<Microbenchmark>& getMicrobenchmarks();
+
+	struct MeasureSettings
+	{
+		uint32 repetitions = 9;
+		double minimumRepetitionMs = 10.0;
+	};
+
+	struct MicroResult
+	{
+		const Microbenchmark* benchmark = nullptr;
+		uint64 opsPerRepetition = 0;
+		Core::SampleSummary nsPerOp;
+		double medianNs = 0.0;
+		double minimumNs = 0.0;
+		double checksum = 0.0;
+		Core::PerfValues counters; // summed over the repetitions
+		uint64 totalOps = 0;
+		bool allocationFree = true;
+	};
+
+	// Calibrates the passes per repetition to the minimum duration, then times the repetitions.
+	MicroResult Measure(const Microbenchmark& benchmark, Workload& workload, const MeasureSettings& settings);
+}
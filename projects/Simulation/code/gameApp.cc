@@ -33,6 +33,7 @@
 #include "render/computeshader.h"
 #include "render/camera.h"
 #include "physics/physicsWorld.h"
+#include "core/profiler.h"
 
 #include "simulations/fluidSimBase.h"
 #include "simulations/fluidSimCPU.h"
@@ -142,9 +143,20 @@ namespace Game
 		Cam.setViewProjection();
 		shader.setMat4("view", Cam.GetViewMatrix());
 
+		Core::Profiler::getInstance().setThreadName("Main");
+
+		// Unattended runs turn the metrics endpoint on from the environment, e.g. FLUIDSIM_METRICS_PORT=9464.
+		if (const char* metricsPort = std::getenv("FLUIDSIM_METRICS_PORT"))
+		{
+			Physics::Fluid::FluidSimulation::getInstance().startMetricsServer((uint16)atoi(metricsPort));
+		}
+
 		deltatime = 0.016667f;
 		while (this->window->IsOpen())
 		{
+			// Folds the previous frame, so its "Frame" zone has already closed.
+			PROFILE_FRAME();
+			PROFILE_ZONE("Frame");
 			auto timeStart = std::chrono::steady_clock::now();
 			//glClearColor(0.4f, 0.0f, 0.8f, 1.0f);
 			glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -228,6 +240,7 @@ namespace Game
 			{
 				// NOTE! Compute Shader still does not fully work..
 				// Fixed update with interpolation between states to smoothen everything.
+				PROFILE_ZONE("Simulation");
 				simulation->update(deltatime);
 			}
 
@@ -235,33 +248,48 @@ namespace Game
 			
 			
 			auto renderStart = std::chrono::steady_clock::now();
-			simulation->render(particleShader, Cam);
+			{
+				PROFILE_ZONE("Render");
+				simulation->render(particleShader, Cam);
 
-			shader.Enable();
+				shader.Enable();
 
-			shader.setMat4("view", Cam.GetViewMatrix());
-			shader.setMat4("project", Cam.GetProjection());
-
-			//BOUND rendering
-			glm::vec3 boundScale = Physics::Fluid::FluidSimulation::getInstance().getBounds();
-			shader.setVec4("color", glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
-			trans = glm::translate(glm::vec3(0.0f,0.0f, 0.0f)) * glm::scale(boundScale);
-			shader.setMat4("model", trans);
-			//Make a real bound instead of just a wireframe.
-			glPolygonMode(GL_FRONT, GL_LINE);
-			glPolygonMode(GL_BACK, GL_LINE);
-			Bound.bindVAO();
-			Bound.renderMesh(0);
-			Bound.unBindVAO();
-			glPolygonMode(GL_FRONT, GL_FILL);
-			glPolygonMode(GL_BACK, GL_FILL);
-
-			Cam.setViewProjection();
+				shader.setMat4("view", Cam.GetViewMatrix());
+				shader.setMat4("project", Cam.GetProjection());
+
+				//BOUND rendering
+				glm::vec3 boundScale = Physics::Fluid::FluidSimulation::getInstance().getBounds();
+				shader.setVec4("color", glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+				trans = Physics::Fluid::FluidSimulation::getInstance().getBoundTransform() * glm::scale(boundScale);
+				shader.setMat4("model", trans);
+				//Make a real bound instead of just a wireframe.
+				glPolygonMode(GL_FRONT, GL_LINE);
+				glPolygonMode(GL_BACK, GL_LINE);
+				Bound.bindVAO();
+				Bound.renderMesh(0);
+
+				// Rigid bodies, spheres are drawn as their bounding box until there is a sphere mesh.
+				shader.setVec4("color", glm::vec4(0.8f, 0.5f, 0.2f, 1.0f));
+				for (const Physics::Fluid::RigidBody& body : Physics::Fluid::FluidSimulation::getInstance().getRigidBodies())
+				{
+					glm::vec3 extent = body.shape == Physics::Fluid::RigidShape::Sphere ? glm::vec3(body.size.x) : body.size;
+					shader.setMat4("model", glm::translate(body.position) * glm::mat4_cast(body.rotation) * glm::scale(2.0f * extent));
+					Bound.renderMesh(0);
+				}
+				Bound.unBindVAO();
+				glPolygonMode(GL_FRONT, GL_FILL);
+				glPolygonMode(GL_BACK, GL_FILL);
+
+				Cam.setViewProjection();
+			}
 			auto renderEnd = std::chrono::steady_clock::now();
 			renderingElapsed = std::chrono::duration<double>(renderEnd - renderStart).count() * 1000.0f;
 			auto colorUpdateStart = std::chrono::steady_clock::now();
-			this->window->SwapBuffers();
-			this->window->Update();
+			{
+				PROFILE_ZONE("Swap & Events");
+				this->window->SwapBuffers();
+				this->window->Update();
+			}
 			auto colorUpdateEnd = std::chrono::steady_clock::now();
 			colorElapsed = std::chrono::duration<double>(colorUpdateEnd - colorUpdateStart).count() * 1000.0f;
 
@@ -297,7 +325,7 @@ namespace Game
 
 			int fps = 1.0f/ deltatime;
 			ImGui::Text("FPS: %i", fps);
-			ImGui::Text("Number of Particles: %i", particleAmount);
+			ImGui::Text("Number of Particles: %u / %i", Physics::Fluid::FluidSimulation::getInstance().getParticleCount(), particleAmount);
 			ImGui::Text("Simulation type: %s", GPUCalculated ? "GPU" : "CPU");
 			ImGui::Text("Simulation status: %s", isRunning ? "ON" : "OFF");
 			ImGui::NewLine();
@@ -316,8 +344,382 @@ namespace Game
 					ImGui::Text("  Pressure Elapsed:  %.2f ms", Physics::Fluid::FluidSimulation::getInstance().getElapsedTimePressure());
 					ImGui::Text("  Viscosity Elapsed: %.2f ms", Physics::Fluid::FluidSimulation::getInstance().getElapsedTimeViscosity());
 					ImGui::Text("  PosNColl Elapsed:  %.2f ms", Physics::Fluid::FluidSimulation::getInstance().getElapsedTimePosNColl());
+					ImGui::Text("  Rigid Elapsed:     %.2f ms", Physics::Fluid::FluidSimulation::getInstance().getElapsedTimeRigid());
+					ImGui::Text("  Secondary Elapsed: %.2f ms", Physics::Fluid::FluidSimulation::getInstance().getElapsedTimeSecondary());
+
+					bool accuracyMetrics = Physics::Fluid::FluidSimulation::getInstance().getAccuracyMetrics();
+					if (ImGui::Checkbox("Accuracy Metrics", &accuracyMetrics))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setAccuracyMetrics(accuracyMetrics);
+					}
+					if (accuracyMetrics)
+					{
+						const Physics::Fluid::AccuracyMetrics& accuracy = Physics::Fluid::FluidSimulation::getInstance().getAccuracy();
+						ImGui::SameLine();
+						ImGui::Text("(%.3f ms, %.2f%% of the step)", accuracy.ms, simTime > 0.0f ? accuracy.ms * 100.0 / simTime : 0.0);
+						if (accuracy.densityValid)
+						{
+							ImGui::Text("  Density Error:     %.2f%% mean, %.2f%% max", accuracy.meanDensityError * 100.0f, accuracy.maxDensityError * 100.0f);
+						}
+						ImGui::Text("  Energy:            %.1f kinetic, %.1f potential, %.1f total", accuracy.kineticEnergy, accuracy.potentialEnergy,
+							accuracy.kineticEnergy + accuracy.potentialEnergy);
+						ImGui::Text("  Momentum Drift:    %.4f", accuracy.momentumDrift);
+						ImGui::Text("  Max Velocity:      %.2f, CFL %.3f", accuracy.maxSpeed, accuracy.cfl);
+					}
+
+					Core::SimulationArena& arena = Core::SimulationArena::getInstance();
+					ImGui::Text("  Arena:             %.1f MiB in use, %.1f MiB peak, %u blocks (%s)", arena.getInUse() / 1048576.0,
+						arena.getPeak() / 1048576.0, arena.getBlockCount(), arena.getHugePageStatus());
+
+					bool hardwareCounters = Physics::Fluid::FluidSimulation::getInstance().getHardwareCounters();
+					if (ImGui::Checkbox("Hardware Counters", &hardwareCounters))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setHardwareCounters(hardwareCounters);
+					}
+					ImGui::SameLine();
+					ImGui::Text("(%s)", Physics::Fluid::FluidSimulation::getInstance().getHardwareCounterStatus());
+					const uint32 counterParticles = Physics::Fluid::FluidSimulation::getInstance().getPhaseCounterParticles();
+					if (hardwareCounters && counterParticles == 0)
+					{
+						ImGui::Text("  Phase counters:    n/a, only the single-rate SPH solver is counted");
+					}
+					if (hardwareCounters && counterParticles > 0)
+					{
+						const char* phaseNames[] = { "Gravity", "Spatial", "Density", "Pressure", "Viscosity", "PosNColl" };
+						const double phaseTimes[] = {
+							Physics::Fluid::FluidSimulation::getInstance().getElapsedTimeGravity(),
+							Physics::Fluid::FluidSimulation::getInstance().getElapsedTimeSpatial(),
+							Physics::Fluid::FluidSimulation::getInstance().getElapsedTimeDensity(),
+							Physics::Fluid::FluidSimulation::getInstance().getElapsedTimePressure(),
+							Physics::Fluid::FluidSimulation::getInstance().getElapsedTimeViscosity(),
+							Physics::Fluid::FluidSimulation::getInstance().getElapsedTimePosNColl()
+						};
+						for (uint32 phase = 0; phase < (uint32)Physics::Fluid::SimPhase::Count; phase++)
+						{
+							const Core::PerfValues& counters = Physics::Fluid::FluidSimulation::getInstance().getPhaseCounters((Physics::Fluid::SimPhase)phase);
+							const double cycles = counters.get(Core::PerfEvent::Cycles);
+							const double ipc = cycles > 0.0 ? counters.get(Core::PerfEvent::Instructions) / cycles : 0.0;
+							const double llcMisses = counters.get(Core::PerfEvent::LLCMisses);
+							// Every LLC miss moves one 64 byte line from memory, a lower bound on the bandwidth.
+							const double bandwidth = phaseTimes[phase] > 0.0 ? llcMisses * 64.0 / (phaseTimes[phase] * 1e6) : 0.0;
+							ImGui::Text("  %-10s IPC %.2f, %.2f LLC miss/p, %.2f branch miss/p, %.2f GB/s, %.2f dTLB miss/p, %.0f faults", phaseNames[phase],
+								counters.has(Core::PerfEvent::Instructions) ? ipc : 0.0,
+								counters.has(Core::PerfEvent::LLCMisses) ? llcMisses / counterParticles : 0.0,
+								counters.has(Core::PerfEvent::BranchMisses) ? counters.get(Core::PerfEvent::BranchMisses) / counterParticles : 0.0,
+								counters.has(Core::PerfEvent::LLCMisses) ? bandwidth : 0.0,
+								counters.has(Core::PerfEvent::DTLBMisses) ? counters.get(Core::PerfEvent::DTLBMisses) / counterParticles : 0.0,
+								counters.has(Core::PerfEvent::PageFaults) ? counters.get(Core::PerfEvent::PageFaults) : 0.0);
+						}
+					}
+					if (Physics::Fluid::FluidSimulation::getInstance().getImplicitViscosity())
+					{
+						ImGui::Text("  Viscosity CG:      %i iterations, %.5f residual", Physics::Fluid::FluidSimulation::getInstance().getViscosityIterations(),
+							Physics::Fluid::FluidSimulation::getInstance().getViscosityResidual());
+					}
+					if (Physics::Fluid::FluidSimulation::getInstance().getMultiRate())
+					{
+						ImGui::Text("  Multi-Rate:        %i levels, %u particle updates", Physics::Fluid::FluidSimulation::getInstance().getMultiRateLevel() + 1,
+							Physics::Fluid::FluidSimulation::getInstance().getMultiRateUpdates());
+					}
+					if (Physics::Fluid::FluidSimulation::getInstance().getSleeping())
+					{
+						ImGui::Text("  Awake Particles:   %u / %i", Physics::Fluid::FluidSimulation::getInstance().getAwakeCount(), particleAmount);
+					}
+					if (Physics::Fluid::FluidSimulation::getInstance().getAdaptiveResolution())
+					{
+						ImGui::Text("  Adaptive:          %u splits, %u merges", Physics::Fluid::FluidSimulation::getInstance().getAdaptiveSplits(),
+							Physics::Fluid::FluidSimulation::getInstance().getAdaptiveMerges());
+					}
+					ImGui::Text("  Spatial Movers:    %u (%s)", Physics::Fluid::FluidSimulation::getInstance().getSpatialMoverCount(),
+						Physics::Fluid::FluidSimulation::getInstance().getSpatialFullRebuild() ? "full rebuild" : "incremental");
+					if (Physics::Fluid::FluidSimulation::getInstance().getSolverType() == Physics::Fluid::SolverType::DFSPH)
+					{
+						ImGui::Text("  DFSPH Substeps:    %i", Physics::Fluid::FluidSimulation::getInstance().getDFSPHSubsteps());
+						ImGui::Text("  DFSPH Iterations:  %i density, %i divergence", Physics::Fluid::FluidSimulation::getInstance().getDFSPHDensityIterations(),
+							Physics::Fluid::FluidSimulation::getInstance().getDFSPHDivergenceIterations());
+						ImGui::Text("  DFSPH Density Err: %.3f %%", Physics::Fluid::FluidSimulation::getInstance().getDFSPHDensityError() * 100.0f);
+					}
+					if (Physics::Fluid::FluidSimulation::getInstance().getSolverType() == Physics::Fluid::SolverType::PBF)
+					{
+						ImGui::Text("  PBF Density Err:   %.3f %%", Physics::Fluid::FluidSimulation::getInstance().getPBFDensityError() * 100.0f);
+					}
+					if (Physics::Fluid::FluidSimulation::getInstance().getSolverType() == Physics::Fluid::SolverType::FLIP)
+					{
+						Physics::Fluid::FlipSolver& flip = Physics::Fluid::FluidSimulation::getInstance().getFlipSolver();
+						ImGui::Text("  FLIP Substeps:     %i", flip.substeps);
+						ImGui::Text("  FLIP Fluid Cells:  %u", flip.fluidCellCount);
+						ImGui::Text("  FLIP CG:           %i iterations, %.5f residual", flip.pressureIterations, flip.pressureResidual);
+					}
+				}
+			}
+			if (ImGui::CollapsingHeader("PROFILER"))
+			{
+				static char tracePath[256] = "trace.json";
+#ifndef FLUIDSIM_PROFILER
+				ImGui::Text("Built without FLUIDSIM_PROFILER, no zones are recorded.");
+#endif
+				if (ImGui::BeginTable("ProfilerStats", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+				{
+					ImGui::TableSetupColumn("Zone");
+					ImGui::TableSetupColumn("Last");
+					ImGui::TableSetupColumn("Min");
+					ImGui::TableSetupColumn("Avg");
+					ImGui::TableSetupColumn("P99");
+					ImGui::TableHeadersRow();
+					for (const Core::ProfileStats& zone : Core::Profiler::getInstance().getStats())
+					{
+						ImGui::TableNextColumn(); ImGui::Text("%s", zone.name.c_str());
+						ImGui::TableNextColumn(); ImGui::Text("%.2f ms", zone.last);
+						ImGui::TableNextColumn(); ImGui::Text("%.2f ms", zone.min);
+						ImGui::TableNextColumn(); ImGui::Text("%.2f ms", zone.avg);
+						ImGui::TableNextColumn(); ImGui::Text("%.2f ms", zone.p99);
+					}
+					ImGui::EndTable();
+				}
+
+				ImGui::InputText("Trace Path", tracePath, sizeof(tracePath));
+				if (ImGui::Button("Export Chrome Trace", { 150,25 }))
+				{
+					Core::Profiler::getInstance().exportChromeTrace(tracePath);
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Reset Stats", { 100,25 }))
+				{
+					Core::Profiler::getInstance().resetStats();
+				}
+			}
+			if (ImGui::CollapsingHeader("ROOFLINE"))
+			{
+				static char rooflinePath[256] = "roofline.csv";
+				bool roofline = Physics::Fluid::FluidSimulation::getInstance().getRooflineAnalysis();
+				if (ImGui::Checkbox("Roofline Analysis", &roofline))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setRooflineAnalysis(roofline);
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Measure Machine", { 120,20 }))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().measureMachineRoofline();
+				}
+
+				const Core::MachineRoofline& machine = Physics::Fluid::FluidSimulation::getInstance().getMachineRoofline();
+				ImGui::Text("Bandwidth: %.1f GB/s, Peak: %.1f GFLOP/s, Ridge: %.2f FLOP/B", machine.bandwidth, machine.peakFlops,
+					machine.bandwidth > 0.0 ? machine.peakFlops / machine.bandwidth : 0.0);
+
+				const uint32 rooflineParticles = Physics::Fluid::FluidSimulation::getInstance().getRooflineParticles();
+				if (roofline && rooflineParticles > 0 && ImGui::BeginTable("RooflinePhases", 7, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+				{
+					ImGui::TableSetupColumn("Phase");
+					ImGui::TableSetupColumn("Cand/p");
+					ImGui::TableSetupColumn("Neigh/p");
+					ImGui::TableSetupColumn("FLOP/B");
+					ImGui::TableSetupColumn("GFLOP/s");
+					ImGui::TableSetupColumn("GB/s");
+					ImGui::TableSetupColumn("Roof");
+					ImGui::TableHeadersRow();
+					const char* phaseNames[] = { "Gravity", "Spatial", "Density", "Pressure", "Viscosity", "PosNColl" };
+					for (uint32 phase = 0; phase < (uint32)Physics::Fluid::SimPhase::Count; phase++)
+					{
+						const Physics::Fluid::PhaseRoofline& row = Physics::Fluid::FluidSimulation::getInstance().getPhaseRoofline((Physics::Fluid::SimPhase)phase);
+						if (row.bytes <= 0.0) continue;
+						ImGui::TableNextColumn(); ImGui::Text("%s", phaseNames[phase]);
+						ImGui::TableNextColumn(); ImGui::Text("%.1f", row.candidates / rooflineParticles);
+						ImGui::TableNextColumn(); ImGui::Text("%.1f", row.neighbours / rooflineParticles);
+						ImGui::TableNextColumn(); ImGui::Text("%.3f", row.intensity);
+						ImGui::TableNextColumn(); ImGui::Text("%.2f", row.achieved);
+						ImGui::TableNextColumn(); ImGui::Text("%.1f", row.bandwidth);
+						ImGui::TableNextColumn(); ImGui::Text("%.0f %%", row.attainable > 0.0 ? row.achieved / row.attainable * 100.0 : 0.0);
+					}
+					ImGui::EndTable();
+				}
+
+				ImGui::InputText("Report Path", rooflinePath, sizeof(rooflinePath));
+				if (ImGui::Button("Export Report", { 100,25 }))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().exportRooflineReport(rooflinePath);
+				}
+			}
+			if (ImGui::CollapsingHeader("ALLOCATIONS"))
+			{
+				Core::AllocationTracker& tracker = Core::AllocationTracker::getInstance();
+				bool tracking = tracker.getEnabled();
+				if (ImGui::Checkbox("Track Allocations", &tracking))
+				{
+					tracker.setEnabled(tracking);
+				}
+				ImGui::SameLine();
+				bool strict = tracker.getStrict();
+				if (ImGui::Checkbox("Strict", &strict))
+				{
+					tracker.setStrict(strict);
+				}
+				ImGui::Text("Steps: %llu, Failed: %llu", (unsigned long long)tracker.getSteps(), (unsigned long long)tracker.getFailedSteps());
+				ImGui::SameLine();
+				if (ImGui::Button("Reset Failures", { 110,20 }))
+				{
+					tracker.resetFailedSteps();
+				}
+
+				if (tracker.getLastAllocatingStepIndex() > 0)
+				{
+					ImGui::Text("Last allocating step: %llu", (unsigned long long)tracker.getLastAllocatingStepIndex());
+					for (const Core::PhaseAllocations& phase : tracker.getLastAllocatingStep())
+					{
+						ImGui::Text("  %s: %llu allocations, %llu bytes", phase.phase, (unsigned long long)phase.count, (unsigned long long)phase.bytes);
+						for (const Core::AllocationSite& site : phase.sites)
+						{
+							ImGui::Text("    %llu x %s", (unsigned long long)site.count, Core::AllocationTracker::DescribeSite(site.address).c_str());
+						}
+					}
 				}
 			}
+			if (ImGui::CollapsingHeader("DASHBOARD"))
+			{
+				Physics::Fluid::FluidSimulation& simulation = Physics::Fluid::FluidSimulation::getInstance();
+				bool dashboard = simulation.getDashboard();
+				if (ImGui::Checkbox("Live Dashboard", &dashboard))
+				{
+					simulation.setDashboard(dashboard);
+				}
+
+				// Copied out of the simulation's rings every frame, the solver never waits on the UI.
+				static Physics::Fluid::DashboardSample samples[Physics::Fluid::FluidSimulation::DashboardLength];
+				static Physics::Fluid::DashboardHistograms histograms[4];
+				const uint32 count = simulation.getDashboardSamples().Read(samples, Physics::Fluid::FluidSimulation::DashboardLength);
+				const uint32 histogramCount = simulation.getDashboardHistograms().Read(histograms, 4);
+
+				const uint32 layers = (uint32)Physics::Fluid::SimPhase::Count + 3;
+				const char* layerNames[layers] = { "Gravity", "Spatial", "Density", "Pressure", "Viscosity", "PosNColl", "Rigid", "Secondary", "Other" };
+				ImU32 layerColors[layers];
+				for (uint32 layer = 0; layer < layers; layer++)
+				{
+					layerColors[layer] = ImColor::HSV(layer / (float)layers, 0.6f, 0.9f);
+				}
+
+				if (dashboard && count > 0)
+				{
+					const Physics::Fluid::DashboardSample& last = samples[count - 1];
+					ImGui::Text("Step: %.2f ms, Particles: %u, Threads: %u", last.stepMs, last.particles, last.threads);
+					ImGui::Text("Memory: %.1f MiB resident, %.1f MiB arena", last.residentMiB, last.arenaMiB);
+
+					char overlay[64];
+					const float graphWidth = ImGui::GetContentRegionAvail().x;
+					for (uint32 phase = 0; phase < (uint32)Physics::Fluid::SimPhase::Count; phase++)
+					{
+						float peak = 0.0f;
+						for (uint32 i = 0; i < count; i++) peak = std::max(peak, samples[i].phaseMs[phase]);
+						snprintf(overlay, sizeof(overlay), "%s %.2f ms, max %.2f", layerNames[phase], last.phaseMs[phase], peak);
+						ImGui::PushID(phase);
+						ImGui::PlotLines("##Phase", &samples[0].phaseMs[phase], count, 0, overlay, 0.0f, peak * 1.1f + 0.001f, { graphWidth, 40.0f }, sizeof(Physics::Fluid::DashboardSample));
+						ImGui::PopID();
+					}
+
+					// Stacked breakdown of each step, oldest on the left, the column height is the whole Update.
+					float stepPeak = 0.0f;
+					for (uint32 i = 0; i < count; i++) stepPeak = std::max(stepPeak, samples[i].stepMs);
+					ImGui::Text("Step breakdown, max %.2f ms", stepPeak);
+					const ImVec2 origin = ImGui::GetCursorScreenPos();
+					const ImVec2 size = { graphWidth, 120.0f };
+					ImDrawList* drawList = ImGui::GetWindowDrawList();
+					drawList->AddRectFilled(origin, { origin.x + size.x, origin.y + size.y }, IM_COL32(25, 25, 30, 255));
+					const float columnWidth = size.x / Physics::Fluid::FluidSimulation::DashboardLength;
+					for (uint32 i = 0; i < count && stepPeak > 0.0f; i++)
+					{
+						const Physics::Fluid::DashboardSample& sample = samples[i];
+						float values[layers];
+						float accounted = 0.0f;
+						for (uint32 phase = 0; phase < (uint32)Physics::Fluid::SimPhase::Count; phase++)
+						{
+							values[phase] = sample.phaseMs[phase];
+							accounted += sample.phaseMs[phase];
+						}
+						values[layers - 3] = sample.rigidMs;
+						values[layers - 2] = sample.secondaryMs;
+						values[layers - 1] = std::max(0.0f, sample.stepMs - accounted - sample.rigidMs - sample.secondaryMs);
+
+						const float x = origin.x + size.x - (count - i) * columnWidth;
+						float bottom = origin.y + size.y;
+						for (uint32 layer = 0; layer < layers; layer++)
+						{
+							const float top = std::max(origin.y, bottom - values[layer] / stepPeak * size.y);
+							drawList->AddRectFilled({ x, top }, { x + columnWidth, bottom }, layerColors[layer]);
+							bottom = top;
+						}
+					}
+					ImGui::Dummy(size);
+					for (uint32 layer = 0; layer < layers; layer++)
+					{
+						ImGui::ColorButton(layerNames[layer], ImColor(layerColors[layer]), ImGuiColorEditFlags_NoTooltip, { 10, 10 });
+						ImGui::SameLine();
+						ImGui::Text("%s", layerNames[layer]);
+						if (layer % 5 != 4 && layer + 1 < layers) ImGui::SameLine();
+					}
+
+					float residentPeak = 0.0f;
+					for (uint32 i = 0; i < count; i++) residentPeak = std::max(residentPeak, samples[i].residentMiB);
+					snprintf(overlay, sizeof(overlay), "Resident %.1f MiB, max %.1f", last.residentMiB, residentPeak);
+					ImGui::PlotLines("##Resident", &samples[0].residentMiB, count, 0, overlay, 0.0f, residentPeak * 1.1f + 0.001f, { graphWidth, 40.0f }, sizeof(Physics::Fluid::DashboardSample));
+
+					if (simulation.getAccuracyMetrics())
+					{
+						float errorPeak = 0.0f;
+						float cflPeak = 0.0f;
+						for (uint32 i = 0; i < count; i++)
+						{
+							errorPeak = std::max(errorPeak, samples[i].densityError);
+							cflPeak = std::max(cflPeak, samples[i].cfl);
+						}
+						snprintf(overlay, sizeof(overlay), "Density error %.2f%%, max %.2f%%", last.densityError * 100.0f, errorPeak * 100.0f);
+						ImGui::PlotLines("##DensityError", &samples[0].densityError, count, 0, overlay, 0.0f, errorPeak * 1.1f + 0.0001f, { graphWidth, 40.0f }, sizeof(Physics::Fluid::DashboardSample));
+						snprintf(overlay, sizeof(overlay), "CFL %.3f, max %.3f", last.cfl, cflPeak);
+						ImGui::PlotLines("##CFL", &samples[0].cfl, count, 0, overlay, 0.0f, cflPeak * 1.1f + 0.001f, { graphWidth, 40.0f }, sizeof(Physics::Fluid::DashboardSample));
+					}
+				}
+
+				if (dashboard && histogramCount > 0)
+				{
+					const Physics::Fluid::DashboardHistograms& latest = histograms[histogramCount - 1];
+					static float neighbourBins[Physics::Fluid::DashboardHistograms::NeighbourBins];
+					static float bucketBins[Physics::Fluid::DashboardHistograms::BucketBins];
+					float neighbourSum = 0.0f;
+					float neighbourPeak = 0.0f;
+					for (uint32 bin = 0; bin < Physics::Fluid::DashboardHistograms::NeighbourBins; bin++)
+					{
+						neighbourBins[bin] = (float)latest.neighbours[bin];
+						neighbourSum += bin * neighbourBins[bin];
+						neighbourPeak = std::max(neighbourPeak, neighbourBins[bin]);
+					}
+					float bucketPeak = 0.0f;
+					for (uint32 bin = 0; bin < Physics::Fluid::DashboardHistograms::BucketBins; bin++)
+					{
+						bucketBins[bin] = (float)latest.buckets[bin];
+						bucketPeak = std::max(bucketPeak, bucketBins[bin]);
+					}
+
+					char overlay[64];
+					const float graphWidth = ImGui::GetContentRegionAvail().x;
+					snprintf(overlay, sizeof(overlay), "Neighbours per particle, mean %.1f", latest.particles > 0 ? neighbourSum / latest.particles : 0.0f);
+					ImGui::PlotHistogram("##Neighbours", neighbourBins, Physics::Fluid::DashboardHistograms::NeighbourBins, 0, overlay, 0.0f, neighbourPeak * 1.1f, { graphWidth, 70.0f });
+					snprintf(overlay, sizeof(overlay), "Particles per bucket, %u empty, %u shared", latest.buckets[0], latest.sharedBuckets);
+					ImGui::PlotHistogram("##Buckets", bucketBins, Physics::Fluid::DashboardHistograms::BucketBins, 0, overlay, 0.0f, bucketPeak * 1.1f, { graphWidth, 70.0f });
+				}
+			}
+			if (ImGui::CollapsingHeader("METRICS"))
+			{
+				static int metricsPort = 9464;
+				static char metricsAddress[64] = "127.0.0.1";
+				Physics::Fluid::FluidSimulation& simulation = Physics::Fluid::FluidSimulation::getInstance();
+				const bool serving = simulation.getMetricsServer();
+				ImGui::InputText("Address", metricsAddress, sizeof(metricsAddress), serving ? ImGuiInputTextFlags_ReadOnly : 0);
+				ImGui::InputInt("Port", &metricsPort, 1, 100, serving ? ImGuiInputTextFlags_ReadOnly : 0);
+				if (ImGui::Button(serving ? "Stop Server" : "Start Server", { 100,25 }))
+				{
+					if (serving) simulation.stopMetricsServer();
+					else simulation.startMetricsServer((uint16)std::clamp(metricsPort, 1, 65535), metricsAddress);
+				}
+				ImGui::Text("%s", simulation.getMetricsServerStatus());
+				ImGui::Text("Scrapes: %llu", (unsigned long long)simulation.getMetricsScrapes());
+			}
 			if (ImGui::CollapsingHeader("PARTICLE DATA"))
 			{
 				int targetParticle = CurrentParticle;
@@ -361,6 +763,13 @@ namespace Game
 				}
 			}
 
+			const char* solvers[] = { "SPH", "DFSPH", "PBF", "FLIP/APIC" };
+			int solver = (int)Physics::Fluid::FluidSimulation::getInstance().getSolverType();
+			if (ImGui::Combo("Solver", &solver, solvers, IM_ARRAYSIZE(solvers)))
+			{
+				Physics::Fluid::FluidSimulation::getInstance().setSolverType((Physics::Fluid::SolverType)solver);
+			}
+
 			bool gravity = Physics::Fluid::FluidSimulation::getInstance().getGravityStatus();
 			if (ImGui::Checkbox("Gravity", &gravity))
 			{
@@ -391,18 +800,218 @@ namespace Game
 				Physics::Fluid::FluidSimulation::getInstance().setNearPressureMultiplier(nearPressureMulti);
 			}
 
+			bool implicitViscosity = Physics::Fluid::FluidSimulation::getInstance().getImplicitViscosity();
+			if (ImGui::Checkbox("Implicit Viscosity", &implicitViscosity))
+			{
+				Physics::Fluid::FluidSimulation::getInstance().setImplicitViscosity(implicitViscosity);
+			}
+
+			// The explicit blend goes unstable above 1, the implicit solve takes honey-like strengths.
 			float viscosityStrength = Physics::Fluid::FluidSimulation::getInstance().getViscosityStrength();
-			if (ImGui::SliderFloat("Viscosity Strength", &viscosityStrength, 0.0f, 1.0f))
+			if (ImGui::SliderFloat("Viscosity Strength", &viscosityStrength, 0.0f, implicitViscosity ? 500.0f : 1.0f))
 			{
 				Physics::Fluid::FluidSimulation::getInstance().setViscosityStrength(viscosityStrength);
 			}
 
+			if (implicitViscosity)
+			{
+				int viscosityIterations = Physics::Fluid::FluidSimulation::getInstance().getViscosityMaxIterations();
+				if (ImGui::SliderInt("Viscosity Max Iterations", &viscosityIterations, 1, 200))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setViscosityMaxIterations(viscosityIterations);
+				}
+
+				float viscosityTolerance = Physics::Fluid::FluidSimulation::getInstance().getViscosityTolerance();
+				if (ImGui::SliderFloat("Viscosity Tolerance", &viscosityTolerance, 0.00001f, 0.01f, "%.5f"))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setViscosityTolerance(viscosityTolerance);
+				}
+			}
+
 			float gravityScale = Physics::Fluid::FluidSimulation::getInstance().getGravityScale();
 			if (ImGui::SliderFloat("Gravity Scale", &gravityScale, 0.0f, 10.0f))
 			{
 				Physics::Fluid::FluidSimulation::getInstance().setGravityScale(gravityScale);
 			}
 
+			if (Physics::Fluid::FluidSimulation::getInstance().getSolverType() == Physics::Fluid::SolverType::SPH)
+			{
+				bool multiRate = Physics::Fluid::FluidSimulation::getInstance().getMultiRate();
+				if (ImGui::Checkbox("Multi-Rate Stepping", &multiRate))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setMultiRate(multiRate);
+				}
+
+				bool adaptive = Physics::Fluid::FluidSimulation::getInstance().getAdaptiveResolution();
+				if (ImGui::Checkbox("Adaptive Resolution", &adaptive))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setAdaptiveResolution(adaptive);
+				}
+
+				if (adaptive)
+				{
+					int maxRefine = Physics::Fluid::FluidSimulation::getInstance().getAdaptiveMaxRefine();
+					if (ImGui::SliderInt("Max Refine Level", &maxRefine, 0, 3))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setAdaptiveMaxRefine(maxRefine);
+					}
+
+					int maxCoarsen = Physics::Fluid::FluidSimulation::getInstance().getAdaptiveMaxCoarsen();
+					if (ImGui::SliderInt("Max Coarsen Level", &maxCoarsen, 0, 3))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setAdaptiveMaxCoarsen(maxCoarsen);
+					}
+
+					float surfaceRatio = Physics::Fluid::FluidSimulation::getInstance().getAdaptiveSurfaceRatio();
+					if (ImGui::SliderFloat("Surface Density Ratio", &surfaceRatio, 0.1f, 1.0f))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setAdaptiveSurfaceRatio(surfaceRatio);
+					}
+
+					float vorticity = Physics::Fluid::FluidSimulation::getInstance().getAdaptiveVorticity();
+					if (ImGui::SliderFloat("Refine Vorticity", &vorticity, 0.0f, 20.0f))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setAdaptiveVorticity(vorticity);
+					}
+
+					int interval = Physics::Fluid::FluidSimulation::getInstance().getAdaptiveInterval();
+					if (ImGui::SliderInt("Adapt Interval", &interval, 1, 60))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setAdaptiveInterval(interval);
+					}
+				}
+
+				bool sleeping = Physics::Fluid::FluidSimulation::getInstance().getSleeping();
+				if (ImGui::Checkbox("Sleeping Regions", &sleeping))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setSleeping(sleeping);
+				}
+
+				if (sleeping)
+				{
+					float sleepVelocity = Physics::Fluid::FluidSimulation::getInstance().getSleepVelocity();
+					if (ImGui::SliderFloat("Sleep Velocity", &sleepVelocity, 0.0f, 5.0f))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setSleepVelocity(sleepVelocity);
+					}
+
+					float sleepDensityError = Physics::Fluid::FluidSimulation::getInstance().getSleepDensityError();
+					if (ImGui::SliderFloat("Sleep Density Error", &sleepDensityError, 0.0f, 1.0f))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setSleepDensityError(sleepDensityError);
+					}
+
+					int sleepSteps = Physics::Fluid::FluidSimulation::getInstance().getSleepSteps();
+					if (ImGui::SliderInt("Sleep Steps", &sleepSteps, 1, 240))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setSleepSteps(sleepSteps);
+					}
+				}
+
+				if (multiRate)
+				{
+					int maxLevel = Physics::Fluid::FluidSimulation::getInstance().getMultiRateMaxLevel();
+					if (ImGui::SliderInt("Max Time Level", &maxLevel, 0, 7))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setMultiRateMaxLevel(maxLevel);
+					}
+
+					float cfl = Physics::Fluid::FluidSimulation::getInstance().getMultiRateCFL();
+					if (ImGui::SliderFloat("Time Level CFL", &cfl, 0.01f, 1.0f))
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setMultiRateCFL(cfl);
+					}
+				}
+			}
+
+			bool incrementalSpatial = Physics::Fluid::FluidSimulation::getInstance().getIncrementalSpatial();
+			if (ImGui::Checkbox("Incremental Spatial Lookup", &incrementalSpatial))
+			{
+				Physics::Fluid::FluidSimulation::getInstance().setIncrementalSpatial(incrementalSpatial);
+			}
+
+			float churnThreshold = Physics::Fluid::FluidSimulation::getInstance().getSpatialChurnThreshold();
+			if (ImGui::SliderFloat("Spatial Churn Threshold", &churnThreshold, 0.0f, 1.0f))
+			{
+				Physics::Fluid::FluidSimulation::getInstance().setSpatialChurnThreshold(churnThreshold);
+			}
+
+			if (Physics::Fluid::FluidSimulation::getInstance().getSolverType() == Physics::Fluid::SolverType::DFSPH && ImGui::CollapsingHeader("DFSPH"))
+			{
+				int maxIterations = Physics::Fluid::FluidSimulation::getInstance().getDFSPHMaxIterations();
+				if (ImGui::SliderInt("Max Iterations", &maxIterations, 1, 200))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setDFSPHMaxIterations(maxIterations);
+				}
+
+				float densityTolerance = Physics::Fluid::FluidSimulation::getInstance().getDFSPHDensityTolerance();
+				if (ImGui::SliderFloat("Density Tolerance", &densityTolerance, 0.0001f, 0.05f, "%.4f"))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setDFSPHDensityTolerance(densityTolerance);
+				}
+
+				float divergenceTolerance = Physics::Fluid::FluidSimulation::getInstance().getDFSPHDivergenceTolerance();
+				if (ImGui::SliderFloat("Divergence Tolerance", &divergenceTolerance, 0.0001f, 0.1f, "%.4f"))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setDFSPHDivergenceTolerance(divergenceTolerance);
+				}
+
+				float maxTimeStep = Physics::Fluid::FluidSimulation::getInstance().getDFSPHMaxTimeStep();
+				if (ImGui::SliderFloat("Max Time Step", &maxTimeStep, 0.001f, 0.2f, "%.4f"))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setDFSPHMaxTimeStep(maxTimeStep);
+				}
+
+				bool warmStart = Physics::Fluid::FluidSimulation::getInstance().getDFSPHWarmStart();
+				if (ImGui::Checkbox("Warm Start", &warmStart))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setDFSPHWarmStart(warmStart);
+				}
+			}
+
+			if (Physics::Fluid::FluidSimulation::getInstance().getSolverType() == Physics::Fluid::SolverType::PBF && ImGui::CollapsingHeader("PBF"))
+			{
+				int iterations = Physics::Fluid::FluidSimulation::getInstance().getPBFIterations();
+				if (ImGui::SliderInt("Iterations", &iterations, 1, 20))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setPBFIterations(iterations);
+				}
+
+				float timeStep = Physics::Fluid::FluidSimulation::getInstance().getPBFTimeStep();
+				if (ImGui::SliderFloat("Time Step", &timeStep, 0.001f, 0.1f, "%.4f"))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setPBFTimeStep(timeStep);
+				}
+
+				float relaxation = Physics::Fluid::FluidSimulation::getInstance().getPBFRelaxation();
+				if (ImGui::SliderFloat("Relaxation", &relaxation, 0.01f, 100.0f, "%.2f"))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setPBFRelaxation(relaxation);
+				}
+
+				float xsph = Physics::Fluid::FluidSimulation::getInstance().getPBFXSPHViscosity();
+				if (ImGui::SliderFloat("XSPH Viscosity", &xsph, 0.0f, 0.5f))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setPBFXSPHViscosity(xsph);
+				}
+
+				float tensile = Physics::Fluid::FluidSimulation::getInstance().getPBFTensileStrength();
+				if (ImGui::SliderFloat("Artificial Pressure", &tensile, 0.0f, 0.01f, "%.4f"))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setPBFTensileStrength(tensile);
+				}
+			}
+
+			if (Physics::Fluid::FluidSimulation::getInstance().getSolverType() == Physics::Fluid::SolverType::FLIP && ImGui::CollapsingHeader("FLIP/APIC"))
+			{
+				Physics::Fluid::FlipSolver& flip = Physics::Fluid::FluidSimulation::getInstance().getFlipSolver();
+				ImGui::SliderFloat("Cell Size", &flip.cellSize, 0.1f, 2.0f);
+				ImGui::SliderFloat("FLIP Ratio", &flip.flipRatio, 0.0f, 1.0f);
+				ImGui::SliderInt("CG Max Iterations", &flip.maxIterations, 1, 1000);
+				ImGui::SliderFloat("CG Tolerance", &flip.pressureTolerance, 0.000001f, 0.01f, "%.6f");
+				ImGui::SliderInt("Max Substeps", &flip.maxSubsteps, 1, 32);
+			}
+
 			glm::vec3 bound = Physics::Fluid::FluidSimulation::getInstance().getBounds();
 			float b[3] = {bound.x, bound.y, bound.z};
 			if (ImGui::SliderFloat3("Bounding Volume", b, 0.0f, 30.0f, "%.6f"))
@@ -410,6 +1019,287 @@ namespace Game
 				Physics::Fluid::FluidSimulation::getInstance().setBound({b[0], b[1], b[2]});
 			}
 
+			glm::bvec3 periodic = Physics::Fluid::FluidSimulation::getInstance().getPeriodic();
+			bool periodicChanged = ImGui::Checkbox("Periodic X", &periodic.x);
+			ImGui::SameLine();
+			periodicChanged |= ImGui::Checkbox("Periodic Y", &periodic.y);
+			ImGui::SameLine();
+			periodicChanged |= ImGui::Checkbox("Periodic Z", &periodic.z);
+			if (periodicChanged)
+			{
+				Physics::Fluid::FluidSimulation::getInstance().setPeriodic(periodic);
+			}
+
+			if (ImGui::CollapsingHeader("BOUND ANIMATION"))
+			{
+				bool animate = Physics::Fluid::FluidSimulation::getInstance().getBoundAnimation();
+				if (ImGui::Checkbox("Animate Bound", &animate))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setBoundAnimation(animate);
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Restart", { 100,25 }))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().resetBoundAnimation();
+				}
+
+				std::vector<Physics::Fluid::BoundKeyframe> keys = Physics::Fluid::FluidSimulation::getInstance().getBoundKeyframes();
+				bool keysChanged = false;
+				if (ImGui::Button("Slosh Preset", { 100,25 }))
+				{
+					// Tilts back and forth about z while sliding along x, and ends where it started so it loops smoothly.
+					keys.assign(5, {});
+					for (int k = 0; k < 5; k++)
+					{
+						keys[k].time = k * 0.75f;
+					}
+					keys[1].position = { 1.0f, 0.0f, 0.0f };
+					keys[1].rotation = glm::angleAxis(glm::radians(15.0f), glm::vec3(0, 0, 1));
+					keys[3].position = { -1.0f, 0.0f, 0.0f };
+					keys[3].rotation = glm::angleAxis(glm::radians(-15.0f), glm::vec3(0, 0, 1));
+					keysChanged = true;
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Add Keyframe", { 100,25 }))
+				{
+					Physics::Fluid::BoundKeyframe key;
+					key.time = keys.empty() ? 0.0f : keys.back().time + 1.0f;
+					keys.push_back(key);
+					keysChanged = true;
+				}
+
+				for (size_t k = 0; k < keys.size(); k++)
+				{
+					ImGui::PushID((int)k);
+					ImGui::Separator();
+					keysChanged |= ImGui::DragFloat("Time", &keys[k].time, 0.01f, 0.0f, 60.0f);
+					keysChanged |= ImGui::DragFloat3("Position", &keys[k].position.x, 0.01f);
+					glm::vec3 euler = glm::degrees(glm::eulerAngles(keys[k].rotation));
+					if (ImGui::DragFloat3("Rotation", &euler.x, 0.5f, -180.0f, 180.0f))
+					{
+						keys[k].rotation = glm::quat(glm::radians(euler));
+						keysChanged = true;
+					}
+					if (ImGui::Button("Remove", { 100,25 }))
+					{
+						keys.erase(keys.begin() + k);
+						keysChanged = true;
+						ImGui::PopID();
+						break;
+					}
+					ImGui::PopID();
+				}
+				if (keysChanged)
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setBoundKeyframes(keys);
+				}
+			}
+
+			if (ImGui::CollapsingHeader("EMITTERS & SINKS"))
+			{
+				std::vector<Physics::Fluid::ParticleEmitter>& emitters = Physics::Fluid::FluidSimulation::getInstance().getEmitters();
+				std::vector<Physics::Fluid::ParticleSink>& sinks = Physics::Fluid::FluidSimulation::getInstance().getSinks();
+				ImGui::Text("Spawned: %u, Killed: %u", Physics::Fluid::FluidSimulation::getInstance().getSpawnedCount(),
+					Physics::Fluid::FluidSimulation::getInstance().getKilledCount());
+				if (ImGui::Button("Add Emitter", { 100,25 }))
+				{
+					emitters.push_back({});
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Add Sink", { 100,25 }))
+				{
+					sinks.push_back({});
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Clear", { 100,25 }))
+				{
+					emitters.clear();
+					sinks.clear();
+				}
+
+				const char* shapes[] = { "Box", "Sphere" };
+				for (int i = 0; i < emitters.size(); i++)
+				{
+					ImGui::PushID(i);
+					ImGui::Text("Emitter %i", i);
+					ImGui::Checkbox("Emitter Enabled", &emitters[i].enabled);
+					int shape = (int)emitters[i].shape;
+					if (ImGui::Combo("Emitter Shape", &shape, shapes, 2))
+					{
+						emitters[i].shape = (Physics::Fluid::PoolShape)shape;
+					}
+					ImGui::SliderFloat3("Emitter Centre", &emitters[i].centre[0], -15.0f, 15.0f);
+					ImGui::SliderFloat3("Emitter Size", &emitters[i].size[0], 0.05f, 5.0f);
+					ImGui::SliderFloat3("Emitter Velocity", &emitters[i].velocity[0], -20.0f, 20.0f);
+					ImGui::SliderFloat("Emitter Rate", &emitters[i].rate, 0.0f, 5000.0f);
+					int phase = emitters[i].phase;
+					if (ImGui::SliderInt("Emitter Phase", &phase, 0, Physics::Fluid::MaxFluidPhases - 1))
+					{
+						emitters[i].phase = (uint8_t)phase;
+					}
+					ImGui::PopID();
+				}
+				for (int i = 0; i < sinks.size(); i++)
+				{
+					ImGui::PushID(1000 + i);
+					ImGui::Text("Sink %i", i);
+					ImGui::Checkbox("Sink Enabled", &sinks[i].enabled);
+					int shape = (int)sinks[i].shape;
+					if (ImGui::Combo("Sink Shape", &shape, shapes, 2))
+					{
+						sinks[i].shape = (Physics::Fluid::PoolShape)shape;
+					}
+					ImGui::SliderFloat3("Sink Centre", &sinks[i].centre[0], -15.0f, 15.0f);
+					ImGui::SliderFloat3("Sink Size", &sinks[i].size[0], 0.05f, 5.0f);
+					ImGui::PopID();
+				}
+			}
+
+			if (ImGui::CollapsingHeader("PHASES"))
+			{
+				for (uint32 p = 0; p < Physics::Fluid::MaxFluidPhases; p++)
+				{
+					ImGui::PushID(2000 + p);
+					ImGui::Text("Phase %u", p);
+					Physics::Fluid::FluidPhase phase = Physics::Fluid::FluidSimulation::getInstance().getPhase(p);
+					bool changed = ImGui::SliderFloat("Density Ratio", &phase.densityRatio, 0.1f, 4.0f);
+					changed |= ImGui::SliderFloat("Pressure Scale", &phase.pressureScale, 0.1f, 4.0f);
+					changed |= ImGui::SliderFloat("Viscosity Scale", &phase.viscosityScale, 0.0f, 10.0f);
+					if (changed)
+					{
+						Physics::Fluid::FluidSimulation::getInstance().setPhase(p, phase);
+					}
+					ImGui::PopID();
+				}
+
+				ImGui::Text("Interface Tension");
+				for (uint32 a = 0; a < Physics::Fluid::MaxFluidPhases; a++)
+				{
+					for (uint32 b = a; b < Physics::Fluid::MaxFluidPhases; b++)
+					{
+						ImGui::PushID(3000 + a * Physics::Fluid::MaxFluidPhases + b);
+						float tension = Physics::Fluid::FluidSimulation::getInstance().getPhaseTension(a, b);
+						std::string label = "Tension " + std::to_string(a) + "-" + std::to_string(b);
+						if (ImGui::SliderFloat(label.c_str(), &tension, 0.0f, 2.0f))
+						{
+							Physics::Fluid::FluidSimulation::getInstance().setPhaseTension(a, b, tension);
+						}
+						ImGui::PopID();
+					}
+				}
+			}
+
+			if (ImGui::CollapsingHeader("SECONDARY PARTICLES"))
+			{
+				static char secondaryPath[256] = "secondary.ply";
+				ImGui::Text("Secondary Particles: %u", Physics::Fluid::FluidSimulation::getInstance().getSecondaryCount());
+
+				bool secondary = Physics::Fluid::FluidSimulation::getInstance().getSecondaryParticles();
+				if (ImGui::Checkbox("Secondary Enabled", &secondary))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setSecondaryParticles(secondary);
+				}
+
+				int secondaryCapacity = Physics::Fluid::FluidSimulation::getInstance().getSecondaryCapacity();
+				if (ImGui::InputInt("Secondary Capacity", &secondaryCapacity, 100000) && secondaryCapacity >= 0)
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setSecondaryCapacity(secondaryCapacity);
+				}
+
+				float trappedAirRate = Physics::Fluid::FluidSimulation::getInstance().getSecondaryTrappedAirRate();
+				if (ImGui::SliderFloat("Trapped Air Rate", &trappedAirRate, 0.0f, 1000.0f))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setSecondaryTrappedAirRate(trappedAirRate);
+				}
+
+				float waveCrestRate = Physics::Fluid::FluidSimulation::getInstance().getSecondaryWaveCrestRate();
+				if (ImGui::SliderFloat("Wave Crest Rate", &waveCrestRate, 0.0f, 1000.0f))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setSecondaryWaveCrestRate(waveCrestRate);
+				}
+
+				float secondaryLifetime = Physics::Fluid::FluidSimulation::getInstance().getSecondaryLifetime();
+				if (ImGui::SliderFloat("Foam Lifetime", &secondaryLifetime, 0.1f, 20.0f))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setSecondaryLifetime(secondaryLifetime);
+				}
+
+				float secondaryBuoyancy = Physics::Fluid::FluidSimulation::getInstance().getSecondaryBuoyancy();
+				if (ImGui::SliderFloat("Bubble Buoyancy", &secondaryBuoyancy, 0.0f, 10.0f))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setSecondaryBuoyancy(secondaryBuoyancy);
+				}
+
+				float secondaryDrag = Physics::Fluid::FluidSimulation::getInstance().getSecondaryDrag();
+				if (ImGui::SliderFloat("Bubble Drag", &secondaryDrag, 0.0f, 1.0f))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setSecondaryDrag(secondaryDrag);
+				}
+
+				ImGui::InputText("PLY Path", secondaryPath, sizeof(secondaryPath));
+				if (ImGui::Button("Export PLY", { 100,25 }))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().exportSecondaryParticles(secondaryPath);
+				}
+			}
+
+			if (ImGui::CollapsingHeader("COLLIDERS"))
+			{
+				static char colliderPath[256] = "";
+				ImGui::Text("Colliders: %u", Physics::Fluid::FluidSimulation::getInstance().getColliderCount());
+				ImGui::InputText("OBJ Path", colliderPath, sizeof(colliderPath));
+
+				float colliderCellSize = Physics::Fluid::FluidSimulation::getInstance().getColliderCellSize();
+				if (ImGui::SliderFloat("SDF Cell Size", &colliderCellSize, 0.01f, 0.5f))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setColliderCellSize(colliderCellSize);
+				}
+
+				float colliderRadius = Physics::Fluid::FluidSimulation::getInstance().getColliderRadius();
+				if (ImGui::SliderFloat("Collider Radius", &colliderRadius, 0.01f, 0.5f))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().setColliderRadius(colliderRadius);
+				}
+
+				if (ImGui::Button("Load OBJ", { 100,25 }))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().loadCollider(colliderPath);
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Clear Colliders", { 120,25 }))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().clearColliders();
+				}
+			}
+
+			if (ImGui::CollapsingHeader("RIGID BODIES"))
+			{
+				static int rigidShape = 0;
+				static float rigidSize[3] = { 0.5f, 0.25f, 0.5f };
+				static float rigidDensity = 0.5f;
+				ImGui::Text("Bodies: %u, Boundary Particles: %u, Contacts: %u", (uint32)Physics::Fluid::FluidSimulation::getInstance().getRigidBodies().size(),
+					Physics::Fluid::FluidSimulation::getInstance().getBoundaryParticleCount(), Physics::Fluid::FluidSimulation::getInstance().getRigidContactCount());
+				const char* rigidShapes[] = { "Box", "Sphere" };
+				ImGui::Combo("Body Shape", &rigidShape, rigidShapes, 2);
+				ImGui::SliderFloat3(rigidShape == 0 ? "Half Extents" : "Radius", rigidSize, 0.1f, 2.0f);
+				ImGui::SliderFloat("Relative Density", &rigidDensity, 0.1f, 3.0f);
+
+				if (ImGui::Button("Drop Body", { 100,25 }))
+				{
+					// Dropped from just under the top of the bound with a small random tilt.
+					glm::vec3 bound = Physics::Fluid::FluidSimulation::getInstance().getBounds();
+					glm::vec3 size = { rigidSize[0], rigidSize[1], rigidSize[2] };
+					float top = 0.5f * bound.y - (rigidShape == 0 ? glm::length(size) : size.x);
+					glm::quat tilt = glm::angleAxis(glm::radians((float)(rand() % 60 - 30)), glm::normalize(glm::vec3(1, 0, 1)));
+					Physics::Fluid::FluidSimulation::getInstance().addRigidBody((Physics::Fluid::RigidShape)rigidShape, size, { 0, top, 0 }, tilt, rigidDensity);
+				}
+				ImGui::SameLine();
+				if (ImGui::Button("Clear Bodies", { 100,25 }))
+				{
+					Physics::Fluid::FluidSimulation::getInstance().clearRigidBodies();
+				}
+			}
+
 			if (ImGui::CollapsingHeader("COLORS"))
 			{
 				if (ImGui::CollapsingHeader("Color 1"))
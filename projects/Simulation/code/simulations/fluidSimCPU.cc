@@ -24,6 +24,8 @@ void FluidSimCPU::initialize(int particleAmount)
 
 	glGenBuffers(1, &bufPositions);
 	glGenBuffers(1, &bufColors);
+	glGenBuffers(1, &bufSecondaryPositions);
+	glGenBuffers(1, &bufSecondaryColors);
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufPositions);
 	glBufferData(GL_SHADER_STORAGE_BUFFER, particleAmount * sizeof(glm::vec4), &Physics::Fluid::FluidSimulation::getInstance().OutPositions[0], GL_DYNAMIC_DRAW);
@@ -37,6 +39,7 @@ void FluidSimCPU::update(float dt)
 	// Run CPU Simulation
 	Physics::Fluid::FluidSimulation::getInstance().Update(dt);
 	updateColors();
+	updateSecondaryColors();
 }
 
 void FluidSimCPU::reset()
@@ -75,10 +78,30 @@ void FluidSimCPU::render(Shader& renderShader, RenderUtils::Camera& cam)
 
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufPositions);
 	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufColors);
+	drawParticles(nrParticles, particleOffsetLoc);
 
-	int numVerts = nrParticles * 6;
+	// Secondary particles go through the same billboards from buffers of their own.
+	const uint32 secondaryCount = Physics::Fluid::FluidSimulation::getInstance().getSecondaryCount();
+	if (secondaryCount > 0)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufSecondaryPositions);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, secondaryCount * sizeof(glm::vec4), &Physics::Fluid::FluidSimulation::getInstance().getSecondaryPositions()[0], GL_DYNAMIC_DRAW);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, bufSecondaryColors);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, secondaryCount * sizeof(glm::vec4), &secondaryColors[0], GL_DYNAMIC_DRAW);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bufSecondaryPositions);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, bufSecondaryColors);
+		drawParticles(secondaryCount, particleOffsetLoc);
+	}
+
+	renderShader.Disable();
+}
+
+void FluidSimCPU::drawParticles(int count, GLuint particleOffsetLoc)
+{
+	int numVerts = count * 6;
 	const int numVertsPerDrawCall = 0x44580; // has to be divisible with 6
-	int numDrawCalls = (1024 / numVertsPerDrawCall) + 1;
 	int particleOffset = 0;
 	while (numVerts > 0)
 	{
@@ -88,8 +111,6 @@ void FluidSimCPU::render(Shader& renderShader, RenderUtils::Camera& cam)
 		numVerts -= drawVertCount;
 		particleOffset += drawVertCount / 6;
 	}
-
-	renderShader.Disable();
 }
 
 FluidSimCPU::FluidSimCPU()
@@ -121,5 +142,21 @@ void FluidSimCPU::updateColors()
 				colors[i] = (1.0f - (normalized - breakpoint2) / (1.0f - breakpoint2)) * Color3 +
 					((normalized - breakpoint2) / (1.0f - breakpoint2)) * Color4;
 			}
+
+			// Other fluid phases keep the speed gradient but are tinted apart from the default one.
+			static const glm::vec4 phaseTints[Physics::Fluid::MaxFluidPhases] = {
+				{ 1.0f, 1.0f, 1.0f, 1.0f }, { 1.0f, 0.55f, 0.2f, 1.0f }, { 0.4f, 1.0f, 0.4f, 1.0f }, { 1.0f, 0.4f, 1.0f, 1.0f } };
+			colors[i] *= phaseTints[Physics::Fluid::FluidSimulation::getInstance().getParticlePhase(i)];
 		});
+}
+
+void FluidSimCPU::updateSecondaryColors()
+{
+	const uint32 secondaryCount = Physics::Fluid::FluidSimulation::getInstance().getSecondaryCount();
+	if (secondaryCount == 0) return;
+
+	const Core::ArenaVector<uint8_t>& types = Physics::Fluid::FluidSimulation::getInstance().getSecondaryTypes();
+	secondaryColors.resize(secondaryCount);
+	std::transform(std::execution::par, types.begin(), types.begin() + secondaryCount, secondaryColors.begin(),
+		[this](uint8_t type) { return SecondaryColors[type]; });
 }
\ No newline at end of file
@@ -18,9 +18,12 @@ private:
 	int nrParticles;
 	std::vector<int> Particles;
 	std::vector<glm::vec4> colors;
+	std::vector<glm::vec4> secondaryColors;
 
 	GLuint bufPositions;
 	GLuint bufColors;
+	GLuint bufSecondaryPositions;
+	GLuint bufSecondaryColors;
 
 	//Will be moved to an singleton ish - Needs to be changable from multiple places.
 	glm::vec4 Color1 = { 0.0f, 0.75f, 1.0f, 1.0f };
@@ -28,7 +31,12 @@ private:
 	glm::vec4 Color3 = { 1.0f, 1.0f, 0.0f, 1.0f };
 	glm::vec4 Color4 = { 1.0f, 0.0f, 0.0f, 1.0f };
 
+	// Spray, foam and bubbles.
+	glm::vec4 SecondaryColors[3] = { { 0.85f, 0.9f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f, 1.0f }, { 0.6f, 0.8f, 1.0f, 1.0f } };
+
 private:
 	void updateColors();
+	void updateSecondaryColors();
+	void drawParticles(int count, GLuint particleOffsetLoc);
 
 };
\ No newline at end of file